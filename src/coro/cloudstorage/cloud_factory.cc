@@ -14,6 +14,7 @@
 #include "coro/cloudstorage/providers/webdav.h"
 #include "coro/cloudstorage/providers/yandex_disk.h"
 #include "coro/cloudstorage/providers/youtube.h"
+#include "coro/cloudstorage/util/retrying_cloud_provider.h"
 
 namespace coro::cloudstorage {
 
@@ -364,9 +365,10 @@ std::unique_ptr<AbstractCloudProvider> CloudFactory::Create(
         on_token_updated,
     util::ItemUrlProvider item_url_provider) const {
   auto type = static_cast<int>(auth_token.type);
-  return factory_[type]->Create(std::move(auth_token),
-                                std::move(on_token_updated),
-                                std::move(item_url_provider));
+  return std::make_unique<util::RetryingCloudProvider>(
+      event_loop_, factory_[type]->Create(std::move(auth_token),
+                                          std::move(on_token_updated),
+                                          std::move(item_url_provider)));
 }
 
 const AbstractCloudProvider::Auth& CloudFactory::GetAuth(
@@ -24,6 +24,11 @@ T ToItemImpl(const nlohmann::json& json) {
   if constexpr (std::is_same_v<T, Dropbox::File>) {
     result.size = json.at("size");
     result.timestamp = http::ParseTime(std::string(json["client_modified"]));
+    if (json.contains("content_hash")) {
+      result.content_hash =
+          util::ContentHash{.type = util::ContentHash::Type::kDropbox,
+                            .value = json["content_hash"]};
+    }
   }
   return result;
 }
@@ -403,6 +408,9 @@ nlohmann::json Dropbox::ToJson(const Item& item) {
           json[".tag"] = "file";
           json["size"] = item.size;
           json["client_modified"] = http::ToTimeString(item.timestamp);
+          if (item.content_hash) {
+            json["content_hash"] = item.content_hash->value;
+          }
         } else {
           json[".tag"] = "folder";
         }
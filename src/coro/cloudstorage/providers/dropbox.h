@@ -7,6 +7,7 @@
 #include "coro/cloudstorage/util/assets.h"
 #include "coro/cloudstorage/util/auth_data.h"
 #include "coro/cloudstorage/util/auth_manager.h"
+#include "coro/cloudstorage/util/content_hash.h"
 #include "coro/cloudstorage/util/fetch_json.h"
 #include "coro/http/http.h"
 #include "coro/when_all.h"
@@ -34,6 +35,7 @@ class Dropbox {
   struct File : ItemData {
     int64_t size;
     int64_t timestamp;
+    std::optional<util::ContentHash> content_hash;
   };
 
   using Item = std::variant<File, Directory>;
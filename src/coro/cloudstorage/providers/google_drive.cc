@@ -11,7 +11,7 @@ constexpr std::string_view kSeparator = "fWoDm9QNn3v3Bq3bScUX";
 constexpr std::string_view kEndpoint = "https://www.googleapis.com/drive/v3";
 constexpr std::string_view kFileProperties =
     "id,name,thumbnailLink,trashed,mimeType,iconLink,parents,size,"
-    "modifiedTime";
+    "modifiedTime,md5Checksum";
 constexpr int kThumbnailSize = 256;
 
 using ::coro::cloudstorage::util::FetchJson;
@@ -51,6 +51,11 @@ T ToItemImpl(const nlohmann::json& json) {
       result.size = std::stoll(std::string(json["size"]));
     }
     result.mime_type = json["mimeType"];
+    if (json.contains("md5Checksum")) {
+      result.content_hash =
+          util::ContentHash{.type = util::ContentHash::Type::kMD5,
+                            .value = json["md5Checksum"]};
+    }
   }
   return result;
 }
@@ -390,6 +395,9 @@ nlohmann::json GoogleDrive::ToJson(const Item& item) {
           if (item.mime_type) {
             json["mimeType"] = *item.mime_type;
           }
+          if (item.content_hash) {
+            json["md5Checksum"] = item.content_hash->value;
+          }
         } else {
           json["mimeType"] = "application/vnd.google-apps.folder";
         }
@@ -8,6 +8,7 @@
 #include "coro/cloudstorage/util/assets.h"
 #include "coro/cloudstorage/util/auth_data.h"
 #include "coro/cloudstorage/util/auth_manager.h"
+#include "coro/cloudstorage/util/content_hash.h"
 #include "coro/cloudstorage/util/fetch_json.h"
 #include "coro/http/http.h"
 #include "coro/http/http_parse.h"
@@ -66,6 +67,7 @@ class GoogleDrive {
   struct File : ItemData {
     std::optional<std::string> mime_type;
     std::optional<int64_t> size;
+    std::optional<util::ContentHash> content_hash;
   };
 
   using Item = std::variant<File, Directory>;
@@ -11,7 +11,7 @@ namespace {
 using ::coro::cloudstorage::util::StrCat;
 
 constexpr std::string_view kFileProperties =
-    "name,folder,audio,image,photo,video,id,size,lastModifiedDateTime,"
+    "name,folder,file,audio,image,photo,video,id,size,lastModifiedDateTime,"
     "thumbnails,@content.downloadUrl,mimeType";
 
 template <typename T>
@@ -28,6 +28,12 @@ T ToItemImpl(const nlohmann::json& json) {
     if (json.contains("mimeType")) {
       result.mime_type = json["mimeType"];
     }
+    if (json.contains("file") && json["file"].contains("hashes") &&
+        json["file"]["hashes"].contains("quickXorHash")) {
+      result.content_hash =
+          util::ContentHash{.type = util::ContentHash::Type::kQuickXor,
+                            .value = json["file"]["hashes"]["quickXorHash"]};
+    }
   }
   return result;
 }
@@ -338,6 +344,9 @@ nlohmann::json OneDrive::ToJson(const Item& item) {
           if (i.mime_type) {
             json["mimeType"] = *i.mime_type;
           }
+          if (i.content_hash) {
+            json["file"]["hashes"]["quickXorHash"] = i.content_hash->value;
+          }
         } else {
           json["folder"] = true;
         }
@@ -4,6 +4,7 @@
 #include "coro/cloudstorage/util/assets.h"
 #include "coro/cloudstorage/util/auth_data.h"
 #include "coro/cloudstorage/util/auth_manager.h"
+#include "coro/cloudstorage/util/content_hash.h"
 #include "coro/cloudstorage/util/fetch_json.h"
 #include "coro/when_all.h"
 
@@ -62,6 +63,7 @@ class OneDrive {
   struct File : ItemData {
     std::optional<std::string> mime_type;
     int64_t size;
+    std::optional<util::ContentHash> content_hash;
   };
 
   using Item = std::variant<File, Directory>;
@@ -9,6 +9,8 @@
 #include <vector>
 
 #include "coro/cloudstorage/cloud_exception.h"
+#include "coro/cloudstorage/util/content_hash.h"
+#include "coro/cloudstorage/util/image_signature.h"
 #include "coro/cloudstorage/util/thumbnail_quality.h"
 #include "coro/generator.h"
 #include "coro/http/http.h"
@@ -71,6 +73,7 @@ class AbstractCloudProvider {
     std::optional<int64_t> size;
     std::optional<int64_t> timestamp;
     std::string mime_type;
+    std::optional<ContentHash> content_hash;
     std::any impl;
   };
 
@@ -104,6 +107,8 @@ class AbstractCloudProvider {
     Generator<std::string> data;
     int64_t size;
     std::string mime_type;
+    // Set for thumbnails generated locally and for cached thumbnails.
+    std::optional<ImageSignature> signature;
   };
 
   virtual ~AbstractCloudProvider() = default;
@@ -136,6 +136,11 @@ concept HasTimestamp = requires(T v) {
   { v.timestamp } -> stdx::convertible_to<std::optional<int64_t>>;
 };
 
+template <typename T>
+concept HasContentHash = requires(T v) {
+  { v.content_hash } -> stdx::convertible_to<std::optional<ContentHash>>;
+};
+
 template <typename T>
 concept HasUsageData = requires(T v) {
   { v.space_used } -> stdx::convertible_to<std::optional<int64_t>>;
@@ -359,6 +364,7 @@ class AbstractCloudProviderImpl : public AbstractCloudProvider,
     result.timestamp = GetTimestamp(d);
     if constexpr (std::is_same_v<To, File> && IsFile<From, CloudProviderT>) {
       result.mime_type = GetMimeType(d);
+      result.content_hash = GetContentHash(d);
     }
     result.impl.template emplace<ItemT>(std::move(d));
     return result;
@@ -404,6 +410,15 @@ class AbstractCloudProviderImpl : public AbstractCloudProvider,
     }
   }
 
+  template <typename T>
+  static std::optional<ContentHash> GetContentHash(const T& d) {
+    if constexpr (HasContentHash<T>) {
+      return d.content_hash;
+    } else {
+      return std::nullopt;
+    }
+  }
+
   auto* provider() const {
     return const_cast<CloudProviderT*>(CloudProviderSupplier::provider());
   }
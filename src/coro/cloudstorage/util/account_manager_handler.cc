@@ -2,21 +2,26 @@
 
 #include <fmt/core.h>
 
+#include "coro/cloudstorage/util/animated_preview_handler.h"
 #include "coro/cloudstorage/util/assets.h"
 #include "coro/cloudstorage/util/dash_handler.h"
 #include "coro/cloudstorage/util/exception_utils.h"
 #include "coro/cloudstorage/util/generator_utils.h"
 #include "coro/cloudstorage/util/get_size_handler.h"
+#include "coro/cloudstorage/util/instrumented_cloud_provider.h"
 #include "coro/cloudstorage/util/item_content_handler.h"
 #include "coro/cloudstorage/util/item_thumbnail_handler.h"
 #include "coro/cloudstorage/util/list_directory_handler.h"
+#include "coro/cloudstorage/util/metrics_handler.h"
 #include "coro/cloudstorage/util/mux_handler.h"
 #include "coro/cloudstorage/util/on_auth_token_updated.h"
 #include "coro/cloudstorage/util/settings_handler.h"
 #include "coro/cloudstorage/util/static_file_handler.h"
 #include "coro/cloudstorage/util/theme_handler.h"
+#include "coro/cloudstorage/util/thumbnail_sheet_handler.h"
 #include "coro/cloudstorage/util/webdav_handler.h"
 #include "coro/cloudstorage/util/webdav_utils.h"
+#include "coro/util/raii_utils.h"
 #include "coro/util/stop_token_or.h"
 
 namespace coro::cloudstorage::util {
@@ -96,6 +101,25 @@ Generator<std::string> Validate(Generator<std::string> body, Args...) {
   }
 }
 
+Generator<std::string> CountResponseBytes(Generator<std::string> body,
+                                          Metrics* metrics,
+                                          Metrics::Labels labels) {
+  int64_t bytes = 0;
+  auto scope_guard = coro::util::AtScopeExit([&] {
+    metrics->IncrementCounter("cloudstorage_http_response_bytes_total", labels,
+                              static_cast<double>(bytes));
+  });
+  FOR_CO_AWAIT(std::string & chunk, body) {
+    bytes += static_cast<int64_t>(chunk.size());
+    co_yield std::move(chunk);
+  }
+}
+
+std::string GetRoute(std::string_view path) {
+  auto components = SplitString(std::string(path), '/');
+  return components.empty() ? "" : std::move(components[0]);
+}
+
 auto CreateItemUrlProvider(CloudProviderAccount::Id id) {
   return ItemUrlProvider([id = std::move(id)](std::string_view item_id) {
     return StrCat("/content/", id.type, '/', http::EncodeUri(id.username), '/',
@@ -118,16 +142,22 @@ auto CreateCloudProvider(const AbstractCloudFactory* factory,
 
 AccountManagerHandler::AccountManagerHandler(
     const AbstractCloudFactory* factory,
-    const ThumbnailGenerator* thumbnail_generator, const Muxer* muxer,
-    const Clock* clock, AccountListener account_listener,
-    SettingsManager* settings_manager, CacheManager* cache_manager)
+    const ThumbnailGenerator* thumbnail_generator,
+    ThumbnailPregenerator* thumbnail_pregenerator, const Muxer* muxer,
+    MuxCache* mux_cache, SegmentCache* segment_cache, const Clock* clock,
+    AccountListener account_listener, SettingsManager* settings_manager,
+    CacheManager* cache_manager, Metrics* metrics)
     : factory_(factory),
       thumbnail_generator_(thumbnail_generator),
+      thumbnail_pregenerator_(thumbnail_pregenerator),
       muxer_(muxer),
+      mux_cache_(mux_cache),
+      segment_cache_(segment_cache),
       clock_(clock),
       account_listener_(std::move(account_listener)),
       settings_manager_(settings_manager),
-      cache_manager_(cache_manager) {
+      cache_manager_(cache_manager),
+      metrics_(metrics) {
   for (auto auth_token : settings_manager_->LoadTokenData()) {
     CloudProviderAccount::Id provider_id{
         std::string(CreateCloudProvider(factory_, auth_token)->GetId()),
@@ -197,18 +227,28 @@ auto AccountManagerHandler::HandleRequest(http::Request<> request,
     co_return http::Response<>{.status = 400};
   }
   if (auto handler = ChooseHandler(*path)) {
+    Metrics::Labels labels = {{"route", GetRoute(*path)}};
+    // /metrics isn't authenticated, so series aren't labeled with usernames.
+    if (handler->account) {
+      labels.emplace_back("provider", handler->account->type());
+    }
+    metrics_->IncrementCounter("cloudstorage_http_requests_total", labels);
     if (handler->account) {
       auto stop_token_or = MakeUniqueStopTokenOr(handler->account->stop_token(),
                                                  std::move(stop_token));
       auto response = co_await handler->handler(std::move(request),
                                                 stop_token_or->GetToken());
-      response.body = Validate(std::move(response.body),
-                               std::move(stop_token_or), std::move(handler));
+      response.body = CountResponseBytes(
+          Validate(std::move(response.body), std::move(stop_token_or),
+                   std::move(handler)),
+          metrics_, std::move(labels));
       co_return response;
     } else {
       auto response =
           co_await handler->handler(std::move(request), std::move(stop_token));
-      response.body = Validate(std::move(response.body), std::move(handler));
+      response.body = CountResponseBytes(
+          Validate(std::move(response.body), std::move(handler)), metrics_,
+          std::move(labels));
       co_return response;
     }
   } else if (*path == "/" || *path == "") {
@@ -277,10 +317,13 @@ auto AccountManagerHandler::ChooseHandler(std::string_view path)
     return Handler{.handler = ThemeHandler{}};
   } else if (path.starts_with("/settings")) {
     return Handler{.handler = SettingsHandler(settings_manager_)};
+  } else if (path == "/metrics") {
+    return Handler{.handler = MetricsHandler{metrics_}};
   } else if (path.starts_with("/mux")) {
     return Handler{
         .handler = MuxHandler{
-            muxer_, std::span<const CloudProviderAccount>(accounts_)}};
+            muxer_, mux_cache_, segment_cache_,
+            std::span<const CloudProviderAccount>(accounts_)}};
   } else {
     for (AbstractCloudProvider::Type type :
          factory_->GetSupportedCloudProviders()) {
@@ -301,7 +344,7 @@ auto AccountManagerHandler::ChooseHandler(std::string_view path)
         return Handler{
             .account = account,
             .handler = ListDirectoryHandler(
-                account,
+                account, thumbnail_pregenerator_,
                 [account_id = account.id()](std::string_view item_id) {
                   return StrCat("/list/", account_id.type, '/',
                                 http::EncodeUri(account_id.username), '/',
@@ -326,6 +369,12 @@ auto AccountManagerHandler::ChooseHandler(std::string_view path)
       } else if (match("/thumbnail/")) {
         return Handler{.account = account,
                        .handler = ItemThumbnailHandler(account)};
+      } else if (match("/preview/")) {
+        return Handler{.account = account,
+                       .handler = AnimatedPreviewHandler(account)};
+      } else if (match("/thumbnail-sheet/")) {
+        return Handler{.account = account,
+                       .handler = ThumbnailSheetHandler(account)};
       } else if (match("/dash/")) {
         return Handler{
             .account = account,
@@ -400,6 +449,9 @@ void AccountManagerHandler::RemoveCloudProvider(const F& predicate) {
 CloudProviderAccount AccountManagerHandler::CreateAccount(
     std::unique_ptr<AbstractCloudProvider> provider, std::string username,
     int64_t version) {
+  Metrics::Labels labels = {{"provider", std::string(provider->GetId())}};
+  provider = std::make_unique<InstrumentedCloudProvider>(
+      metrics_, std::move(labels), std::move(provider));
   return {std::move(username), version, std::move(provider),
           cache_manager_,      clock_,  thumbnail_generator_};
 }
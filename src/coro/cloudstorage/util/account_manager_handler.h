@@ -4,10 +4,14 @@
 #include "coro/cloudstorage/util/cache_manager.h"
 #include "coro/cloudstorage/util/clock.h"
 #include "coro/cloudstorage/util/cloud_provider_account.h"
+#include "coro/cloudstorage/util/metrics.h"
+#include "coro/cloudstorage/util/mux_cache.h"
 #include "coro/cloudstorage/util/muxer.h"
+#include "coro/cloudstorage/util/segment_cache.h"
 #include "coro/cloudstorage/util/settings_manager.h"
 #include "coro/cloudstorage/util/string_utils.h"
 #include "coro/cloudstorage/util/thumbnail_generator.h"
+#include "coro/cloudstorage/util/thumbnail_pregenerator.h"
 #include "coro/http/http.h"
 #include "coro/http/http_parse.h"
 #include "coro/stdx/any_invocable.h"
@@ -65,10 +69,12 @@ class AccountManagerHandler {
  public:
   AccountManagerHandler(const AbstractCloudFactory* factory,
                         const ThumbnailGenerator* thumbnail_generator,
-                        const Muxer* muxer, const Clock* clock,
+                        ThumbnailPregenerator* thumbnail_pregenerator,
+                        const Muxer* muxer, MuxCache* mux_cache,
+                        SegmentCache* segment_cache, const Clock* clock,
                         AccountListener account_listener,
                         SettingsManager* settings_manager,
-                        CacheManager* cache_manager);
+                        CacheManager* cache_manager, Metrics* metrics);
   AccountManagerHandler(AccountManagerHandler&&) noexcept = default;
   AccountManagerHandler(const AccountManagerHandler&) = delete;
   ~AccountManagerHandler();
@@ -130,11 +136,15 @@ class AccountManagerHandler {
 
   const AbstractCloudFactory* factory_;
   const ThumbnailGenerator* thumbnail_generator_;
+  ThumbnailPregenerator* thumbnail_pregenerator_;
   const Muxer* muxer_;
+  MuxCache* mux_cache_;
+  SegmentCache* segment_cache_;
   const Clock* clock_;
   AccountListener account_listener_;
   SettingsManager* settings_manager_;
   CacheManager* cache_manager_;
+  Metrics* metrics_;
   std::vector<CloudProviderAccount> accounts_;
   int64_t version_ = 0;
 };
@@ -0,0 +1,47 @@
+#include "coro/cloudstorage/util/animated_preview_handler.h"
+
+#include <string>
+#include <utility>
+
+#include "coro/cloudstorage/util/cloud_provider_utils.h"
+#include "coro/http/http_parse.h"
+#include "coro/util/regex.h"
+
+namespace coro::cloudstorage::util {
+
+namespace {
+
+namespace re = coro::util::re;
+
+}  // namespace
+
+Task<http::Response<>> AnimatedPreviewHandler::operator()(
+    http::Request<> request, stdx::stop_token stop_token) const {
+  auto uri = http::ParseUri(request.url);
+  re::smatch results;
+  if (!re::regex_match(uri.path.value(), results,
+                       re::regex(R"(\/preview\/[^\/]+\/[^\/]+\/(.*)$)"))) {
+    co_return http::Response<>{.status = 400};
+  }
+  if (!IsAnimatedPreviewSupported()) {
+    co_return http::Response<>{.status = 501};
+  }
+  std::string item_id =
+      http::DecodeUri(ToStringView(results[1].begin(), results[1].end()));
+  auto item = co_await account_.GetItemById(item_id, stop_token);
+  auto* file = std::get_if<AbstractCloudProvider::File>(&item.item);
+  if (!file || GetFileType(file->mime_type) != FileType::kVideo) {
+    co_return http::Response<>{.status = 404};
+  }
+  std::string preview =
+      co_await account_.GetAnimatedPreview(*file, std::move(stop_token));
+  co_return http::Response<>{
+      .status = 200,
+      .headers = {{"Content-Type", "image/webp"},
+                  {"Content-Length", std::to_string(preview.size())},
+                  {"Cache-Control", "private"},
+                  {"Cache-Control", "max-age=604800"}},
+      .body = http::CreateBody(std::move(preview))};
+}
+
+}  // namespace coro::cloudstorage::util
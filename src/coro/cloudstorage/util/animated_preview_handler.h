@@ -0,0 +1,27 @@
+#ifndef CORO_CLOUDSTORAGE_UTIL_ANIMATED_PREVIEW_HANDLER_H
+#define CORO_CLOUDSTORAGE_UTIL_ANIMATED_PREVIEW_HANDLER_H
+
+#include "coro/cloudstorage/util/cloud_provider_account.h"
+#include "coro/http/http.h"
+#include "coro/stdx/stop_token.h"
+#include "coro/task.h"
+
+namespace coro::cloudstorage::util {
+
+// Serves animated WebP previews of videos, for clients to show on hover
+// without streaming the video itself.
+class AnimatedPreviewHandler {
+ public:
+  explicit AnimatedPreviewHandler(CloudProviderAccount account)
+      : account_(std::move(account)) {}
+
+  Task<http::Response<>> operator()(http::Request<> request,
+                                    stdx::stop_token stop_token) const;
+
+ private:
+  CloudProviderAccount account_;
+};
+
+}  // namespace coro::cloudstorage::util
+
+#endif  // CORO_CLOUDSTORAGE_UTIL_ANIMATED_PREVIEW_HANDLER_H
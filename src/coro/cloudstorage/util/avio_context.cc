@@ -1,88 +1,223 @@
 #include "coro/cloudstorage/util/avio_context.h"
 
-#include "coro/cloudstorage/util/generator_utils.h"
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "coro/generator.h"
 #include "coro/http/http.h"
+#include "coro/promise.h"
+#include "coro/stdx/stop_source.h"
+#include "coro/util/stop_token_or.h"
 
 namespace coro::cloudstorage::util {
 
 namespace {
 
+using ::coro::util::MakeUniqueStopTokenOr;
+
+// Data kept before the read position, so that small backward seeks don't need
+// a new upstream request.
+constexpr int64_t kBackwardBufferSize = 256 * 1024;
+// How far ahead of the read position the upstream stream is read.
+constexpr int64_t kPrefetchSize = 2 * 1024 * 1024;
+// Forward seeks up to this distance past the fetched data keep reading the
+// current upstream stream instead of starting a new one.
+constexpr int64_t kForwardSeekThreshold = 1024 * 1024;
+
+// State of a provider backed input. Only accessed on the event loop thread.
+// Shared with the prefetch task, which may still be waiting on the provider
+// when the AVIOContext is freed.
 struct Context {
   const coro::util::EventLoop* event_loop;
   const AbstractCloudProvider* provider;
   AbstractCloudProvider::File file;
-  int64_t offset;
   stdx::stop_token stop_token;
-  std::optional<Generator<std::string>> generator;
-  std::optional<Generator<std::string>::iterator> it;
+
+  // Read position.
+  int64_t offset = 0;
+  // Data fetched from the upstream stream, starting at buffer_offset.
+  std::string buffer;
+  int64_t buffer_offset = 0;
+  // Identifies the current upstream stream, tasks of older streams exit.
+  int64_t generation = 0;
+  std::shared_ptr<stdx::stop_source> fetch_stop_source;
+  bool eof = false;
+  std::exception_ptr exception;
+  // Awaited by the reader until more data is fetched.
+  std::shared_ptr<Promise<void>> data_fetched;
+  // Awaited by the prefetch task until the reader consumes data.
+  std::shared_ptr<Promise<void>> data_consumed;
+
+  int64_t buffer_end() const {
+    return buffer_offset + static_cast<int64_t>(buffer.size());
+  }
 };
 
+Task<> Wait(std::shared_ptr<Promise<void>>& waiter) {
+  auto promise = std::make_shared<Promise<void>>();
+  waiter = promise;
+  co_await *promise;
+}
+
+void Notify(std::shared_ptr<Promise<void>>& waiter) {
+  if (auto promise = std::exchange(waiter, nullptr)) {
+    promise->SetValue();
+  }
+}
+
+// Drops data which is too far behind the read position. Done in large steps,
+// erasing from the front of the buffer moves the rest of it.
+void Trim(Context* d) {
+  int64_t size = std::min<int64_t>(d->offset - kBackwardBufferSize,
+                                   d->buffer_end()) -
+                 d->buffer_offset;
+  if (size >= kBackwardBufferSize) {
+    d->buffer.erase(0, static_cast<size_t>(size));
+    d->buffer_offset += size;
+  }
+}
+
+Task<> Prefetch(std::shared_ptr<Context> d, int64_t generation,
+                std::shared_ptr<stdx::stop_source> stop_source) {
+  auto stop_token_or =
+      MakeUniqueStopTokenOr(d->stop_token, stop_source->get_token());
+  auto stop_token = stop_token_or->GetToken();
+  try {
+    auto content = d->provider->GetFileContent(
+        d->file, http::Range{.start = d->buffer_end()}, stop_token);
+    FOR_CO_AWAIT(std::string & chunk, content) {
+      if (d->generation != generation) {
+        co_return;
+      }
+      d->buffer += chunk;
+      Trim(d.get());
+      Notify(d->data_fetched);
+      while (d->buffer_end() - d->offset >= kPrefetchSize) {
+        co_await Wait(d->data_consumed);
+        if (d->generation != generation) {
+          co_return;
+        }
+      }
+    }
+    if (d->generation == generation) {
+      d->eof = true;
+    }
+  } catch (...) {
+    if (d->generation == generation) {
+      d->exception = std::current_exception();
+    }
+  }
+  if (d->generation == generation) {
+    Notify(d->data_fetched);
+  }
+}
+
+void Cancel(Context* d) {
+  d->generation++;
+  if (d->fetch_stop_source) {
+    d->fetch_stop_source->request_stop();
+  }
+  Notify(d->data_consumed);
+}
+
+// Starts a new upstream stream at the read position.
+void Restart(const std::shared_ptr<Context>& d) {
+  Cancel(d.get());
+  d->buffer.clear();
+  d->buffer_offset = d->offset;
+  d->eof = false;
+  d->exception = nullptr;
+  d->fetch_stop_source = std::make_shared<stdx::stop_source>();
+  RunTask(Prefetch, d, d->generation, d->fetch_stop_source);
+}
+
+bool IsBuffered(const Context& d, int64_t offset) {
+  return offset >= d.buffer_offset && offset < d.buffer_end();
+}
+
+bool IsInFetchWindow(const Context& d, int64_t offset) {
+  return d.generation > 0 && !d.exception && offset >= d.buffer_offset &&
+         offset <= d.buffer_end() + kForwardSeekThreshold;
+}
+
+Task<int> Read(const std::shared_ptr<Context>& d, uint8_t* buf, int buf_size) {
+  if (d->offset == d->file.size) {
+    co_return AVERROR_EOF;
+  }
+  if (d->stop_token.stop_requested()) {
+    co_return AVERROR(EINTR);
+  }
+  // The buffer may hold the prefix passed to CreateIOContext before any
+  // upstream stream is started.
+  if (!IsBuffered(*d, d->offset) && !IsInFetchWindow(*d, d->offset)) {
+    Restart(d);
+  }
+  while (d->buffer_end() <= d->offset) {
+    if (d->exception) {
+      co_return AVERROR(EIO);
+    }
+    if (d->eof) {
+      co_return AVERROR_EOF;
+    }
+    co_await Wait(d->data_fetched);
+  }
+  auto size = static_cast<size_t>(
+      std::min<int64_t>(buf_size, d->buffer_end() - d->offset));
+  memcpy(buf, d->buffer.data() + (d->offset - d->buffer_offset), size);
+  d->offset += static_cast<int64_t>(size);
+  Trim(d.get());
+  Notify(d->data_consumed);
+  co_return static_cast<int>(size);
+}
+
 }  // namespace
 
 void AVIOContextDeleter::operator()(AVIOContext* context) {
-  delete reinterpret_cast<Context*>(context->opaque);
+  auto* opaque = reinterpret_cast<std::shared_ptr<Context>*>(context->opaque);
+  std::shared_ptr<Context> d = std::move(*opaque);
+  delete opaque;
   av_free(context->buffer);
   avio_context_free(&context);
+  d->event_loop->RunOnEventLoop([d = std::move(d)] { Cancel(d.get()); });
 }
 
 std::unique_ptr<AVIOContext, AVIOContextDeleter> CreateIOContext(
     const coro::util::EventLoop* event_loop,
     const AbstractCloudProvider* provider, AbstractCloudProvider::File file,
-    stdx::stop_token stop_token) {
+    stdx::stop_token stop_token, std::string prefix) {
   const int kBufferSize = 32 * 1024;
   auto* buffer = static_cast<uint8_t*>(av_malloc(kBufferSize));
   std::unique_ptr<AVIOContext, AVIOContextDeleter> context(avio_alloc_context(
       buffer, kBufferSize, /*write_flag=*/0,
-      new Context{event_loop, provider, std::move(file), 0,
-                  std::move(stop_token), std::nullopt, std::nullopt},
+      new std::shared_ptr<Context>(std::make_shared<Context>(
+          Context{.event_loop = event_loop,
+                  .provider = provider,
+                  .file = std::move(file),
+                  .stop_token = std::move(stop_token),
+                  .buffer = std::move(prefix)})),
       [](void* opaque, uint8_t* buf, int buf_size) -> int {
-        auto* data = reinterpret_cast<Context*>(opaque);
-        return data->event_loop->Do([&]() -> Task<int> {
-          try {
-            if (data->offset == -1) {
-              co_return AVERROR(EIO);
-            }
-            if (data->offset == data->file.size) {
-              co_return AVERROR_EOF;
-            }
-            if (data->stop_token.stop_requested()) {
-              co_return AVERROR(EINTR);
-            }
-            if (!data->generator) {
-              data->generator = data->provider->GetFileContent(
-                  data->file, http::Range{.start = data->offset},
-                  data->stop_token);
-              data->it = co_await data->generator->begin();
-            }
-            auto buffer = co_await http::GetBody(util::Take(
-                *data->generator, *data->it, static_cast<size_t>(buf_size)));
-            data->offset += static_cast<int64_t>(buffer.size());
-            memcpy(buf, buffer.data(), buffer.size());
-            if (buffer.empty()) {
-              co_return AVERROR_EOF;
-            }
-            co_return static_cast<int>(buffer.size());
-          } catch (...) {
-            data->generator.reset();
-            data->offset = -1;
-            co_return AVERROR(EIO);
-          }
-        });
+        const auto& d = *reinterpret_cast<std::shared_ptr<Context>*>(opaque);
+        return d->event_loop->Do(
+            [&]() -> Task<int> { return Read(d, buf, buf_size); });
       },
       /*write_packet=*/nullptr,
       [](void* opaque, int64_t offset, int whence) -> int64_t {
-        auto* data = reinterpret_cast<Context*>(opaque);
+        const auto& d = *reinterpret_cast<std::shared_ptr<Context>*>(opaque);
         whence &= ~AVSEEK_FORCE;
         if (whence == AVSEEK_SIZE) {
-          return data->file.size.value_or(AVERROR(ENOSYS));
+          return d->file.size.value_or(AVERROR(ENOSYS));
         }
         int64_t new_offset = -1;
         if (whence == SEEK_SET) {
           new_offset = offset;
         } else if (whence == SEEK_CUR) {
-          new_offset = data->offset + offset;
+          new_offset = d->offset + offset;
         } else if (whence == SEEK_END) {
-          auto size = data->file.size;
+          auto size = d->file.size;
           if (!size) {
             return AVERROR(ENOSYS);
           }
@@ -90,24 +225,19 @@ std::unique_ptr<AVIOContext, AVIOContextDeleter> CreateIOContext(
         } else {
           return AVERROR(EINVAL);
         }
-        if (data->offset == new_offset) {
+        if (d->offset == new_offset) {
           return new_offset;
         }
-        return data->event_loop->Do([&]() -> Task<int64_t> {
-          try {
-            if (data->stop_token.stop_requested()) {
-              data->offset = -1;
-              co_return AVERROR(EINTR);
-            }
-            data->generator = data->provider->GetFileContent(
-                data->file, http::Range{.start = new_offset}, data->stop_token);
-            data->it = co_await data->generator->begin();
-            co_return data->offset = new_offset;
-          } catch (...) {
-            data->generator.reset();
-            data->offset = -1;
-            co_return AVERROR(EIO);
+        return d->event_loop->Do([&]() -> Task<int64_t> {
+          if (d->stop_token.stop_requested()) {
+            co_return AVERROR(EINTR);
           }
+          // Data already fetched or about to be fetched by the current
+          // upstream stream is reused, otherwise the next read restarts it.
+          d->offset = new_offset;
+          Trim(d.get());
+          Notify(d->data_consumed);
+          co_return new_offset;
         });
       }));
   if (!context) {
@@ -116,4 +246,4 @@ std::unique_ptr<AVIOContext, AVIOContextDeleter> CreateIOContext(
   return context;
 }
 
-}  // namespace coro::cloudstorage::util
\ No newline at end of file
+}  // namespace coro::cloudstorage::util
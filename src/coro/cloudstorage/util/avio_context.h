@@ -1,6 +1,8 @@
 #ifndef CORO_CLOUDSTORAGE_UTIL_AVIO_CONTEXT_H
 #define CORO_CLOUDSTORAGE_UTIL_AVIO_CONTEXT_H
 
+#include <string>
+
 #include "coro/cloudstorage/util/abstract_cloud_provider.h"
 #include "coro/util/event_loop.h"
 
@@ -14,10 +16,12 @@ struct AVIOContextDeleter {
   void operator()(AVIOContext* context);
 };
 
+// `prefix` holds the first bytes of the file if the caller already fetched
+// them, they are read without an upstream request.
 std::unique_ptr<AVIOContext, AVIOContextDeleter> CreateIOContext(
     const coro::util::EventLoop* event_loop,
     const AbstractCloudProvider* provider, AbstractCloudProvider::File file,
-    stdx::stop_token stop_token);
+    stdx::stop_token stop_token, std::string prefix = {});
 
 }  // namespace coro::cloudstorage::util
 
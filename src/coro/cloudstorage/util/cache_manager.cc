@@ -49,9 +49,13 @@ struct DbImage {
   std::string account_username;
   std::string item_id;
   int quality;
+  int codec;
+  int type;
   std::string mime_type;
   std::vector<char> image_bytes;
   int64_t update_time;
+  std::optional<int64_t> perceptual_hash;
+  std::optional<int64_t> dominant_color;
 };
 
 auto CreateStorage(std::string path) {
@@ -105,11 +109,16 @@ auto CreateStorage(std::string path) {
                  make_column("account_username", &DbImage::account_username),
                  make_column("item_id", &DbImage::item_id),
                  make_column("quality", &DbImage::quality),
+                 make_column("codec", &DbImage::codec),
+                 make_column("type", &DbImage::type),
                  make_column("mime_type", &DbImage::mime_type),
                  make_column("image_bytes", &DbImage::image_bytes),
                  make_column("update_time", &DbImage::update_time),
+                 make_column("perceptual_hash", &DbImage::perceptual_hash),
+                 make_column("dominant_color", &DbImage::dominant_color),
                  primary_key(&DbImage::account_type, &DbImage::account_username,
-                             &DbImage::item_id)));
+                             &DbImage::item_id, &DbImage::quality,
+                             &DbImage::codec, &DbImage::type)));
   storage.sync_schema();
   return storage;
 }
@@ -120,6 +129,23 @@ auto* GetDb(CacheDatabase* any) {
   return reinterpret_cast<CacheDatabaseT*>(any);
 }
 
+// SQLite integers are signed, the hash is stored with the same bits.
+std::optional<int64_t> ToDbPerceptualHash(
+    const std::optional<ImageSignature>& signature) {
+  if (!signature) {
+    return std::nullopt;
+  }
+  return static_cast<int64_t>(signature->perceptual_hash);
+}
+
+std::optional<int64_t> ToDbDominantColor(
+    const std::optional<ImageSignature>& signature) {
+  if (!signature) {
+    return std::nullopt;
+  }
+  return signature->dominant_color;
+}
+
 std::vector<char> ToCbor(const nlohmann::json& json) {
   std::vector<char> output;
   nlohmann::json::to_cbor(json, output);
@@ -268,9 +294,14 @@ Task<> CacheManager::Put(AccountKey account, ImageKey key, ImageData image,
                        .account_username = std::move(account.username),
                        .item_id = std::move(key.item_id),
                        .quality = static_cast<int>(key.quality),
+                       .codec = static_cast<int>(key.codec),
+                       .type = static_cast<int>(key.type),
                        .mime_type = std::move(image.mime_type),
                        .image_bytes = std::move(image.image_bytes),
-                       .update_time = image.update_time}]() mutable {
+                       .update_time = image.update_time,
+                       .perceptual_hash = ToDbPerceptualHash(image.signature),
+                       .dominant_color = ToDbDominantColor(
+                           image.signature)}]() mutable {
         db->replace(entry);
       });
 }
@@ -282,19 +313,31 @@ auto CacheManager::Get(AccountKey account, ImageKey key,
   auto result = co_await worker_.Do(std::move(stop_token), [&] {
     return db->select(
         columns(&DbImage::image_bytes, &DbImage::mime_type,
-                &DbImage::update_time),
+                &DbImage::update_time, &DbImage::perceptual_hash,
+                &DbImage::dominant_color),
         where(and_(c(&DbImage::account_type) == account.provider->GetId(),
                    and_(c(&DbImage::account_username) == account.username,
                         and_(c(&DbImage::item_id) == key.item_id,
-                             c(&DbImage::quality) ==
-                                 static_cast<int>(key.quality))))));
+                             and_(c(&DbImage::quality) ==
+                                      static_cast<int>(key.quality),
+                                  and_(c(&DbImage::codec) ==
+                                           static_cast<int>(key.codec),
+                                       c(&DbImage::type) ==
+                                           static_cast<int>(key.type))))))));
   });
   if (result.empty()) {
     co_return std::nullopt;
   }
+  std::optional<ImageSignature> signature;
+  if (std::get<3>(result[0]) && std::get<4>(result[0])) {
+    signature = ImageSignature{
+        .perceptual_hash = static_cast<uint64_t>(*std::get<3>(result[0])),
+        .dominant_color = static_cast<uint32_t>(*std::get<4>(result[0]))};
+  }
   co_return ImageData{.image_bytes = std::move(std::get<0>(result[0])),
                       .mime_type = std::move(std::get<1>(result[0])),
-                      .update_time = std::get<2>(result[0])};
+                      .update_time = std::get<2>(result[0]),
+                      .signature = signature};
 }
 
 Task<std::optional<CacheManager::ItemData>> CacheManager::Get(
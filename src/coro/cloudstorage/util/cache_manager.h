@@ -2,8 +2,11 @@
 #define CORO_CLOUDSTORAGE_CACHE_MANAGER_H
 
 #include <any>
+#include <optional>
 
 #include "coro/cloudstorage/util/abstract_cloud_provider.h"
+#include "coro/cloudstorage/util/image_signature.h"
+#include "coro/cloudstorage/util/thumbnail_options.h"
 #include "coro/task.h"
 #include "coro/util/event_loop.h"
 #include "coro/util/thread_pool.h"
@@ -26,15 +29,20 @@ class CacheManager {
     std::string username;
   };
 
+  enum class ImageType { kThumbnail, kAnimatedPreview };
+
   struct ImageKey {
     std::string item_id;
     ThumbnailQuality quality;
+    ThumbnailOptions::Codec codec = ThumbnailOptions::Codec::PNG;
+    ImageType type = ImageType::kThumbnail;
   };
 
   struct ImageData {
     std::vector<char> image_bytes;
     std::string mime_type;
     int64_t update_time;
+    std::optional<ImageSignature> signature;
   };
 
   struct ItemKey {
@@ -7,8 +7,10 @@
 
 #include "coro/cloudstorage/util/auth_data.h"
 #include "coro/cloudstorage/util/file_utils.h"
+#include "coro/cloudstorage/util/job_scheduler.h"
 #include "coro/cloudstorage/util/random_number_generator.h"
 #include "coro/cloudstorage/util/settings_utils.h"
+#include "coro/cloudstorage/util/thumbnail_pregenerator.h"
 #include "coro/http/cache_http.h"
 #include "coro/http/curl_http.h"
 
@@ -32,6 +34,11 @@ struct CloudFactoryConfig {
     CreateDirectory(GetDirectoryPath(path));
     return path;
   }();
+  std::string mux_cache_path = StrCat(GetDirectoryPath(cache_path), "/mux");
+  int64_t mux_cache_size = int64_t{4} << 30;
+  int64_t segment_cache_size = int64_t{256} << 20;
+  JobScheduler::Config job_scheduler_config;
+  ThumbnailPregenerator::Config thumbnail_pregenerator_config;
   std::function<std::string(std::string_view account_type,
                             std::string_view username)>
       post_auth_redirect_uri = GetDefaultPostAuthRedirectUri;
@@ -1,7 +1,29 @@
 #include "coro/cloudstorage/util/cloud_factory_context.h"
 
+#include <algorithm>
+
 namespace coro::cloudstorage::util {
 
+namespace {
+
+// Pool threads a streaming job may block at once: the demuxers of both
+// tracks, each waiting for data to arrive over the network.
+constexpr int kStreamingJobThreads = 2;
+
+// Background jobs transcode, each of the two tracks also has a decoder and an
+// encoder task running on the pool next to its demuxer.
+constexpr int kBackgroundJobThreads = 6;
+
+// A pool sized by the cores would serialize the tasks of the admitted muxes
+// behind a few threads, so it holds all of them.
+int GetMuxThreadPoolSize(const JobScheduler::Config& config) {
+  return std::max(
+      1, config.streaming.max_running * kStreamingJobThreads +
+             config.background.max_running * kBackgroundJobThreads);
+}
+
+}  // namespace
+
 using ::coro::http::CurlHttpConfig;
 
 CloudFactoryServer::CloudFactoryServer(
@@ -29,8 +51,19 @@ CloudFactoryContext::CloudFactoryContext(CloudFactoryConfig config)
       cached_http_(http::CacheHttp(config.http_cache_config, &http_)),
       thumbnail_thread_pool_(
           event_loop_, std::thread::hardware_concurrency() / 2, "coro-thumb"),
-      thumbnail_generator_(&thumbnail_thread_pool_, event_loop_),
-      muxer_(event_loop_, &thumbnail_thread_pool_),
+      mux_thread_pool_(event_loop_,
+                       GetMuxThreadPoolSize(config.job_scheduler_config),
+                       "coro-mux"),
+      job_scheduler_(config.job_scheduler_config),
+      thumbnail_generator_(&thumbnail_thread_pool_, event_loop_,
+                           &job_scheduler_),
+      muxer_(event_loop_, &mux_thread_pool_, &job_scheduler_),
+      mux_cache_(&thread_pool_, &muxer_,
+                 {.directory = config.mux_cache_path,
+                  .max_size = config.mux_cache_size}),
+      segment_cache_(&muxer_, {.max_size = config.segment_cache_size}),
+      thumbnail_pregenerator_(event_loop_, &job_scheduler_,
+                              config.thumbnail_pregenerator_config),
       random_number_generator_(std::move(config.random_number_generator)),
       cache_(cache_db_.get(), event_loop_),
       factory_(event_loop_, &thread_pool_, &cached_http_, &thumbnail_generator_,
@@ -39,8 +72,17 @@ CloudFactoryContext::CloudFactoryContext(CloudFactoryConfig config)
 
 AccountManagerHandler CloudFactoryContext::CreateAccountManagerHandler(
     AccountListener listener) {
-  return {&factory_,           &thumbnail_generator_, &muxer_, &clock_,
-          std::move(listener), &settings_manager_,    &cache_};
+  return {&factory_,
+          &thumbnail_generator_,
+          &thumbnail_pregenerator_,
+          &muxer_,
+          &mux_cache_,
+          &segment_cache_,
+          &clock_,
+          std::move(listener),
+          &settings_manager_,
+          &cache_,
+          &metrics_};
 }
 
 coro::util::TcpServer CloudFactoryContext::CreateHttpServer(
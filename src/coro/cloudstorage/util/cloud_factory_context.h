@@ -6,9 +6,13 @@
 #include "coro/cloudstorage/util/auth_data.h"
 #include "coro/cloudstorage/util/cache_manager.h"
 #include "coro/cloudstorage/util/clock.h"
+#include "coro/cloudstorage/util/metrics.h"
+#include "coro/cloudstorage/util/mux_cache.h"
 #include "coro/cloudstorage/util/muxer.h"
 #include "coro/cloudstorage/util/random_number_generator.h"
+#include "coro/cloudstorage/util/segment_cache.h"
 #include "coro/cloudstorage/util/thumbnail_generator.h"
+#include "coro/cloudstorage/util/thumbnail_pregenerator.h"
 #include "coro/http/cache_http.h"
 #include "coro/http/curl_http.h"
 #include "coro/http/http_server.h"
@@ -41,6 +45,9 @@ class CloudFactoryContext {
   auto* thread_pool() { return &thread_pool_; }
   auto* cache() { return &cache_; }
   auto* clock() { return &clock_; }
+  auto* metrics() { return &metrics_; }
+  auto* job_scheduler() { return &job_scheduler_; }
+  auto* mux_cache() { return &mux_cache_; }
 
   AccountManagerHandler CreateAccountManagerHandler(AccountListener listener);
   coro::util::TcpServer CreateHttpServer(coro::http::HttpHandler handler);
@@ -53,13 +60,19 @@ class CloudFactoryContext {
   http::Http http_;
   http::Http cached_http_;
   coro::util::ThreadPool thumbnail_thread_pool_;
+  coro::util::ThreadPool mux_thread_pool_;
+  util::JobScheduler job_scheduler_;
   util::ThumbnailGenerator thumbnail_generator_;
   util::Muxer muxer_;
+  util::MuxCache mux_cache_;
+  util::SegmentCache segment_cache_;
+  util::ThumbnailPregenerator thumbnail_pregenerator_;
   util::RandomNumberGenerator random_number_generator_;
   util::CacheManager cache_;
   CloudFactory factory_;
   util::SettingsManager settings_manager_;
   util::Clock clock_;
+  util::Metrics metrics_;
 };
 
 }  // namespace coro::cloudstorage::util
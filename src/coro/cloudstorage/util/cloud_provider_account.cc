@@ -1,7 +1,10 @@
 #include "coro/cloudstorage/util/cloud_provider_account.h"
 
+#include <exception>
+
 #include "coro/cloudstorage/util/cloud_provider_utils.h"
 #include "coro/cloudstorage/util/generator_utils.h"
+#include "coro/exception.h"
 
 namespace coro::cloudstorage::util {
 
@@ -49,6 +52,28 @@ Task<> UpdateDirectoryListCache(
   }
 }
 
+// Generated thumbnails come with their signature, thumbnails of the cloud
+// provider are decoded once before they get cached, in a slot of class
+// `priority` as their generation would be. A thumbnail which can't be decoded
+// is still served, just without the signature.
+Task<std::optional<ImageSignature>> GetThumbnailSignature(
+    const ThumbnailGenerator* thumbnail_generator,
+    const AbstractCloudProvider* provider,
+    const AbstractCloudProvider::Thumbnail& thumbnail, std::string image,
+    JobScheduler::Priority priority, stdx::stop_token stop_token) {
+  if (thumbnail.signature) {
+    co_return thumbnail.signature;
+  }
+  try {
+    co_return co_await thumbnail_generator->GetSignature(
+        provider, std::move(image), priority, stop_token);
+  } catch (const InterruptedException&) {
+    throw;
+  } catch (const std::exception&) {
+    co_return std::nullopt;
+  }
+}
+
 }  // namespace
 
 Task<VersionedDirectoryContent> CloudProviderAccount::ListDirectory(
@@ -157,12 +182,14 @@ Task<VersionedItem> CloudProviderAccount::GetItemById(
 
 template <typename Item>
 Task<VersionedThumbnail> CloudProviderAccount::GetItemThumbnailWithFallback(
-    Item item, ThumbnailQuality quality, http::Range range,
+    Item item, ThumbnailQuality quality, ThumbnailOptions::Codec codec,
+    http::Range range, JobScheduler::Priority priority,
     stdx::stop_token stop_token) const {
   auto current_time = clock_->Now();
   std::optional<CacheManager::ImageData> image_data =
       co_await cache_manager_->Get(
-          account_key(), CacheManager::ImageKey{item.id, quality}, stop_token);
+          account_key(), CacheManager::ImageKey{item.id, quality, codec},
+          stop_token);
   auto updated = std::make_shared<
       Promise<std::optional<AbstractCloudProvider::Thumbnail>>>();
   if (image_data) {
@@ -170,30 +197,36 @@ Task<VersionedThumbnail> CloudProviderAccount::GetItemThumbnailWithFallback(
       RunTask([account_key = account_key(),
                thumbnail_generator = thumbnail_generator_,
                cache_manager = cache_manager_, current_time,
-               provider = provider_, item = std::move(item), quality, range,
-               stop_token = stop_source_.get_token(),
+               provider = provider_, item = std::move(item), quality, codec,
+               range, priority, stop_token = stop_source_.get_token(),
                updated]() mutable -> Task<> {
         try {
           AbstractCloudProvider::Thumbnail thumbnail =
               co_await ::coro::cloudstorage::util::GetItemThumbnailWithFallback(
-                  thumbnail_generator, provider.get(), item, quality,
-                  http::Range{}, stop_token);
+                  thumbnail_generator, provider.get(), item, quality, codec,
+                  http::Range{}, priority, stop_token);
           auto image_bytes = co_await http::GetBody(std::move(thumbnail.data));
+          auto signature = co_await GetThumbnailSignature(
+              thumbnail_generator, provider.get(), thumbnail, image_bytes,
+              priority, stop_token);
           CacheManager::ImageData image_data{
               .image_bytes =
                   std::vector<char>(image_bytes.begin(), image_bytes.end()),
               .mime_type = thumbnail.mime_type,
-              .update_time = current_time};
-          co_await cache_manager->Put(std::move(account_key),
-                                      CacheManager::ImageKey{item.id, quality},
-                                      image_data, std::move(stop_token));
+              .update_time = current_time,
+              .signature = signature};
+          co_await cache_manager->Put(
+              std::move(account_key),
+              CacheManager::ImageKey{item.id, quality, codec}, image_data,
+              std::move(stop_token));
           int64_t size = static_cast<int64_t>(image_data.image_bytes.size());
           std::string data(image_data.image_bytes.begin(),
                            image_data.image_bytes.end());
           updated->SetValue(AbstractCloudProvider::Thumbnail{
               .data = ToGenerator(Trim(std::move(data), range)),
               .size = size,
-              .mime_type = std::move(image_data.mime_type)});
+              .mime_type = std::move(image_data.mime_type),
+              .signature = signature});
         } catch (...) {
           updated->SetException(std::current_exception());
         }
@@ -208,22 +241,27 @@ Task<VersionedThumbnail> CloudProviderAccount::GetItemThumbnailWithFallback(
             AbstractCloudProvider::Thumbnail{
                 .data = ToGenerator(Trim(std::move(data), range)),
                 .size = size,
-                .mime_type = std::move(image_data->mime_type)},
+                .mime_type = std::move(image_data->mime_type),
+                .signature = image_data->signature},
         .update_time = image_data->update_time,
         .updated = std::move(updated)};
   }
   try {
     AbstractCloudProvider::Thumbnail thumbnail =
         co_await ::coro::cloudstorage::util::GetItemThumbnailWithFallback(
-            thumbnail_generator_, provider_.get(), item, quality, http::Range{},
-            stop_token);
+            thumbnail_generator_, provider_.get(), item, quality, codec,
+            http::Range{}, priority, stop_token);
     auto image_bytes = co_await http::GetBody(std::move(thumbnail.data));
+    auto signature = co_await GetThumbnailSignature(
+        thumbnail_generator_, provider_.get(), thumbnail, image_bytes,
+        priority, stop_token);
     co_await cache_manager_->Put(
-        account_key(), CacheManager::ImageKey{item.id, quality},
+        account_key(), CacheManager::ImageKey{item.id, quality, codec},
         CacheManager::ImageData{.image_bytes = std::vector<char>(
                                     image_bytes.begin(), image_bytes.end()),
                                 .mime_type = thumbnail.mime_type,
-                                .update_time = current_time},
+                                .update_time = current_time,
+                                .signature = signature},
         std::move(stop_token));
     updated->SetValue(std::nullopt);
     co_return VersionedThumbnail{
@@ -231,7 +269,8 @@ Task<VersionedThumbnail> CloudProviderAccount::GetItemThumbnailWithFallback(
             AbstractCloudProvider::Thumbnail{
                 .data = ToGenerator(Trim(std::move(image_bytes), range)),
                 .size = thumbnail.size,
-                .mime_type = std::move(thumbnail.mime_type)},
+                .mime_type = std::move(thumbnail.mime_type),
+                .signature = signature},
         .update_time = current_time,
         .updated = updated};
   } catch (...) {
@@ -240,14 +279,62 @@ Task<VersionedThumbnail> CloudProviderAccount::GetItemThumbnailWithFallback(
   }
 }
 
+Task<std::string> CloudProviderAccount::GetAnimatedPreview(
+    AbstractCloudProvider::File file, stdx::stop_token stop_token) const {
+  auto current_time = clock_->Now();
+  CacheManager::ImageKey key{
+      .item_id = file.id,
+      .quality = ThumbnailQuality::kLow,
+      .codec = ThumbnailOptions::Codec::WEBP,
+      .type = CacheManager::ImageType::kAnimatedPreview};
+  std::optional<CacheManager::ImageData> image_data =
+      co_await cache_manager_->Get(account_key(), key, stop_token);
+  if (image_data &&
+      current_time - image_data->update_time <= kThumbnailTimeToLive) {
+    co_return std::string(image_data->image_bytes.begin(),
+                          image_data->image_bytes.end());
+  }
+  std::string preview = co_await thumbnail_generator_->GetAnimatedPreview(
+      provider_.get(), std::move(file), AnimatedPreviewOptions{}, stop_token);
+  co_await cache_manager_->Put(
+      account_key(), std::move(key),
+      CacheManager::ImageData{
+          .image_bytes = std::vector<char>(preview.begin(), preview.end()),
+          .mime_type = "image/webp",
+          .update_time = current_time},
+      std::move(stop_token));
+  co_return preview;
+}
+
+Task<ContactSheet> CloudProviderAccount::GetContactSheet(
+    std::vector<AbstractCloudProvider::File> files, ContactSheetOptions options,
+    stdx::stop_token stop_token) const {
+  ThumbnailQuality quality =
+      options.tile_size <= GetThumbnailSize(ThumbnailQuality::kLow)
+          ? ThumbnailQuality::kLow
+          : ThumbnailQuality::kHigh;
+  co_return co_await thumbnail_generator_->GetContactSheet(
+      std::move(files), options,
+      [this, quality, codec = GetBrowserThumbnailCodec()](
+          AbstractCloudProvider::File file,
+          stdx::stop_token stop_token) -> Task<std::string> {
+        auto versioned = co_await GetItemThumbnailWithFallback(
+            std::move(file), quality, codec, http::Range{},
+            JobScheduler::Priority::kInteractive, std::move(stop_token));
+        co_return co_await http::GetBody(std::move(versioned.thumbnail.data));
+      },
+      std::move(stop_token));
+}
+
 template Task<VersionedThumbnail>
     CloudProviderAccount::GetItemThumbnailWithFallback(
-        AbstractCloudProvider::File, ThumbnailQuality, http::Range,
-        stdx::stop_token) const;
+        AbstractCloudProvider::File, ThumbnailQuality, ThumbnailOptions::Codec,
+        http::Range, JobScheduler::Priority, stdx::stop_token) const;
 
 template Task<VersionedThumbnail>
     CloudProviderAccount::GetItemThumbnailWithFallback(
-        AbstractCloudProvider::Directory, ThumbnailQuality, http::Range,
+        AbstractCloudProvider::Directory, ThumbnailQuality,
+        ThumbnailOptions::Codec, http::Range, JobScheduler::Priority,
         stdx::stop_token) const;
 
 }  // namespace coro::cloudstorage::util
\ No newline at end of file
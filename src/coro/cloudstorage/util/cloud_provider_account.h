@@ -62,10 +62,23 @@ class CloudProviderAccount {
   Task<VersionedItem> GetItemById(std::string id,
                                   stdx::stop_token stop_token) const;
 
+  // Missing thumbnails are generated in a slot of class `priority`, also when
+  // a stale cached one is refreshed.
   template <typename Item>
-  Task<VersionedThumbnail> GetItemThumbnailWithFallback(Item, ThumbnailQuality,
-                                                        http::Range,
-                                                        stdx::stop_token) const;
+  Task<VersionedThumbnail> GetItemThumbnailWithFallback(
+      Item, ThumbnailQuality, ThumbnailOptions::Codec, http::Range,
+      JobScheduler::Priority priority, stdx::stop_token) const;
+
+  // Animated WebP preview of a video, see ThumbnailGenerator.
+  Task<std::string> GetAnimatedPreview(AbstractCloudProvider::File,
+                                       stdx::stop_token) const;
+
+  // Contact sheet of `files`, see ThumbnailGenerator. The tiles are made from
+  // the thumbnails served to browsers, taken from the cache or the provider
+  // and only generated if neither has them.
+  Task<ContactSheet> GetContactSheet(std::vector<AbstractCloudProvider::File>,
+                                     ContactSheetOptions,
+                                     stdx::stop_token) const;
 
  private:
   CloudProviderAccount(std::string username, int64_t version,
@@ -8,6 +8,10 @@ namespace {
 
 using Item = AbstractCloudProvider::Item;
 
+// Thumbnails of videos are picked among this many keyframes, which bounds the
+// data read from the cloud provider to a few groups of pictures.
+constexpr int kVideoThumbnailKeyframeCount = 4;
+
 Task<Item> GetItemByPathComponents(
     const AbstractCloudProvider* p,
     AbstractCloudProvider::Directory current_directory,
@@ -51,17 +55,24 @@ Task<Item> GetItemByPath(const AbstractCloudProvider* d,
       std::move(stop_token));
 }
 
-Task<std::string> GenerateThumbnail(
+Task<GeneratedThumbnail> GenerateThumbnail(
     const ThumbnailGenerator* thumbnail_generator,
     const AbstractCloudProvider* provider, AbstractCloudProvider::File item,
-    stdx::stop_token stop_token) {
+    ThumbnailQuality quality, ThumbnailOptions::Codec codec,
+    JobScheduler::Priority priority, stdx::stop_token stop_token) {
   switch (GetFileType(item.mime_type)) {
     case FileType::kImage:
+      return thumbnail_generator->Generate(
+          provider, std::move(item),
+          ThumbnailOptions{.size = GetThumbnailSize(quality), .codec = codec},
+          priority, std::move(stop_token));
     case FileType::kVideo:
-      return (*thumbnail_generator)(
+      return thumbnail_generator->Generate(
           provider, std::move(item),
-          ThumbnailOptions{.codec = ThumbnailOptions::Codec::PNG},
-          std::move(stop_token));
+          ThumbnailOptions{.size = GetThumbnailSize(quality),
+                           .codec = codec,
+                           .keyframe_count = kVideoThumbnailKeyframeCount},
+          priority, std::move(stop_token));
     default:
       throw CloudException(CloudException::Type::kNotFound);
   }
@@ -70,19 +81,22 @@ Task<std::string> GenerateThumbnail(
 Task<AbstractCloudProvider::Thumbnail> GetThumbnail(
     const ThumbnailGenerator* thumbnail_generator,
     const AbstractCloudProvider* provider, AbstractCloudProvider::File file,
-    ThumbnailQuality quality, http::Range range, stdx::stop_token stop_token) {
+    ThumbnailQuality quality, ThumbnailOptions::Codec codec, http::Range range,
+    JobScheduler::Priority priority, stdx::stop_token stop_token) {
   try {
     co_return co_await provider->GetItemThumbnail(file, quality, range,
                                                   stop_token);
   } catch (...) {
   }
-  std::string image_bytes = co_await GenerateThumbnail(
-      thumbnail_generator, provider, file, std::move(stop_token));
-  int64_t size = image_bytes.size();
+  GeneratedThumbnail thumbnail =
+      co_await GenerateThumbnail(thumbnail_generator, provider, file, quality,
+                                 codec, priority, std::move(stop_token));
+  int64_t size = thumbnail.image.size();
   co_return AbstractCloudProvider::Thumbnail{
-      .data = ToGenerator(Trim(std::move(image_bytes), range)),
+      .data = ToGenerator(Trim(std::move(thumbnail.image), range)),
       .size = size,
-      .mime_type = "image/png"};
+      .mime_type = std::string(GetMimeType(codec)),
+      .signature = thumbnail.signature};
 }
 
 }  // namespace
@@ -117,9 +131,10 @@ Task<AbstractCloudProvider::Thumbnail>
 GetItemThumbnailWithFallback<AbstractCloudProvider::File>(
     const ThumbnailGenerator* thumbnail_generator,
     const AbstractCloudProvider* provider, AbstractCloudProvider::File file,
-    ThumbnailQuality quality, http::Range range, stdx::stop_token stop_token) {
+    ThumbnailQuality quality, ThumbnailOptions::Codec codec, http::Range range,
+    JobScheduler::Priority priority, stdx::stop_token stop_token) {
   return GetThumbnail(thumbnail_generator, provider, std::move(file), quality,
-                      range, std::move(stop_token));
+                      codec, range, priority, std::move(stop_token));
 }
 
 template <>
@@ -127,7 +142,8 @@ Task<AbstractCloudProvider::Thumbnail>
 GetItemThumbnailWithFallback<AbstractCloudProvider::Directory>(
     const ThumbnailGenerator*, const AbstractCloudProvider* provider,
     AbstractCloudProvider::Directory directory, ThumbnailQuality quality,
-    http::Range range, stdx::stop_token stop_token) {
+    ThumbnailOptions::Codec, http::Range range, JobScheduler::Priority,
+    stdx::stop_token stop_token) {
   return provider->GetItemThumbnail(std::move(directory), quality, range,
                                     std::move(stop_token));
 }
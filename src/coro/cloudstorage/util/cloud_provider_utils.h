@@ -43,24 +43,27 @@ Task<AbstractCloudProvider::Item> GetItemById(const AbstractCloudProvider*,
                                               std::string id,
                                               stdx::stop_token stop_token);
 
+// Thumbnails which the provider doesn't have are generated in a slot of
+// class `priority`.
 template <typename Item>
 Task<AbstractCloudProvider::Thumbnail> GetItemThumbnailWithFallback(
     const ThumbnailGenerator*, const AbstractCloudProvider*, Item,
-    ThumbnailQuality, http::Range, stdx::stop_token) = delete;
+    ThumbnailQuality, ThumbnailOptions::Codec, http::Range,
+    JobScheduler::Priority, stdx::stop_token) = delete;
 
 template <>
 Task<AbstractCloudProvider::Thumbnail>
 GetItemThumbnailWithFallback<AbstractCloudProvider::File>(
     const ThumbnailGenerator*, const AbstractCloudProvider*,
-    AbstractCloudProvider::File, ThumbnailQuality, http::Range,
-    stdx::stop_token);
+    AbstractCloudProvider::File, ThumbnailQuality, ThumbnailOptions::Codec,
+    http::Range, JobScheduler::Priority, stdx::stop_token);
 
 template <>
 Task<AbstractCloudProvider::Thumbnail>
 GetItemThumbnailWithFallback<AbstractCloudProvider::Directory>(
     const ThumbnailGenerator*, const AbstractCloudProvider*,
-    AbstractCloudProvider::Directory, ThumbnailQuality, http::Range,
-    stdx::stop_token);
+    AbstractCloudProvider::Directory, ThumbnailQuality, ThumbnailOptions::Codec,
+    http::Range, JobScheduler::Priority, stdx::stop_token);
 
 template <typename T>
 struct TypedItemId {
@@ -0,0 +1,196 @@
+#include "coro/cloudstorage/util/content_hash.h"
+
+#define CRYPTOPP_ENABLE_NAMESPACE_WEAK 1
+
+#include <cryptopp/md5.h>
+#include <cryptopp/sha.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <variant>
+
+#include "coro/cloudstorage/util/crypto_utils.h"
+#include "coro/http/http_parse.h"
+
+namespace coro::cloudstorage::util {
+
+namespace {
+
+constexpr int64_t kDropboxBlockSize = 4 * 1024 * 1024;
+
+template <typename HashT>
+std::string GetDigest(HashT& hash) {
+  std::string result(hash.DigestSize(), 0);
+  hash.Final(reinterpret_cast<uint8_t*>(result.data()));
+  return result;
+}
+
+class MD5Hash {
+ public:
+  void Update(std::string_view data) {
+    hash_.Update(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+  }
+
+  std::string Finalize() { return ToHex(GetDigest(hash_)); }
+
+ private:
+  ::CryptoPP::Weak::MD5 hash_;
+};
+
+class DropboxHash {
+ public:
+  void Update(std::string_view data) {
+    while (!data.empty()) {
+      auto size = static_cast<size_t>(
+          std::min<int64_t>(kDropboxBlockSize - block_size_, data.size()));
+      block_hash_.Update(reinterpret_cast<const uint8_t*>(data.data()), size);
+      block_size_ += static_cast<int64_t>(size);
+      data.remove_prefix(size);
+      if (block_size_ == kDropboxBlockSize) {
+        FinishBlock();
+      }
+    }
+  }
+
+  std::string Finalize() {
+    if (block_size_ > 0) {
+      FinishBlock();
+    }
+    return ToHex(GetSHA256(block_digests_));
+  }
+
+ private:
+  void FinishBlock() {
+    block_digests_ += GetDigest(block_hash_);
+    block_size_ = 0;
+  }
+
+  ::CryptoPP::SHA256 block_hash_;
+  int64_t block_size_ = 0;
+  std::string block_digests_;
+};
+
+// Byte k of the input is xored into a circular 160 bit state at bit offset
+// 11 * k mod 160. Since the offset only depends on k mod 160, the bytes are
+// first folded into 160 byte lanes, which is a plain xor of 160 byte blocks
+// that compilers vectorize, and the lanes are shifted into place only once in
+// Finalize.
+class QuickXorHash {
+ public:
+  void Update(std::string_view data) {
+    length_ += data.size();
+    const auto* it = reinterpret_cast<const uint8_t*>(data.data());
+    const auto* end = it + data.size();
+    for (; it != end && position_ != 0; it++) {
+      lanes_[position_] ^= *it;
+      position_ = (position_ + 1) % kLaneCount;
+    }
+    for (; end - it >= kLaneCount; it += kLaneCount) {
+      for (int i = 0; i < kLaneCount; i++) {
+        lanes_[i] ^= it[i];
+      }
+    }
+    for (; it != end; it++) {
+      lanes_[position_++] ^= *it;
+    }
+  }
+
+  std::string Finalize() {
+    std::array<uint8_t, kWidthInBits / 8> result{};
+    for (int i = 0; i < kLaneCount; i++) {
+      int bit = (i * kShift) % kWidthInBits;
+      int index = bit / 8;
+      int shift = bit % 8;
+      result[index] ^= static_cast<uint8_t>(lanes_[i] << shift);
+      if (shift != 0) {
+        result[(index + 1) % result.size()] ^=
+            static_cast<uint8_t>(lanes_[i] >> (8 - shift));
+      }
+    }
+    for (int i = 0; i < 8; i++) {
+      result[result.size() - 8 + i] ^=
+          static_cast<uint8_t>((length_ >> (8 * i)) & 0xFF);
+    }
+    return http::ToBase64(
+        std::string(reinterpret_cast<const char*>(result.data()),
+                    result.size()));
+  }
+
+ private:
+  static constexpr int kWidthInBits = 160;
+  static constexpr int kLaneCount = 160;
+  static constexpr int kShift = 11;
+
+  std::array<uint8_t, kLaneCount> lanes_{};
+  int position_ = 0;
+  uint64_t length_ = 0;
+};
+
+}  // namespace
+
+class ContentHasher::Impl {
+ public:
+  explicit Impl(ContentHash::Type type) : type_(type) {
+    switch (type) {
+      case ContentHash::Type::kMD5:
+        hash_.emplace<MD5Hash>();
+        break;
+      case ContentHash::Type::kDropbox:
+        hash_.emplace<DropboxHash>();
+        break;
+      case ContentHash::Type::kQuickXor:
+        hash_.emplace<QuickXorHash>();
+        break;
+    }
+  }
+
+  void Update(std::string_view data) {
+    std::visit([&](auto& hash) { hash.Update(data); }, hash_);
+  }
+
+  ContentHash Finalize() {
+    return ContentHash{
+        .type = type_,
+        .value = std::visit([](auto& hash) { return hash.Finalize(); }, hash_)};
+  }
+
+ private:
+  ContentHash::Type type_;
+  std::variant<MD5Hash, DropboxHash, QuickXorHash> hash_;
+};
+
+ContentHasher::ContentHasher(ContentHash::Type type)
+    : d_(std::make_unique<Impl>(type)) {}
+
+ContentHasher::ContentHasher(ContentHasher&&) noexcept = default;
+
+ContentHasher& ContentHasher::operator=(ContentHasher&&) noexcept = default;
+
+ContentHasher::~ContentHasher() = default;
+
+void ContentHasher::Update(std::string_view data) { d_->Update(data); }
+
+ContentHash ContentHasher::Finalize() && { return d_->Finalize(); }
+
+bool operator==(const ContentHash& a, const ContentHash& b) {
+  if (a.type != b.type) {
+    return false;
+  }
+  if (a.type == ContentHash::Type::kQuickXor) {
+    return a.value == b.value;
+  }
+  return std::equal(a.value.begin(), a.value.end(), b.value.begin(),
+                    b.value.end(), [](char c1, char c2) {
+                      return std::tolower(c1) == std::tolower(c2);
+                    });
+}
+
+ContentHash GetContentHash(ContentHash::Type type, std::string_view content) {
+  ContentHasher hasher(type);
+  hasher.Update(content);
+  return std::move(hasher).Finalize();
+}
+
+}  // namespace coro::cloudstorage::util
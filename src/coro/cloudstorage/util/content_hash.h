@@ -0,0 +1,50 @@
+#ifndef CORO_CLOUDSTORAGE_UTIL_CONTENT_HASH_H
+#define CORO_CLOUDSTORAGE_UTIL_CONTENT_HASH_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace coro::cloudstorage::util {
+
+// Hash of a file's content, as reported by the cloud provider.
+struct ContentHash {
+  enum class Type {
+    // Hex encoded MD5, e.g. Google Drive's md5Checksum.
+    kMD5,
+    // Hex encoded SHA256 of concatenated SHA256 digests of 4MiB blocks.
+    kDropbox,
+    // Base64 encoded OneDrive quickXorHash.
+    kQuickXor,
+  };
+
+  Type type;
+  std::string value;
+};
+
+// Incrementally computes a ContentHash of a given type.
+class ContentHasher {
+ public:
+  explicit ContentHasher(ContentHash::Type type);
+  ContentHasher(ContentHasher&&) noexcept;
+  ContentHasher& operator=(ContentHasher&&) noexcept;
+  ~ContentHasher();
+
+  void Update(std::string_view data);
+
+  // Returns the digest encoded the way providers report it.
+  ContentHash Finalize() &&;
+
+ private:
+  class Impl;
+
+  std::unique_ptr<Impl> d_;
+};
+
+bool operator==(const ContentHash&, const ContentHash&);
+
+ContentHash GetContentHash(ContentHash::Type type, std::string_view content);
+
+}  // namespace coro::cloudstorage::util
+
+#endif  // CORO_CLOUDSTORAGE_UTIL_CONTENT_HASH_H
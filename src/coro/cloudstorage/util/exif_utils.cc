@@ -0,0 +1,190 @@
+#include "coro/cloudstorage/util/exif_utils.h"
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace coro::cloudstorage::util {
+
+namespace {
+
+constexpr uint8_t kMarkerPrefix = 0xFF;
+constexpr uint8_t kStartOfImage = 0xD8;
+constexpr uint8_t kStartOfScan = 0xDA;
+constexpr uint8_t kApp1 = 0xE1;
+
+constexpr uint16_t kOrientationTag = 0x0112;
+constexpr uint16_t kThumbnailOffsetTag = 0x0201;
+constexpr uint16_t kThumbnailLengthTag = 0x0202;
+
+constexpr std::string_view kExifSignature("Exif\0\0", 6);
+
+constexpr size_t kIfdEntrySize = 12;
+
+uint8_t GetByte(std::string_view data, size_t offset) {
+  return static_cast<uint8_t>(data[offset]);
+}
+
+uint16_t GetBigEndian16(std::string_view data, size_t offset) {
+  return static_cast<uint16_t>(GetByte(data, offset) << 8 |
+                               GetByte(data, offset + 1));
+}
+
+// Reads the TIFF structure of the EXIF block, which has its own byte order.
+class TiffReader {
+ public:
+  explicit TiffReader(std::string_view tiff) : tiff_(tiff) {}
+
+  bool ReadHeader() {
+    if (tiff_.size() < 8) {
+      return false;
+    }
+    if (tiff_.substr(0, 2) == "II") {
+      little_endian_ = true;
+    } else if (tiff_.substr(0, 2) != "MM") {
+      return false;
+    }
+    return Get16(2) == 42;
+  }
+
+  std::optional<uint32_t> Get16(size_t offset) const {
+    if (offset + 2 > tiff_.size()) {
+      return std::nullopt;
+    }
+    uint16_t b0 = GetByte(tiff_, offset);
+    uint16_t b1 = GetByte(tiff_, offset + 1);
+    return little_endian_ ? (b1 << 8 | b0) : (b0 << 8 | b1);
+  }
+
+  std::optional<uint32_t> Get32(size_t offset) const {
+    auto lo = Get16(offset + (little_endian_ ? 0 : 2));
+    auto hi = Get16(offset + (little_endian_ ? 2 : 0));
+    if (!lo || !hi) {
+      return std::nullopt;
+    }
+    return *hi << 16 | *lo;
+  }
+
+  // Returns the offset of the tag's entry within the IFD, if it has one.
+  std::optional<size_t> FindTag(uint32_t ifd_offset, uint16_t tag) const {
+    auto count = Get16(ifd_offset);
+    if (!count) {
+      return std::nullopt;
+    }
+    for (uint32_t i = 0; i < *count; i++) {
+      size_t entry = ifd_offset + 2 + i * kIfdEntrySize;
+      auto entry_tag = Get16(entry);
+      if (!entry_tag) {
+        return std::nullopt;
+      }
+      if (*entry_tag == tag) {
+        return entry;
+      }
+    }
+    return std::nullopt;
+  }
+
+  std::optional<uint32_t> GetNextIfd(uint32_t ifd_offset) const {
+    auto count = Get16(ifd_offset);
+    if (!count) {
+      return std::nullopt;
+    }
+    return Get32(ifd_offset + 2 + *count * kIfdEntrySize);
+  }
+
+  // Value of a SHORT or LONG tag, stored inline in the entry.
+  std::optional<uint32_t> GetValue(uint32_t ifd_offset, uint16_t tag) const {
+    auto entry = FindTag(ifd_offset, tag);
+    if (!entry) {
+      return std::nullopt;
+    }
+    constexpr uint16_t kShort = 3;
+    constexpr uint16_t kLong = 4;
+    auto type = Get16(*entry + 2);
+    if (type == kShort) {
+      return Get16(*entry + 8);
+    } else if (type == kLong) {
+      return Get32(*entry + 8);
+    } else {
+      return std::nullopt;
+    }
+  }
+
+  std::string_view data() const { return tiff_; }
+
+ private:
+  std::string_view tiff_;
+  bool little_endian_ = false;
+};
+
+std::optional<std::string_view> GetExifBlock(std::string_view jpeg) {
+  if (jpeg.size() < 2 || GetByte(jpeg, 0) != kMarkerPrefix ||
+      GetByte(jpeg, 1) != kStartOfImage) {
+    return std::nullopt;
+  }
+  size_t offset = 2;
+  while (offset + 4 <= jpeg.size()) {
+    if (GetByte(jpeg, offset) != kMarkerPrefix) {
+      return std::nullopt;
+    }
+    uint8_t marker = GetByte(jpeg, offset + 1);
+    if (marker == kStartOfScan) {
+      return std::nullopt;
+    }
+    size_t length = GetBigEndian16(jpeg, offset + 2);
+    if (length < 2) {
+      return std::nullopt;
+    }
+    std::string_view segment = jpeg.substr(offset + 4, length - 2);
+    if (marker == kApp1 && segment.substr(0, kExifSignature.size()) ==
+                               kExifSignature) {
+      if (segment.size() != length - 2) {
+        // The segment doesn't fit in the header.
+        return std::nullopt;
+      }
+      return segment.substr(kExifSignature.size());
+    }
+    offset += 2 + length;
+  }
+  return std::nullopt;
+}
+
+}  // namespace
+
+std::optional<ExifThumbnail> GetExifThumbnail(std::string_view jpeg_header) {
+  auto exif = GetExifBlock(jpeg_header);
+  if (!exif) {
+    return std::nullopt;
+  }
+  TiffReader reader(*exif);
+  if (!reader.ReadHeader()) {
+    return std::nullopt;
+  }
+  auto ifd0 = reader.Get32(4);
+  if (!ifd0) {
+    return std::nullopt;
+  }
+  auto ifd1 = reader.GetNextIfd(*ifd0);
+  if (!ifd1 || *ifd1 == 0) {
+    return std::nullopt;
+  }
+  auto offset = reader.GetValue(*ifd1, kThumbnailOffsetTag);
+  auto length = reader.GetValue(*ifd1, kThumbnailLengthTag);
+  if (!offset || !length || *offset >= exif->size() ||
+      *length > exif->size() - *offset) {
+    return std::nullopt;
+  }
+  std::string_view data = exif->substr(*offset, *length);
+  if (data.size() < 2 || GetByte(data, 0) != kMarkerPrefix ||
+      GetByte(data, 1) != kStartOfImage) {
+    return std::nullopt;
+  }
+  auto orientation = reader.GetValue(*ifd0, kOrientationTag);
+  return ExifThumbnail{
+      .data = data,
+      .orientation = orientation && *orientation >= 1 && *orientation <= 8
+                         ? static_cast<int>(*orientation)
+                         : 1};
+}
+
+}  // namespace coro::cloudstorage::util
@@ -0,0 +1,28 @@
+#ifndef CORO_CLOUDSTORAGE_UTIL_EXIF_UTILS_H
+#define CORO_CLOUDSTORAGE_UTIL_EXIF_UTILS_H
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace coro::cloudstorage::util {
+
+// Bytes of a JPEG file read when looking for the EXIF block. The APP1 segment
+// can't be larger than 64 KiB and comes right after the SOI marker, usually
+// after a JFIF APP0 segment.
+inline constexpr int64_t kExifHeaderSize = 70 * 1024;
+
+struct ExifThumbnail {
+  // JPEG preview stored in IFD1, points into the parsed header.
+  std::string_view data;
+  // Orientation of the main image, 1 when not set.
+  int orientation;
+};
+
+// Finds the preview embedded in the EXIF block of a JPEG file, given a prefix
+// of the file. Returns nullopt if the prefix doesn't contain one.
+std::optional<ExifThumbnail> GetExifThumbnail(std::string_view jpeg_header);
+
+}  // namespace coro::cloudstorage::util
+
+#endif  // CORO_CLOUDSTORAGE_UTIL_EXIF_UTILS_H
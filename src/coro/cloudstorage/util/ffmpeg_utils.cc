@@ -1,5 +1,6 @@
 #include "coro/cloudstorage/util/ffmpeg_utils.h"
 
+#include <algorithm>
 #include <memory>
 #include <string>
 
@@ -47,7 +48,7 @@ std::unique_ptr<AVFormatContext, AVFormatContextDeleter> CreateFormatContext(
 }
 
 std::unique_ptr<AVCodecContext, AVCodecContextDeleter> CreateCodecContext(
-    AVFormatContext* context, int stream_index) {
+    AVFormatContext* context, int stream_index, int lowres) {
   auto* codec =
       avcodec_find_decoder(context->streams[stream_index]->codecpar->codec_id);
   if (!codec) {
@@ -62,6 +63,7 @@ std::unique_ptr<AVCodecContext, AVCodecContextDeleter> CreateCodecContext(
       avcodec_parameters_to_context(codec_context.get(),
                                     context->streams[stream_index]->codecpar),
       "avcodec_parameters_to_context");
+  codec_context->lowres = std::min<int>(lowres, codec->max_lowres);
   CheckAVError(avcodec_open2(codec_context.get(), codec, nullptr),
                "avcodec_open2");
   return codec_context;
@@ -75,4 +77,12 @@ std::unique_ptr<AVPacket, AVPacketDeleter> CreatePacket() {
   return packet;
 }
 
+std::unique_ptr<AVFrame, AVFrameDeleter> CreateFrame() {
+  std::unique_ptr<AVFrame, AVFrameDeleter> frame(av_frame_alloc());
+  if (!frame) {
+    throw RuntimeError("av_frame_alloc");
+  }
+  return frame;
+}
+
 }  // namespace coro::cloudstorage::util
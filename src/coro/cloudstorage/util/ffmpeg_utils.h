@@ -4,6 +4,8 @@
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
 }
 
 #include <memory>
@@ -27,12 +29,23 @@ struct AVPacketDeleter {
   void operator()(AVPacket* packet) const { av_packet_free(&packet); }
 };
 
+struct AVFrameDeleter {
+  void operator()(AVFrame* frame) const { av_frame_free(&frame); }
+};
+
+struct SwsContextDeleter {
+  void operator()(SwsContext* context) const { sws_freeContext(context); }
+};
+
 void CheckAVError(int code, std::string_view call);
 std::unique_ptr<AVFormatContext, AVFormatContextDeleter> CreateFormatContext(
     AVIOContext* io_context);
+// `lowres` asks the decoder to output frames downscaled by 2^lowres; it is
+// clamped to what the decoder supports (MJPEG only goes down to 1/8).
 std::unique_ptr<AVCodecContext, AVCodecContextDeleter> CreateCodecContext(
-    AVFormatContext* context, int stream_index);
+    AVFormatContext* context, int stream_index, int lowres = 0);
 std::unique_ptr<AVPacket, AVPacketDeleter> CreatePacket();
+std::unique_ptr<AVFrame, AVFrameDeleter> CreateFrame();
 
 }  // namespace coro::cloudstorage::util
 
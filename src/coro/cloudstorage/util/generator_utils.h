@@ -1,6 +1,7 @@
 #ifndef CORO_CLOUDSTORAGE_GENERATOR_UTILS_H
 #define CORO_CLOUDSTORAGE_GENERATOR_UTILS_H
 
+#include <memory>
 #include <string>
 
 #include "coro/generator.h"
@@ -11,6 +12,14 @@ inline Generator<std::string> ToGenerator(std::string chunk) {
   co_yield std::move(chunk);
 }
 
+// Yields `content` in chunks, without copying it as a whole.
+inline Generator<std::string> ToGenerator(
+    std::shared_ptr<const std::string> content, size_t chunk_size = 65536) {
+  for (size_t offset = 0; offset < content->size(); offset += chunk_size) {
+    co_yield content->substr(offset, chunk_size);
+  }
+}
+
 template <typename... Args>
 Generator<std::string> Forward(Generator<std::string> body, Args...) {
   FOR_CO_AWAIT(std::string & chunk, body) { co_yield std::move(chunk); }
@@ -1,12 +1,63 @@
 #include "coro/cloudstorage/util/handler_utils.h"
 
+#include <algorithm>
+#include <charconv>
+#include <functional>
 #include <string>
 
+#include "coro/cloudstorage/util/crypto_utils.h"
 #include "coro/cloudstorage/util/string_utils.h"
+#include "coro/cloudstorage/util/webdav_utils.h"
 #include "coro/http/http.h"
 
 namespace coro::cloudstorage::util {
 
+namespace {
+
+constexpr int64_t kMaxFetchedRangeGap = 64 * 1024;
+constexpr size_t kMaxRanges = 16;
+
+std::string_view TrimWhitespace(std::string_view input) {
+  while (!input.empty() && (input.front() == ' ' || input.front() == '\t')) {
+    input.remove_prefix(1);
+  }
+  while (!input.empty() && (input.back() == ' ' || input.back() == '\t')) {
+    input.remove_suffix(1);
+  }
+  return input;
+}
+
+std::optional<int64_t> ParseRangeNumber(std::string_view input) {
+  int64_t result;
+  auto [ptr, ec] =
+      std::from_chars(input.data(), input.data() + input.size(), result);
+  if (input.empty() || ec != std::errc() ||
+      ptr != input.data() + input.size() || result < 0) {
+    return std::nullopt;
+  }
+  return result;
+}
+
+std::string_view StripWeakPrefix(std::string_view etag) {
+  if (etag.starts_with("W/")) {
+    etag.remove_prefix(2);
+  }
+  return etag;
+}
+
+bool IsETagListMatching(std::string_view header, std::string_view etag) {
+  for (const std::string& entry : SplitString(std::string(header), ',')) {
+    std::string_view candidate = TrimWhitespace(entry);
+    if (candidate == "*" ||
+        StripWeakPrefix(candidate) == StripWeakPrefix(etag)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
 namespace internal {
 
 Generator<std::string> GetFileContentResponseBody(
@@ -17,8 +68,182 @@ Generator<std::string> GetFileContentResponseBody(
   }
 }
 
+std::string GetByteRangesBoundary(std::string_view item_id, int64_t size) {
+  return StrCat("coro-cloudstorage-",
+                std::hash<std::string>{}(StrCat(item_id, '/', size)));
+}
+
+std::string GetByteRangesPartHeader(std::string_view boundary,
+                                    std::string_view mime_type,
+                                    http::Range range, int64_t size) {
+  return StrCat("\r\n--", boundary, "\r\nContent-Type: ", mime_type,
+                "\r\nContent-Range: bytes ", range.start, '-', *range.end, '/',
+                size, "\r\n\r\n");
+}
+
+std::string GetByteRangesTrailer(std::string_view boundary) {
+  return StrCat("\r\n--", boundary, "--\r\n");
+}
+
+std::vector<std::vector<http::Range>> GroupRangesForFetch(
+    std::span<const http::Range> ranges) {
+  std::vector<std::vector<http::Range>> groups;
+  for (http::Range range : ranges) {
+    if (groups.empty() ||
+        range.start - *groups.back().back().end - 1 > kMaxFetchedRangeGap) {
+      groups.emplace_back();
+    }
+    groups.back().emplace_back(range);
+  }
+  return groups;
+}
+
 }  // namespace internal
 
+std::vector<http::Range> ParseRanges(std::string_view header,
+                                     std::optional<int64_t> size) {
+  header = TrimWhitespace(header);
+  if (!header.starts_with("bytes=")) {
+    return {};
+  }
+  header.remove_prefix(std::string_view("bytes=").size());
+  std::vector<http::Range> ranges;
+  for (const std::string& entry : SplitString(std::string(header), ',')) {
+    std::string_view spec = TrimWhitespace(entry);
+    if (spec.empty()) {
+      continue;
+    }
+    if (ranges.size() == kMaxRanges) {
+      return {};
+    }
+    auto dash = spec.find('-');
+    if (dash == std::string_view::npos) {
+      return {};
+    }
+    std::string_view first = TrimWhitespace(spec.substr(0, dash));
+    std::string_view last = TrimWhitespace(spec.substr(dash + 1));
+    if (first.empty()) {
+      auto suffix_length = ParseRangeNumber(last);
+      if (!suffix_length) {
+        return {};
+      }
+      if (!size) {
+        return {};
+      }
+      if (*suffix_length > 0 && *size > 0) {
+        ranges.emplace_back(
+            http::Range{.start = std::max<int64_t>(*size - *suffix_length, 0),
+                        .end = *size - 1});
+      } else {
+        // Selects no bytes, kept so that the request is answered with 416.
+        ranges.emplace_back(http::Range{.start = *size, .end = *size});
+      }
+      continue;
+    }
+    auto start = ParseRangeNumber(first);
+    if (!start) {
+      return {};
+    }
+    http::Range range{.start = *start};
+    if (!last.empty()) {
+      range.end = ParseRangeNumber(last);
+      if (!range.end || *range.end < range.start) {
+        return {};
+      }
+    }
+    ranges.emplace_back(range);
+  }
+  return ranges;
+}
+
+std::vector<http::Range> GetRanges(
+    std::span<const std::pair<std::string, std::string>> headers,
+    std::optional<int64_t> size) {
+  if (auto header = http::GetHeader(headers, "Range")) {
+    return ParseRanges(*header, size);
+  } else {
+    return {};
+  }
+}
+
+ContentValidators GetContentValidators(
+    std::string_view id, std::optional<int64_t> timestamp,
+    std::optional<int64_t> size,
+    const std::optional<ContentHash>& content_hash) {
+  std::optional<std::string> input;
+  if (content_hash) {
+    input = StrCat(static_cast<int>(content_hash->type), '\n',
+                   content_hash->value);
+  } else if (timestamp) {
+    input = StrCat(id, '\n', *timestamp, '\n',
+                   size ? std::to_string(*size) : "");
+  } else if (size) {
+    input = StrCat(id, '\n', '\n', *size);
+  }
+  ContentValidators validators{.last_modified = timestamp};
+  if (input) {
+    validators.etag =
+        StrCat('"', ToHex(GetSHA256(*input)).substr(0, 32), '"');
+  }
+  return validators;
+}
+
+bool IsNotModified(std::span<const std::pair<std::string, std::string>> headers,
+                   const ContentValidators& validators) {
+  if (auto if_none_match = http::GetHeader(headers, "If-None-Match")) {
+    return validators.etag &&
+           IsETagListMatching(*if_none_match, *validators.etag);
+  }
+  if (auto if_modified_since = http::GetHeader(headers, "If-Modified-Since")) {
+    auto since = ParseRFC1123(*if_modified_since);
+    return since && validators.last_modified &&
+           *validators.last_modified <= *since;
+  }
+  return false;
+}
+
+bool IsRangeApplicable(
+    std::span<const std::pair<std::string, std::string>> headers,
+    const ContentValidators& validators) {
+  auto if_range = http::GetHeader(headers, "If-Range");
+  if (!if_range) {
+    return true;
+  }
+  std::string_view value = TrimWhitespace(*if_range);
+  if (value.starts_with('"')) {
+    return validators.etag && value == *validators.etag;
+  }
+  if (value.starts_with("W/")) {
+    return false;
+  }
+  auto date = ParseRFC1123(value);
+  return date && validators.last_modified && *date == *validators.last_modified;
+}
+
+bool IsRangeSetExcessive(std::span<const http::Range> ranges, int64_t size) {
+  int64_t total = 0;
+  for (http::Range range : ranges) {
+    total += *range.end - range.start + 1;
+  }
+  return total > size;
+}
+
+std::vector<http::Range> CoalesceRanges(std::vector<http::Range> ranges) {
+  std::sort(ranges.begin(), ranges.end(),
+            [](const http::Range& r1, const http::Range& r2) {
+              return r1.start < r2.start;
+            });
+  std::vector<http::Range> result;
+  for (http::Range range : ranges) {
+    if (!result.empty() && range.start <= *result.back().end + 1) {
+      result.back().end = std::max(*result.back().end, *range.end);
+    } else {
+      result.emplace_back(range);
+    }
+  }
+  return result;
+}
+
 std::vector<std::string> GetEffectivePath(std::string_view uri_path) {
   std::vector<std::string> components;
   for (std::string_view component : SplitString(std::string(uri_path), '/')) {
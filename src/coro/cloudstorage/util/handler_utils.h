@@ -1,12 +1,17 @@
 #ifndef CORO_CLOUDSTORAGE_HANDLER_UTILS_H
 #define CORO_CLOUDSTORAGE_HANDLER_UTILS_H
 
+#include <algorithm>
+#include <optional>
 #include <span>
 #include <sstream>
 #include <string_view>
 #include <vector>
 
 #include "coro/cloudstorage/util/abstract_cloud_provider.h"
+#include "coro/cloudstorage/util/generator_utils.h"
+#include "coro/cloudstorage/util/string_utils.h"
+#include "coro/cloudstorage/util/webdav_utils.h"
 #include "coro/generator.h"
 #include "coro/http/http.h"
 #include "coro/http/http_parse.h"
@@ -18,6 +23,45 @@ namespace internal {
 Generator<std::string> GetFileContentResponseBody(
     Generator<std::string> content, Generator<std::string>::iterator it);
 
+std::string GetByteRangesBoundary(std::string_view item_id, int64_t size);
+
+std::string GetByteRangesPartHeader(std::string_view boundary,
+                                    std::string_view mime_type,
+                                    http::Range range, int64_t size);
+
+std::string GetByteRangesTrailer(std::string_view boundary);
+
+// Groups sorted, non-overlapping ranges so that ranges separated by a small gap
+// are fetched from the cloud provider with a single request.
+std::vector<std::vector<http::Range>> GroupRangesForFetch(
+    std::span<const http::Range> ranges);
+
+template <typename CloudProvider, typename Item>
+Generator<std::string> GetByteRangesResponseBody(
+    CloudProvider* provider, Item d, std::vector<http::Range> ranges,
+    std::string boundary, stdx::stop_token stop_token) {
+  int64_t size = *d.size;
+  for (const auto& group : GroupRangesForFetch(ranges)) {
+    http::Range fetch_range{.start = group.front().start,
+                            .end = group.back().end};
+    auto content = provider->GetFileContent(d, fetch_range, stop_token);
+    auto it = co_await content.begin();
+    int64_t offset = fetch_range.start;
+    for (http::Range range : group) {
+      co_await http::GetBody(
+          Take(content, it, static_cast<size_t>(range.start - offset)));
+      co_yield GetByteRangesPartHeader(boundary, d.mime_type, range, size);
+      FOR_CO_AWAIT(std::string & chunk,
+                   Take(content, it,
+                        static_cast<size_t>(*range.end - range.start + 1))) {
+        co_yield std::move(chunk);
+      }
+      offset = *range.end + 1;
+    }
+  }
+  co_yield GetByteRangesTrailer(boundary);
+}
+
 }  // namespace internal
 
 template <typename T>
@@ -50,22 +94,133 @@ auto ToFileContent(AbstractCloudProvider* p,
   return content;
 }
 
+// Parses a Range header value (e.g. "bytes=0-99,200-,-50"). Suffix ranges are
+// resolved against size, the header is ignored if it has one and the size is
+// unknown. Empty suffix ranges ("-0", or any suffix of an empty file) become a
+// range starting at size, which is unsatisfiable. Returns an empty vector if
+// the header is malformed or has more than 16 ranges, in which case it should
+// be ignored.
+std::vector<http::Range> ParseRanges(std::string_view header,
+                                     std::optional<int64_t> size);
+
+// Whether the ranges, which must have their ends set, select more bytes than
+// the whole file has, which takes overlapping ones. Such requests are answered
+// with the whole file.
+bool IsRangeSetExcessive(std::span<const http::Range> ranges, int64_t size);
+
+// Sorts ranges and merges the ones which overlap or are adjacent. Ranges must
+// have their ends set.
+std::vector<http::Range> CoalesceRanges(std::vector<http::Range> ranges);
+
+std::vector<http::Range> GetRanges(
+    std::span<const std::pair<std::string, std::string>> headers,
+    std::optional<int64_t> size);
+
+struct ContentValidators {
+  std::optional<std::string> etag;
+  std::optional<int64_t> last_modified;
+};
+
+// The ETag is derived from the content hash reported by the provider, or else
+// from the modification time and the size, or else from the size alone.
+// Last-Modified is only produced when the provider reports a modification
+// time.
+ContentValidators GetContentValidators(
+    std::string_view id, std::optional<int64_t> timestamp,
+    std::optional<int64_t> size,
+    const std::optional<ContentHash>& content_hash = std::nullopt);
+
+// Evaluates If-None-Match and If-Modified-Since.
+bool IsNotModified(std::span<const std::pair<std::string, std::string>> headers,
+                   const ContentValidators& validators);
+
+// Evaluates If-Range, returns false if the Range header has to be ignored.
+bool IsRangeApplicable(
+    std::span<const std::pair<std::string, std::string>> headers,
+    const ContentValidators& validators);
+
 template <typename CloudProvider, typename Item>
-Task<http::Response<>> GetFileContentResponse(CloudProvider* provider, Item d,
-                                              std::optional<http::Range> range,
-                                              stdx::stop_token stop_token) {
+Task<http::Response<>> GetFileContentResponse(
+    CloudProvider* provider, Item d,
+    std::vector<std::pair<std::string, std::string>> request_headers,
+    stdx::stop_token stop_token) {
   std::vector<std::pair<std::string, std::string>> headers = {
-      {"Content-Type", d.mime_type},
       {"Content-Disposition", "inline; filename=\"" + d.name + "\""},
       {"Access-Control-Allow-Origin", "*"},
       {"Access-Control-Allow-Headers", "*"}};
+  ContentValidators validators =
+      GetContentValidators(d.id, d.timestamp, d.size, d.content_hash);
+  if (validators.etag) {
+    headers.emplace_back("ETag", *validators.etag);
+  }
+  if (validators.last_modified) {
+    headers.emplace_back("Last-Modified",
+                         GetRFC1123(*validators.last_modified));
+  }
+  if (IsNotModified(request_headers, validators)) {
+    co_return http::Response<>{.status = 304, .headers = std::move(headers)};
+  }
   auto size = d.size;
+  std::vector<http::Range> ranges;
+  if (IsRangeApplicable(request_headers, validators)) {
+    ranges = GetRanges(request_headers, size);
+  }
+  if (size) {
+    headers.emplace_back("Accept-Ranges", "bytes");
+    if (!ranges.empty()) {
+      std::vector<http::Range> satisfiable;
+      for (http::Range range : ranges) {
+        if (range.start < *size && (!range.end || *range.end >= range.start)) {
+          range.end = std::min<int64_t>(range.end.value_or(*size - 1),
+                                        *size - 1);
+          satisfiable.emplace_back(range);
+        }
+      }
+      if (satisfiable.empty()) {
+        headers.emplace_back("Content-Range", StrCat("bytes */", *size));
+        co_return http::Response<>{.status = 416,
+                                   .headers = std::move(headers)};
+      }
+      if (IsRangeSetExcessive(satisfiable, *size)) {
+        ranges.clear();
+      } else {
+        ranges = CoalesceRanges(std::move(satisfiable));
+      }
+    }
+    if (ranges.size() > 1) {
+      std::string boundary = internal::GetByteRangesBoundary(d.id, *size);
+      int64_t content_length =
+          static_cast<int64_t>(internal::GetByteRangesTrailer(boundary).size());
+      for (http::Range range : ranges) {
+        content_length +=
+            static_cast<int64_t>(internal::GetByteRangesPartHeader(
+                                     boundary, d.mime_type, range, *size)
+                                     .size()) +
+            *range.end - range.start + 1;
+      }
+      headers.emplace_back("Content-Type",
+                           "multipart/byteranges; boundary=" + boundary);
+      headers.emplace_back("Content-Length", std::to_string(content_length));
+      co_return http::Response<>{
+          .status = 206,
+          .headers = std::move(headers),
+          .body = internal::GetByteRangesResponseBody(
+              provider, std::move(d), std::move(ranges), std::move(boundary),
+              std::move(stop_token))};
+    }
+  }
+  std::optional<http::Range> range;
+  // Without the size, a multipart response can't be described, the whole file
+  // is sent instead of a subset of the ranges.
+  if (ranges.size() == 1) {
+    range = ranges.front();
+  }
+  headers.emplace_back("Content-Type", d.mime_type);
   if (size) {
     http::Range drange = range.value_or(http::Range{});
     if (!drange.end) {
       drange.end = *size - 1;
     }
-    headers.emplace_back("Accept-Ranges", "bytes");
     headers.emplace_back("Content-Length",
                          std::to_string(*drange.end - drange.start + 1));
     if (range) {
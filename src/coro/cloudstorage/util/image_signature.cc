@@ -0,0 +1,104 @@
+#include "coro/cloudstorage/util/image_signature.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+
+namespace coro::cloudstorage::util {
+
+namespace {
+
+constexpr int kHashWidth = 9;
+constexpr int kHashHeight = 8;
+// Bits per channel of the color histogram.
+constexpr int kColorBits = 4;
+
+// BT.601 luma, scaled by 256.
+int GetLuma(const uint8_t* pixel) {
+  return 77 * pixel[0] + 150 * pixel[1] + 29 * pixel[2];
+}
+
+// Each bit tells whether a cell of a 9x8 grid of box averaged luma is
+// brighter than its right neighbour, which survives scaling, recompression
+// and small color changes.
+uint64_t GetDifferenceHash(const RgbaImage& image) {
+  std::array<int64_t, kHashWidth * kHashHeight> sums{};
+  std::array<int64_t, kHashWidth * kHashHeight> counts{};
+  for (int y = 0; y < image.height; y++) {
+    const uint8_t* row = image.data + y * image.linesize;
+    int cell_y = y * kHashHeight / image.height;
+    for (int x = 0; x < image.width; x++) {
+      int cell = cell_y * kHashWidth + x * kHashWidth / image.width;
+      sums[cell] += GetLuma(row + 4 * x);
+      counts[cell]++;
+    }
+  }
+  uint64_t hash = 0;
+  for (int y = 0; y < kHashHeight; y++) {
+    for (int x = 0; x + 1 < kHashWidth; x++) {
+      int cell = y * kHashWidth + x;
+      // Compares sums[cell] / counts[cell] with the next cell's average.
+      bool brighter = sums[cell] * std::max<int64_t>(counts[cell + 1], 1) >
+                      sums[cell + 1] * std::max<int64_t>(counts[cell], 1);
+      hash = (hash << 1) | (brighter ? 1 : 0);
+    }
+  }
+  return hash;
+}
+
+// Mean color of the most populated bucket of a coarse color histogram, the
+// plain mean would turn a red and blue image purple.
+uint32_t GetDominantColor(const RgbaImage& image) {
+  struct Bucket {
+    int64_t count;
+    std::array<int64_t, 3> sum;
+  };
+  std::array<Bucket, 1 << (3 * kColorBits)> buckets{};
+  for (int y = 0; y < image.height; y++) {
+    const uint8_t* row = image.data + y * image.linesize;
+    for (int x = 0; x < image.width; x++) {
+      const uint8_t* pixel = row + 4 * x;
+      int index = 0;
+      for (int c = 0; c < 3; c++) {
+        index = (index << kColorBits) | (pixel[c] >> (8 - kColorBits));
+      }
+      Bucket& bucket = buckets[index];
+      bucket.count++;
+      for (int c = 0; c < 3; c++) {
+        bucket.sum[c] += pixel[c];
+      }
+    }
+  }
+  const Bucket* dominant = &buckets[0];
+  for (const Bucket& bucket : buckets) {
+    if (bucket.count > dominant->count) {
+      dominant = &bucket;
+    }
+  }
+  if (dominant->count == 0) {
+    return 0;
+  }
+  uint32_t color = 0;
+  for (int c = 0; c < 3; c++) {
+    color = (color << 8) |
+            static_cast<uint32_t>(dominant->sum[c] / dominant->count);
+  }
+  return color;
+}
+
+}  // namespace
+
+ImageSignature GetImageSignature(const RgbaImage& image) {
+  if (image.width == 0 || image.height == 0) {
+    return {.perceptual_hash = 0, .dominant_color = 0};
+  }
+  return {.perceptual_hash = GetDifferenceHash(image),
+          .dominant_color = GetDominantColor(image)};
+}
+
+int GetHammingDistance(uint64_t hash1, uint64_t hash2) {
+  return std::popcount(hash1 ^ hash2);
+}
+
+}  // namespace coro::cloudstorage::util
@@ -0,0 +1,33 @@
+#ifndef CORO_CLOUDSTORAGE_UTIL_IMAGE_SIGNATURE_H
+#define CORO_CLOUDSTORAGE_UTIL_IMAGE_SIGNATURE_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace coro::cloudstorage::util {
+
+// Summary of an image kept next to its cached thumbnail, so that clients can
+// show a placeholder and near-duplicates can be found without decoding it.
+struct ImageSignature {
+  // Difference hash, the images look alike when few bits differ.
+  uint64_t perceptual_hash;
+  // 0xRRGGBB.
+  uint32_t dominant_color;
+};
+
+// 8 bit RGBA pixels.
+struct RgbaImage {
+  const uint8_t* data;
+  ptrdiff_t linesize;
+  int width;
+  int height;
+};
+
+ImageSignature GetImageSignature(const RgbaImage& image);
+
+// Number of differing bits, near-duplicates are within about 10.
+int GetHammingDistance(uint64_t hash1, uint64_t hash2);
+
+}  // namespace coro::cloudstorage::util
+
+#endif  // CORO_CLOUDSTORAGE_UTIL_IMAGE_SIGNATURE_H
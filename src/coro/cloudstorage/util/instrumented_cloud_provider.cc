@@ -0,0 +1,264 @@
+#include "coro/cloudstorage/util/instrumented_cloud_provider.h"
+
+#include <type_traits>
+
+#include "coro/util/raii_utils.h"
+
+namespace coro::cloudstorage::util {
+
+namespace {
+
+// Waits for upstream data longer than this are accounted as stall time.
+constexpr double kStallThresholdSeconds = 0.5;
+
+}  // namespace
+
+bool InstrumentedCloudProvider::IsFileContentSizeRequired(
+    const AbstractCloudProvider::Directory& d) const {
+  return provider_->IsFileContentSizeRequired(d);
+}
+
+std::string_view InstrumentedCloudProvider::GetId() const {
+  return provider_->GetId();
+}
+
+nlohmann::json InstrumentedCloudProvider::ToJson(
+    const AbstractCloudProvider::Item& item) const {
+  return provider_->ToJson(item);
+}
+
+AbstractCloudProvider::Item InstrumentedCloudProvider::ToItem(
+    const nlohmann::json& json) const {
+  return provider_->ToItem(json);
+}
+
+Task<AbstractCloudProvider::Directory> InstrumentedCloudProvider::GetRoot(
+    stdx::stop_token stop_token) const {
+  return Measure("GetRoot", provider_->GetRoot(std::move(stop_token)));
+}
+
+Task<AbstractCloudProvider::Item> InstrumentedCloudProvider::GetItem(
+    std::string id, stdx::stop_token stop_token) const {
+  return Measure("GetItem",
+                 provider_->GetItem(std::move(id), std::move(stop_token)));
+}
+
+Task<AbstractCloudProvider::PageData>
+InstrumentedCloudProvider::ListDirectoryPage(
+    AbstractCloudProvider::Directory directory,
+    std::optional<std::string> page_token, stdx::stop_token stop_token) const {
+  return Measure("ListDirectoryPage",
+                 provider_->ListDirectoryPage(std::move(directory),
+                                              std::move(page_token),
+                                              std::move(stop_token)));
+}
+
+Task<AbstractCloudProvider::GeneralData>
+InstrumentedCloudProvider::GetGeneralData(stdx::stop_token stop_token) const {
+  return Measure("GetGeneralData",
+                 provider_->GetGeneralData(std::move(stop_token)));
+}
+
+Generator<std::string> InstrumentedCloudProvider::GetFileContent(
+    AbstractCloudProvider::File file, http::Range range,
+    stdx::stop_token stop_token) const {
+  auto start = std::chrono::steady_clock::now();
+  auto last_chunk = start;
+  bool first_chunk = true;
+  int64_t bytes = 0;
+  double stall_seconds = 0;
+  // Stays unset if the consumer drops the stream before its end, e.g. on a
+  // seek or a client disconnect.
+  std::string_view result = "cancelled";
+  metrics_->AddGauge("cloudstorage_active_content_streams", labels_, 1);
+  auto scope_guard = coro::util::AtScopeExit([&] {
+    metrics_->AddGauge("cloudstorage_active_content_streams", labels_, -1);
+    metrics_->IncrementCounter("cloudstorage_content_stall_seconds_total",
+                               labels_, stall_seconds);
+    metrics_->IncrementCounter("cloudstorage_downloaded_bytes_total", labels_,
+                               static_cast<double>(bytes));
+    OnCallFinished("GetFileContent", result, start);
+  });
+  try {
+    auto generator = provider_->GetFileContent(std::move(file), range,
+                                               std::move(stop_token));
+    FOR_CO_AWAIT(std::string & chunk, generator) {
+      double wait_seconds = GetElapsedSeconds(last_chunk);
+      if (first_chunk) {
+        first_chunk = false;
+        metrics_->Observe("cloudstorage_content_time_to_first_byte_seconds",
+                          labels_, wait_seconds);
+      } else if (wait_seconds >= kStallThresholdSeconds) {
+        stall_seconds += wait_seconds;
+      }
+      bytes += static_cast<int64_t>(chunk.size());
+      co_yield std::move(chunk);
+      // Time spent by the consumer doesn't count as upstream stall time.
+      last_chunk = std::chrono::steady_clock::now();
+    }
+  } catch (...) {
+    result = "error";
+    throw;
+  }
+  result = "success";
+  if (double elapsed = GetElapsedSeconds(start); elapsed > 0 && bytes > 0) {
+    metrics_->Observe("cloudstorage_content_throughput_bytes_per_second",
+                      labels_, static_cast<double>(bytes) / elapsed,
+                      Metrics::kThroughputBuckets);
+  }
+}
+
+Task<AbstractCloudProvider::File> InstrumentedCloudProvider::RenameItem(
+    AbstractCloudProvider::File item, std::string new_name,
+    stdx::stop_token stop_token) const {
+  return Measure("RenameItem",
+                 provider_->RenameItem(std::move(item), std::move(new_name),
+                                       std::move(stop_token)));
+}
+
+Task<AbstractCloudProvider::Directory> InstrumentedCloudProvider::RenameItem(
+    AbstractCloudProvider::Directory item, std::string new_name,
+    stdx::stop_token stop_token) const {
+  return Measure("RenameItem",
+                 provider_->RenameItem(std::move(item), std::move(new_name),
+                                       std::move(stop_token)));
+}
+
+Task<AbstractCloudProvider::Directory>
+InstrumentedCloudProvider::CreateDirectory(
+    AbstractCloudProvider::Directory parent, std::string name,
+    stdx::stop_token stop_token) const {
+  return Measure("CreateDirectory",
+                 provider_->CreateDirectory(std::move(parent), std::move(name),
+                                            std::move(stop_token)));
+}
+
+Task<> InstrumentedCloudProvider::RemoveItem(
+    AbstractCloudProvider::Directory item, stdx::stop_token stop_token) const {
+  return Measure("RemoveItem",
+                 provider_->RemoveItem(std::move(item), std::move(stop_token)));
+}
+
+Task<> InstrumentedCloudProvider::RemoveItem(
+    AbstractCloudProvider::File item, stdx::stop_token stop_token) const {
+  return Measure("RemoveItem",
+                 provider_->RemoveItem(std::move(item), std::move(stop_token)));
+}
+
+Task<AbstractCloudProvider::File> InstrumentedCloudProvider::MoveItem(
+    AbstractCloudProvider::File source,
+    AbstractCloudProvider::Directory destination,
+    stdx::stop_token stop_token) const {
+  return Measure("MoveItem",
+                 provider_->MoveItem(std::move(source), std::move(destination),
+                                     std::move(stop_token)));
+}
+
+Task<AbstractCloudProvider::Directory> InstrumentedCloudProvider::MoveItem(
+    AbstractCloudProvider::Directory source,
+    AbstractCloudProvider::Directory destination,
+    stdx::stop_token stop_token) const {
+  return Measure("MoveItem",
+                 provider_->MoveItem(std::move(source), std::move(destination),
+                                     std::move(stop_token)));
+}
+
+Task<AbstractCloudProvider::File> InstrumentedCloudProvider::CreateFile(
+    AbstractCloudProvider::Directory parent, std::string name,
+    AbstractCloudProvider::FileContent content,
+    stdx::stop_token stop_token) const {
+  content.data = CountUploadedBytes(std::move(content.data));
+  return Measure("CreateFile",
+                 provider_->CreateFile(std::move(parent), std::move(name),
+                                       std::move(content),
+                                       std::move(stop_token)));
+}
+
+Task<AbstractCloudProvider::Thumbnail>
+InstrumentedCloudProvider::GetItemThumbnail(
+    AbstractCloudProvider::File item, http::Range range,
+    stdx::stop_token stop_token) const {
+  return Measure("GetItemThumbnail",
+                 provider_->GetItemThumbnail(std::move(item), range,
+                                             std::move(stop_token)));
+}
+
+Task<AbstractCloudProvider::Thumbnail>
+InstrumentedCloudProvider::GetItemThumbnail(
+    AbstractCloudProvider::Directory item, http::Range range,
+    stdx::stop_token stop_token) const {
+  return Measure("GetItemThumbnail",
+                 provider_->GetItemThumbnail(std::move(item), range,
+                                             std::move(stop_token)));
+}
+
+Task<AbstractCloudProvider::Thumbnail>
+InstrumentedCloudProvider::GetItemThumbnail(
+    AbstractCloudProvider::File item, ThumbnailQuality quality,
+    http::Range range, stdx::stop_token stop_token) const {
+  return Measure("GetItemThumbnail",
+                 provider_->GetItemThumbnail(std::move(item), quality, range,
+                                             std::move(stop_token)));
+}
+
+Task<AbstractCloudProvider::Thumbnail>
+InstrumentedCloudProvider::GetItemThumbnail(
+    AbstractCloudProvider::Directory item, ThumbnailQuality quality,
+    http::Range range, stdx::stop_token stop_token) const {
+  return Measure("GetItemThumbnail",
+                 provider_->GetItemThumbnail(std::move(item), quality, range,
+                                             std::move(stop_token)));
+}
+
+template <typename T>
+Task<T> InstrumentedCloudProvider::Measure(std::string_view method,
+                                           Task<T> task) const {
+  auto start = std::chrono::steady_clock::now();
+  try {
+    if constexpr (std::is_void_v<T>) {
+      co_await std::move(task);
+      OnCallFinished(method, "success", start);
+    } else {
+      auto result = co_await std::move(task);
+      OnCallFinished(method, "success", start);
+      co_return result;
+    }
+  } catch (...) {
+    OnCallFinished(method, "error", start);
+    throw;
+  }
+}
+
+void InstrumentedCloudProvider::OnCallFinished(
+    std::string_view method, std::string_view result,
+    std::chrono::steady_clock::time_point start) const {
+  metrics_->IncrementCounter(
+      "cloudstorage_provider_requests_total",
+      GetLabels({{"method", std::string(method)},
+                 {"result", std::string(result)}}));
+  metrics_->Observe("cloudstorage_provider_request_duration_seconds",
+                    GetLabels({{"method", std::string(method)}}),
+                    GetElapsedSeconds(start));
+}
+
+Generator<std::string> InstrumentedCloudProvider::CountUploadedBytes(
+    Generator<std::string> content) const {
+  int64_t bytes = 0;
+  auto scope_guard = coro::util::AtScopeExit([&] {
+    metrics_->IncrementCounter("cloudstorage_uploaded_bytes_total", labels_,
+                               static_cast<double>(bytes));
+  });
+  FOR_CO_AWAIT(std::string & chunk, content) {
+    bytes += static_cast<int64_t>(chunk.size());
+    co_yield std::move(chunk);
+  }
+}
+
+Metrics::Labels InstrumentedCloudProvider::GetLabels(
+    std::initializer_list<std::pair<std::string, std::string>> extra) const {
+  Metrics::Labels labels = labels_;
+  labels.insert(labels.end(), extra.begin(), extra.end());
+  return labels;
+}
+
+}  // namespace coro::cloudstorage::util
@@ -0,0 +1,121 @@
+#ifndef CORO_CLOUDSTORAGE_UTIL_INSTRUMENTED_CLOUD_PROVIDER_H
+#define CORO_CLOUDSTORAGE_UTIL_INSTRUMENTED_CLOUD_PROVIDER_H
+
+#include <memory>
+#include <string_view>
+
+#include "coro/cloudstorage/util/abstract_cloud_provider.h"
+#include "coro/cloudstorage/util/metrics.h"
+
+namespace coro::cloudstorage::util {
+
+// Records call counts and latencies of every provider call, as well as
+// transferred bytes, time to first byte, upstream stall time and throughput
+// of content streams. All metrics are labeled with `labels`.
+class InstrumentedCloudProvider : public AbstractCloudProvider {
+ public:
+  InstrumentedCloudProvider(Metrics* metrics, Metrics::Labels labels,
+                            std::unique_ptr<AbstractCloudProvider> provider)
+      : metrics_(metrics),
+        labels_(std::move(labels)),
+        provider_(std::move(provider)) {}
+
+  bool IsFileContentSizeRequired(
+      const AbstractCloudProvider::Directory& d) const override;
+
+  std::string_view GetId() const override;
+
+  nlohmann::json ToJson(const AbstractCloudProvider::Item& item) const override;
+
+  AbstractCloudProvider::Item ToItem(const nlohmann::json&) const override;
+
+  Task<AbstractCloudProvider::Directory> GetRoot(
+      stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::Item> GetItem(std::string id,
+                                            stdx::stop_token) const override;
+
+  Task<AbstractCloudProvider::PageData> ListDirectoryPage(
+      AbstractCloudProvider::Directory directory,
+      std::optional<std::string> page_token,
+      stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::GeneralData> GetGeneralData(
+      stdx::stop_token stop_token) const override;
+
+  Generator<std::string> GetFileContent(
+      AbstractCloudProvider::File file, http::Range range,
+      stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::File> RenameItem(
+      AbstractCloudProvider::File item, std::string new_name,
+      stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::Directory> RenameItem(
+      AbstractCloudProvider::Directory item, std::string new_name,
+      stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::Directory> CreateDirectory(
+      AbstractCloudProvider::Directory parent, std::string name,
+      stdx::stop_token stop_token) const override;
+
+  Task<> RemoveItem(AbstractCloudProvider::Directory item,
+                    stdx::stop_token stop_token) const override;
+
+  Task<> RemoveItem(AbstractCloudProvider::File item,
+                    stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::File> MoveItem(
+      AbstractCloudProvider::File source,
+      AbstractCloudProvider::Directory destination,
+      stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::Directory> MoveItem(
+      AbstractCloudProvider::Directory source,
+      AbstractCloudProvider::Directory destination,
+      stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::File> CreateFile(
+      AbstractCloudProvider::Directory parent, std::string name,
+      AbstractCloudProvider::FileContent content,
+      stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::Thumbnail> GetItemThumbnail(
+      AbstractCloudProvider::File item, http::Range range,
+      stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::Thumbnail> GetItemThumbnail(
+      AbstractCloudProvider::Directory item, http::Range range,
+      stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::Thumbnail> GetItemThumbnail(
+      AbstractCloudProvider::File item, ThumbnailQuality, http::Range range,
+      stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::Thumbnail> GetItemThumbnail(
+      AbstractCloudProvider::Directory item, ThumbnailQuality,
+      http::Range range, stdx::stop_token stop_token) const override;
+
+ private:
+  template <typename T>
+  Task<T> Measure(std::string_view method, Task<T> task) const;
+
+  // `result` is "success", "error", or "cancelled" for content streams
+  // dropped by the consumer.
+  void OnCallFinished(std::string_view method, std::string_view result,
+                      std::chrono::steady_clock::time_point start) const;
+
+  Generator<std::string> CountUploadedBytes(
+      Generator<std::string> content) const;
+
+  Metrics::Labels GetLabels(
+      std::initializer_list<std::pair<std::string, std::string>> extra) const;
+
+  Metrics* metrics_;
+  Metrics::Labels labels_;
+  std::unique_ptr<AbstractCloudProvider> provider_;
+};
+
+}  // namespace coro::cloudstorage::util
+
+#endif  // CORO_CLOUDSTORAGE_UTIL_INSTRUMENTED_CLOUD_PROVIDER_H
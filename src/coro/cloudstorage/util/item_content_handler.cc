@@ -23,14 +23,7 @@ Task<http::Response<>> ItemContentHandler::operator()(
     co_return http::Response<>{.status = 400};
   }
   co_return co_await GetFileContentResponse(
-      account_.provider().get(), std::move(*file),
-      [&]() -> std::optional<http::Range> {
-        if (auto header = http::GetHeader(request.headers, "Range")) {
-          return http::ParseRange(std::move(*header));
-        } else {
-          return std::nullopt;
-        }
-      }(),
+      account_.provider().get(), std::move(*file), std::move(request.headers),
       std::move(stop_token));
 }
 
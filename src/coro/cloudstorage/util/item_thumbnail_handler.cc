@@ -2,7 +2,11 @@
 
 #include <fmt/format.h>
 
+#include <cstdlib>
 #include <iostream>
+#include <span>
+#include <string>
+#include <string_view>
 
 #include "coro/cloudstorage/util/cloud_provider_utils.h"
 #include "coro/cloudstorage/util/handler_utils.h"
@@ -43,18 +47,61 @@ http::Response<> GetStaticIcon(const Item& item, int http_code) {
   return http::Response<>{.status = http_code, .headers = std::move(headers)};
 }
 
+// Whether `mime_type` is listed in the Accept header and not excluded with
+// q=0. Wildcards are ignored, browsers send */* for formats they can't show.
+bool IsAccepted(std::string_view accept, std::string_view mime_type) {
+  std::string stripped;
+  for (char c : accept) {
+    if (c != ' ' && c != '\t') {
+      stripped += c;
+    }
+  }
+  for (const std::string& media_range : SplitString(stripped, ',')) {
+    auto parameters = SplitString(media_range, ';');
+    if (parameters.empty() || parameters[0] != mime_type) {
+      continue;
+    }
+    bool rejected = false;
+    for (size_t i = 1; i < parameters.size(); i++) {
+      if (parameters[i].starts_with("q=")) {
+        rejected = std::strtod(parameters[i].c_str() + 2, nullptr) <= 0;
+      }
+    }
+    return !rejected;
+  }
+  return false;
+}
+
+// Generated thumbnails are PNG unless the client accepts a smaller format.
+ThumbnailOptions::Codec GetThumbnailCodec(
+    std::span<const std::pair<std::string, std::string>> headers) {
+  if (auto accept = http::GetHeader(headers, "Accept")) {
+    for (auto codec :
+         {ThumbnailOptions::Codec::AVIF, ThumbnailOptions::Codec::WEBP}) {
+      if (IsAccepted(*accept, GetMimeType(codec)) &&
+          IsThumbnailCodecSupported(codec)) {
+        return codec;
+      }
+    }
+  }
+  return ThumbnailOptions::Codec::PNG;
+}
+
 template <typename Item>
 Task<http::Response<>> GetItemThumbnail(CloudProviderAccount account, Item d,
                                         ThumbnailQuality quality,
+                                        ThumbnailOptions::Codec codec,
                                         std::optional<http::Range> range,
                                         stdx::stop_token stop_token) {
   try {
     auto data = co_await account.GetItemThumbnailWithFallback(
-        d, quality, range.value_or(http::Range{}), stop_token);
+        d, quality, codec, range.value_or(http::Range{}),
+        JobScheduler::Priority::kInteractive, stop_token);
     std::vector<std::pair<std::string, std::string>> headers = {
         {"Cache-Control", "private"},
         {"Cache-Control", "max-age=604800"},
-        {"Content-Type", std::string(data.thumbnail.mime_type)}};
+        {"Content-Type", std::string(data.thumbnail.mime_type)},
+        {"Vary", "Accept"}};
     http::Range drange = range.value_or(http::Range{});
     if (!drange.end) {
       drange.end = data.thumbnail.size - 1;
@@ -67,6 +114,12 @@ Task<http::Response<>> GetItemThumbnail(CloudProviderAccount account, Item d,
                            fmt::format("bytes {}-{}/{}", drange.start,
                                        *drange.end, data.thumbnail.size));
     }
+    if (const auto& signature = data.thumbnail.signature) {
+      headers.emplace_back("X-Dominant-Color",
+                           fmt::format("#{:06x}", signature->dominant_color));
+      headers.emplace_back("X-Perceptual-Hash",
+                           fmt::format("{:016x}", signature->perceptual_hash));
+    }
     co_return http::Response<>{.status = range ? 206 : 200,
                                .headers = std::move(headers),
                                .body = std::move(data.thumbnail.data)};
@@ -103,6 +156,7 @@ Task<http::Response<>> ItemThumbnailHandler::operator()(
     }
     return ThumbnailQuality::kLow;
   }();
+  ThumbnailOptions::Codec codec = GetThumbnailCodec(request.headers);
   std::string item_id =
       http::DecodeUri(ToStringView(results[1].begin(), results[1].end()));
   auto range = [&]() -> std::optional<http::Range> {
@@ -114,9 +168,9 @@ Task<http::Response<>> ItemThumbnailHandler::operator()(
   }();
   auto item = co_await account_.GetItemById(item_id, stop_token);
   co_return co_await std::visit(
-      [account = account_, quality, range,
+      [account = account_, quality, codec, range,
        stop_token = std::move(stop_token)](auto item) mutable {
-        return GetItemThumbnail(account, std::move(item), quality, range,
+        return GetItemThumbnail(account, std::move(item), quality, codec, range,
                                 std::move(stop_token));
       },
       std::move(item.item));
@@ -0,0 +1,122 @@
+#include "coro/cloudstorage/util/job_scheduler.h"
+
+#include <exception>
+#include <utility>
+
+#include "coro/exception.h"
+#include "coro/http/http_exception.h"
+#include "coro/stdx/stop_source.h"
+
+namespace coro::cloudstorage::util {
+
+namespace {
+
+constexpr int kServiceUnavailable = 503;
+
+}  // namespace
+
+auto JobScheduler::Slot::operator=(Slot&& other) noexcept -> Slot& {
+  if (scheduler_) {
+    scheduler_->Release(priority_);
+  }
+  scheduler_ = std::exchange(other.scheduler_, nullptr);
+  priority_ = other.priority_;
+  return *this;
+}
+
+JobScheduler::Slot::~Slot() {
+  if (scheduler_) {
+    scheduler_->Release(priority_);
+  }
+}
+
+JobScheduler::JobScheduler(Config config)
+    : interactive_{.config = config.interactive},
+      streaming_{.config = config.streaming},
+      background_{.config = config.background},
+      idle_{.config = config.idle} {}
+
+auto JobScheduler::Acquire(Priority priority, const void* owner,
+                           stdx::stop_token stop_token) -> Task<Slot> {
+  Class& job_class = GetClass(priority);
+  if (job_class.running < job_class.config.max_running &&
+      job_class.waiting.empty()) {
+    job_class.running++;
+    job_class.last_owner = owner;
+    co_return Slot(this, priority);
+  }
+  if (job_class.queued >= job_class.config.max_queued) {
+    throw http::HttpException(kServiceUnavailable, "too many queued jobs");
+  }
+  auto waiter = std::make_shared<Waiter>();
+  job_class.waiting[owner].push_back(waiter);
+  job_class.queued++;
+  stdx::stop_callback stop_callback(stop_token, [&] {
+    if (waiter->done) {
+      return;
+    }
+    waiter->done = true;
+    auto it = job_class.waiting.find(owner);
+    std::erase(it->second, waiter);
+    if (it->second.empty()) {
+      job_class.waiting.erase(it);
+    }
+    job_class.queued--;
+    waiter->admitted.SetException(
+        std::make_exception_ptr(InterruptedException()));
+  });
+  co_await waiter->admitted;
+  co_return Slot(this, priority);
+}
+
+bool JobScheduler::IsIdle(Priority priority) const {
+  const Class& job_class = GetClass(priority);
+  return job_class.running == 0 && job_class.queued == 0;
+}
+
+auto JobScheduler::GetClass(Priority priority) -> Class& {
+  return const_cast<Class&>(std::as_const(*this).GetClass(priority));
+}
+
+auto JobScheduler::GetClass(Priority priority) const -> const Class& {
+  switch (priority) {
+    case Priority::kInteractive:
+      return interactive_;
+    case Priority::kStreaming:
+      return streaming_;
+    case Priority::kBackground:
+      return background_;
+    case Priority::kIdle:
+      return idle_;
+  }
+  throw RuntimeError("invalid priority");
+}
+
+void JobScheduler::Release(Priority priority) {
+  Class& job_class = GetClass(priority);
+  job_class.running--;
+  AdmitWaiting(job_class);
+}
+
+void JobScheduler::AdmitWaiting(Class& job_class) {
+  while (job_class.running < job_class.config.max_running &&
+         !job_class.waiting.empty()) {
+    // The next owner after the previously admitted one, wrapping around.
+    auto it = job_class.waiting.upper_bound(job_class.last_owner);
+    if (it == job_class.waiting.end()) {
+      it = job_class.waiting.begin();
+    }
+    std::shared_ptr<Waiter> waiter = std::move(it->second.front());
+    it->second.pop_front();
+    job_class.last_owner = it->first;
+    if (it->second.empty()) {
+      job_class.waiting.erase(it);
+    }
+    job_class.queued--;
+    job_class.running++;
+    waiter->done = true;
+    waiter->admitted.SetValue();
+  }
+}
+
+}  // namespace coro::cloudstorage::util
@@ -0,0 +1,108 @@
+#ifndef CORO_CLOUDSTORAGE_UTIL_JOB_SCHEDULER_H
+#define CORO_CLOUDSTORAGE_UTIL_JOB_SCHEDULER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+#include <utility>
+
+#include "coro/promise.h"
+#include "coro/stdx/stop_token.h"
+#include "coro/task.h"
+
+namespace coro::cloudstorage::util {
+
+// Admission control for media jobs. A job holds a slot of its priority class
+// while it runs, so long background jobs (cached remuxes, transcodes) can't
+// take the capacity reserved for interactive ones (thumbnails) or for playback
+// (streamed remuxes and HLS / DASH segments). Speculative work (thumbnail
+// pregeneration) has a class of its own, so it can't take any of these
+// either. Jobs which don't get a slot wait in a queue and are rejected with
+// 503 once the queue is full. Waiting jobs of a class are admitted round robin
+// across owners (accounts), so a single account can't starve the others. Only
+// used on the event loop thread.
+class JobScheduler {
+ public:
+  enum class Priority { kInteractive, kStreaming, kBackground, kIdle };
+
+  struct ClassConfig {
+    int max_running;
+    size_t max_queued;
+  };
+
+  struct Config {
+    ClassConfig interactive = {
+        .max_running = std::max<int>(
+            1, static_cast<int>(std::thread::hardware_concurrency() / 2)),
+        .max_queued = 64};
+    // Streamed remuxes mostly wait for the network and hold their slot for
+    // the whole playback.
+    ClassConfig streaming = {.max_running = 16, .max_queued = 16};
+    ClassConfig background = {.max_running = 2, .max_queued = 8};
+    ClassConfig idle = {.max_running = 1, .max_queued = 1};
+  };
+
+  // Gives the slot back once destroyed.
+  class Slot {
+   public:
+    Slot(Slot&& other) noexcept
+        : scheduler_(std::exchange(other.scheduler_, nullptr)),
+          priority_(other.priority_) {}
+    Slot& operator=(Slot&& other) noexcept;
+    ~Slot();
+
+   private:
+    friend class JobScheduler;
+
+    Slot(JobScheduler* scheduler, Priority priority)
+        : scheduler_(scheduler), priority_(priority) {}
+
+    JobScheduler* scheduler_;
+    Priority priority_;
+  };
+
+  explicit JobScheduler(Config config);
+  JobScheduler(const JobScheduler&) = delete;
+  JobScheduler(JobScheduler&&) = delete;
+  JobScheduler& operator=(const JobScheduler&) = delete;
+  JobScheduler& operator=(JobScheduler&&) = delete;
+
+  // Waits for a free slot. `owner` identifies the account the job runs for.
+  Task<Slot> Acquire(Priority priority, const void* owner,
+                     stdx::stop_token stop_token);
+
+  // Whether no job of the class runs or waits.
+  bool IsIdle(Priority priority) const;
+
+ private:
+  struct Waiter {
+    Promise<void> admitted;
+    bool done = false;
+  };
+
+  struct Class {
+    ClassConfig config;
+    int running = 0;
+    size_t queued = 0;
+    std::map<const void*, std::deque<std::shared_ptr<Waiter>>> waiting;
+    // Owner of the most recently admitted job.
+    const void* last_owner = nullptr;
+  };
+
+  Class& GetClass(Priority priority);
+  const Class& GetClass(Priority priority) const;
+  void Release(Priority priority);
+  void AdmitWaiting(Class&);
+
+  Class interactive_;
+  Class streaming_;
+  Class background_;
+  Class idle_;
+};
+
+}  // namespace coro::cloudstorage::util
+
+#endif  // CORO_CLOUDSTORAGE_UTIL_JOB_SCHEDULER_H
@@ -110,6 +110,7 @@ Generator<std::string> ListDirectoryHandler::GetDirectoryContent(
       co_yield GetItemEntry(host, item, list_url_generator_,
                             thumbnail_url_generator_, content_url_generator_);
     }
+    thumbnail_pregenerator_->OnDirectoryListed(account_, page.items);
   }
   co_yield "</table>"
       "</body>"
@@ -6,6 +6,7 @@
 #include "coro/cloudstorage/util/clock.h"
 #include "coro/cloudstorage/util/cloud_provider_account.h"
 #include "coro/cloudstorage/util/handler_utils.h"
+#include "coro/cloudstorage/util/thumbnail_pregenerator.h"
 #include "coro/http/http_parse.h"
 #include "coro/mutex.h"
 
@@ -15,6 +16,7 @@ class ListDirectoryHandler {
  public:
   ListDirectoryHandler(
       CloudProviderAccount account,
+      ThumbnailPregenerator* thumbnail_pregenerator,
       stdx::any_invocable<std::string(std::string_view item_id) const>
           list_url_generator,
       stdx::any_invocable<std::string(std::string_view item_id) const>
@@ -22,6 +24,7 @@ class ListDirectoryHandler {
       stdx::any_invocable<std::string(const AbstractCloudProvider::File&) const>
           content_url_generator)
       : account_(std::move(account)),
+        thumbnail_pregenerator_(thumbnail_pregenerator),
         list_url_generator_(std::move(list_url_generator)),
         thumbnail_url_generator_(std::move(thumbnail_url_generator)),
         content_url_generator_(std::move(content_url_generator)) {}
@@ -36,6 +39,7 @@ class ListDirectoryHandler {
       stdx::stop_token stop_token) const;
 
   CloudProviderAccount account_;
+  ThumbnailPregenerator* thumbnail_pregenerator_;
   stdx::any_invocable<std::string(std::string_view item_id) const>
       list_url_generator_;
   stdx::any_invocable<std::string(std::string_view id) const>
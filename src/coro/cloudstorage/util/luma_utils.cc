@@ -0,0 +1,162 @@
+#include "coro/cloudstorage/util/luma_utils.h"
+
+#include <cstdint>
+#include <cstdlib>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CORO_CLOUDSTORAGE_LUMA_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(CORO_CLOUDSTORAGE_LUMA_SSE2) && defined(__GNUC__)
+#define CORO_CLOUDSTORAGE_LUMA_AVX2
+#include <immintrin.h>
+#endif
+
+namespace coro::cloudstorage::util {
+
+namespace {
+
+using CountFunction = int (*)(const uint8_t* row, int width,
+                              uint8_t threshold);
+
+int CountDarkScalar(const uint8_t* row, int width, uint8_t threshold) {
+  int count = 0;
+  for (int i = 0; i < width; i++) {
+    count += row[i] < threshold;
+  }
+  return count;
+}
+
+#ifdef CORO_CLOUDSTORAGE_LUMA_SSE2
+
+// Horizontal sum of the 16 byte counters.
+int SumBytes(__m128i counters) {
+  __m128i sums = _mm_sad_epu8(counters, _mm_setzero_si128());
+  return _mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4);
+}
+
+// x < t is computed as min(x, t - 1) == x, SSE2 has no unsigned byte compare.
+int CountDarkSse2(const uint8_t* row, int width, uint8_t threshold) {
+  if (threshold == 0) {
+    return 0;
+  }
+  const __m128i max_dark = _mm_set1_epi8(static_cast<char>(threshold - 1));
+  int count = 0;
+  int i = 0;
+  while (i + 16 <= width) {
+    // Byte counters overflow after 255 steps.
+    __m128i counters = _mm_setzero_si128();
+    for (int step = 0; step < 255 && i + 16 <= width; step++, i += 16) {
+      __m128i x =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+      __m128i dark = _mm_cmpeq_epi8(_mm_min_epu8(x, max_dark), x);
+      counters = _mm_sub_epi8(counters, dark);
+    }
+    count += SumBytes(counters);
+  }
+  return count + CountDarkScalar(row + i, width - i, threshold);
+}
+
+#endif  // CORO_CLOUDSTORAGE_LUMA_SSE2
+
+#ifdef CORO_CLOUDSTORAGE_LUMA_AVX2
+
+__attribute__((target("avx2"))) int CountDarkAvx2(const uint8_t* row,
+                                                   int width,
+                                                   uint8_t threshold) {
+  if (threshold == 0) {
+    return 0;
+  }
+  const __m256i max_dark = _mm256_set1_epi8(static_cast<char>(threshold - 1));
+  int count = 0;
+  int i = 0;
+  while (i + 32 <= width) {
+    __m256i counters = _mm256_setzero_si256();
+    for (int step = 0; step < 255 && i + 32 <= width; step++, i += 32) {
+      __m256i x =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i));
+      __m256i dark = _mm256_cmpeq_epi8(_mm256_min_epu8(x, max_dark), x);
+      counters = _mm256_sub_epi8(counters, dark);
+    }
+    __m256i sums = _mm256_sad_epu8(counters, _mm256_setzero_si256());
+    count += static_cast<int>(
+        _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1) +
+        _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3));
+  }
+  return count + CountDarkSse2(row + i, width - i, threshold);
+}
+
+#endif  // CORO_CLOUDSTORAGE_LUMA_AVX2
+
+CountFunction GetCountFunction() {
+#if defined(CORO_CLOUDSTORAGE_LUMA_AVX2)
+  if (__builtin_cpu_supports("avx2")) {
+    return CountDarkAvx2;
+  }
+#endif
+#if defined(CORO_CLOUDSTORAGE_LUMA_SSE2)
+  return CountDarkSse2;
+#else
+  return CountDarkScalar;
+#endif
+}
+
+}  // namespace
+
+bool IsMostlyDark(const LumaPlane& plane, uint8_t threshold,
+                  int min_percent) {
+  static const CountFunction count_dark = GetCountFunction();
+  int64_t total = int64_t{plane.width} * plane.height;
+  if (total == 0) {
+    return false;
+  }
+  // count * 100 / total >= min_percent, with integer division.
+  int64_t max_bright = total - (total * min_percent + 99) / 100;
+  int64_t bright = 0;
+  const uint8_t* row = plane.data;
+  for (int i = 0; i < plane.height; i++) {
+    bright += plane.width - count_dark(row, plane.width, threshold);
+    if (bright > max_bright) {
+      return false;
+    }
+    row += plane.linesize;
+  }
+  return true;
+}
+
+double GetMeanLuma(const LumaPlane& plane) {
+  int64_t total = int64_t{plane.width} * plane.height;
+  if (total == 0) {
+    return 0;
+  }
+  int64_t sum = 0;
+  const uint8_t* row = plane.data;
+  for (int i = 0; i < plane.height; i++) {
+    for (int j = 0; j < plane.width; j++) {
+      sum += row[j];
+    }
+    row += plane.linesize;
+  }
+  return static_cast<double>(sum) / static_cast<double>(total);
+}
+
+double GetSharpness(const LumaPlane& plane) {
+  if (plane.width < 2 || plane.height < 2) {
+    return 0;
+  }
+  int64_t sum = 0;
+  const uint8_t* row = plane.data;
+  for (int i = 0; i + 1 < plane.height; i++) {
+    const uint8_t* next_row = row + plane.linesize;
+    for (int j = 0; j + 1 < plane.width; j++) {
+      sum += std::abs(row[j + 1] - row[j]) + std::abs(next_row[j] - row[j]);
+    }
+    row = next_row;
+  }
+  int64_t count = 2 * int64_t{plane.width - 1} * (plane.height - 1);
+  return static_cast<double>(sum) / static_cast<double>(count);
+}
+
+}  // namespace coro::cloudstorage::util
@@ -0,0 +1,30 @@
+#ifndef CORO_CLOUDSTORAGE_UTIL_LUMA_UTILS_H
+#define CORO_CLOUDSTORAGE_UTIL_LUMA_UTILS_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace coro::cloudstorage::util {
+
+// 8 bit luma plane of a decoded frame.
+struct LumaPlane {
+  const uint8_t* data;
+  ptrdiff_t linesize;
+  int width;
+  int height;
+};
+
+// Whether at least `min_percent` percent of the samples are below
+// `threshold`. Uses AVX2 or SSE2 when available and stops scanning as soon
+// as there are too many bright samples for the plane to be dark.
+bool IsMostlyDark(const LumaPlane& plane, uint8_t threshold, int min_percent);
+
+double GetMeanLuma(const LumaPlane& plane);
+
+// Mean absolute difference between each sample and its right and lower
+// neighbours. Blurry and flat planes score low.
+double GetSharpness(const LumaPlane& plane);
+
+}  // namespace coro::cloudstorage::util
+
+#endif  // CORO_CLOUDSTORAGE_UTIL_LUMA_UTILS_H
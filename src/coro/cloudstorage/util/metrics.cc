@@ -0,0 +1,140 @@
+#include "coro/cloudstorage/util/metrics.h"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include "coro/cloudstorage/util/string_utils.h"
+#include "coro/exception.h"
+
+namespace coro::cloudstorage::util {
+
+namespace {
+
+std::string EscapeLabelValue(std::string_view value) {
+  std::string result;
+  result.reserve(value.size());
+  for (char c : value) {
+    switch (c) {
+      case '\\':
+        result += "\\\\";
+        break;
+      case '"':
+        result += "\\\"";
+        break;
+      case '\n':
+        result += "\\n";
+        break;
+      default:
+        result += c;
+    }
+  }
+  return result;
+}
+
+std::string ToLabelString(const Metrics::Labels& labels) {
+  std::string result;
+  for (const auto& [key, value] : labels) {
+    if (!result.empty()) {
+      result += ',';
+    }
+    result += StrCat(key, "=\"", EscapeLabelValue(value), '"');
+  }
+  return result;
+}
+
+std::string WithBraces(std::string_view labels) {
+  return labels.empty() ? "" : StrCat('{', labels, '}');
+}
+
+}  // namespace
+
+std::string_view Metrics::ToString(Type type) {
+  switch (type) {
+    case Type::kCounter:
+      return "counter";
+    case Type::kGauge:
+      return "gauge";
+    case Type::kHistogram:
+      return "histogram";
+  }
+  throw RuntimeError("invalid metric type");
+}
+
+void Metrics::IncrementCounter(std::string_view name, const Labels& labels,
+                               double value) {
+  std::unique_lock lock(mutex_);
+  GetFamily(name, Type::kCounter).values[ToLabelString(labels)] += value;
+}
+
+void Metrics::SetGauge(std::string_view name, const Labels& labels,
+                       double value) {
+  std::unique_lock lock(mutex_);
+  GetFamily(name, Type::kGauge).values[ToLabelString(labels)] = value;
+}
+
+void Metrics::AddGauge(std::string_view name, const Labels& labels,
+                       double value) {
+  std::unique_lock lock(mutex_);
+  GetFamily(name, Type::kGauge).values[ToLabelString(labels)] += value;
+}
+
+void Metrics::Observe(std::string_view name, const Labels& labels,
+                      double value, std::span<const double> buckets) {
+  std::unique_lock lock(mutex_);
+  Histogram& histogram =
+      GetFamily(name, Type::kHistogram).histograms[ToLabelString(labels)];
+  if (histogram.bounds.empty()) {
+    histogram.bounds.assign(buckets.begin(), buckets.end());
+    histogram.counts.resize(buckets.size());
+  }
+  auto it = std::lower_bound(histogram.bounds.begin(), histogram.bounds.end(),
+                             value);
+  if (it != histogram.bounds.end()) {
+    histogram.counts[it - histogram.bounds.begin()]++;
+  }
+  histogram.sum += value;
+  histogram.count++;
+}
+
+std::string Metrics::ToPrometheusText() const {
+  std::unique_lock lock(mutex_);
+  std::stringstream stream;
+  for (const auto& [name, family] : families_) {
+    stream << "# TYPE " << name << ' ' << ToString(family.type) << '\n';
+    for (const auto& [labels, value] : family.values) {
+      stream << name << WithBraces(labels) << ' ' << fmt::format("{}", value)
+             << '\n';
+    }
+    for (const auto& [labels, histogram] : family.histograms) {
+      std::string prefix = labels.empty() ? "" : StrCat(labels, ',');
+      int64_t cumulative = 0;
+      for (size_t i = 0; i < histogram.bounds.size(); i++) {
+        cumulative += histogram.counts[i];
+        stream << name << "_bucket{" << prefix << "le=\""
+               << fmt::format("{}", histogram.bounds[i]) << "\"} "
+               << cumulative << '\n';
+      }
+      stream << name << "_bucket{" << prefix << "le=\"+Inf\"} "
+             << histogram.count << '\n';
+      stream << name << "_sum" << WithBraces(labels) << ' '
+             << fmt::format("{}", histogram.sum) << '\n';
+      stream << name << "_count" << WithBraces(labels) << ' '
+             << histogram.count << '\n';
+    }
+  }
+  return std::move(stream).str();
+}
+
+auto Metrics::GetFamily(std::string_view name, Type type) -> Family& {
+  auto it = families_.find(name);
+  if (it == families_.end()) {
+    it = families_.emplace(std::string(name), Family{.type = type}).first;
+  } else if (it->second.type != type) {
+    throw RuntimeError(StrCat("metric ", name, " registered with other type"));
+  }
+  return it->second;
+}
+
+}  // namespace coro::cloudstorage::util
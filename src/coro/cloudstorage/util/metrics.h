@@ -0,0 +1,74 @@
+#ifndef CORO_CLOUDSTORAGE_UTIL_METRICS_H
+#define CORO_CLOUDSTORAGE_UTIL_METRICS_H
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace coro::cloudstorage::util {
+
+// Registry of counters, gauges and histograms which can be rendered in the
+// Prometheus text exposition format. Every metric is identified by its name
+// and a set of labels; all methods are thread safe.
+class Metrics {
+ public:
+  using Labels = std::vector<std::pair<std::string, std::string>>;
+
+  // Upper bounds, in seconds.
+  static constexpr double kLatencyBuckets[] = {
+      0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30};
+
+  // Upper bounds, in bytes per second.
+  static constexpr double kThroughputBuckets[] = {
+      64 << 10, 256 << 10, 1 << 20, 4 << 20, 16 << 20, 64 << 20, 256 << 20};
+
+  void IncrementCounter(std::string_view name, const Labels& labels,
+                        double value = 1);
+
+  void SetGauge(std::string_view name, const Labels& labels, double value);
+
+  void AddGauge(std::string_view name, const Labels& labels, double value);
+
+  void Observe(std::string_view name, const Labels& labels, double value,
+               std::span<const double> buckets = kLatencyBuckets);
+
+  std::string ToPrometheusText() const;
+
+ private:
+  enum class Type { kCounter, kGauge, kHistogram };
+
+  struct Histogram {
+    std::vector<double> bounds;
+    std::vector<int64_t> counts;
+    double sum = 0;
+    int64_t count = 0;
+  };
+
+  struct Family {
+    Type type;
+    std::map<std::string, double> values;
+    std::map<std::string, Histogram> histograms;
+  };
+
+  static std::string_view ToString(Type type);
+
+  Family& GetFamily(std::string_view name, Type type);
+
+  mutable std::mutex mutex_;
+  std::map<std::string, Family, std::less<>> families_;
+};
+
+inline double GetElapsedSeconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+}  // namespace coro::cloudstorage::util
+
+#endif  // CORO_CLOUDSTORAGE_UTIL_METRICS_H
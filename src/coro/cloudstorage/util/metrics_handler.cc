@@ -0,0 +1,18 @@
+#include "coro/cloudstorage/util/metrics_handler.h"
+
+#include "coro/cloudstorage/util/generator_utils.h"
+
+namespace coro::cloudstorage::util {
+
+auto MetricsHandler::operator()(Request request, stdx::stop_token) const
+    -> Task<Response> {
+  std::string content = metrics->ToPrometheusText();
+  auto length = content.size();
+  co_return Response{
+      .status = 200,
+      .headers = {{"Content-Type", "text/plain; version=0.0.4"},
+                  {"Content-Length", std::to_string(length)}},
+      .body = ToGenerator(std::move(content))};
+}
+
+}  // namespace coro::cloudstorage::util
@@ -0,0 +1,21 @@
+#ifndef CORO_CLOUDSTORAGE_UTIL_METRICS_HANDLER_H
+#define CORO_CLOUDSTORAGE_UTIL_METRICS_HANDLER_H
+
+#include "coro/cloudstorage/util/metrics.h"
+#include "coro/http/http.h"
+#include "coro/stdx/stop_token.h"
+
+namespace coro::cloudstorage::util {
+
+struct MetricsHandler {
+  using Request = http::Request<>;
+  using Response = http::Response<>;
+
+  Task<Response> operator()(Request request, stdx::stop_token) const;
+
+  const Metrics* metrics;
+};
+
+}  // namespace coro::cloudstorage::util
+
+#endif  // CORO_CLOUDSTORAGE_UTIL_METRICS_HANDLER_H
@@ -0,0 +1,322 @@
+#include "coro/cloudstorage/util/mux_cache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <filesystem>
+#include <utility>
+#include <vector>
+
+#include "coro/cloudstorage/util/crypto_utils.h"
+#include "coro/cloudstorage/util/file_utils.h"
+#include "coro/cloudstorage/util/string_utils.h"
+#include "coro/exception.h"
+#include "coro/stdx/stop_callback.h"
+#include "coro/util/raii_utils.h"
+#include "coro/util/stop_token_or.h"
+
+namespace coro::cloudstorage::util {
+
+namespace {
+
+using ::coro::util::MakeUniqueStopTokenOr;
+
+constexpr std::string_view kPartialSuffix = ".part";
+
+std::string GetKey(const CloudProviderAccount& video_account,
+                   const AbstractCloudProvider::File& video_track,
+                   const CloudProviderAccount& audio_account,
+                   const AbstractCloudProvider::File& audio_track,
+                   MediaContainer container) {
+  std::string key =
+      StrCat(video_account.type(), '\n', video_account.username(), '\n',
+             video_track.id, '\n', video_track.timestamp.value_or(-1), '\n',
+             audio_account.type(), '\n', audio_account.username(), '\n',
+             audio_track.id, '\n', audio_track.timestamp.value_or(-1));
+  return StrCat(ToHex(GetSHA256(key)), '.', GetFormatName(container));
+}
+
+std::unique_ptr<std::FILE, FileDeleter> OpenFile(const std::string& path,
+                                                 const char* mode) {
+  std::unique_ptr<std::FILE, FileDeleter> file(std::fopen(path.c_str(), mode));
+  if (!file) {
+    throw RuntimeError(StrCat("can't open ", path, ": ", ErrorToString(errno)));
+  }
+  return file;
+}
+
+}  // namespace
+
+MuxCache::MuxCache(coro::util::ThreadPool* thread_pool, const Muxer* muxer,
+                   Config config)
+    : thread_pool_(thread_pool), muxer_(muxer), config_(std::move(config)) {
+  CreateDirectory(config_.directory);
+  std::vector<std::pair<std::filesystem::file_time_type, std::string>> files;
+  std::error_code ec;
+  for (const auto& e : std::filesystem::directory_iterator(
+           std::filesystem::path(config_.directory), ec)) {
+    if (!e.is_regular_file(ec)) {
+      continue;
+    }
+    std::string name = e.path().filename().string();
+    if (name.ends_with(kPartialSuffix)) {
+      std::filesystem::remove(e.path(), ec);
+      continue;
+    }
+    files.emplace_back(e.last_write_time(ec), std::move(name));
+  }
+  std::sort(files.begin(), files.end(), [](const auto& e1, const auto& e2) {
+    return e1.first > e2.first;
+  });
+  for (auto& [time, key] : files) {
+    auto size = std::filesystem::file_size(GetPath(key), ec);
+    if (ec) {
+      continue;
+    }
+    lru_.push_back(key);
+    entries_.emplace(std::move(key),
+                     Entry{.size = static_cast<int64_t>(size),
+                           .lru_position = std::prev(lru_.end())});
+    size_ += static_cast<int64_t>(size);
+  }
+  Evict();
+}
+
+MuxCache::~MuxCache() { stop_source_.request_stop(); }
+
+Task<MuxedFile> MuxCache::Get(CloudProviderAccount video_account,
+                              AbstractCloudProvider::File video_track,
+                              CloudProviderAccount audio_account,
+                              AbstractCloudProvider::File audio_track,
+                              MediaContainer container,
+                              std::optional<http::Range> range,
+                              stdx::stop_token stop_token) {
+  std::string key = GetKey(video_account, video_track, audio_account,
+                           audio_track, container);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    it = entries_.emplace(key, Entry{}).first;
+    it->second.job.emplace(MuxJob{.d = this,
+                                  .key = key,
+                                  .video_account = video_account,
+                                  .video_track = video_track,
+                                  .audio_account = audio_account,
+                                  .audio_track = audio_track,
+                                  .container = container});
+  }
+  if (it->second.job && range && range->end && range->start <= *range->end) {
+    StartJob(key);
+    while (true) {
+      it = entries_.find(key);
+      if (it == entries_.end() || !it->second.job) {
+        break;
+      }
+      const MuxedFileProgress& progress = it->second.progress;
+      if (range->start >= progress.final_begin &&
+          *range->end < progress.final_end) {
+        co_return MuxedFile{.thread_pool = thread_pool_,
+                            .file = it->second.file.lock(),
+                            .size = std::nullopt};
+      }
+      co_await WaitForProgress(it->second, stop_token);
+    }
+    if (it == entries_.end()) {
+      // Evicted as soon as it was muxed, mux it again.
+      co_return co_await Get(std::move(video_account), std::move(video_track),
+                             std::move(audio_account), std::move(audio_track),
+                             container, range, std::move(stop_token));
+    }
+  }
+  if (it->second.job) {
+    co_return co_await it->second.job->Get(std::move(stop_token));
+  }
+  lru_.splice(lru_.begin(), lru_, it->second.lru_position);
+  if (auto file = it->second.file.lock()) {
+    co_return MuxedFile{
+        .thread_pool = thread_pool_, .file = file, .size = it->second.size};
+  }
+  co_return co_await OpenMuxed(std::move(key));
+}
+
+Task<MuxedFile> MuxCache::MuxJob::operator()() const {
+  // The job is destroyed once it's done, keep what's needed afterwards.
+  MuxCache* cache = d;
+  std::string path = cache->GetPath(key);
+  std::string partial_path = StrCat(path, kPartialSuffix);
+  std::string entry_key = key;
+  try {
+    auto stop_token_or = MakeUniqueStopTokenOr(cache->stop_source_.get_token(),
+                                               video_account.stop_token(),
+                                               audio_account.stop_token());
+    std::shared_ptr<SpillFile> output = cache->CreateFile(
+        entry_key,
+        co_await cache->thread_pool_->Do(OpenFile, partial_path, "wb+"));
+    if (auto it = cache->entries_.find(entry_key);
+        it != cache->entries_.end()) {
+      it->second.file = output;
+    }
+    MuxedFile file = co_await cache->muxer_->MuxToFile(
+        video_account.provider().get(), video_track,
+        audio_account.provider().get(), audio_track, container,
+        std::move(output),
+        [cache, entry_key](const MuxedFileProgress& progress) {
+          cache->OnWritten(entry_key, progress);
+        },
+        stop_token_or->GetToken());
+    // It's renamed from the partial path once all readers release the file.
+    cache->OnMuxed(entry_key, *file.size);
+    co_return file;
+  } catch (...) {
+    // The output was released when the try block was left.
+    std::remove(partial_path.c_str());
+    if (auto it = cache->entries_.find(entry_key);
+        it != cache->entries_.end()) {
+      auto waiters = std::move(it->second.waiters);
+      cache->entries_.erase(it);
+      for (const auto& waiter : waiters) {
+        if (!waiter->done) {
+          waiter->done = true;
+          waiter->progressed.SetException(std::current_exception());
+        }
+      }
+    }
+    throw;
+  }
+}
+
+void MuxCache::StartJob(std::string key) {
+  RunTask([d = this, key = std::move(key)]() -> Task<> {
+    auto it = d->entries_.find(key);
+    if (it == d->entries_.end() || !it->second.job) {
+      co_return;
+    }
+    try {
+      co_await it->second.job->Get(stdx::stop_token());
+    } catch (...) {
+      // Reported to the readers which wait for the output.
+    }
+  });
+}
+
+Task<> MuxCache::WaitForProgress(Entry& entry, stdx::stop_token stop_token) {
+  auto waiter = std::make_shared<Waiter>();
+  entry.waiters.push_back(waiter);
+  stdx::stop_callback stop_callback(stop_token, [&] {
+    if (!waiter->done) {
+      waiter->done = true;
+      waiter->progressed.SetException(
+          std::make_exception_ptr(InterruptedException()));
+    }
+  });
+  co_await waiter->progressed;
+}
+
+Task<MuxedFile> MuxCache::OpenMuxed(std::string key) {
+  auto it = entries_.find(key);
+  // Not evicted while it's being opened.
+  it->second.opening++;
+  auto guard = coro::util::AtScopeExit([&] { it->second.opening--; });
+  auto file = co_await thread_pool_->Do(OpenFile, GetPath(key), "rb");
+  // Someone else could've opened it in the meantime, share their file so that
+  // eviction sees that it's open.
+  std::shared_ptr<SpillFile> shared = it->second.file.lock();
+  if (!shared) {
+    shared = CreateFile(key, std::move(file));
+    it->second.file = shared;
+  }
+  co_return MuxedFile{
+      .thread_pool = thread_pool_, .file = shared, .size = it->second.size};
+}
+
+std::shared_ptr<SpillFile> MuxCache::CreateFile(
+    std::string key, std::unique_ptr<std::FILE, FileDeleter> file) {
+  return std::shared_ptr<SpillFile>(
+      new SpillFile(std::move(file)),
+      [d = this, key = std::move(key)](SpillFile* file) {
+        delete file;
+        d->OnReleased(key);
+      });
+}
+
+std::string MuxCache::GetPath(std::string_view key) const {
+  return StrCat(config_.directory, kPathSeparator, key);
+}
+
+void MuxCache::OnWritten(const std::string& key,
+                         const MuxedFileProgress& progress) {
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    return;
+  }
+  it->second.progress = progress;
+  for (const auto& waiter : std::exchange(it->second.waiters, {})) {
+    if (!waiter->done) {
+      waiter->done = true;
+      waiter->progressed.SetValue();
+    }
+  }
+}
+
+void MuxCache::OnMuxed(const std::string& key, int64_t size) {
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    return;
+  }
+  lru_.push_front(key);
+  it->second.size = size;
+  it->second.lru_position = lru_.begin();
+  it->second.is_partial = true;
+  size_ += size;
+  Evict();
+  auto waiters = std::move(it->second.waiters);
+  // Last, the waiters may resume right away and find the output muxed.
+  it->second.job = std::nullopt;
+  for (const auto& waiter : waiters) {
+    if (!waiter->done) {
+      waiter->done = true;
+      waiter->progressed.SetValue();
+    }
+  }
+}
+
+void MuxCache::OnReleased(const std::string& key) {
+  auto it = entries_.find(key);
+  if (it != entries_.end() && it->second.is_partial &&
+      it->second.file.expired()) {
+    it->second.is_partial = false;
+    std::string path = GetPath(key);
+    std::string partial_path = StrCat(path, kPartialSuffix);
+    if (std::rename(partial_path.c_str(), path.c_str()) != 0) {
+      std::remove(partial_path.c_str());
+      size_ -= it->second.size;
+      lru_.erase(it->second.lru_position);
+      entries_.erase(it);
+    }
+  }
+  Evict();
+}
+
+void MuxCache::Evict() {
+  // The most recently used output is kept even if it exceeds the budget on
+  // its own, it is about to be served. Outputs which are open or can't be
+  // removed are skipped, they still count towards the budget.
+  if (lru_.empty()) {
+    return;
+  }
+  auto it = std::prev(lru_.end());
+  while (size_ > config_.max_size && it != lru_.begin()) {
+    auto current = it--;
+    auto entry = entries_.find(*current);
+    if (!entry->second.file.expired() || entry->second.opening > 0) {
+      continue;
+    }
+    if (std::remove(GetPath(*current).c_str()) != 0 && errno != ENOENT) {
+      continue;
+    }
+    size_ -= entry->second.size;
+    entries_.erase(entry);
+    lru_.erase(current);
+  }
+}
+
+}  // namespace coro::cloudstorage::util
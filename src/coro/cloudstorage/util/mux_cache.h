@@ -0,0 +1,121 @@
+#ifndef CORO_CLOUDSTORAGE_UTIL_MUX_CACHE_H
+#define CORO_CLOUDSTORAGE_UTIL_MUX_CACHE_H
+
+#include <exception>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "coro/cloudstorage/util/abstract_cloud_provider.h"
+#include "coro/cloudstorage/util/cloud_provider_account.h"
+#include "coro/cloudstorage/util/muxer.h"
+#include "coro/http/http.h"
+#include "coro/promise.h"
+#include "coro/shared_promise.h"
+#include "coro/stdx/stop_source.h"
+#include "coro/stdx/stop_token.h"
+#include "coro/task.h"
+#include "coro/util/thread_pool.h"
+
+namespace coro::cloudstorage::util {
+
+// Keeps muxed outputs on disk, keyed by the input tracks and their
+// modification times. Concurrent requests for the same output share a single
+// mux job. Least recently used outputs are removed once the total size
+// exceeds the budget; outputs left by previous runs are picked up on startup.
+// Outputs are only removed or renamed once the files returned for them are
+// released: open files can't be removed on every platform. Must be used on the
+// event loop thread, which is also where the returned files have to be
+// released.
+class MuxCache {
+ public:
+  struct Config {
+    std::string directory;
+    int64_t max_size;
+  };
+
+  MuxCache(coro::util::ThreadPool* thread_pool, const Muxer* muxer,
+           Config config);
+  MuxCache(const MuxCache&) = delete;
+  MuxCache(MuxCache&&) = delete;
+  MuxCache& operator=(const MuxCache&) = delete;
+  MuxCache& operator=(MuxCache&&) = delete;
+  ~MuxCache();
+
+  // Returns the output once `range` of it is written and won't change
+  // anymore, which may be long before the whole output is muxed; the size of
+  // the returned file is unset then. Without a range, or with an open-ended
+  // one, waits for the whole output.
+  Task<MuxedFile> Get(CloudProviderAccount video_account,
+                      AbstractCloudProvider::File video_track,
+                      CloudProviderAccount audio_account,
+                      AbstractCloudProvider::File audio_track,
+                      MediaContainer container,
+                      std::optional<http::Range> range,
+                      stdx::stop_token stop_token);
+
+ private:
+  struct MuxJob {
+    Task<MuxedFile> operator()() const;
+
+    MuxCache* d;
+    std::string key;
+    CloudProviderAccount video_account;
+    AbstractCloudProvider::File video_track;
+    CloudProviderAccount audio_account;
+    AbstractCloudProvider::File audio_track;
+    MediaContainer container;
+  };
+
+  struct Waiter {
+    Promise<void> progressed;
+    bool done = false;
+  };
+
+  struct Entry {
+    // Set while the output is being muxed.
+    std::optional<SharedPromise<MuxJob>> job;
+    // Final part of the output while it's being muxed.
+    MuxedFileProgress progress{};
+    // Notified whenever the progress advances or the job is done.
+    std::vector<std::shared_ptr<Waiter>> waiters;
+    // The output while it's being muxed or read.
+    std::weak_ptr<SpillFile> file;
+    // Set once the output is muxed, until it's renamed from the partial path.
+    bool is_partial = false;
+    // Number of Get calls opening the output.
+    int opening = 0;
+    int64_t size = 0;
+    std::list<std::string>::iterator lru_position;
+  };
+
+  // Makes sure the job of `key` runs for readers which only wait for a part of
+  // its output; the job starts once its result is first awaited.
+  void StartJob(std::string key);
+  Task<> WaitForProgress(Entry& entry, stdx::stop_token stop_token);
+  Task<MuxedFile> OpenMuxed(std::string key);
+  std::shared_ptr<SpillFile> CreateFile(
+      std::string key, std::unique_ptr<std::FILE, FileDeleter> file);
+  std::string GetPath(std::string_view key) const;
+  void OnWritten(const std::string& key, const MuxedFileProgress& progress);
+  void OnMuxed(const std::string& key, int64_t size);
+  void OnReleased(const std::string& key);
+  void Evict();
+
+  coro::util::ThreadPool* thread_pool_;
+  const Muxer* muxer_;
+  Config config_;
+  std::map<std::string, Entry, std::less<>> entries_;
+  // Keys of finished outputs, most recently used first.
+  std::list<std::string> lru_;
+  int64_t size_ = 0;
+  stdx::stop_source stop_source_;
+};
+
+}  // namespace coro::cloudstorage::util
+
+#endif  // CORO_CLOUDSTORAGE_UTIL_MUX_CACHE_H
@@ -1,10 +1,22 @@
 #include "coro/cloudstorage/util/mux_handler.h"
 
+#include <fmt/format.h>
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <memory>
+#include <optional>
+#include <span>
 #include <string>
+#include <utility>
 
 #include "coro/cloudstorage/cloud_exception.h"
 #include "coro/cloudstorage/util/cloud_provider_utils.h"
 #include "coro/cloudstorage/util/generator_utils.h"
+#include "coro/cloudstorage/util/handler_utils.h"
 #include "coro/cloudstorage/util/string_utils.h"
 #include "coro/http/http_parse.h"
 #include "coro/stdx/stop_source.h"
@@ -32,6 +44,166 @@ CloudProviderAccount FindAccount(std::span<const CloudProviderAccount> accounts,
   throw CloudException(CloudException::Type::kNotFound);
 }
 
+// Exposes a finished mux as a cloud provider so that GetFileContentResponse
+// can serve ranges from it.
+struct MuxedFileProvider {
+  Generator<std::string> GetFileContent(AbstractCloudProvider::File,
+                                        http::Range range,
+                                        stdx::stop_token) const {
+    return file.GetContent(range);
+  }
+
+  MuxedFile file;
+};
+
+// The range of a request which can be served before the whole output is
+// muxed: a single one, with both ends given.
+std::optional<http::Range> GetBoundedRange(
+    std::span<const std::pair<std::string, std::string>> headers) {
+  auto header = http::GetHeader(headers, "Range");
+  if (!header || http::GetHeader(headers, "If-Range")) {
+    return std::nullopt;
+  }
+  auto ranges = ParseRanges(*header, /*size=*/std::nullopt);
+  if (ranges.size() != 1 || !ranges.front().end ||
+      *ranges.front().end < ranges.front().start) {
+    return std::nullopt;
+  }
+  return ranges.front();
+}
+
+std::optional<int64_t> GetMuxedTimestamp(
+    const AbstractCloudProvider::File& video_file,
+    const AbstractCloudProvider::File& audio_file) {
+  if (!video_file.timestamp || !audio_file.timestamp) {
+    return std::nullopt;
+  }
+  return std::max(*video_file.timestamp, *audio_file.timestamp);
+}
+
+double GetSeconds(const SegmentIndex& index, int64_t duration) {
+  return static_cast<double>(duration) * index.time_base_num /
+         index.time_base_den;
+}
+
+std::string EscapeXml(std::string_view text) {
+  std::string result;
+  for (char c : text) {
+    switch (c) {
+      case '&':
+        result += "&amp;";
+        break;
+      case '<':
+        result += "&lt;";
+        break;
+      case '>':
+        result += "&gt;";
+        break;
+      case '"':
+        result += "&quot;";
+        break;
+      default:
+        result += c;
+    }
+  }
+  return result;
+}
+
+// `segment_url` followed by "init" or the segment number addresses a segment.
+std::string GetHlsPlaylist(const SegmentIndex& index,
+                           std::string_view segment_url) {
+  double target_duration = 0;
+  for (const auto& segment : index.segments) {
+    target_duration = std::max(target_duration,
+                               GetSeconds(index, segment.end - segment.start));
+  }
+  std::string playlist = fmt::format(
+      "#EXTM3U\n"
+      "#EXT-X-VERSION:7\n"
+      "#EXT-X-TARGETDURATION:{}\n"
+      "#EXT-X-PLAYLIST-TYPE:VOD\n"
+      "#EXT-X-INDEPENDENT-SEGMENTS\n"
+      "#EXT-X-MAP:URI=\"{}init\"\n",
+      static_cast<int64_t>(std::ceil(target_duration)), segment_url);
+  for (size_t i = 0; i < index.segments.size(); i++) {
+    const auto& segment = index.segments[i];
+    playlist += fmt::format("#EXTINF:{:.3f},\n{}{}\n",
+                            GetSeconds(index, segment.end - segment.start),
+                            segment_url, i);
+  }
+  playlist += "#EXT-X-ENDLIST\n";
+  return playlist;
+}
+
+std::string GetDashManifest(const SegmentIndex& index,
+                            std::string_view segment_url) {
+  std::string url = EscapeXml(segment_url);
+  double max_duration = 0;
+  for (const auto& segment : index.segments) {
+    max_duration = std::max(max_duration,
+                            GetSeconds(index, segment.end - segment.start));
+  }
+  std::string manifest = fmt::format(
+      R"(<?xml version="1.0" encoding="UTF-8"?>
+<MPD xmlns="urn:mpeg:dash:schema:mpd:2011" type="static" profiles="urn:mpeg:dash:profile:isoff-live:2011" minBufferTime="PT{:.3f}S" mediaPresentationDuration="PT{:.3f}S">
+  <Period start="PT0S">
+    <AdaptationSet mimeType="video/mp4" segmentAlignment="true" startWithSAP="1">
+      <Representation id="0" codecs="{}" bandwidth="{}" width="{}" height="{}">
+        <SegmentTemplate timescale="{}" presentationTimeOffset="{}" initialization="{}init" media="{}$Number$" startNumber="0">
+          <SegmentTimeline>
+)",
+      max_duration,
+      GetSeconds(index,
+                 index.segments.back().end - index.segments.front().start),
+      EscapeXml(index.codecs), index.bandwidth, index.width, index.height,
+      index.time_base_den, index.segments.front().start * index.time_base_num,
+      url, url);
+  for (const auto& segment : index.segments) {
+    manifest += fmt::format(
+        R"(            <S t="{}" d="{}"/>
+)",
+        segment.start * index.time_base_num,
+        (segment.end - segment.start) * index.time_base_num);
+  }
+  manifest += R"(          </SegmentTimeline>
+        </SegmentTemplate>
+      </Representation>
+    </AdaptationSet>
+  </Period>
+</MPD>
+)";
+  return manifest;
+}
+
+nlohmann::json ToJson(const MuxerProgress& progress) {
+  nlohmann::json json;
+  json["id"] = progress.id;
+  json["video_name"] = progress.video_name;
+  json["audio_name"] = progress.audio_name;
+  json["container"] = GetFormatName(progress.container);
+  json["transcode"] = progress.transcode;
+  json["video_bytes_read"] = progress.video_bytes_read;
+  json["audio_bytes_read"] = progress.audio_bytes_read;
+  json["packets_written"] = progress.packets_written;
+  json["bytes_written"] = progress.bytes_written;
+  json["position"] = progress.position;
+  json["duration"] = progress.duration;
+  json["elapsed"] = progress.elapsed;
+  json["realtime_factor"] = progress.realtime_factor;
+  return json;
+}
+
+// Unlike std::stoull, rejects signs, whitespace and out of range values.
+std::optional<size_t> ParseSegmentNumber(std::string_view text) {
+  size_t result;
+  auto [ptr, ec] =
+      std::from_chars(text.data(), text.data() + text.size(), result);
+  if (text.empty() || ec != std::errc() || ptr != text.data() + text.size()) {
+    return std::nullopt;
+  }
+  return result;
+}
+
 }  // namespace
 
 Task<http::Response<>> MuxHandler::operator()(
@@ -49,6 +221,16 @@ Task<http::Response<>> MuxHandler::operator()(
         .headers = {
             {"Location", StrCat(kWebmSample, '&', uri.query.value_or(""))}}};
   }
+  if (uri.path == "/mux/jobs") {
+    nlohmann::json json = nlohmann::json::array();
+    for (const MuxerProgress& progress : muxer_->GetProgress()) {
+      json.push_back(ToJson(progress));
+    }
+    co_return http::Response<>{
+        .status = 200,
+        .headers = {{"Content-Type", "application/json"}},
+        .body = http::CreateBody(json.dump())};
+  }
   if (!uri.query) {
     co_return http::Response<>{.status = 400};
   }
@@ -61,13 +243,40 @@ Task<http::Response<>> MuxHandler::operator()(
   auto audio_id = query.find("audio_id");
   auto format = query.find("format");
   auto seekable = query.find("seekable");
-  if (video_account_type == query.end() || video_account_name == query.end() ||
-      video_id == query.end() || audio_account_type == query.end() ||
-      audio_account_name == query.end() || audio_id == query.end() ||
-      format == query.end()) {
+  auto transcode = query.find("transcode");
+  bool has_video = video_account_type != query.end() &&
+                   video_account_name != query.end() &&
+                   video_id != query.end();
+  bool has_audio = audio_account_type != query.end() &&
+                   audio_account_name != query.end() &&
+                   audio_id != query.end();
+  if ((!has_video && !has_audio) || format == query.end()) {
+    co_return http::Response<>{.status = 400};
+  }
+  bool is_seekable = seekable != query.end() && seekable->second == "true";
+  bool is_transcoded =
+      transcode != query.end() && transcode->second == "true";
+  // Transcoding is only wired into the streamed output.
+  if (is_transcoded && (is_seekable || format->second == "hls" ||
+                        format->second == "dash")) {
     co_return http::Response<>{.status = 400};
   }
-  if (format->second != "webm" && format->second != "mp4") {
+  if (!has_video || !has_audio) {
+    if (is_seekable) {
+      co_return http::Response<>{.status = 400};
+    }
+    auto [account_type, account_name, id] =
+        has_video ? std::tie(video_account_type->second,
+                             video_account_name->second, video_id->second)
+                  : std::tie(audio_account_type->second,
+                             audio_account_name->second, audio_id->second);
+    co_return co_await GetSingleTrackResponse(
+        has_video ? TrackType::kVideo : TrackType::kAudio,
+        {http::DecodeUri(account_type), http::DecodeUri(account_name)}, id,
+        format->second, is_transcoded, std::move(stop_token));
+  }
+  if (format->second != "webm" && format->second != "mp4" &&
+      format->second != "hls" && format->second != "dash") {
     co_return http::Response<>{.status = 400};
   }
 
@@ -91,20 +300,97 @@ Task<http::Response<>> MuxHandler::operator()(
   auto video_file = std::get<AbstractCloudProvider::File>(video_item);
   auto audio_file = std::get<AbstractCloudProvider::File>(audio_item);
 
-  bool is_seekable = seekable != query.end() && seekable->second == "true";
+  if (format->second == "hls" || format->second == "dash") {
+    auto segment = query.find("segment");
+    if (segment == query.end()) {
+      auto index = co_await segment_cache_->GetIndex(
+          video_account, video_file, audio_account, audio_file,
+          stop_token_or->GetToken());
+      // Relative to the playlist, only the query changes.
+      std::string segment_url = StrCat('?', *uri.query, "&segment=");
+      bool is_hls = format->second == "hls";
+      co_return http::Response<>{
+          .status = 200,
+          .headers = {{"Content-Type", is_hls ? "application/vnd.apple.mpegurl"
+                                              : "application/dash+xml"}},
+          .body = http::CreateBody(is_hls
+                                       ? GetHlsPlaylist(*index, segment_url)
+                                       : GetDashManifest(*index, segment_url))};
+    }
+    std::shared_ptr<const std::string> content;
+    if (segment->second == "init") {
+      auto index = co_await segment_cache_->GetIndex(
+          video_account, video_file, audio_account, audio_file,
+          stop_token_or->GetToken());
+      content = std::shared_ptr<const std::string>(index, &index->init_segment);
+    } else if (auto number = ParseSegmentNumber(segment->second)) {
+      content = co_await segment_cache_->GetSegment(
+          video_account, video_file, audio_account, audio_file, *number,
+          stop_token_or->GetToken());
+    } else {
+      co_return http::Response<>{.status = 400};
+    }
+    co_return http::Response<>{
+        .status = 200,
+        .headers = {{"Content-Type", "video/mp4"},
+                    {"Content-Length", std::to_string(content->size())}},
+        .body = ToGenerator(std::move(content))};
+  }
+
+  MediaContainer container =
+      format->second == "mp4" ? MediaContainer::kMp4 : MediaContainer::kWebm;
+  if (is_seekable) {
+    std::optional<http::Range> range = GetBoundedRange(request.headers);
+    MuxedFile file =
+        co_await mux_cache_->Get(video_account, video_file, audio_account,
+                                 audio_file, container, range,
+                                 stop_token_or->GetToken());
+    if (!file.size) {
+      // Still being muxed, the total size isn't known yet.
+      Generator<std::string> content = file.GetContent(*range);
+      co_return http::Response<>{
+          .status = 206,
+          .headers = {{"Content-Type", "video/" + format->second},
+                      {"Accept-Ranges", "bytes"},
+                      {"Content-Range", StrCat("bytes ", range->start, '-',
+                                               *range->end, "/*")},
+                      {"Content-Length",
+                       std::to_string(*range->end - range->start + 1)}},
+          .body = Forward(std::move(content), std::move(file), video_account,
+                          audio_account, std::move(stop_token_or))};
+    }
+    auto provider = std::make_shared<MuxedFileProvider>(
+        MuxedFileProvider{.file = std::move(file)});
+    AbstractCloudProvider::File muxed_file{
+        .id = StrCat(video_file.id, ':', audio_file.id, ':', format->second),
+        .name = video_file.name,
+        .size = provider->file.size,
+        .timestamp = GetMuxedTimestamp(video_file, audio_file),
+        .mime_type = "application/octet-stream"};
+    auto response = co_await GetFileContentResponse(
+        provider.get(), std::move(muxed_file), std::move(request.headers),
+        stop_token_or->GetToken());
+    response.body =
+        Forward(std::move(response.body), std::move(provider), video_account,
+                audio_account, std::move(stop_token_or));
+    co_return response;
+  }
+  MuxerOptions options{.container = container, .buffered = false};
+  if (is_transcoded) {
+    options.transcode = TranscodeOptions{};
+  }
+  // Before the headers, so that a full queue is reported as 503.
+  options.slot = co_await muxer_->AcquireSlot(
+      video_account.provider().get(), options, stop_token_or->GetToken());
   Generator<std::string> content =
       (*muxer_)(video_account.provider().get(), video_file,
-                audio_account.provider().get(), audio_file,
-                {.container = format->second == "mp4" ? MediaContainer::kMp4
-                                                      : MediaContainer::kWebm,
-                 .buffered = is_seekable},
+                audio_account.provider().get(), audio_file, std::move(options),
                 stop_token_or->GetToken());
   co_return http::Response<>{
       .status = 200,
       .headers =
           {
-              {"Content-Type", is_seekable ? "application/octet-stream"
-                                           : "video/" + format->second},
+              {"Content-Type", "video/" + format->second},
               {"Content-Disposition",
                "inline; filename=\"" + video_file.name + "\""},
           },
@@ -112,4 +398,45 @@ Task<http::Response<>> MuxHandler::operator()(
                       std::move(stop_token_or))};
 }
 
+Task<http::Response<>> MuxHandler::GetSingleTrackResponse(
+    TrackType type, CloudProviderAccount::Id account_id, std::string id,
+    std::string format, bool transcode, stdx::stop_token stop_token) const {
+  std::optional<MediaContainer> container;
+  if (format == "mp4") {
+    container = MediaContainer::kMp4;
+  } else if (format == "webm") {
+    container = MediaContainer::kWebm;
+  } else if (format == "ogg") {
+    container = MediaContainer::kOgg;
+  } else {
+    co_return http::Response<>{.status = 400};
+  }
+  auto account = FindAccount(accounts_, account_id);
+  auto stop_token_or =
+      MakeUniqueStopTokenOr(account.stop_token(), std::move(stop_token));
+  auto file = std::get<AbstractCloudProvider::File>(co_await GetItemById(
+      account.provider().get(), std::move(id), stop_token_or->GetToken()));
+  MuxerOptions options{.container = *container, .buffered = false};
+  if (transcode) {
+    options.transcode = TranscodeOptions{};
+  }
+  options.slot = co_await muxer_->AcquireSlot(
+      account.provider().get(), options, stop_token_or->GetToken());
+  Generator<std::string> content =
+      (*muxer_)(account.provider().get(), file, type, std::move(options),
+                stop_token_or->GetToken());
+  co_return http::Response<>{
+      .status = 200,
+      .headers =
+          {
+              {"Content-Type",
+               StrCat(type == TrackType::kVideo ? "video/" : "audio/",
+                      format)},
+              {"Content-Disposition",
+               "inline; filename=\"" + file.name + "\""},
+          },
+      .body = Forward(std::move(content), std::move(account),
+                      std::move(stop_token_or))};
+}
+
 }  // namespace coro::cloudstorage::util
@@ -1,23 +1,49 @@
 #ifndef CORO_CLOUDSTORAGE_MUX_HANDLER_H
 #define CORO_CLOUDSTORAGE_MUX_HANDLER_H
 
+#include <string>
+
 #include "coro/cloudstorage/util/cloud_provider_account.h"
+#include "coro/cloudstorage/util/mux_cache.h"
 #include "coro/cloudstorage/util/muxer.h"
+#include "coro/cloudstorage/util/segment_cache.h"
 #include "coro/http/http.h"
 #include "coro/stdx/stop_token.h"
 
 namespace coro::cloudstorage::util {
 
+// Serves /mux, which combines a video and an audio track (or rewraps a
+// single one) into the container named by `format`:
+//   - "mp4" / "webm" stream the output as it is muxed; it can't be seeked.
+//   - With "seekable=true" the output is muxed to a file in MuxCache and
+//     served with range support. While the remux runs, a bounded range is
+//     served as soon as that part of the file is written for good, with the
+//     total size left out of Content-Range; other requests wait for the whole
+//     remux. Later requests are served from the cache.
+//   - "hls" / "dash" return a playlist whose segments are muxed on demand.
+// "transcode=true" re-encodes the tracks; it's only accepted for the streamed
+// "mp4" / "webm" output.
 class MuxHandler {
  public:
-  MuxHandler(const Muxer* muxer, std::span<const CloudProviderAccount> accounts)
-      : muxer_(muxer), accounts_(accounts) {}
+  MuxHandler(const Muxer* muxer, MuxCache* mux_cache,
+             SegmentCache* segment_cache,
+             std::span<const CloudProviderAccount> accounts)
+      : muxer_(muxer),
+        mux_cache_(mux_cache),
+        segment_cache_(segment_cache),
+        accounts_(accounts) {}
 
   Task<http::Response<>> operator()(http::Request<> request,
                                     stdx::stop_token stop_token) const;
 
  private:
+  Task<http::Response<>> GetSingleTrackResponse(
+      TrackType type, CloudProviderAccount::Id account_id, std::string id,
+      std::string format, bool transcode, stdx::stop_token stop_token) const;
+
   const Muxer* muxer_;
+  MuxCache* mux_cache_;
+  SegmentCache* segment_cache_;
   std::span<const CloudProviderAccount> accounts_;
 };
 
@@ -1,11 +1,28 @@
 #include "coro/cloudstorage/util/muxer.h"
 
-#include <iostream>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 #include "coro/cloudstorage/util/avio_context.h"
 #include "coro/cloudstorage/util/ffmpeg_utils.h"
 #include "coro/cloudstorage/util/file_utils.h"
+#include "coro/cloudstorage/util/metrics.h"
+#include "coro/cloudstorage/util/string_utils.h"
+#include "coro/cloudstorage/util/transcoder.h"
 #include "coro/generator.h"
+#include "coro/stdx/stop_source.h"
 #include "coro/util/event_loop.h"
 #include "coro/util/raii_utils.h"
 #include "coro/util/thread_pool.h"
@@ -15,22 +32,56 @@ namespace coro::cloudstorage::util {
 
 namespace {
 
-auto CreateMuxerIOContext(std::FILE* file) {
-  const int kBufferSize = 4 * 1024;
+struct SpillFileSink {
+  std::shared_ptr<SpillFile> file;
+  int64_t position = 0;
+  int64_t size = 0;
+};
+
+int64_t SeekSpillFileSink(void* opaque, int64_t offset, int whence) {
+  auto* sink = reinterpret_cast<SpillFileSink*>(opaque);
+  switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+      return sink->size;
+    case SEEK_SET:
+      sink->position = offset;
+      break;
+    case SEEK_CUR:
+      sink->position += offset;
+      break;
+    case SEEK_END:
+      sink->position = sink->size + offset;
+      break;
+    default:
+      return AVERROR(EINVAL);
+  }
+  return sink->position;
+}
+
+// Without `seekable`, the muxer can't go back to rewrite what it has already
+// written.
+auto CreateMuxerIOContext(SpillFileSink* sink, bool seekable) {
+  const int kBufferSize = static_cast<int>(SpillFile::kBufferSize);
   auto* buffer = static_cast<uint8_t*>(av_malloc(kBufferSize));
   auto* io_context = avio_alloc_context(
-      buffer, kBufferSize, /*write_flag=*/1, file,
+      buffer, kBufferSize, /*write_flag=*/1, sink,
       /*read_packet=*/nullptr,
       /*write_packet=*/
       [](void* opaque, uint8_t* buf, int buf_size) -> int {
-        return static_cast<int>(fwrite(buf, 1, static_cast<size_t>(buf_size),
-                                       reinterpret_cast<std::FILE*>(opaque)));
+        auto* sink = reinterpret_cast<SpillFileSink*>(opaque);
+        try {
+          sink->file->Write(
+              sink->position,
+              std::string_view(reinterpret_cast<const char*>(buf),
+                               static_cast<size_t>(buf_size)));
+        } catch (const std::exception&) {
+          return AVERROR(EIO);
+        }
+        sink->position += buf_size;
+        sink->size = std::max(sink->size, sink->position);
+        return buf_size;
       },
-      [](void* opaque, int64_t offset, int whence) -> int64_t {
-        auto* file = reinterpret_cast<std::FILE*>(opaque);
-        whence &= ~AVSEEK_FORCE;
-        return Fseek(file, offset, whence);
-      });
+      seekable ? SeekSpillFileSink : nullptr);
   if (!io_context) {
     throw RuntimeError("avio_alloc_context");
   }
@@ -56,146 +107,494 @@ auto CreateMuxerIOContext(std::string* data) {
   return io_context;
 }
 
+struct AVIOWriteContextDeleter {
+  void operator()(AVIOContext* context) {
+    av_free(context->buffer);
+    avio_context_free(&context);
+  }
+};
+
+struct AVFormatWriteContextDeleter {
+  void operator()(AVFormatContext* context) { avformat_free_context(context); }
+};
+
+using Packet = std::unique_ptr<AVPacket, AVPacketDeleter>;
+using Frame = std::unique_ptr<AVFrame, AVFrameDeleter>;
+
+// Bounded queue between two stages of the pipeline, e.g. the demuxer of an
+// input and the interleaver. Only used on the event loop thread.
+template <typename T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(size_t capacity) : capacity_(capacity) {}
+
+  // Waits while the queue is full. The item is dropped if the queue was
+  // closed by the consumer.
+  Task<> Push(T item) {
+    while (items_.size() >= capacity_ && !closed_) {
+      co_await Wait(not_full_);
+    }
+    if (!closed_) {
+      items_.push_back(std::move(item));
+      Notify(not_empty_);
+    }
+  }
+
+  // Returns nullptr once the producer finished and the queue is drained.
+  Task<T> Pop() {
+    while (items_.empty() && !finished_) {
+      co_await Wait(not_empty_);
+    }
+    if (items_.empty()) {
+      if (exception_) {
+        std::rethrow_exception(exception_);
+      }
+      co_return nullptr;
+    }
+    T item = std::move(items_.front());
+    items_.pop_front();
+    Notify(not_full_);
+    co_return item;
+  }
+
+  void Finish(std::exception_ptr exception) {
+    finished_ = true;
+    exception_ = std::move(exception);
+    Notify(not_empty_);
+  }
+
+  void Close() {
+    closed_ = true;
+    Notify(not_full_);
+  }
+
+  bool closed() const { return closed_; }
+
+ private:
+  static Task<> Wait(std::shared_ptr<Promise<void>>& waiter) {
+    auto promise = std::make_shared<Promise<void>>();
+    waiter = promise;
+    co_await *promise;
+  }
+
+  static void Notify(std::shared_ptr<Promise<void>>& waiter) {
+    if (auto promise = std::exchange(waiter, nullptr)) {
+      promise->SetValue();
+    }
+  }
+
+  size_t capacity_;
+  std::deque<T> items_;
+  std::shared_ptr<Promise<void>> not_empty_;
+  std::shared_ptr<Promise<void>> not_full_;
+  bool finished_ = false;
+  bool closed_ = false;
+  std::exception_ptr exception_;
+};
+
+using PacketQueue = BoundedQueue<Packet>;
+using FrameQueue = BoundedQueue<Frame>;
+
+// Input track. Shared with its demuxer task, which may still be reading when
+// the mux is interrupted.
+struct Input {
+  std::unique_ptr<AVIOContext, AVIOContextDeleter> io_context;
+  std::unique_ptr<AVFormatContext, AVFormatContextDeleter> format_context;
+  std::unique_ptr<AVCodecContext, AVCodecContextDeleter> codec_context;
+  int source_stream_index;
+  AVRational output_time_base;
+  int output_stream_index;
+  // Copy of io_context->bytes_read, which may only be read by the demuxer.
+  int64_t bytes_read = 0;
+};
+
+std::shared_ptr<Input> CreateInput(
+    std::unique_ptr<AVIOContext, AVIOContextDeleter> io_context,
+    AVMediaType type) {
+  auto input = std::make_shared<Input>();
+  input->io_context = std::move(io_context);
+  input->format_context = CreateFormatContext(input->io_context.get());
+  input->source_stream_index = av_find_best_stream(input->format_context.get(),
+                                                   type, -1, -1, nullptr, 0);
+  input->codec_context = CreateCodecContext(input->format_context.get(),
+                                            input->source_stream_index);
+  return input;
+}
+
+// Opens the track on the thread pool, avformat_open_input blocks until the
+// header is read over the network. Awaited by the mux coroutines, so that the
+// tracks of a job are opened in parallel without blocking another thread.
+Task<std::shared_ptr<Input>> OpenInput(const coro::util::EventLoop* event_loop,
+                                       coro::util::ThreadPool* thread_pool,
+                                       AbstractCloudProvider* cloud_provider,
+                                       AbstractCloudProvider::File track,
+                                       AVMediaType type,
+                                       stdx::stop_token stop_token) {
+  co_return co_await thread_pool->Do(stop_token, [&] {
+    return CreateInput(
+        CreateIOContext(event_loop, cloud_provider, std::move(track),
+                        stop_token),
+        type);
+  });
+}
+
+AVStream* AddOutputStream(AVFormatContext* format_context, const Input& input) {
+  AVStream* stream =
+      avformat_new_stream(format_context, input.codec_context->codec);
+  if (!stream) {
+    throw RuntimeError("couldn't add stream");
+  }
+  CheckAVError(avcodec_parameters_from_context(stream->codecpar,
+                                               input.codec_context.get()),
+               "avcodec_parameters_from_context");
+  const AVStream* source =
+      input.format_context->streams[input.source_stream_index];
+  stream->time_base = source->time_base;
+  stream->duration = source->duration;
+  return stream;
+}
+
+// Reads the packets of the input's stream on the thread pool, rescales them to
+// the output stream and pushes them to the queue, independently of the other
+// input.
+Task<> Demux(std::shared_ptr<Input> input, std::shared_ptr<PacketQueue> queue,
+             coro::util::ThreadPool* thread_pool, stdx::stop_token stop_token) {
+  std::exception_ptr exception;
+  try {
+    AVRational time_base =
+        input->format_context->streams[input->source_stream_index]->time_base;
+    while (!queue->closed()) {
+      Packet packet = CreatePacket();
+      int result = co_await thread_pool->Do(stop_token, av_read_frame,
+                                            input->format_context.get(),
+                                            packet.get());
+      input->bytes_read = input->io_context->bytes_read;
+      if (result == AVERROR_EOF) {
+        break;
+      }
+      CheckAVError(result, "av_read_frame");
+      if (packet->stream_index != input->source_stream_index) {
+        continue;
+      }
+      CheckAVError(av_packet_make_writable(packet.get()),
+                   "av_packet_make_writable");
+      av_packet_rescale_ts(packet.get(), time_base, input->output_time_base);
+      packet->stream_index = input->output_stream_index;
+      co_await queue->Push(std::move(packet));
+    }
+  } catch (...) {
+    exception = std::current_exception();
+  }
+  queue->Finish(std::move(exception));
+}
+
+// Decodes the demuxed packets of a transcoded input on the thread pool.
+Task<> Decode(std::shared_ptr<Transcoder> transcoder,
+              std::shared_ptr<PacketQueue> packets,
+              std::shared_ptr<FrameQueue> frames,
+              coro::util::ThreadPool* thread_pool,
+              stdx::stop_token stop_token) {
+  std::exception_ptr exception;
+  try {
+    while (!frames->closed()) {
+      Packet packet = co_await packets->Pop();
+      std::vector<Frame> decoded = co_await thread_pool->Do(
+          stop_token, [&] { return transcoder->Decode(packet.get()); });
+      for (Frame& frame : decoded) {
+        co_await frames->Push(std::move(frame));
+      }
+      if (!packet) {
+        break;
+      }
+    }
+  } catch (...) {
+    exception = std::current_exception();
+  }
+  packets->Close();
+  frames->Finish(std::move(exception));
+}
+
+// Encodes the decoded frames on the thread pool and pushes the packets,
+// rescaled to the output stream, to the interleaver's queue.
+Task<> Encode(std::shared_ptr<Transcoder> transcoder,
+              std::shared_ptr<FrameQueue> frames,
+              std::shared_ptr<PacketQueue> packets, AVRational time_base,
+              int stream_index, coro::util::ThreadPool* thread_pool,
+              stdx::stop_token stop_token) {
+  std::exception_ptr exception;
+  try {
+    while (!packets->closed()) {
+      Frame frame = co_await frames->Pop();
+      std::vector<Packet> encoded = co_await thread_pool->Do(
+          stop_token, [&] { return transcoder->Encode(frame.get()); });
+      for (Packet& packet : encoded) {
+        av_packet_rescale_ts(packet.get(), transcoder->encoder()->time_base,
+                             time_base);
+        packet->stream_index = stream_index;
+        co_await packets->Push(std::move(packet));
+      }
+      if (!frame) {
+        break;
+      }
+    }
+  } catch (...) {
+    exception = std::current_exception();
+  }
+  frames->Close();
+  packets->Finish(std::move(exception));
+}
+
+double GetDuration(const Input& input) {
+  const AVStream* stream =
+      input.format_context->streams[input.source_stream_index];
+  if (stream->duration != AV_NOPTS_VALUE) {
+    return static_cast<double>(stream->duration) * av_q2d(stream->time_base);
+  }
+  if (input.format_context->duration != AV_NOPTS_VALUE) {
+    return static_cast<double>(input.format_context->duration) / AV_TIME_BASE;
+  }
+  return 0;
+}
+
+AVCodecID GetTranscodeCodecId(MediaContainer container, AVMediaType type) {
+  bool is_video = type == AVMEDIA_TYPE_VIDEO;
+  switch (container) {
+    case MediaContainer::kMp4:
+      return is_video ? AV_CODEC_ID_H264 : AV_CODEC_ID_AAC;
+    case MediaContainer::kWebm:
+    case MediaContainer::kOgg:
+      return is_video ? AV_CODEC_ID_VP8 : AV_CODEC_ID_OPUS;
+    default:
+      throw RuntimeError("invalid container");
+  }
+}
+
 class MuxerContext {
  public:
-  MuxerContext(coro::util::ThreadPool* thread_pool, AVIOContext* video,
-               AVIOContext* audio, MuxerOptions options,
+  MuxerContext(coro::util::ThreadPool* thread_pool,
+               std::shared_ptr<Input> video, std::shared_ptr<Input> audio,
+               MediaContainer container,
+               std::optional<TranscodeOptions> transcode,
+               std::shared_ptr<SpillFile> file, MuxerProgress progress,
+               std::function<void(const MuxerProgress&)> on_progress,
                stdx::stop_token stop_token);
 
   Generator<std::string> GetContent();
 
+  // Writes all packets and the trailer. Yields the output unless it is being
+  // written to the file, then yields an empty chunk whenever the file grows.
+  Generator<std::string> Mux();
+
+  MuxedFile GetMuxedFile() const;
+
+  MuxedFileProgress GetFileProgress() const;
+
+  MuxerProgress GetProgress() const;
+
  private:
-  struct AVIOContextDeleter {
-    void operator()(AVIOContext* context) {
-      av_free(context->buffer);
-      avio_context_free(&context);
-    }
-  };
-  struct AVFormatWriteContextDeleter {
-    void operator()(AVFormatContext* context) {
-      avformat_free_context(context);
-    }
-  };
+  static constexpr size_t kPacketQueueSize = 256;
+  // Decoded frames are large, a few are enough to keep the encoder busy.
+  static constexpr size_t kFrameQueueSize = 8;
 
   struct Stream {
-    std::unique_ptr<AVFormatContext, AVFormatContextDeleter> format_context;
-    std::unique_ptr<AVCodecContext, AVCodecContextDeleter> codec_context;
-    int source_stream_index;
+    std::shared_ptr<Input> input;
+    // Set if the stream is transcoded.
+    std::shared_ptr<Transcoder> transcoder;
+    std::shared_ptr<PacketQueue> queue;
     AVStream* stream;
-    std::unique_ptr<AVPacket, AVPacketDeleter> packet;
+    Packet packet;
     bool is_eof;
   };
 
-  Stream CreateStream(AVIOContext* io_context, AVMediaType type) const;
+  Stream CreateStream(std::shared_ptr<Input> input, AVMediaType type,
+                      MediaContainer container,
+                      const std::optional<TranscodeOptions>& transcode) const;
 
   std::unique_ptr<std::string> data_ = std::make_unique<std::string>();
   coro::util::ThreadPool* thread_pool_;
-  std::unique_ptr<std::FILE, FileDeleter> file_;
-  std::unique_ptr<AVIOContext, AVIOContextDeleter> io_context_;
+  std::unique_ptr<SpillFileSink> sink_;
+  std::unique_ptr<AVIOContext, AVIOWriteContextDeleter> io_context_;
   std::unique_ptr<AVFormatContext, AVFormatWriteContextDeleter> format_context_;
+  // Muxers only seek back into the header, to complete it in the trailer.
+  int64_t header_size_ = 0;
   std::vector<Stream> streams_;
+  MuxerProgress progress_;
+  std::function<void(const MuxerProgress&)> on_progress_;
+  std::chrono::steady_clock::time_point start_time_ =
+      std::chrono::steady_clock::now();
   stdx::stop_token stop_token_;
 };
 
-MuxerContext::MuxerContext(coro::util::ThreadPool* thread_pool,
-                           AVIOContext* video, AVIOContext* audio,
-                           MuxerOptions options, stdx::stop_token stop_token)
+MuxerContext::MuxerContext(
+    coro::util::ThreadPool* thread_pool, std::shared_ptr<Input> video,
+    std::shared_ptr<Input> audio, MediaContainer container,
+    std::optional<TranscodeOptions> transcode, std::shared_ptr<SpillFile> file,
+    MuxerProgress progress,
+    std::function<void(const MuxerProgress&)> on_progress,
+    stdx::stop_token stop_token)
     : thread_pool_(thread_pool),
-      file_(options.buffered ? CreateTmpFile() : nullptr),
-      io_context_(options.buffered ? CreateMuxerIOContext(file_.get())
-                                   : CreateMuxerIOContext(data_.get())),
+      sink_(file ? std::make_unique<SpillFileSink>(
+                       SpillFileSink{.file = std::move(file)})
+                 : nullptr),
+      io_context_(sink_ ? CreateMuxerIOContext(
+                              sink_.get(),
+                              /*seekable=*/container != MediaContainer::kMp4)
+                        : CreateMuxerIOContext(data_.get())),
       format_context_([&] {
         AVFormatContext* format_context;
         CheckAVError(avformat_alloc_output_context2(
                          &format_context,
                          /*oformat=*/nullptr,
-                         [&] {
-                           switch (options.container) {
-                             case MediaContainer::kMp4:
-                               return "mp4";
-                             case MediaContainer::kWebm:
-                               return "webm";
-                             default:
-                               throw RuntimeError("invalid container");
-                           }
-                         }(),
+                         std::string(GetFormatName(container)).c_str(),
                          /*filename=*/nullptr),
                      "avformat_alloc_output_context");
         format_context->pb = io_context_.get();
         return format_context;
       }()),
+      progress_(std::move(progress)),
+      on_progress_(std::move(on_progress)),
       stop_token_(std::move(stop_token)) {
-  streams_.emplace_back(CreateStream(video, AVMEDIA_TYPE_VIDEO));
-  streams_.emplace_back(CreateStream(audio, AVMEDIA_TYPE_AUDIO));
+  // Either input may be missing when a single track is repackaged.
+  if (video) {
+    streams_.emplace_back(CreateStream(std::move(video), AVMEDIA_TYPE_VIDEO,
+                                       container, transcode));
+  }
+  if (audio) {
+    streams_.emplace_back(CreateStream(std::move(audio), AVMEDIA_TYPE_AUDIO,
+                                       container, transcode));
+  }
+  for (const auto& stream : streams_) {
+    progress_.duration =
+        std::max(progress_.duration, GetDuration(*stream.input));
+  }
   AVDictionary* options_dict = nullptr;
   auto guard = coro::util::AtScopeExit([&] { av_dict_free(&options_dict); });
-  if (!options.buffered) {
-    if (options.container == MediaContainer::kMp4) {
-      CheckAVError(
-          av_dict_set(&options_dict, "movflags", "frag_keyframe+empty_moov", 0),
-          "av_dict_set");
-    }
+  // MP4 is fragmented even when written to a file, so that nothing written
+  // is rewritten later and the file can be served while it grows.
+  if (container == MediaContainer::kMp4) {
+    CheckAVError(
+        av_dict_set(&options_dict, "movflags", "frag_keyframe+empty_moov", 0),
+        "av_dict_set");
   }
   CheckAVError(avformat_write_header(format_context_.get(), &options_dict),
                "avformat_write_header");
+  header_size_ = avio_tell(io_context_.get());
+  for (auto& stream : streams_) {
+    // Packets of transcoded streams are fed to the decoder as they are.
+    stream.input->output_time_base =
+        stream.transcoder
+            ? stream.input->format_context
+                  ->streams[stream.input->source_stream_index]
+                  ->time_base
+            : stream.stream->time_base;
+    stream.input->output_stream_index = stream.stream->index;
+  }
 }
 
-MuxerContext::Stream MuxerContext::CreateStream(AVIOContext* io_context,
-                                                AVMediaType type) const {
+MuxerContext::Stream MuxerContext::CreateStream(
+    std::shared_ptr<Input> input, AVMediaType type, MediaContainer container,
+    const std::optional<TranscodeOptions>& transcode) const {
   Stream stream{};
-  stream.format_context = CreateFormatContext(io_context);
-  stream.source_stream_index = av_find_best_stream(stream.format_context.get(),
-                                                   type, -1, -1, nullptr, 0);
-  stream.codec_context = CreateCodecContext(stream.format_context.get(),
-                                            stream.source_stream_index);
-  stream.stream =
-      avformat_new_stream(format_context_.get(), stream.codec_context->codec);
+  stream.input = std::move(input);
+  stream.queue = std::make_shared<PacketQueue>(kPacketQueueSize);
+  if (!transcode) {
+    stream.stream = AddOutputStream(format_context_.get(), *stream.input);
+    return stream;
+  }
+  const AVStream* source =
+      stream.input->format_context->streams[stream.input->source_stream_index];
+  stream.transcoder = std::make_shared<Transcoder>(
+      source, GetTranscodeCodecId(container, type), *transcode,
+      format_context_->oformat->flags & AVFMT_GLOBALHEADER);
+  stream.stream = avformat_new_stream(format_context_.get(), nullptr);
   if (!stream.stream) {
     throw RuntimeError("couldn't add stream");
   }
-  CheckAVError(avcodec_parameters_from_context(stream.stream->codecpar,
-                                               stream.codec_context.get()),
-               "avcodec_parameters_from_context");
-  stream.stream->time_base =
-      stream.format_context->streams[stream.source_stream_index]->time_base;
+  const AVCodecContext* encoder = stream.transcoder->encoder();
+  CheckAVError(
+      avcodec_parameters_from_context(stream.stream->codecpar, encoder),
+      "avcodec_parameters_from_context");
+  stream.stream->time_base = encoder->time_base;
   stream.stream->duration =
-      stream.format_context->streams[stream.source_stream_index]->duration;
+      source->duration != AV_NOPTS_VALUE
+          ? av_rescale_q(source->duration, source->time_base,
+                         encoder->time_base)
+          : AV_NOPTS_VALUE;
   return stream;
 }
 
 Generator<std::string> MuxerContext::GetContent() {
-  int previous_progress = 0;
+  FOR_CO_AWAIT(std::string & chunk, Mux()) { co_yield std::move(chunk); }
+  if (sink_) {
+    FOR_CO_AWAIT(std::string & chunk,
+                 sink_->file->GetContent(thread_pool_, 0, sink_->size)) {
+      co_yield std::move(chunk);
+    }
+  }
+}
+
+MuxedFile MuxerContext::GetMuxedFile() const {
+  if (!sink_) {
+    throw RuntimeError("muxer output is not a file");
+  }
+  return MuxedFile{
+      .thread_pool = thread_pool_, .file = sink_->file, .size = sink_->size};
+}
+
+MuxedFileProgress MuxerContext::GetFileProgress() const {
+  return MuxedFileProgress{
+      .final_begin = io_context_->seekable ? header_size_ : 0,
+      .final_end = sink_->size};
+}
+
+MuxerProgress MuxerContext::GetProgress() const {
+  MuxerProgress progress = progress_;
+  for (const auto& stream : streams_) {
+    (stream.stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO
+         ? progress.video_bytes_read
+         : progress.audio_bytes_read) = stream.input->bytes_read;
+  }
+  progress.elapsed = GetElapsedSeconds(start_time_);
+  if (progress.elapsed > 0) {
+    progress.realtime_factor = progress.position / progress.elapsed;
+  }
+  return progress;
+}
+
+Generator<std::string> MuxerContext::Mux() {
+  stdx::stop_source stop_source;
+  stdx::stop_callback stop_callback(stop_token_,
+                                    [&] { stop_source.request_stop(); });
+  auto guard = coro::util::AtScopeExit([&] {
+    stop_source.request_stop();
+    for (auto& stream : streams_) {
+      stream.queue->Close();
+    }
+  });
+  for (auto& stream : streams_) {
+    if (stream.transcoder) {
+      auto packets = std::make_shared<PacketQueue>(kPacketQueueSize);
+      auto frames = std::make_shared<FrameQueue>(kFrameQueueSize);
+      RunTask(Demux, stream.input, packets, thread_pool_,
+              stop_source.get_token());
+      RunTask(Decode, stream.transcoder, packets, frames, thread_pool_,
+              stop_source.get_token());
+      RunTask(Encode, stream.transcoder, frames, stream.queue,
+              stream.stream->time_base, stream.stream->index, thread_pool_,
+              stop_source.get_token());
+    } else {
+      RunTask(Demux, stream.input, stream.queue, thread_pool_,
+              stop_source.get_token());
+    }
+  }
+
+  auto last_report = std::chrono::steady_clock::now();
+  int64_t reported_size = 0;
   while (true) {
     for (auto& stream : streams_) {
       if (!stream.is_eof && !stream.packet) {
-        stream.packet = CreatePacket();
-        while (true) {
-          auto read_packet = co_await thread_pool_->Do(
-              stop_token_, av_read_frame, stream.format_context.get(),
-              stream.packet.get());
-          if (read_packet != 0 && read_packet != AVERROR_EOF) {
-            CheckAVError(read_packet, "av_read_frame");
-          } else {
-            if (read_packet == 0 &&
-                stream.packet->stream_index != stream.source_stream_index) {
-              continue;
-            }
-            if (read_packet == AVERROR_EOF) {
-              stream.is_eof = true;
-              stream.packet.reset();
-            } else {
-              CheckAVError(av_packet_make_writable(stream.packet.get()),
-                           "av_packet_make_writable");
-              av_packet_rescale_ts(
-                  stream.packet.get(),
-                  stream.format_context->streams[stream.source_stream_index]
-                      ->time_base,
-                  stream.stream->time_base);
-              stream.packet->stream_index = stream.stream->index;
-            }
-            break;
-          }
-        }
+        stream.packet = co_await stream.queue->Pop();
+        stream.is_eof = !stream.packet;
       }
     }
     Stream* picked_stream = nullptr;
@@ -211,18 +610,27 @@ Generator<std::string> MuxerContext::GetContent() {
     if (!picked_stream) {
       break;
     }
-    int current_progress = static_cast<int>(100 * picked_stream->packet->pts /
-                                            picked_stream->stream->duration);
-    if (current_progress > previous_progress) {
-      previous_progress = current_progress;
-      std::cerr << "TRANSCODE PROGRESS " << current_progress << "%\n";
+    if (picked_stream->packet->dts != AV_NOPTS_VALUE) {
+      progress_.position = std::max(
+          progress_.position,
+          static_cast<double>(picked_stream->packet->dts) *
+              av_q2d(picked_stream->stream->time_base));
     }
     CheckAVError(
         av_write_frame(format_context_.get(), picked_stream->packet.get()),
         "av_write_frame");
+    progress_.packets_written++;
+    progress_.bytes_written = avio_tell(io_context_.get());
+    if (on_progress_ && GetElapsedSeconds(last_report) >= 1) {
+      last_report = std::chrono::steady_clock::now();
+      on_progress_(GetProgress());
+    }
     if (!data_->empty()) {
       co_yield std::move(*data_);
       data_->clear();
+    } else if (sink_ && sink_->size != reported_size) {
+      reported_size = sink_->size;
+      co_yield std::string();
     }
     picked_stream->packet.reset();
   }
@@ -230,37 +638,328 @@ Generator<std::string> MuxerContext::GetContent() {
   CheckAVError(av_write_frame(format_context_.get(), nullptr),
                "av_write_frame");
   CheckAVError(av_write_trailer(format_context_.get()), "av_write_trailer");
+  progress_.bytes_written =
+      sink_ ? sink_->size : avio_tell(io_context_.get());
+  progress_.done = true;
+  if (on_progress_) {
+    on_progress_(GetProgress());
+  }
 
   if (!data_->empty()) {
     co_yield std::move(*data_);
     data_->clear();
   }
+}
+
+// Segments are cut at the first video keyframe at least this many seconds
+// after the start of the segment.
+constexpr int64_t kSegmentDuration = 4;
+
+// Segments are muxed and cached in memory. They are cut early to stay below
+// this size, inputs whose keyframes are further apart are refused.
+constexpr int64_t kMaxSegmentSize = int64_t{64} << 20;
+
+constexpr int kUnsupportedMediaType = 415;
+
+// Fragmented MP4 output. The header written on construction is the init
+// segment, the packets written afterwards form a fragment once flushed.
+class FragmentedOutput {
+ public:
+  FragmentedOutput(Input* video, Input* audio)
+      : io_context_(CreateMuxerIOContext(&data_)),
+        format_context_([&] {
+          AVFormatContext* format_context;
+          CheckAVError(avformat_alloc_output_context2(&format_context,
+                                                      /*oformat=*/nullptr,
+                                                      "mp4",
+                                                      /*filename=*/nullptr),
+                       "avformat_alloc_output_context");
+          format_context->pb = io_context_.get();
+          return format_context;
+        }()) {
+    AddOutputStream(format_context_.get(), *video);
+    AddOutputStream(format_context_.get(), *audio);
+    // Segments are muxed independently, the original timestamps have to be
+    // kept for the decode times of consecutive segments to line up. 0 is
+    // AVFMT_AVOID_NEG_TS_DISABLED, which older FFmpeg versions don't define.
+    format_context_->avoid_negative_ts = 0;
+    AVDictionary* options_dict = nullptr;
+    auto guard = coro::util::AtScopeExit([&] { av_dict_free(&options_dict); });
+    CheckAVError(av_dict_set(&options_dict, "movflags",
+                             "frag_custom+empty_moov+default_base_moof+"
+                             "frag_discont",
+                             0),
+                 "av_dict_set");
+    CheckAVError(av_dict_set(&options_dict, "use_editlist", "0", 0),
+                 "av_dict_set");
+    CheckAVError(avformat_write_header(format_context_.get(), &options_dict),
+                 "avformat_write_header");
+    video->output_time_base = format_context_->streams[0]->time_base;
+    video->output_stream_index = 0;
+    audio->output_time_base = format_context_->streams[1]->time_base;
+    audio->output_stream_index = 1;
+  }
 
-  std::cerr << "TRANSCODE DONE\n";
+  FragmentedOutput(const FragmentedOutput&) = delete;
+  FragmentedOutput& operator=(const FragmentedOutput&) = delete;
 
-  if (file_) {
-    FOR_CO_AWAIT(std::string & chunk, ReadFile(thread_pool_, file_.get())) {
-      co_yield std::move(chunk);
+  void Write(Packet packet) {
+    CheckAVError(
+        av_interleaved_write_frame(format_context_.get(), packet.get()),
+        "av_interleaved_write_frame");
+  }
+
+  // Writes the packets written so far as a fragment.
+  void Flush() {
+    CheckAVError(av_interleaved_write_frame(format_context_.get(), nullptr),
+                 "av_interleaved_write_frame");
+    CheckAVError(av_write_frame(format_context_.get(), nullptr),
+                 "av_write_frame");
+  }
+
+  std::string TakeOutput() {
+    avio_flush(io_context_.get());
+    return std::exchange(data_, std::string());
+  }
+
+ private:
+  std::string data_;
+  std::unique_ptr<AVIOContext, AVIOWriteContextDeleter> io_context_;
+  std::unique_ptr<AVFormatContext, AVFormatWriteContextDeleter> format_context_;
+};
+
+// Only the parts of the codec strings which players check are filled in.
+std::string GetCodecString(const AVCodecParameters* codec) {
+  switch (codec->codec_id) {
+    case AV_CODEC_ID_H264:
+      if (codec->extradata_size >= 4 && codec->extradata[0] == 1) {
+        // avcC: profile, profile compatibility and level.
+        return fmt::format("avc1.{:02x}{:02x}{:02x}", codec->extradata[1],
+                           codec->extradata[2], codec->extradata[3]);
+      }
+      return "avc1";
+    case AV_CODEC_ID_HEVC:
+      return "hvc1";
+    case AV_CODEC_ID_VP9:
+      return "vp09";
+    case AV_CODEC_ID_AV1:
+      return "av01";
+    case AV_CODEC_ID_AAC:
+      return StrCat("mp4a.40.", codec->profile >= 0 ? codec->profile + 1 : 2);
+    case AV_CODEC_ID_MP3:
+      return "mp4a.40.34";
+    case AV_CODEC_ID_OPUS:
+      return "opus";
+    case AV_CODEC_ID_FLAC:
+      return "fLaC";
+    default:
+      return avcodec_get_name(codec->codec_id);
+  }
+}
+
+struct Keyframe {
+  int64_t timestamp;
+  // Byte offset in the input.
+  int64_t pos;
+};
+
+std::vector<Keyframe> GetKeyframes(AVStream* stream) {
+  std::vector<Keyframe> keyframes;
+  for (int i = 0; i < avformat_index_get_entries_count(stream); i++) {
+    const AVIndexEntry* entry = avformat_index_get_entry(stream, i);
+    if (entry->flags & AVINDEX_KEYFRAME) {
+      keyframes.push_back({.timestamp = entry->timestamp, .pos = entry->pos});
     }
   }
+  std::sort(keyframes.begin(), keyframes.end(),
+            [](const Keyframe& k1, const Keyframe& k2) {
+              return k1.timestamp < k2.timestamp;
+            });
+  keyframes.erase(std::unique(keyframes.begin(), keyframes.end(),
+                              [](const Keyframe& k1, const Keyframe& k2) {
+                                return k1.timestamp == k2.timestamp;
+                              }),
+                  keyframes.end());
+  return keyframes;
 }
 
-}  // namespace
+// Segments can only start at keyframes the container index lists. Without
+// an index (TS, Ogg, FLV, MKV without cues) the whole video would be one
+// segment, which is refused rather than muxed into memory.
+SegmentIndex CreateSegmentIndex(Input* video, Input* audio,
+                                int64_t video_size, int64_t size) {
+  AVStream* stream =
+      video->format_context->streams[video->source_stream_index];
+  std::vector<Keyframe> keyframes = GetKeyframes(stream);
+  if (keyframes.empty()) {
+    throw http::HttpException(kUnsupportedMediaType,
+                              "segmented output needs a keyframe index");
+  }
+  // Byte offset where the data of the i-th keyframe's group of pictures ends.
+  auto get_end_pos = [&](size_t i) {
+    return i + 1 < keyframes.size() ? keyframes[i + 1].pos : video_size;
+  };
+  bool has_positions =
+      video_size > 0 &&
+      std::all_of(keyframes.begin(), keyframes.end(),
+                  [](const Keyframe& keyframe) { return keyframe.pos >= 0; });
+  if (has_positions) {
+    for (size_t i = 0; i < keyframes.size(); i++) {
+      if (get_end_pos(i) - keyframes[i].pos > kMaxSegmentSize) {
+        throw http::HttpException(kUnsupportedMediaType,
+                                  "keyframes too far apart for segments");
+      }
+    }
+  }
+
+  int64_t start = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+  int64_t duration =
+      stream->duration != AV_NOPTS_VALUE
+          ? stream->duration
+          : av_rescale_q(video->format_context->duration, AV_TIME_BASE_Q,
+                         stream->time_base);
+  if (duration <= 0) {
+    throw RuntimeError("unknown video duration");
+  }
+  int64_t end = start + duration;
 
-template <typename F1, typename F2>
-auto Muxer::InParallel(F1&& f1, F2&& f2, stdx::stop_token stop_token) const
-    -> std::tuple<decltype(f1()), decltype(f2())> {
-  std::promise<std::tuple<decltype(f1()), decltype(f2())>> promise;
-  event_loop_->RunOnEventLoop([&]() -> Task<> {
-    try {
-      promise.set_value(
-          co_await WhenAll(thread_pool_->Do(stop_token, std::forward<F1>(f1)),
-                           thread_pool_->Do(stop_token, std::forward<F2>(f2))));
-    } catch (...) {
-      promise.set_exception(std::current_exception());
+  SegmentIndex index{.time_base_num = stream->time_base.num,
+                     .time_base_den = stream->time_base.den};
+  int64_t segment_duration =
+      av_rescale_q(kSegmentDuration, AVRational{1, 1}, stream->time_base);
+  size_t segment_begin = 0;
+  for (size_t i = 1; i < keyframes.size() && keyframes[i].timestamp < end;
+       i++) {
+    const Keyframe& first = keyframes[segment_begin];
+    if (keyframes[i].timestamp - first.timestamp >= segment_duration ||
+        (has_positions && get_end_pos(i) - first.pos > kMaxSegmentSize)) {
+      index.segments.push_back(
+          {.start = first.timestamp, .end = keyframes[i].timestamp});
+      segment_begin = i;
     }
-  });
-  return promise.get_future().get();
+  }
+  int64_t segment_start = keyframes[segment_begin].timestamp;
+  index.segments.push_back(
+      {.start = segment_start, .end = std::max(end, segment_start + 1)});
+
+  index.init_segment = FragmentedOutput(video, audio).TakeOutput();
+  index.codecs = StrCat(
+      GetCodecString(stream->codecpar), ',',
+      GetCodecString(
+          audio->format_context->streams[audio->source_stream_index]
+              ->codecpar));
+  index.width = stream->codecpar->width;
+  index.height = stream->codecpar->height;
+  index.bandwidth = av_rescale(size * 8, stream->time_base.den,
+                               duration * stream->time_base.num);
+  return index;
+}
+
+// Writes the packets of the input's stream which belong to the segment. The
+// video track ends right before the keyframe starting the next segment.
+// `segment_size` accumulates the packet sizes of all tracks of the segment.
+void WriteSegmentPackets(Input* input, AVRational time_base,
+                         const SegmentIndex::Segment& segment, bool is_video,
+                         int64_t* segment_size, FragmentedOutput* output) {
+  AVFormatContext* format_context = input->format_context.get();
+  AVStream* stream = format_context->streams[input->source_stream_index];
+  int64_t start = av_rescale_q(segment.start, time_base, stream->time_base);
+  int64_t end = av_rescale_q(segment.end, time_base, stream->time_base);
+  CheckAVError(av_seek_frame(format_context, input->source_stream_index, start,
+                             AVSEEK_FLAG_BACKWARD),
+               "av_seek_frame");
+  bool started = false;
+  while (true) {
+    Packet packet = CreatePacket();
+    int result = av_read_frame(format_context, packet.get());
+    if (result == AVERROR_EOF) {
+      break;
+    }
+    CheckAVError(result, "av_read_frame");
+    if (packet->stream_index != input->source_stream_index) {
+      continue;
+    }
+    // Index entries of the demuxers hold decode timestamps.
+    int64_t timestamp =
+        packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+    if (is_video) {
+      bool is_keyframe = packet->flags & AV_PKT_FLAG_KEY;
+      if (!started) {
+        if (!is_keyframe || timestamp < start) {
+          continue;
+        }
+        started = true;
+      } else if (is_keyframe && timestamp >= end) {
+        break;
+      }
+    } else {
+      if (timestamp >= end) {
+        break;
+      }
+      if (timestamp < start) {
+        continue;
+      }
+    }
+    // The index can't bound the size of inputs without keyframe positions.
+    *segment_size += packet->size;
+    if (*segment_size > kMaxSegmentSize) {
+      throw http::HttpException(kUnsupportedMediaType, "segment too large");
+    }
+    av_packet_rescale_ts(packet.get(), stream->time_base,
+                         input->output_time_base);
+    packet->stream_index = input->output_stream_index;
+    output->Write(std::move(packet));
+  }
+}
+
+}  // namespace
+
+std::string_view GetFormatName(MediaContainer container) {
+  switch (container) {
+    case MediaContainer::kMp4:
+      return "mp4";
+    case MediaContainer::kWebm:
+      return "webm";
+    case MediaContainer::kOgg:
+      return "ogg";
+  }
+  throw RuntimeError("invalid container");
+}
+
+struct SegmentInputs {
+  const AbstractCloudProvider* owner;
+  int64_t video_size;
+  int64_t size;
+  std::shared_ptr<Input> video;
+  std::shared_ptr<Input> audio;
+};
+
+Generator<std::string> MuxedFile::GetContent(http::Range range) const {
+  if (!size && !range.end) {
+    throw http::HttpException(http::HttpException::kRangeNotSatisfiable);
+  }
+  int64_t end = range.end ? *range.end : *size - 1;
+  if (range.start < 0 || range.start > end || (size && end >= *size)) {
+    throw http::HttpException(http::HttpException::kRangeNotSatisfiable);
+  }
+  return file->GetContent(thread_pool, range.start, end - range.start + 1);
+}
+
+std::vector<MuxerProgress> Muxer::GetProgress() const {
+  std::vector<MuxerProgress> progress;
+  for (const auto& [id, get_progress] : jobs_->progress) {
+    progress.push_back(get_progress());
+  }
+  return progress;
+}
+
+Task<JobScheduler::Slot> Muxer::AcquireSlot(const AbstractCloudProvider* owner,
+                                            const MuxerOptions& options,
+                                            stdx::stop_token stop_token) const {
+  return job_scheduler_->Acquire(options.transcode
+                                     ? JobScheduler::Priority::kBackground
+                                     : JobScheduler::Priority::kStreaming,
+                                 owner, std::move(stop_token));
 }
 
 Generator<std::string> Muxer::operator()(
@@ -269,22 +968,71 @@ Generator<std::string> Muxer::operator()(
     AbstractCloudProvider* audio_cloud_provider,
     AbstractCloudProvider::File audio_track, MuxerOptions options,
     stdx::stop_token stop_token) const {
-  std::unique_ptr<AVIOContext, AVIOContextDeleter> video_io_context;
-  std::unique_ptr<AVIOContext, AVIOContextDeleter> audio_io_context;
+  JobScheduler::Slot slot =
+      options.slot ? std::move(*options.slot)
+                   : co_await AcquireSlot(video_cloud_provider, options,
+                                          stop_token);
+  MuxerProgress progress{.id = jobs_->next_id++,
+                         .video_name = video_track.name,
+                         .audio_name = audio_track.name,
+                         .container = options.container,
+                         .transcode = options.transcode.has_value()};
+  std::shared_ptr<Input> video;
+  std::shared_ptr<Input> audio;
+  std::tie(video, audio) = co_await WhenAll(
+      OpenInput(event_loop_, thread_pool_, video_cloud_provider,
+                std::move(video_track), AVMEDIA_TYPE_VIDEO, stop_token),
+      OpenInput(event_loop_, thread_pool_, audio_cloud_provider,
+                std::move(audio_track), AVMEDIA_TYPE_AUDIO, stop_token));
+  auto muxer_context = co_await thread_pool_->Do(stop_token, [&] {
+    return MuxerContext(thread_pool_, std::move(video), std::move(audio),
+                        options.container, std::move(options.transcode),
+                        options.buffered
+                            ? std::make_shared<SpillFile>(CreateTmpFile())
+                            : nullptr,
+                        progress, std::move(options.on_progress), stop_token);
+  });
+  jobs_->progress.emplace(progress.id,
+                          [&] { return muxer_context.GetProgress(); });
+  auto guard = coro::util::AtScopeExit(
+      [&] { jobs_->progress.erase(progress.id); });
+  FOR_CO_AWAIT(std::string & chunk, muxer_context.GetContent()) {
+    if (!chunk.empty()) {
+      co_yield std::move(chunk);
+    }
+  }
+}
+
+Generator<std::string> Muxer::operator()(AbstractCloudProvider* cloud_provider,
+                                         AbstractCloudProvider::File track,
+                                         TrackType type, MuxerOptions options,
+                                         stdx::stop_token stop_token) const {
+  JobScheduler::Slot slot =
+      options.slot
+          ? std::move(*options.slot)
+          : co_await AcquireSlot(cloud_provider, options, stop_token);
+  bool is_video = type == TrackType::kVideo;
+  MuxerProgress progress{.id = jobs_->next_id++,
+                         .video_name = is_video ? track.name : "",
+                         .audio_name = is_video ? "" : track.name,
+                         .container = options.container,
+                         .transcode = options.transcode.has_value()};
+  auto input = co_await OpenInput(
+      event_loop_, thread_pool_, cloud_provider, std::move(track),
+      is_video ? AVMEDIA_TYPE_VIDEO : AVMEDIA_TYPE_AUDIO, stop_token);
   auto muxer_context = co_await thread_pool_->Do(stop_token, [&] {
-    std::tie(video_io_context, audio_io_context) = InParallel(
-        [&] {
-          return CreateIOContext(event_loop_, video_cloud_provider,
-                                 std::move(video_track), stop_token);
-        },
-        [&] {
-          return CreateIOContext(event_loop_, audio_cloud_provider,
-                                 std::move(audio_track), stop_token);
-        },
-        stop_token);
-    return MuxerContext(thread_pool_, video_io_context.get(),
-                        audio_io_context.get(), options, stop_token);
+    return MuxerContext(
+        thread_pool_, is_video ? std::move(input) : nullptr,
+        is_video ? nullptr : std::move(input), options.container,
+        std::move(options.transcode),
+        options.buffered ? std::make_shared<SpillFile>(CreateTmpFile())
+                         : nullptr,
+        progress, std::move(options.on_progress), stop_token);
   });
+  jobs_->progress.emplace(progress.id,
+                          [&] { return muxer_context.GetProgress(); });
+  auto guard = coro::util::AtScopeExit(
+      [&] { jobs_->progress.erase(progress.id); });
   FOR_CO_AWAIT(std::string & chunk, muxer_context.GetContent()) {
     if (!chunk.empty()) {
       co_yield std::move(chunk);
@@ -292,4 +1040,96 @@ Generator<std::string> Muxer::operator()(
   }
 }
 
+Task<MuxedFile> Muxer::MuxToFile(
+    AbstractCloudProvider* video_cloud_provider,
+    AbstractCloudProvider::File video_track,
+    AbstractCloudProvider* audio_cloud_provider,
+    AbstractCloudProvider::File audio_track, MediaContainer container,
+    std::shared_ptr<SpillFile> output,
+    std::function<void(const MuxedFileProgress&)> on_written,
+    stdx::stop_token stop_token) const {
+  auto slot = co_await job_scheduler_->Acquire(
+      JobScheduler::Priority::kBackground, video_cloud_provider, stop_token);
+  MuxerProgress progress{.id = jobs_->next_id++,
+                         .video_name = video_track.name,
+                         .audio_name = audio_track.name,
+                         .container = container,
+                         .transcode = false};
+  std::shared_ptr<Input> video;
+  std::shared_ptr<Input> audio;
+  std::tie(video, audio) = co_await WhenAll(
+      OpenInput(event_loop_, thread_pool_, video_cloud_provider,
+                std::move(video_track), AVMEDIA_TYPE_VIDEO, stop_token),
+      OpenInput(event_loop_, thread_pool_, audio_cloud_provider,
+                std::move(audio_track), AVMEDIA_TYPE_AUDIO, stop_token));
+  auto muxer_context = co_await thread_pool_->Do(stop_token, [&] {
+    return MuxerContext(thread_pool_, std::move(video), std::move(audio),
+                        container, /*transcode=*/std::nullopt,
+                        std::move(output), progress, /*on_progress=*/nullptr,
+                        stop_token);
+  });
+  jobs_->progress.emplace(progress.id,
+                          [&] { return muxer_context.GetProgress(); });
+  auto guard = coro::util::AtScopeExit(
+      [&] { jobs_->progress.erase(progress.id); });
+  // The chunks are empty, they only mark the growth of the file.
+  FOR_CO_AWAIT(const std::string& chunk, muxer_context.Mux()) {
+    if (on_written) {
+      on_written(muxer_context.GetFileProgress());
+    }
+  }
+  co_return muxer_context.GetMuxedFile();
+}
+
+Task<std::shared_ptr<SegmentInputs>> Muxer::OpenSegmentInputs(
+    AbstractCloudProvider* video_cloud_provider,
+    AbstractCloudProvider::File video_track,
+    AbstractCloudProvider* audio_cloud_provider,
+    AbstractCloudProvider::File audio_track,
+    stdx::stop_token stop_token) const {
+  auto slot = co_await job_scheduler_->Acquire(
+      JobScheduler::Priority::kStreaming, video_cloud_provider, stop_token);
+  auto inputs = std::make_shared<SegmentInputs>(SegmentInputs{
+      .owner = video_cloud_provider,
+      .video_size = video_track.size.value_or(0),
+      .size = video_track.size.value_or(0) + audio_track.size.value_or(0)});
+  std::tie(inputs->video, inputs->audio) = co_await WhenAll(
+      OpenInput(event_loop_, thread_pool_, video_cloud_provider,
+                std::move(video_track), AVMEDIA_TYPE_VIDEO, stop_token),
+      OpenInput(event_loop_, thread_pool_, audio_cloud_provider,
+                std::move(audio_track), AVMEDIA_TYPE_AUDIO, stop_token));
+  co_return inputs;
+}
+
+Task<SegmentIndex> Muxer::GetSegmentIndex(SegmentInputs& inputs,
+                                          stdx::stop_token stop_token) const {
+  // Only the headers read on open are used, nothing is read from the tracks.
+  co_return co_await thread_pool_->Do(std::move(stop_token), [&] {
+    return CreateSegmentIndex(inputs.video.get(), inputs.audio.get(),
+                              inputs.video_size, inputs.size);
+  });
+}
+
+Task<std::string> Muxer::GetSegment(SegmentInputs& inputs,
+                                    const SegmentIndex& index, size_t segment,
+                                    stdx::stop_token stop_token) const {
+  auto slot = co_await job_scheduler_->Acquire(
+      JobScheduler::Priority::kStreaming, inputs.owner, stop_token);
+  co_return co_await thread_pool_->Do(stop_token, [&] {
+    FragmentedOutput output(inputs.video.get(), inputs.audio.get());
+    // Same as index.init_segment.
+    output.TakeOutput();
+    AVRational time_base{index.time_base_num, index.time_base_den};
+    int64_t segment_size = 0;
+    WriteSegmentPackets(inputs.video.get(), time_base,
+                        index.segments.at(segment), /*is_video=*/true,
+                        &segment_size, &output);
+    WriteSegmentPackets(inputs.audio.get(), time_base,
+                        index.segments.at(segment), /*is_video=*/false,
+                        &segment_size, &output);
+    output.Flush();
+    return output.TakeOutput();
+  });
+}
+
 }  // namespace coro::cloudstorage::util
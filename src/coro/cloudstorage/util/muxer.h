@@ -1,23 +1,144 @@
 #ifndef CORO_CLOUDSTORAGE_FUSE_MUXER_H
 #define CORO_CLOUDSTORAGE_FUSE_MUXER_H
 
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
 #include "coro/cloudstorage/util/abstract_cloud_provider.h"
+#include "coro/cloudstorage/util/file_utils.h"
+#include "coro/cloudstorage/util/job_scheduler.h"
+#include "coro/cloudstorage/util/spill_file.h"
+#include "coro/http/http.h"
 #include "coro/util/thread_pool.h"
 
 namespace coro::cloudstorage::util {
 
-enum class MediaContainer { kMp4, kWebm };
+enum class MediaContainer { kMp4, kWebm, kOgg };
+
+enum class TrackType { kVideo, kAudio };
+
+// Name of the FFmpeg muxer, also used as the file extension.
+std::string_view GetFormatName(MediaContainer container);
+
+// Re-encodes both tracks with fast software encoders: H.264 and AAC for MP4,
+// VP8 and Opus for WebM. Used for inputs the target players can't decode.
+struct TranscodeOptions {
+  // Output video height, inputs which aren't taller are left as is.
+  int max_height = 0;
+  // Decoder and encoder threads per track, 0 picks one per core.
+  int thread_count = 0;
+};
+
+// State of a mux job, updated as its packets are written.
+struct MuxerProgress {
+  int64_t id;
+  std::string video_name;
+  std::string audio_name;
+  MediaContainer container;
+  bool transcode;
+  // Bytes consumed by the demuxers of the tracks.
+  int64_t video_bytes_read = 0;
+  int64_t audio_bytes_read = 0;
+  int64_t packets_written = 0;
+  int64_t bytes_written = 0;
+  // Timestamp of the last written packet and length of the longer track, in
+  // seconds.
+  double position = 0;
+  double duration = 0;
+  double elapsed = 0;
+  // Seconds of media muxed per second of wall time.
+  double realtime_factor = 0;
+  bool done = false;
+};
 
 struct MuxerOptions {
   MediaContainer container;
   bool buffered = true;
+  std::optional<TranscodeOptions> transcode;
+  // Called on the event loop thread at most once per second while muxing and
+  // once the output is complete.
+  std::function<void(const MuxerProgress&)> on_progress;
+  // Slot from Muxer::AcquireSlot. Without it the muxer waits for a slot once
+  // the output is first read, when a rejection can't become an error response
+  // anymore.
+  std::optional<JobScheduler::Slot> slot;
+};
+
+// Output of a seekable mux. MP4 is written as fragments which carry their own
+// index, with an mfra random access index at the end; WebM gets its cues at the
+// end, so arbitrary byte ranges can be served.
+struct MuxedFile {
+  // Ranges have to be bounded while the size isn't known.
+  Generator<std::string> GetContent(http::Range range) const;
+
+  coro::util::ThreadPool* thread_pool;
+  std::shared_ptr<SpillFile> file;
+  // Unset while the output is still being muxed, only the final part of the
+  // file may be read then, see MuxedFileProgress.
+  std::optional<int64_t> size;
+};
+
+// Part of the output of MuxToFile which is written and won't change anymore.
+// MP4 is final as it's written. The WebM header is rewritten with the duration
+// and the cues position once the mux is done, only the clusters after it are
+// final before that.
+struct MuxedFileProgress {
+  int64_t final_begin;
+  int64_t final_end;
 };
 
+// Split of the tracks into fragmented MP4 (CMAF) segments for HLS and DASH.
+// Segments start at video keyframes taken from the container index, so each
+// of them can be muxed on its own without reading the preceding ones.
+struct SegmentIndex {
+  struct Segment {
+    // Timestamps in `time_base` units, the end is exclusive.
+    int64_t start;
+    int64_t end;
+  };
+
+  // Time base of the segment timestamps, in seconds.
+  int time_base_num;
+  int time_base_den;
+  std::vector<Segment> segments;
+  // ftyp + moov, shared by all segments.
+  std::string init_segment;
+  // RFC 6381 codec strings of both tracks, comma separated.
+  std::string codecs;
+  int width;
+  int height;
+  // Estimated from the track sizes, in bits per second.
+  int64_t bandwidth;
+};
+
+// Opened tracks of a segmented output. The segments of a job are cut from the
+// same inputs, one segment at a time, so that the tracks are opened and their
+// headers probed once per job.
+struct SegmentInputs;
+
 class Muxer {
  public:
   Muxer(const coro::util::EventLoop* event_loop,
-        coro::util::ThreadPool* thread_pool)
-      : event_loop_(event_loop), thread_pool_(thread_pool) {}
+        coro::util::ThreadPool* thread_pool, JobScheduler* job_scheduler)
+      : event_loop_(event_loop),
+        thread_pool_(thread_pool),
+        job_scheduler_(job_scheduler) {}
+
+  // Progress of the running operator() and MuxToFile jobs, oldest first. Must
+  // be called on the event loop thread.
+  std::vector<MuxerProgress> GetProgress() const;
+
+  // Waits for a slot for a streamed mux with `options`: remuxes run in the
+  // streaming class, transcodes in the background one. `owner` is the
+  // provider of the (video) track. Throws 503 if too many jobs are queued.
+  Task<JobScheduler::Slot> AcquireSlot(const AbstractCloudProvider* owner,
+                                       const MuxerOptions& options,
+                                       stdx::stop_token stop_token) const;
 
   Generator<std::string> operator()(AbstractCloudProvider* video_cloud_provider,
                                     AbstractCloudProvider::File video_track,
@@ -26,13 +147,55 @@ class Muxer {
                                     MuxerOptions container,
                                     stdx::stop_token stop_token) const;
 
+  // Repackages a single track, e.g. a WebM audio track as Ogg or an MP4 video
+  // track as fragmented MP4, without downloading a second input.
+  Generator<std::string> operator()(AbstractCloudProvider* cloud_provider,
+                                    AbstractCloudProvider::File track,
+                                    TrackType type, MuxerOptions options,
+                                    stdx::stop_token stop_token) const;
+
+  // Muxes the tracks into `output` and returns it once the container is
+  // finalized, so that the size is known and ranges can be served from it.
+  // `on_written` is called on the event loop thread as the output grows, the
+  // reported part of it can be served before that.
+  Task<MuxedFile> MuxToFile(
+      AbstractCloudProvider* video_cloud_provider,
+      AbstractCloudProvider::File video_track,
+      AbstractCloudProvider* audio_cloud_provider,
+      AbstractCloudProvider::File audio_track, MediaContainer container,
+      std::shared_ptr<SpillFile> output,
+      std::function<void(const MuxedFileProgress&)> on_written,
+      stdx::stop_token stop_token) const;
+
+  // Reads of the returned inputs are interrupted by `stop_token` for as long
+  // as they are used, it has to outlive them.
+  Task<std::shared_ptr<SegmentInputs>> OpenSegmentInputs(
+      AbstractCloudProvider* video_cloud_provider,
+      AbstractCloudProvider::File video_track,
+      AbstractCloudProvider* audio_cloud_provider,
+      AbstractCloudProvider::File audio_track,
+      stdx::stop_token stop_token) const;
+
+  Task<SegmentIndex> GetSegmentIndex(SegmentInputs& inputs,
+                                     stdx::stop_token stop_token) const;
+
+  // Returns the moof + mdat pairs of the segment, to be played after the init
+  // segment of `index`.
+  Task<std::string> GetSegment(SegmentInputs& inputs, const SegmentIndex& index,
+                               size_t segment,
+                               stdx::stop_token stop_token) const;
+
  private:
-  template <typename F1, typename F2>
-  auto InParallel(F1&& f1, F2&& f2, stdx::stop_token) const
-      -> std::tuple<decltype(f1()), decltype(f2())>;
+  struct Jobs {
+    int64_t next_id = 0;
+    std::map<int64_t, std::function<MuxerProgress()>> progress;
+  };
 
   const coro::util::EventLoop* event_loop_;
   coro::util::ThreadPool* thread_pool_;
+  JobScheduler* job_scheduler_;
+  // Only accessed on the event loop thread.
+  std::unique_ptr<Jobs> jobs_ = std::make_unique<Jobs>();
 };
 
 }  // namespace coro::cloudstorage::util
@@ -0,0 +1,223 @@
+#include "coro/cloudstorage/util/retrying_cloud_provider.h"
+
+#include <algorithm>
+
+#include "coro/cloudstorage/cloud_exception.h"
+#include "coro/cloudstorage/util/string_utils.h"
+#include "coro/http/http_exception.h"
+
+namespace coro::cloudstorage::util {
+
+bool IsTransientError(const std::exception_ptr& exception) {
+  try {
+    std::rethrow_exception(exception);
+  } catch (const CloudException& e) {
+    return e.type() == CloudException::Type::kRetry;
+  } catch (const http::HttpException& e) {
+    // Statuses below 400 are transport level errors, e.g. a reset connection.
+    return e.status() < 400 || e.status() == 408 || e.status() == 429 ||
+           e.status() >= 500;
+  } catch (...) {
+    return false;
+  }
+}
+
+bool RetryingCloudProvider::IsFileContentSizeRequired(
+    const AbstractCloudProvider::Directory& d) const {
+  return provider_->IsFileContentSizeRequired(d);
+}
+
+std::string_view RetryingCloudProvider::GetId() const {
+  return provider_->GetId();
+}
+
+nlohmann::json RetryingCloudProvider::ToJson(
+    const AbstractCloudProvider::Item& item) const {
+  return provider_->ToJson(item);
+}
+
+AbstractCloudProvider::Item RetryingCloudProvider::ToItem(
+    const nlohmann::json& json) const {
+  return provider_->ToItem(json);
+}
+
+Task<AbstractCloudProvider::Directory> RetryingCloudProvider::GetRoot(
+    stdx::stop_token stop_token) const {
+  return provider_->GetRoot(std::move(stop_token));
+}
+
+Task<AbstractCloudProvider::Item> RetryingCloudProvider::GetItem(
+    std::string id, stdx::stop_token stop_token) const {
+  return provider_->GetItem(std::move(id), std::move(stop_token));
+}
+
+Task<AbstractCloudProvider::PageData> RetryingCloudProvider::ListDirectoryPage(
+    AbstractCloudProvider::Directory directory,
+    std::optional<std::string> page_token, stdx::stop_token stop_token) const {
+  return provider_->ListDirectoryPage(
+      std::move(directory), std::move(page_token), std::move(stop_token));
+}
+
+Task<AbstractCloudProvider::GeneralData> RetryingCloudProvider::GetGeneralData(
+    stdx::stop_token stop_token) const {
+  return provider_->GetGeneralData(std::move(stop_token));
+}
+
+Generator<std::string> RetryingCloudProvider::GetFileContent(
+    AbstractCloudProvider::File file, http::Range range,
+    stdx::stop_token stop_token) const {
+  // An end past the end of the file would make the complete stream look
+  // short, and the request for the rest would fail with 416.
+  std::optional<int64_t> range_end = range.end;
+  if (range_end && file.size && *file.size > 0) {
+    range_end = std::min<int64_t>(*range_end, *file.size - 1);
+  }
+  std::optional<int64_t> end;
+  if (range_end) {
+    end = *range_end + 1;
+  } else if (file.size) {
+    end = *file.size;
+  }
+  std::optional<ContentHasher> hasher;
+  if (config_.verify_content_hash && file.content_hash && range.start == 0 &&
+      (!range_end || (file.size && *range_end + 1 == *file.size))) {
+    hasher.emplace(file.content_hash->type);
+  }
+  int64_t position = range.start;
+  int retry_count = 0;
+  int backoff_ms = 0;
+  while (true) {
+    if (backoff_ms > 0) {
+      co_await event_loop_->Wait(backoff_ms, stop_token);
+    }
+    int64_t attempt_start = position;
+    std::exception_ptr exception;
+    try {
+      auto generator = provider_->GetFileContent(
+          file, http::Range{.start = position, .end = range_end}, stop_token);
+      FOR_CO_AWAIT(std::string & chunk, generator) {
+        if (!chunk.empty()) {
+          position += static_cast<int64_t>(chunk.size());
+          retry_count = 0;
+          backoff_ms = 0;
+        }
+        if (hasher) {
+          hasher->Update(chunk);
+        }
+        co_yield std::move(chunk);
+      }
+    } catch (...) {
+      exception = std::current_exception();
+    }
+    if (exception) {
+      if (stop_token.stop_requested() || !IsTransientError(exception)) {
+        std::rethrow_exception(exception);
+      }
+    } else if (!end || position >= *end || position == attempt_start) {
+      // Either the whole range was delivered or the upstream has nothing more
+      // to give; a short stream that made no progress is not retried.
+      break;
+    }
+    if (++retry_count > config_.max_retry_count) {
+      if (exception) {
+        std::rethrow_exception(exception);
+      }
+      throw CloudException("Upstream content stream ended prematurely.");
+    }
+    backoff_ms = std::min(std::max(backoff_ms * 2, config_.initial_backoff_ms),
+                          config_.max_backoff_ms);
+  }
+  if (hasher) {
+    auto hash = std::move(*hasher).Finalize();
+    if (hash != *file.content_hash) {
+      throw CloudException(StrCat("Content hash mismatch for ", file.id,
+                                  ": expected ", file.content_hash->value,
+                                  ", got ", hash.value, "."));
+    }
+  }
+}
+
+Task<AbstractCloudProvider::File> RetryingCloudProvider::RenameItem(
+    AbstractCloudProvider::File item, std::string new_name,
+    stdx::stop_token stop_token) const {
+  return provider_->RenameItem(std::move(item), std::move(new_name),
+                               std::move(stop_token));
+}
+
+Task<AbstractCloudProvider::Directory> RetryingCloudProvider::RenameItem(
+    AbstractCloudProvider::Directory item, std::string new_name,
+    stdx::stop_token stop_token) const {
+  return provider_->RenameItem(std::move(item), std::move(new_name),
+                               std::move(stop_token));
+}
+
+Task<AbstractCloudProvider::Directory> RetryingCloudProvider::CreateDirectory(
+    AbstractCloudProvider::Directory parent, std::string name,
+    stdx::stop_token stop_token) const {
+  return provider_->CreateDirectory(std::move(parent), std::move(name),
+                                    std::move(stop_token));
+}
+
+Task<> RetryingCloudProvider::RemoveItem(AbstractCloudProvider::Directory item,
+                                         stdx::stop_token stop_token) const {
+  return provider_->RemoveItem(std::move(item), std::move(stop_token));
+}
+
+Task<> RetryingCloudProvider::RemoveItem(AbstractCloudProvider::File item,
+                                         stdx::stop_token stop_token) const {
+  return provider_->RemoveItem(std::move(item), std::move(stop_token));
+}
+
+Task<AbstractCloudProvider::File> RetryingCloudProvider::MoveItem(
+    AbstractCloudProvider::File source,
+    AbstractCloudProvider::Directory destination,
+    stdx::stop_token stop_token) const {
+  return provider_->MoveItem(std::move(source), std::move(destination),
+                             std::move(stop_token));
+}
+
+Task<AbstractCloudProvider::Directory> RetryingCloudProvider::MoveItem(
+    AbstractCloudProvider::Directory source,
+    AbstractCloudProvider::Directory destination,
+    stdx::stop_token stop_token) const {
+  return provider_->MoveItem(std::move(source), std::move(destination),
+                             std::move(stop_token));
+}
+
+Task<AbstractCloudProvider::File> RetryingCloudProvider::CreateFile(
+    AbstractCloudProvider::Directory parent, std::string name,
+    AbstractCloudProvider::FileContent content,
+    stdx::stop_token stop_token) const {
+  return provider_->CreateFile(std::move(parent), std::move(name),
+                               std::move(content), std::move(stop_token));
+}
+
+Task<AbstractCloudProvider::Thumbnail> RetryingCloudProvider::GetItemThumbnail(
+    AbstractCloudProvider::File item, http::Range range,
+    stdx::stop_token stop_token) const {
+  return provider_->GetItemThumbnail(std::move(item), range,
+                                     std::move(stop_token));
+}
+
+Task<AbstractCloudProvider::Thumbnail> RetryingCloudProvider::GetItemThumbnail(
+    AbstractCloudProvider::Directory item, http::Range range,
+    stdx::stop_token stop_token) const {
+  return provider_->GetItemThumbnail(std::move(item), range,
+                                     std::move(stop_token));
+}
+
+Task<AbstractCloudProvider::Thumbnail> RetryingCloudProvider::GetItemThumbnail(
+    AbstractCloudProvider::File item, ThumbnailQuality quality,
+    http::Range range, stdx::stop_token stop_token) const {
+  return provider_->GetItemThumbnail(std::move(item), quality, range,
+                                     std::move(stop_token));
+}
+
+Task<AbstractCloudProvider::Thumbnail> RetryingCloudProvider::GetItemThumbnail(
+    AbstractCloudProvider::Directory item, ThumbnailQuality quality,
+    http::Range range, stdx::stop_token stop_token) const {
+  return provider_->GetItemThumbnail(std::move(item), quality, range,
+                                     std::move(stop_token));
+}
+
+}  // namespace coro::cloudstorage::util
@@ -0,0 +1,125 @@
+#ifndef CORO_CLOUDSTORAGE_UTIL_RETRYING_CLOUD_PROVIDER_H
+#define CORO_CLOUDSTORAGE_UTIL_RETRYING_CLOUD_PROVIDER_H
+
+#include <exception>
+#include <memory>
+
+#include "coro/cloudstorage/util/abstract_cloud_provider.h"
+#include "coro/util/event_loop.h"
+
+namespace coro::cloudstorage::util {
+
+// Makes file content streams survive transient upstream failures. When the
+// underlying stream throws a transient error or ends before the requested
+// range was delivered, GetFileContent is re-issued for the remaining bytes
+// with exponential backoff. Consecutive failures without any progress are
+// limited by the retry budget.
+//
+// Full file downloads of files with a provider reported content hash are
+// additionally verified against that hash, across all retries.
+class RetryingCloudProvider : public AbstractCloudProvider {
+ public:
+  struct Config {
+    int max_retry_count = 5;
+    int initial_backoff_ms = 100;
+    int max_backoff_ms = 10000;
+    bool verify_content_hash = true;
+  };
+
+  RetryingCloudProvider(const coro::util::EventLoop* event_loop, Config config,
+                        std::unique_ptr<AbstractCloudProvider> provider)
+      : event_loop_(event_loop),
+        config_(config),
+        provider_(std::move(provider)) {}
+
+  RetryingCloudProvider(const coro::util::EventLoop* event_loop,
+                        std::unique_ptr<AbstractCloudProvider> provider)
+      : RetryingCloudProvider(event_loop, Config(), std::move(provider)) {}
+
+  bool IsFileContentSizeRequired(
+      const AbstractCloudProvider::Directory& d) const override;
+
+  std::string_view GetId() const override;
+
+  nlohmann::json ToJson(const AbstractCloudProvider::Item& item) const override;
+
+  AbstractCloudProvider::Item ToItem(const nlohmann::json&) const override;
+
+  Task<AbstractCloudProvider::Directory> GetRoot(
+      stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::Item> GetItem(std::string id,
+                                            stdx::stop_token) const override;
+
+  Task<AbstractCloudProvider::PageData> ListDirectoryPage(
+      AbstractCloudProvider::Directory directory,
+      std::optional<std::string> page_token,
+      stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::GeneralData> GetGeneralData(
+      stdx::stop_token stop_token) const override;
+
+  Generator<std::string> GetFileContent(
+      AbstractCloudProvider::File file, http::Range range,
+      stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::File> RenameItem(
+      AbstractCloudProvider::File item, std::string new_name,
+      stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::Directory> RenameItem(
+      AbstractCloudProvider::Directory item, std::string new_name,
+      stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::Directory> CreateDirectory(
+      AbstractCloudProvider::Directory parent, std::string name,
+      stdx::stop_token stop_token) const override;
+
+  Task<> RemoveItem(AbstractCloudProvider::Directory item,
+                    stdx::stop_token stop_token) const override;
+
+  Task<> RemoveItem(AbstractCloudProvider::File item,
+                    stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::File> MoveItem(
+      AbstractCloudProvider::File source,
+      AbstractCloudProvider::Directory destination,
+      stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::Directory> MoveItem(
+      AbstractCloudProvider::Directory source,
+      AbstractCloudProvider::Directory destination,
+      stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::File> CreateFile(
+      AbstractCloudProvider::Directory parent, std::string name,
+      AbstractCloudProvider::FileContent content,
+      stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::Thumbnail> GetItemThumbnail(
+      AbstractCloudProvider::File item, http::Range range,
+      stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::Thumbnail> GetItemThumbnail(
+      AbstractCloudProvider::Directory item, http::Range range,
+      stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::Thumbnail> GetItemThumbnail(
+      AbstractCloudProvider::File item, ThumbnailQuality, http::Range range,
+      stdx::stop_token stop_token) const override;
+
+  Task<AbstractCloudProvider::Thumbnail> GetItemThumbnail(
+      AbstractCloudProvider::Directory item, ThumbnailQuality,
+      http::Range range, stdx::stop_token stop_token) const override;
+
+ private:
+  const coro::util::EventLoop* event_loop_;
+  Config config_;
+  std::unique_ptr<AbstractCloudProvider> provider_;
+};
+
+bool IsTransientError(const std::exception_ptr& exception);
+
+}  // namespace coro::cloudstorage::util
+
+#endif  // CORO_CLOUDSTORAGE_UTIL_RETRYING_CLOUD_PROVIDER_H
@@ -0,0 +1,206 @@
+#include "coro/cloudstorage/util/segment_cache.h"
+
+#include <utility>
+
+#include "coro/cloudstorage/cloud_exception.h"
+#include "coro/cloudstorage/util/string_utils.h"
+#include "coro/util/stop_token_or.h"
+
+namespace coro::cloudstorage::util {
+
+namespace {
+
+using ::coro::util::MakeUniqueStopTokenOr;
+
+std::string GetKey(const CloudProviderAccount& video_account,
+                   const AbstractCloudProvider::File& video_track,
+                   const CloudProviderAccount& audio_account,
+                   const AbstractCloudProvider::File& audio_track) {
+  return StrCat(video_account.type(), '\n', video_account.username(), '\n',
+                video_track.id, '\n', video_track.timestamp.value_or(-1), '\n',
+                audio_account.type(), '\n', audio_account.username(), '\n',
+                audio_track.id, '\n', audio_track.timestamp.value_or(-1));
+}
+
+}  // namespace
+
+SegmentCache::SegmentCache(const Muxer* muxer, Config config)
+    : muxer_(muxer), config_(config) {}
+
+SegmentCache::~SegmentCache() { stop_source_.request_stop(); }
+
+template <typename Job, typename T>
+Task<std::shared_ptr<const T>> SegmentCache::Get(
+    std::map<std::string, Entry<Job, T>>& entries, Job job,
+    stdx::stop_token stop_token) {
+  auto it = entries.find(job.key);
+  if (it == entries.end()) {
+    it = entries.emplace(job.key, Entry<Job, T>{}).first;
+    it->second.job.emplace(std::move(job));
+  }
+  if (it->second.job) {
+    co_return co_await it->second.job->Get(std::move(stop_token));
+  }
+  lru_.splice(lru_.begin(), lru_, it->second.lru_position);
+  co_return it->second.value;
+}
+
+template <typename Job, typename T>
+void SegmentCache::OnDone(std::map<std::string, Entry<Job, T>>& entries,
+                          bool is_segment, const std::string& key,
+                          std::shared_ptr<const T> value, int64_t size) {
+  auto it = entries.find(key);
+  if (it == entries.end()) {
+    return;
+  }
+  if (size > config_.max_size) {
+    // Handed to the waiting requests only, caching it would evict everything
+    // else and still exceed the budget.
+    entries.erase(it);
+    return;
+  }
+  lru_.push_front(LruKey{.is_segment = is_segment, .key = key});
+  it->second.value = std::move(value);
+  it->second.size = size;
+  it->second.lru_position = lru_.begin();
+  it->second.job = std::nullopt;
+  size_ += size;
+  Evict();
+}
+
+Task<std::shared_ptr<const SegmentIndex>> SegmentCache::GetIndex(
+    CloudProviderAccount video_account, AbstractCloudProvider::File video_track,
+    CloudProviderAccount audio_account, AbstractCloudProvider::File audio_track,
+    stdx::stop_token stop_token) {
+  std::string key =
+      GetKey(video_account, video_track, audio_account, audio_track);
+  return Get(indexes_,
+             IndexJob{.d = this,
+                      .key = std::move(key),
+                      .video_account = std::move(video_account),
+                      .video_track = std::move(video_track),
+                      .audio_account = std::move(audio_account),
+                      .audio_track = std::move(audio_track)},
+             std::move(stop_token));
+}
+
+Task<std::shared_ptr<const std::string>> SegmentCache::GetSegment(
+    CloudProviderAccount video_account, AbstractCloudProvider::File video_track,
+    CloudProviderAccount audio_account, AbstractCloudProvider::File audio_track,
+    size_t segment, stdx::stop_token stop_token) {
+  auto index = co_await GetIndex(video_account, video_track, audio_account,
+                                 audio_track, stop_token);
+  if (segment >= index->segments.size()) {
+    throw CloudException(CloudException::Type::kNotFound);
+  }
+  std::string index_key =
+      GetKey(video_account, video_track, audio_account, audio_track);
+  std::string key = StrCat(index_key, '\n', segment);
+  co_return co_await Get(segments_,
+                         SegmentJob{.d = this,
+                                    .key = std::move(key),
+                                    .video_account = std::move(video_account),
+                                    .video_track = std::move(video_track),
+                                    .audio_account = std::move(audio_account),
+                                    .audio_track = std::move(audio_track),
+                                    .index_key = std::move(index_key),
+                                    .index = std::move(index),
+                                    .segment = segment},
+                         std::move(stop_token));
+}
+
+Task<std::shared_ptr<const SegmentIndex>> SegmentCache::IndexJob::operator()()
+    const {
+  // The job is destroyed once it's done, keep what's needed afterwards.
+  SegmentCache* cache = d;
+  std::string entry_key = key;
+  try {
+    CachedInputs inputs = co_await cache->OpenInputs(
+        video_account, video_track, audio_account, audio_track);
+    auto index = std::make_shared<const SegmentIndex>(
+        co_await cache->muxer_->GetSegmentIndex(*inputs.inputs,
+                                                inputs.stop_token));
+    int64_t size = static_cast<int64_t>(
+        index->init_segment.size() +
+        index->segments.size() * sizeof(SegmentIndex::Segment));
+    cache->OnDone(cache->indexes_, /*is_segment=*/false, entry_key, index,
+                  size);
+    if (cache->indexes_.contains(entry_key)) {
+      cache->inputs_.insert_or_assign(entry_key, std::move(inputs));
+    }
+    co_return index;
+  } catch (...) {
+    cache->indexes_.erase(entry_key);
+    throw;
+  }
+}
+
+Task<std::shared_ptr<const std::string>> SegmentCache::SegmentJob::operator()()
+    const {
+  SegmentCache* cache = d;
+  std::string entry_key = key;
+  std::string inputs_key = index_key;
+  try {
+    // Taken out of the cache while in use, concurrent segment jobs of the
+    // same output open their own inputs.
+    std::optional<CachedInputs> inputs;
+    if (auto it = cache->inputs_.find(inputs_key);
+        it != cache->inputs_.end()) {
+      inputs = std::move(it->second);
+      cache->inputs_.erase(it);
+    } else {
+      inputs = co_await cache->OpenInputs(video_account, video_track,
+                                          audio_account, audio_track);
+    }
+    auto content =
+        std::make_shared<const std::string>(co_await cache->muxer_->GetSegment(
+            *inputs->inputs, *index, segment, inputs->stop_token));
+    if (cache->indexes_.contains(inputs_key)) {
+      cache->inputs_.try_emplace(inputs_key, std::move(*inputs));
+    }
+    cache->OnDone(cache->segments_, /*is_segment=*/true, entry_key, content,
+                  static_cast<int64_t>(content->size()));
+    co_return content;
+  } catch (...) {
+    cache->segments_.erase(entry_key);
+    throw;
+  }
+}
+
+Task<SegmentCache::CachedInputs> SegmentCache::OpenInputs(
+    const CloudProviderAccount& video_account,
+    AbstractCloudProvider::File video_track,
+    const CloudProviderAccount& audio_account,
+    AbstractCloudProvider::File audio_track) {
+  auto stop_token_or = MakeUniqueStopTokenOr(stop_source_.get_token(),
+                                             video_account.stop_token(),
+                                             audio_account.stop_token());
+  stdx::stop_token stop_token = stop_token_or->GetToken();
+  auto inputs = co_await muxer_->OpenSegmentInputs(
+      video_account.provider().get(), std::move(video_track),
+      audio_account.provider().get(), std::move(audio_track), stop_token);
+  co_return CachedInputs{.inputs = std::move(inputs),
+                         .video_account = video_account,
+                         .audio_account = audio_account,
+                         .stop_token_or = std::move(stop_token_or),
+                         .stop_token = std::move(stop_token)};
+}
+
+void SegmentCache::Evict() {
+  while (size_ > config_.max_size && lru_.size() > 1) {
+    const LruKey& key = lru_.back();
+    if (key.is_segment) {
+      auto it = segments_.find(key.key);
+      size_ -= it->second.size;
+      segments_.erase(it);
+    } else {
+      auto it = indexes_.find(key.key);
+      size_ -= it->second.size;
+      indexes_.erase(it);
+      inputs_.erase(key.key);
+    }
+    lru_.pop_back();
+  }
+}
+
+}  // namespace coro::cloudstorage::util
@@ -0,0 +1,132 @@
+#ifndef CORO_CLOUDSTORAGE_UTIL_SEGMENT_CACHE_H
+#define CORO_CLOUDSTORAGE_UTIL_SEGMENT_CACHE_H
+
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "coro/cloudstorage/util/abstract_cloud_provider.h"
+#include "coro/cloudstorage/util/cloud_provider_account.h"
+#include "coro/cloudstorage/util/muxer.h"
+#include "coro/shared_promise.h"
+#include "coro/stdx/stop_source.h"
+#include "coro/stdx/stop_token.h"
+#include "coro/task.h"
+
+namespace coro::cloudstorage::util {
+
+// Keeps segment indexes and segments of segmented (HLS / DASH) mux outputs in
+// memory. Segments are muxed on first request, concurrent requests for the
+// same index or segment share a single job. Least recently used entries are
+// dropped once the total size exceeds the budget.
+//
+// The inputs opened for the index are kept with it until it's evicted and are
+// reused by the segment jobs, a segment job which finds them in use opens its
+// own ones.
+class SegmentCache {
+ public:
+  struct Config {
+    int64_t max_size;
+  };
+
+  SegmentCache(const Muxer* muxer, Config config);
+  SegmentCache(const SegmentCache&) = delete;
+  SegmentCache(SegmentCache&&) = delete;
+  SegmentCache& operator=(const SegmentCache&) = delete;
+  SegmentCache& operator=(SegmentCache&&) = delete;
+  ~SegmentCache();
+
+  Task<std::shared_ptr<const SegmentIndex>> GetIndex(
+      CloudProviderAccount video_account,
+      AbstractCloudProvider::File video_track,
+      CloudProviderAccount audio_account,
+      AbstractCloudProvider::File audio_track, stdx::stop_token stop_token);
+
+  Task<std::shared_ptr<const std::string>> GetSegment(
+      CloudProviderAccount video_account,
+      AbstractCloudProvider::File video_track,
+      CloudProviderAccount audio_account,
+      AbstractCloudProvider::File audio_track, size_t segment,
+      stdx::stop_token stop_token);
+
+ private:
+  struct IndexJob {
+    Task<std::shared_ptr<const SegmentIndex>> operator()() const;
+
+    SegmentCache* d;
+    std::string key;
+    CloudProviderAccount video_account;
+    AbstractCloudProvider::File video_track;
+    CloudProviderAccount audio_account;
+    AbstractCloudProvider::File audio_track;
+  };
+
+  struct SegmentJob {
+    Task<std::shared_ptr<const std::string>> operator()() const;
+
+    SegmentCache* d;
+    std::string key;
+    CloudProviderAccount video_account;
+    AbstractCloudProvider::File video_track;
+    CloudProviderAccount audio_account;
+    AbstractCloudProvider::File audio_track;
+    std::string index_key;
+    std::shared_ptr<const SegmentIndex> index;
+    size_t segment;
+  };
+
+  struct CachedInputs {
+    std::shared_ptr<SegmentInputs> inputs;
+    // The inputs read through the providers of the accounts.
+    CloudProviderAccount video_account;
+    CloudProviderAccount audio_account;
+    // Interrupts the reads of the inputs once the cache or either account is
+    // stopped. Owns the stop state of `stop_token`.
+    std::shared_ptr<void> stop_token_or;
+    stdx::stop_token stop_token;
+  };
+
+  struct LruKey {
+    bool is_segment;
+    std::string key;
+  };
+
+  template <typename Job, typename T>
+  struct Entry {
+    // Reset once the job finishes.
+    std::optional<SharedPromise<Job>> job;
+    std::shared_ptr<const T> value;
+    int64_t size = 0;
+    std::list<LruKey>::iterator lru_position;
+  };
+
+  template <typename Job, typename T>
+  Task<std::shared_ptr<const T>> Get(std::map<std::string, Entry<Job, T>>&,
+                                     Job job, stdx::stop_token);
+  template <typename Job, typename T>
+  void OnDone(std::map<std::string, Entry<Job, T>>&, bool is_segment,
+              const std::string& key, std::shared_ptr<const T> value,
+              int64_t size);
+  void Evict();
+  Task<CachedInputs> OpenInputs(const CloudProviderAccount& video_account,
+                                AbstractCloudProvider::File video_track,
+                                const CloudProviderAccount& audio_account,
+                                AbstractCloudProvider::File audio_track);
+
+  const Muxer* muxer_;
+  Config config_;
+  std::map<std::string, Entry<IndexJob, SegmentIndex>> indexes_;
+  std::map<std::string, Entry<SegmentJob, std::string>> segments_;
+  // Idle inputs of the cached indexes.
+  std::map<std::string, CachedInputs> inputs_;
+  // Finished entries, most recently used first.
+  std::list<LruKey> lru_;
+  int64_t size_ = 0;
+  stdx::stop_source stop_source_;
+};
+
+}  // namespace coro::cloudstorage::util
+
+#endif  // CORO_CLOUDSTORAGE_UTIL_SEGMENT_CACHE_H
@@ -0,0 +1,151 @@
+#include "coro/cloudstorage/util/spill_file.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <utility>
+
+#include "coro/cloudstorage/util/string_utils.h"
+#include "coro/exception.h"
+
+#ifdef WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace coro::cloudstorage::util {
+
+namespace {
+
+#ifdef WIN32
+
+HANDLE GetHandle(std::FILE* file) {
+  return reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file)));
+}
+
+OVERLAPPED GetOverlapped(int64_t offset) {
+  OVERLAPPED overlapped{};
+  overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+  overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+  return overlapped;
+}
+
+int64_t WriteAt(std::FILE* file, const char* data, size_t size,
+                int64_t offset) {
+  OVERLAPPED overlapped = GetOverlapped(offset);
+  DWORD written;
+  if (!::WriteFile(GetHandle(file), data,
+                   static_cast<DWORD>(std::min<size_t>(size, MAXDWORD)),
+                   &written, &overlapped)) {
+    return -1;
+  }
+  return written;
+}
+
+int64_t ReadAt(std::FILE* file, char* data, size_t size, int64_t offset) {
+  OVERLAPPED overlapped = GetOverlapped(offset);
+  DWORD read;
+  if (!::ReadFile(GetHandle(file), data,
+                  static_cast<DWORD>(std::min<size_t>(size, MAXDWORD)), &read,
+                  &overlapped)) {
+    return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+  }
+  return read;
+}
+
+#else
+
+int64_t WriteAt(std::FILE* file, const char* data, size_t size,
+                int64_t offset) {
+  int64_t written;
+  do {
+    written = pwrite(fileno(file), data, size, offset);
+  } while (written < 0 && errno == EINTR);
+  return written;
+}
+
+int64_t ReadAt(std::FILE* file, char* data, size_t size, int64_t offset) {
+  int64_t read;
+  do {
+    read = pread(fileno(file), data, size, offset);
+  } while (read < 0 && errno == EINTR);
+  return read;
+}
+
+#endif
+
+}  // namespace
+
+SpillFile::SpillFile(std::unique_ptr<std::FILE, FileDeleter> file)
+    : file_(std::move(file)) {
+  if (!file_) {
+    throw RuntimeError("spill file not open");
+  }
+}
+
+void SpillFile::Write(int64_t offset, std::string_view data) const {
+  while (!data.empty()) {
+    int64_t written = WriteAt(file_.get(), data.data(), data.size(), offset);
+    if (written < 0) {
+      throw RuntimeError(StrCat("write failed at ", offset, ": ",
+                                ErrorToString(errno)));
+    }
+    data.remove_prefix(static_cast<size_t>(written));
+    offset += written;
+  }
+}
+
+std::string SpillFile::Read(int64_t offset, size_t size) const {
+  std::string buffer(size, 0);
+  size_t total = 0;
+  while (total < size) {
+    int64_t read = ReadAt(file_.get(), buffer.data() + total, size - total,
+                          offset + static_cast<int64_t>(total));
+    if (read < 0) {
+      throw RuntimeError(
+          StrCat("read failed at ", offset, ": ", ErrorToString(errno)));
+    }
+    if (read == 0) {
+      break;
+    }
+    total += static_cast<size_t>(read);
+  }
+  buffer.resize(total);
+  return buffer;
+}
+
+int64_t SpillFile::GetSize() const {
+#ifdef WIN32
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(GetHandle(file_.get()), &size)) {
+    throw RuntimeError("GetFileSizeEx failed");
+  }
+  return size.QuadPart;
+#else
+  struct stat st;
+  if (fstat(fileno(file_.get()), &st) != 0) {
+    throw RuntimeError(StrCat("fstat failed: ", ErrorToString(errno)));
+  }
+  return st.st_size;
+#endif
+}
+
+Generator<std::string> SpillFile::GetContent(
+    coro::util::ThreadPool* thread_pool, int64_t offset, int64_t size) const {
+  while (size > 0) {
+    auto batch_size = static_cast<size_t>(
+        std::min<int64_t>(size, static_cast<int64_t>(kBufferSize)));
+    std::string chunk = co_await thread_pool->Do(
+        [&] { return Read(offset, batch_size); });
+    if (chunk.size() != batch_size) {
+      throw RuntimeError("unexpected end of spill file");
+    }
+    offset += static_cast<int64_t>(batch_size);
+    size -= static_cast<int64_t>(batch_size);
+    co_yield std::move(chunk);
+  }
+}
+
+}  // namespace coro::cloudstorage::util
@@ -0,0 +1,45 @@
+#ifndef CORO_CLOUDSTORAGE_UTIL_SPILL_FILE_H
+#define CORO_CLOUDSTORAGE_UTIL_SPILL_FILE_H
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "coro/cloudstorage/util/file_utils.h"
+#include "coro/generator.h"
+#include "coro/util/thread_pool.h"
+
+namespace coro::cloudstorage::util {
+
+// File used for spilling large outputs to disk. All reads and writes happen at
+// explicit offsets (pread / pwrite), so there is no shared file position and
+// concurrent readers don't need to be serialized. The stdio stream is only
+// used to own the file, it's never read from or written to.
+class SpillFile {
+ public:
+  // Size of the write buffer callers should gather data in, and of the batches
+  // GetContent reads with.
+  static constexpr size_t kBufferSize = 1024 * 1024;
+
+  explicit SpillFile(std::unique_ptr<std::FILE, FileDeleter> file);
+
+  void Write(int64_t offset, std::string_view data) const;
+
+  // Returns less than `size` bytes only if the end of file was reached.
+  std::string Read(int64_t offset, size_t size) const;
+
+  int64_t GetSize() const;
+
+  // Reads `size` bytes starting at `offset` with one thread pool hop per
+  // kBufferSize batch.
+  Generator<std::string> GetContent(coro::util::ThreadPool* thread_pool,
+                                    int64_t offset, int64_t size) const;
+
+ private:
+  std::unique_ptr<std::FILE, FileDeleter> file_;
+};
+
+}  // namespace coro::cloudstorage::util
+
+#endif  // CORO_CLOUDSTORAGE_UTIL_SPILL_FILE_H
@@ -9,19 +9,31 @@ extern "C" {
 #include <libavutil/avutil.h>
 #include <libavutil/display.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
 #include <libswscale/swscale.h>
 }
 
+#include <algorithm>
 #include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
 #include "coro/cloudstorage/util/avio_context.h"
+#include "coro/cloudstorage/util/exif_utils.h"
 #include "coro/cloudstorage/util/ffmpeg_utils.h"
+#include "coro/cloudstorage/util/luma_utils.h"
 #include "coro/cloudstorage/util/string_utils.h"
+#include "coro/generator.h"
 #include "coro/util/raii_utils.h"
+#include "coro/when_all.h"
 
 namespace coro::cloudstorage::util {
 
@@ -34,10 +46,6 @@ struct ImageSize {
   int height;
 };
 
-struct AVFrameDeleter {
-  void operator()(AVFrame* frame) const { av_frame_free(&frame); }
-};
-
 struct AVFrameConvertedDeleter {
   void operator()(AVFrame* frame) const {
     av_freep(&frame->data);
@@ -45,10 +53,68 @@ struct AVFrameConvertedDeleter {
   }
 };
 
-struct SwsContextDeleter {
-  void operator()(SwsContext* context) const { sws_freeContext(context); }
+struct AVIOMemoryContextDeleter {
+  void operator()(AVIOContext* context) const {
+    av_free(context->buffer);
+    avio_context_free(&context);
+  }
+};
+
+struct MemoryInput {
+  std::string_view data;
+  int64_t position = 0;
 };
 
+auto CreateMemoryIOContext(MemoryInput* input) {
+  const int kBufferSize = 4 * 1024;
+  auto* buffer = static_cast<uint8_t*>(av_malloc(kBufferSize));
+  if (!buffer) {
+    throw RuntimeError("av_malloc");
+  }
+  std::unique_ptr<AVIOContext, AVIOMemoryContextDeleter> io_context(
+      avio_alloc_context(
+          buffer, kBufferSize, /*write_flag=*/0, input,
+          [](void* opaque, uint8_t* buf, int buf_size) -> int {
+            auto* input = reinterpret_cast<MemoryInput*>(opaque);
+            auto size = std::min<int64_t>(
+                buf_size,
+                static_cast<int64_t>(input->data.size()) - input->position);
+            if (size <= 0) {
+              return AVERROR_EOF;
+            }
+            memcpy(buf, input->data.data() + input->position,
+                   static_cast<size_t>(size));
+            input->position += size;
+            return static_cast<int>(size);
+          },
+          /*write_packet=*/nullptr,
+          [](void* opaque, int64_t offset, int whence) -> int64_t {
+            auto* input = reinterpret_cast<MemoryInput*>(opaque);
+            auto size = static_cast<int64_t>(input->data.size());
+            switch (whence & ~AVSEEK_FORCE) {
+              case AVSEEK_SIZE:
+                return size;
+              case SEEK_SET:
+                input->position = offset;
+                break;
+              case SEEK_CUR:
+                input->position += offset;
+                break;
+              case SEEK_END:
+                input->position = size + offset;
+                break;
+              default:
+                return AVERROR(EINVAL);
+            }
+            return input->position;
+          }));
+  if (!io_context) {
+    av_free(buffer);
+    throw RuntimeError("avio_alloc_context");
+  }
+  return io_context;
+}
+
 struct AVFilterContextDeleter {
   void operator()(AVFilterContext* filter) const { avfilter_free(filter); }
 };
@@ -210,6 +276,18 @@ auto DecodeFrame(AVFormatContext* context, AVCodecContext* codec_context,
   return result_frame;
 }
 
+// Picks how many times the decoder may halve the image while it stays at
+// least twice the thumbnail size, so the scale filter still has detail to
+// work with. Decoders which support it (MJPEG) then skip most of the IDCT
+// work and allocate a fraction of the full-resolution frame.
+int GetLowres(ImageSize i, int target) {
+  int lowres = 0;
+  while (std::max(i.width, i.height) >> (lowres + 1) >= 2 * target) {
+    lowres++;
+  }
+  return lowres;
+}
+
 ImageSize GetThumbnailSize(ImageSize i, int target) {
   if (i.width == 0 || i.height == 0) {
     return {target, target};
@@ -221,6 +299,23 @@ ImageSize GetThumbnailSize(ImageSize i, int target) {
   }
 }
 
+std::unique_ptr<AVFrame, AVFrameDeleter> ScaleFrame(const AVFrame* frame,
+                                                   int target) {
+  auto size = GetThumbnailSize({frame->width, frame->height}, target);
+  Graph graph =
+      std::move(GraphBuilder(frame).AddFilter(
+                    "scale", {{"width", std::to_string(size.width)},
+                              {"height", std::to_string(size.height)}}))
+          .Build();
+  graph.WriteFrame(frame);
+  graph.WriteFrame(nullptr);
+  auto received_frame = graph.PullFrame();
+  if (!received_frame || *received_frame == nullptr) {
+    throw LogicError("Couldn't extract any frame.");
+  }
+  return std::move(*received_frame);
+}
+
 auto RotateFrame(std::unique_ptr<AVFrame, AVFrameDeleter> frame,
                  int orientation) {
   if (orientation == 1) {
@@ -258,11 +353,15 @@ auto RotateFrame(std::unique_ptr<AVFrame, AVFrameDeleter> frame,
 }
 
 auto ConvertFrame(const AVFrame* frame, AVPixelFormat format) {
-  std::unique_ptr<SwsContext, SwsContextDeleter> sws_context(sws_getContext(
-      frame->width, frame->height, AVPixelFormat(frame->format), frame->width,
-      frame->height, format, SWS_BICUBIC, nullptr, nullptr, nullptr));
+  // Consecutive thumbnails on a thread usually convert between the same
+  // formats and sizes, sws_getCachedContext keeps the context then.
+  thread_local std::unique_ptr<SwsContext, SwsContextDeleter> sws_context;
+  sws_context.reset(sws_getCachedContext(
+      sws_context.release(), frame->width, frame->height,
+      AVPixelFormat(frame->format), frame->width, frame->height, format,
+      SWS_BICUBIC, nullptr, nullptr, nullptr));
   if (!sws_context) {
-    throw RuntimeError("sws_getContext returned null");
+    throw RuntimeError("sws_getCachedContext returned null");
   }
   std::unique_ptr<AVFrame, AVFrameConvertedDeleter> target_frame(
       av_frame_alloc());
@@ -298,18 +397,156 @@ auto ConvertFrame(const AVFrame* frame, const AVCodec* codec) {
   return ConvertFrame(frame, format);
 }
 
-std::string EncodeFrame(std::unique_ptr<AVFrame, AVFrameDeleter> input_frame,
-                        ThumbnailOptions options,
-                        std::atomic_bool* interrupted) {
-  auto* codec = avcodec_find_encoder(
-      options.codec == ThumbnailOptions::Codec::JPEG ? AV_CODEC_ID_MJPEG
-                                                     : AV_CODEC_ID_PNG);
-  if (!codec) {
-    throw LogicError("codec not found");
+const AVCodec* FindEncoderByName(std::initializer_list<const char*> names) {
+  for (const char* name : names) {
+    if (const AVCodec* codec = avcodec_find_encoder_by_name(name)) {
+      return codec;
+    }
+  }
+  return nullptr;
+}
+
+const AVCodec* FindThumbnailEncoder(ThumbnailOptions::Codec codec) {
+  switch (codec) {
+    case ThumbnailOptions::Codec::PNG:
+      return avcodec_find_encoder(AV_CODEC_ID_PNG);
+    case ThumbnailOptions::Codec::JPEG:
+      return avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+    case ThumbnailOptions::Codec::WEBP:
+      // libwebp_anim would produce an animated image.
+      return FindEncoderByName({"libwebp"});
+    case ThumbnailOptions::Codec::AVIF:
+      return FindEncoderByName({"libaom-av1", "libsvtav1", "librav1e"});
+  }
+  return nullptr;
+}
+
+// Favors encoding speed, thumbnails are generated on demand.
+void SetEncoderOptions(const AVCodec* codec, AVDictionary** options) {
+  std::string_view name = codec->name;
+  if (name == "libaom-av1") {
+    CheckAVError(av_dict_set(options, "cpu-used", "6", 0), "av_dict_set");
+    CheckAVError(av_dict_set(options, "crf", "32", 0), "av_dict_set");
+  } else if (name == "libsvtav1") {
+    CheckAVError(av_dict_set(options, "preset", "10", 0), "av_dict_set");
+    CheckAVError(av_dict_set(options, "crf", "35", 0), "av_dict_set");
+  } else if (name == "librav1e") {
+    CheckAVError(av_dict_set(options, "speed", "8", 0), "av_dict_set");
+  } else if (name == "libwebp" || name == "libwebp_anim") {
+    CheckAVError(av_dict_set(options, "quality", "80", 0), "av_dict_set");
+  }
+}
+
+std::unique_ptr<AVCodecContext, AVCodecContextDeleter> CreateEncoder(
+    const AVCodec* codec, const AVFrame* frame, bool global_header = false,
+    AVRational time_base = {1, 24}) {
+  std::unique_ptr<AVCodecContext, AVCodecContextDeleter> context(
+      avcodec_alloc_context3(codec));
+  if (!context) {
+    throw RuntimeError("avcodec_alloc_context3");
+  }
+  context->time_base = time_base;
+  context->pix_fmt = AVPixelFormat(frame->format);
+  context->width = frame->width;
+  context->height = frame->height;
+  context->strict_std_compliance = FF_COMPLIANCE_NORMAL;
+  if (global_header) {
+    context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+  }
+  AVDictionary* options = nullptr;
+  auto options_guard = AtScopeExit([&] { av_dict_free(&options); });
+  SetEncoderOptions(codec, &options);
+  CheckAVError(avcodec_open2(context.get(), codec, &options), "avcodec_open2");
+  return context;
+}
+
+// Opened encoders of the most recently encoded thumbnail sizes and formats,
+// kept per thread. Image encoders without AV_CODEC_CAP_DELAY return the
+// packet as soon as they get the frame, so the context is never drained and
+// can take the next frame of the same size and format.
+class EncoderCache {
+ public:
+  AVCodecContext* Get(const AVCodec* codec, const AVFrame* frame) {
+    Key key{.codec = codec->id,
+            .width = frame->width,
+            .height = frame->height,
+            .format = AVPixelFormat(frame->format)};
+    auto it = std::find_if(entries_.begin(), entries_.end(),
+                           [&](const Entry& e) { return e.key == key; });
+    if (it != entries_.end()) {
+      std::rotate(entries_.begin(), it, it + 1);
+      return entries_.front().context.get();
+    }
+    auto context = CreateEncoder(codec, frame);
+    if (entries_.size() == kMaxSize) {
+      entries_.pop_back();
+    }
+    entries_.insert(entries_.begin(),
+                    Entry{.key = key, .context = std::move(context)});
+    return entries_.front().context.get();
+  }
+
+  // Drops the context after a failed encode, its state is unknown.
+  void Remove(const AVCodecContext* context) {
+    std::erase_if(entries_, [&](const Entry& e) {
+      return e.context.get() == context;
+    });
+  }
+
+ private:
+  static constexpr size_t kMaxSize = 8;
+
+  struct Key {
+    AVCodecID codec;
+    int width;
+    int height;
+    AVPixelFormat format;
+
+    bool operator==(const Key&) const = default;
+  };
+
+  struct Entry {
+    Key key;
+    std::unique_ptr<AVCodecContext, AVCodecContextDeleter> context;
+  };
+
+  std::vector<Entry> entries_;
+};
+
+std::string EncodeWithCachedEncoder(const AVCodec* codec,
+                                    const AVFrame* frame) {
+  thread_local EncoderCache encoder_cache;
+  AVCodecContext* context = encoder_cache.Get(codec, frame);
+  try {
+    CheckAVError(avcodec_send_frame(context, frame), "avcodec_send_frame");
+    auto packet = CreatePacket();
+    std::string result;
+    while (true) {
+      auto err = avcodec_receive_packet(context, packet.get());
+      if (err == AVERROR(EAGAIN)) {
+        break;
+      }
+      CheckAVError(err, "avcodec_receive_packet");
+      result +=
+          std::string_view(reinterpret_cast<char*>(packet->data), packet->size);
+      av_packet_unref(packet.get());
+    }
+    if (result.empty()) {
+      throw RuntimeError("encoder didn't return a packet");
+    }
+    return result;
+  } catch (...) {
+    encoder_cache.Remove(context);
+    throw;
   }
+}
+
+// Applies the frame's "Orientation" metadata to its pixels.
+std::unique_ptr<AVFrame, AVFrameDeleter> OrientFrame(
+    std::unique_ptr<AVFrame, AVFrameDeleter> frame) {
   int orientation = [&] {
     if (AVDictionaryEntry* entry =
-            av_dict_get(input_frame->metadata, "Orientation", nullptr, 0)) {
+            av_dict_get(frame->metadata, "Orientation", nullptr, 0)) {
       int value = std::stoi(entry->value);
       if (value > 1 && value <= 8) {
         return value;
@@ -318,50 +555,136 @@ std::string EncodeFrame(std::unique_ptr<AVFrame, AVFrameDeleter> input_frame,
     return 1;
   }();
   if (orientation != 1) {
-    input_frame = RotateFrame(std::move(input_frame), orientation);
-    CheckAVError(av_dict_set_int(&input_frame->metadata, "Orientation", 1, 0),
+    frame = RotateFrame(std::move(frame), orientation);
+    CheckAVError(av_dict_set_int(&frame->metadata, "Orientation", 1, 0),
                  "av_dict_set_int");
   }
-  auto frame = ConvertFrame(input_frame.get(), codec);
-  std::unique_ptr<AVCodecContext, AVCodecContextDeleter> context(
-      avcodec_alloc_context3(codec));
-  if (!context) {
-    throw RuntimeError("avcodec_alloc_context3");
-  }
-  context->time_base = {1, 24};
-  context->pix_fmt = AVPixelFormat(frame->format);
-  context->width = frame->width;
-  context->height = frame->height;
-  context->strict_std_compliance = FF_COMPLIANCE_NORMAL;
-  CheckAVError(avcodec_open2(context.get(), codec, nullptr), "avcodec_open2");
-  auto packet = CreatePacket();
-  bool frame_sent = false;
+  return frame;
+}
+
+// Encodes `frames` with an encoder which may hold them back until it's
+// flushed.
+std::vector<std::unique_ptr<AVPacket, AVPacketDeleter>> EncodeAndFlush(
+    AVCodecContext* context, const std::vector<const AVFrame*>& frames,
+    std::atomic_bool* interrupted) {
+  size_t sent_frame_count = 0;
   bool flush_sent = false;
-  std::string result;
+  std::vector<std::unique_ptr<AVPacket, AVPacketDeleter>> packets;
   while (true) {
     if (*interrupted) {
       throw InterruptedException();
     }
-    if (!frame_sent) {
-      CheckAVError(avcodec_send_frame(context.get(), frame.get()),
-                   "avcodec_send_frame");
-      frame_sent = true;
+    if (sent_frame_count < frames.size()) {
+      int err = avcodec_send_frame(context, frames[sent_frame_count]);
+      if (err != AVERROR(EAGAIN)) {
+        CheckAVError(err, "avcodec_send_frame");
+        sent_frame_count++;
+      }
     } else if (!flush_sent) {
-      CheckAVError(avcodec_send_frame(context.get(), nullptr),
-                   "avcodec_send_frame");
+      CheckAVError(avcodec_send_frame(context, nullptr), "avcodec_send_frame");
       flush_sent = true;
     }
-    auto err = avcodec_receive_packet(context.get(), packet.get());
+    auto packet = CreatePacket();
+    auto err = avcodec_receive_packet(context, packet.get());
     if (err != 0) {
       if (err == AVERROR_EOF) {
         break;
-      } else {
+      } else if (err != AVERROR(EAGAIN)) {
         CheckAVError(err, "avcodec_receive_packet");
       }
     } else {
-      result +=
-          std::string_view(reinterpret_cast<char*>(packet->data), packet->size);
+      packets.emplace_back(std::move(packet));
+    }
+  }
+  return packets;
+}
+
+struct AVFormatOutputContextDeleter {
+  void operator()(AVFormatContext* context) const {
+    if (context->pb) {
+      uint8_t* buffer = nullptr;
+      avio_close_dyn_buf(context->pb, &buffer);
+      av_free(buffer);
     }
+    avformat_free_context(context);
+  }
+};
+
+// Writes the packets of `encoder` to an in-memory file of `format`.
+std::string Mux(
+    const AVOutputFormat* format, const AVCodecContext* encoder,
+    std::vector<std::unique_ptr<AVPacket, AVPacketDeleter>> packets) {
+  std::unique_ptr<AVFormatContext, AVFormatOutputContextDeleter> context;
+  {
+    AVFormatContext* output = nullptr;
+    CheckAVError(
+        avformat_alloc_output_context2(&output, format, nullptr, nullptr),
+        "avformat_alloc_output_context2");
+    context.reset(output);
+  }
+  AVStream* stream = avformat_new_stream(context.get(), nullptr);
+  if (!stream) {
+    throw RuntimeError("avformat_new_stream");
+  }
+  CheckAVError(avcodec_parameters_from_context(stream->codecpar, encoder),
+               "avcodec_parameters_from_context");
+  stream->time_base = encoder->time_base;
+  CheckAVError(avio_open_dyn_buf(&context->pb), "avio_open_dyn_buf");
+  CheckAVError(avformat_write_header(context.get(), nullptr),
+               "avformat_write_header");
+  for (const auto& packet : packets) {
+    packet->stream_index = stream->index;
+    if (packet->duration == 0) {
+      packet->duration = 1;
+    }
+    av_packet_rescale_ts(packet.get(), encoder->time_base, stream->time_base);
+    CheckAVError(av_write_frame(context.get(), packet.get()), "av_write_frame");
+  }
+  CheckAVError(av_write_trailer(context.get()), "av_write_trailer");
+  uint8_t* buffer = nullptr;
+  int size = avio_close_dyn_buf(std::exchange(context->pb, nullptr), &buffer);
+  auto buffer_guard = AtScopeExit([&] { av_free(buffer); });
+  return std::string(reinterpret_cast<const char*>(buffer),
+                     static_cast<size_t>(size));
+}
+
+// AV1 packets need the AVIF container around them to be an image.
+std::string EncodeAvif(const AVCodec* codec, const AVFrame* frame,
+                       std::atomic_bool* interrupted) {
+  const AVOutputFormat* format = av_guess_format("avif", nullptr, nullptr);
+  if (!format) {
+    throw LogicError("avif muxer unavailable");
+  }
+  auto encoder =
+      CreateEncoder(codec, frame,
+                    /*global_header=*/format->flags & AVFMT_GLOBALHEADER);
+  return Mux(format, encoder.get(),
+             EncodeAndFlush(encoder.get(), {frame}, interrupted));
+}
+
+// Encoders of large one-off images, such as contact sheets, are not worth
+// keeping: `reuse_encoder` keeps them out of the EncoderCache.
+std::string EncodeFrame(const AVFrame* input_frame, ThumbnailOptions options,
+                        std::atomic_bool* interrupted,
+                        bool reuse_encoder = true) {
+  const AVCodec* codec = FindThumbnailEncoder(options.codec);
+  if (!codec) {
+    throw LogicError("codec not found");
+  }
+  auto frame = ConvertFrame(input_frame, codec);
+  frame->pts = 0;
+  if (options.codec == ThumbnailOptions::Codec::AVIF) {
+    return EncodeAvif(codec, frame.get(), interrupted);
+  }
+  if (reuse_encoder && !(codec->capabilities & AV_CODEC_CAP_DELAY)) {
+    return EncodeWithCachedEncoder(codec, frame.get());
+  }
+  auto context = CreateEncoder(codec, frame.get());
+  std::string result;
+  for (const auto& packet :
+       EncodeAndFlush(context.get(), {frame.get()}, interrupted)) {
+    result +=
+        std::string_view(reinterpret_cast<char*>(packet->data), packet->size);
   }
   return result;
 }
@@ -380,70 +703,282 @@ int GetExifOrientation(const int32_t* matrix) {
   }
 }
 
-bool IsFrameBlackImpl(const AVFrame* frame) {
-  int count = 0;
-  const uint8_t* p = frame->data[0];
-  for (int i = 0; i < frame->height; i++) {
-    for (int j = 0; j < frame->width; j++) {
-      count += p[j] < 32;
-    }
-    p += frame->linesize[0];
+// Whether the first plane of the format holds nothing but 8 bit luma, which
+// is the case for planar and semi-planar YUV and for grayscale.
+bool HasLumaPlane(AVPixelFormat format) {
+  const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get(format);
+  if (!descriptor || (descriptor->flags & (AV_PIX_FMT_FLAG_RGB |
+                                           AV_PIX_FMT_FLAG_PAL |
+                                           AV_PIX_FMT_FLAG_BITSTREAM |
+                                           AV_PIX_FMT_FLAG_HWACCEL))) {
+    return false;
   }
-  return count * 100 / (frame->width * frame->height) >= 95;
+  const AVComponentDescriptor& luma = descriptor->comp[0];
+  return luma.plane == 0 && luma.step == 1 && luma.offset == 0 &&
+         luma.depth == 8;
 }
 
 bool IsFrameBlack(const AVFrame* input) {
-  static const enum AVPixelFormat kPixelFormats[] = {
-      AV_PIX_FMT_YUV410P, AV_PIX_FMT_YUV420P, AV_PIX_FMT_GRAY8,
-      AV_PIX_FMT_NV12,    AV_PIX_FMT_NV21,    AV_PIX_FMT_YUV444P,
-      AV_PIX_FMT_YUV422P, AV_PIX_FMT_YUV411P, AV_PIX_FMT_NONE};
-  AVPixelFormat format = avcodec_find_best_pix_fmt_of_list(
-      kPixelFormats, AVPixelFormat(input->format), /*alpha=*/false,
-      /*loss_ptr=*/nullptr);
-  return IsFrameBlackImpl(
-      input->format == format ? input : ConvertFrame(input, format).get());
+  auto is_black = [](const AVFrame* frame) {
+    return IsMostlyDark({.data = frame->data[0],
+                         .linesize = frame->linesize[0],
+                         .width = frame->width,
+                         .height = frame->height},
+                        /*threshold=*/32, /*min_percent=*/95);
+  };
+  if (HasLumaPlane(AVPixelFormat(input->format))) {
+    return is_black(input);
+  }
+  return is_black(ConvertFrame(input, AV_PIX_FMT_GRAY8).get());
 }
 
-auto GetThumbnailFrame(AVIOContext* io_context, ThumbnailOptions options,
-                       std::atomic_bool* interrupted) {
+bool IsAttachedPicture(const AVStream* stream) {
+  return (stream->disposition & AV_DISPOSITION_ATTACHED_PIC) != 0;
+}
+
+// Cover art (MP4 covr atoms, ID3 pictures) is read together with the
+// container header, so it doesn't need any further reads of the input.
+// Returns -1 if there is none, or if it's too small for the thumbnail while
+// the input has a real video stream to take a frame from.
+int FindAttachedPicture(const AVFormatContext* context, int video_stream,
+                        ThumbnailOptions options) {
+  if (IsAttachedPicture(context->streams[video_stream])) {
+    return video_stream;
+  }
+  for (unsigned i = 0; i < context->nb_streams; i++) {
+    const AVStream* stream = context->streams[i];
+    if (IsAttachedPicture(stream) &&
+        std::max(stream->codecpar->width, stream->codecpar->height) >=
+            options.size) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+auto GetAttachedPictureFrame(AVFormatContext* context, int stream,
+                             ThumbnailOptions options) {
+  const AVCodecParameters* codecpar = context->streams[stream]->codecpar;
+  auto codec_context = CreateCodecContext(
+      context, stream,
+      GetLowres({codecpar->width, codecpar->height}, options.size));
+  CheckAVError(avcodec_send_packet(codec_context.get(),
+                                   &context->streams[stream]->attached_pic),
+               "avcodec_send_packet");
+  CheckAVError(avcodec_send_packet(codec_context.get(), nullptr),
+               "avcodec_send_packet");
+  auto frame = CreateFrame();
+  CheckAVError(avcodec_receive_frame(codec_context.get(), frame.get()),
+               "avcodec_receive_frame");
+  return ScaleFrame(frame.get(), options.size);
+}
+
+int GetStreamOrientation(const AVStream* stream) {
+  const AVPacketSideData* stream_matrix =
+      av_packet_side_data_get(stream->codecpar->coded_side_data,
+                              stream->codecpar->nb_coded_side_data,
+                              AV_PKT_DATA_DISPLAYMATRIX);
+  if (stream_matrix != nullptr) {
+    return GetExifOrientation(
+        reinterpret_cast<const int32_t*>(stream_matrix->data));
+  } else {
+    return 0;
+  }
+}
+
+// Stores the orientation in the frame's metadata, from where OrientFrame picks
+// it up once the frame went through the filters.
+void SetFrameOrientation(AVFrame* frame, int stream_orientation) {
+  AVFrameSideData* frame_matrix =
+      av_frame_get_side_data(frame, AV_FRAME_DATA_DISPLAYMATRIX);
+  int orientation =
+      frame_matrix
+          ? GetExifOrientation(reinterpret_cast<int32_t*>(frame_matrix->data))
+          : stream_orientation;
+  if (orientation != 0) {
+    CheckAVError(
+        av_dict_set_int(&frame->metadata, "Orientation", orientation, 0),
+        "av_dict_set_int");
+  }
+}
+
+// Prefers sharp frames with a balanced exposure, so that frames of fades,
+// motion blur and title cards on black lose against regular scenes.
+double GetFrameScore(const AVFrame* frame) {
+  std::unique_ptr<AVFrame, AVFrameDeleter> gray;
+  if (!HasLumaPlane(AVPixelFormat(frame->format))) {
+    gray = ConvertFrame(frame, AV_PIX_FMT_GRAY8);
+    frame = gray.get();
+  }
+  LumaPlane plane{.data = frame->data[0],
+                  .linesize = frame->linesize[0],
+                  .width = frame->width,
+                  .height = frame->height};
+  if (IsMostlyDark(plane, /*threshold=*/32, /*min_percent=*/95)) {
+    return 0;
+  }
+  double exposure = 128 - std::abs(GetMeanLuma(plane) - 128);
+  return GetSharpness(plane) * exposure;
+}
+
+// Decodes `count` keyframes spread over the duration and passes each of them,
+// scaled to `size`, to `on_frame`. Seeking goes straight to the keyframes
+// listed in the container's index when it has one, and the decoder drops
+// everything but keyframes, so only a handful of packets are read from the
+// input. Stops early if the input can't be seeked.
+template <typename F>
+void ForEachKeyframe(AVFormatContext* context, int stream, int size, int count,
+                     std::atomic_bool* interrupted, F on_frame) {
+  AVStream* video = context->streams[stream];
+  auto codec_context = CreateCodecContext(
+      context, stream,
+      GetLowres({video->codecpar->width, video->codecpar->height}, size));
+  codec_context->skip_frame = AVDISCARD_NONKEY;
+  int stream_orientation = GetStreamOrientation(video);
+
+  int64_t start_time =
+      video->start_time == AV_NOPTS_VALUE ? 0 : video->start_time;
+  int64_t duration =
+      av_rescale_q(context->duration, AV_TIME_BASE_Q, video->time_base);
+  std::vector<int64_t> timestamps;
+  for (int i = 0; i < count; i++) {
+    int64_t timestamp = start_time + duration * (2 * i + 1) / (2 * count);
+    if (const AVIndexEntry* entry = avformat_index_get_entry_from_timestamp(
+            video, timestamp, AVSEEK_FLAG_BACKWARD)) {
+      timestamp = entry->timestamp;
+    }
+    // Short videos may have fewer keyframes than requested.
+    if (timestamps.empty() || timestamps.back() != timestamp) {
+      timestamps.push_back(timestamp);
+    }
+  }
+
+  for (int64_t timestamp : timestamps) {
+    if (av_seek_frame(context, stream, timestamp, AVSEEK_FLAG_BACKWARD) < 0) {
+      break;
+    }
+    avcodec_flush_buffers(codec_context.get());
+    auto frame = DecodeFrame(context, codec_context.get(), stream, interrupted);
+    if (!frame) {
+      continue;
+    }
+    SetFrameOrientation(frame.get(), stream_orientation);
+    on_frame(ScaleFrame(frame.get(), size));
+  }
+}
+
+// Returns the best scoring of `options.keyframe_count` keyframes, or null if
+// the input can't be seeked.
+std::unique_ptr<AVFrame, AVFrameDeleter> GetKeyframeThumbnailFrame(
+    AVFormatContext* context, int stream, ThumbnailOptions options,
+    std::atomic_bool* interrupted) {
+  std::unique_ptr<AVFrame, AVFrameDeleter> best_frame;
+  double best_score = -1;
+  ForEachKeyframe(context, stream, options.size, options.keyframe_count,
+                  interrupted,
+                  [&](std::unique_ptr<AVFrame, AVFrameDeleter> frame) {
+                    if (double score = GetFrameScore(frame.get());
+                        score > best_score) {
+                      best_frame = std::move(frame);
+                      best_score = score;
+                    }
+                  });
+  return best_frame;
+}
+
+std::vector<std::unique_ptr<AVFrame, AVFrameDeleter>> GetAnimatedPreviewFrames(
+    AVIOContext* io_context, AnimatedPreviewOptions options,
+    std::atomic_bool* interrupted) {
   auto context = CreateFormatContext(io_context);
   auto stream = av_find_best_stream(context.get(), AVMEDIA_TYPE_VIDEO, -1, -1,
                                     nullptr, 0);
   CheckAVError(stream, "av_find_best_stream");
+  if (IsAttachedPicture(context->streams[stream]) || context->duration <= 0) {
+    throw LogicError("no video to preview");
+  }
+  std::vector<std::unique_ptr<AVFrame, AVFrameDeleter>> frames;
+  ForEachKeyframe(context.get(), stream, options.size, options.frame_count,
+                  interrupted,
+                  [&](std::unique_ptr<AVFrame, AVFrameDeleter> frame) {
+                    frame = OrientFrame(std::move(frame));
+                    // The encoder can't change the size mid-animation.
+                    if (frames.empty() ||
+                        (frame->width == frames[0]->width &&
+                         frame->height == frames[0]->height)) {
+                      frames.emplace_back(std::move(frame));
+                    }
+                  });
+  if (frames.empty()) {
+    throw LogicError("Couldn't extract any frame.");
+  }
+  return frames;
+}
+
+std::string EncodeAnimatedPreview(
+    const std::vector<std::unique_ptr<AVFrame, AVFrameDeleter>>& input_frames,
+    AnimatedPreviewOptions options, std::atomic_bool* interrupted) {
+  const AVCodec* codec = FindEncoderByName({"libwebp_anim"});
+  const AVOutputFormat* format = av_guess_format("webp", nullptr, nullptr);
+  if (!codec || !format) {
+    throw LogicError("animated webp unsupported");
+  }
+  std::vector<std::unique_ptr<AVFrame, AVFrameDeleter>> frames;
+  std::vector<const AVFrame*> frame_pointers;
+  for (const auto& input_frame : input_frames) {
+    auto frame = ConvertFrame(input_frame.get(), codec);
+    frame->pts = static_cast<int64_t>(frames.size()) * options.frame_duration;
+    frame_pointers.push_back(frame.get());
+    frames.emplace_back(std::move(frame));
+  }
+  auto encoder = CreateEncoder(
+      codec, frames[0].get(),
+      /*global_header=*/format->flags & AVFMT_GLOBALHEADER, {1, 1000});
+  return Mux(format, encoder.get(),
+             EncodeAndFlush(encoder.get(), frame_pointers, interrupted));
+}
+
+std::unique_ptr<AVFrame, AVFrameDeleter> GetThumbnailFrame(
+    AVFormatContext* context, ThumbnailOptions options,
+    std::atomic_bool* interrupted) {
+  auto stream =
+      av_find_best_stream(context, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+  CheckAVError(stream, "av_find_best_stream");
+  if (int attached_picture = FindAttachedPicture(context, stream, options);
+      attached_picture != -1) {
+    return GetAttachedPictureFrame(context, attached_picture, options);
+  }
+  if (options.keyframe_count > 0 && context->duration > 0) {
+    if (auto frame =
+            GetKeyframeThumbnailFrame(context, stream, options, interrupted)) {
+      return frame;
+    }
+  }
   if (context->duration > 0) {
-    if (int err = av_seek_frame(context.get(), -1, context->duration / 10, 0);
+    if (int err = av_seek_frame(context, -1, context->duration / 10, 0);
         err < 0) {
       if (err != AVERROR(EPERM)) {
-        CheckAVError(av_seek_frame(context.get(), 0, 0,
+        CheckAVError(av_seek_frame(context, 0, 0,
                                    AVSEEK_FLAG_BYTE | AVSEEK_FLAG_BACKWARD),
                      "av_seek_frame");
       }
     }
   }
-  auto codec_context = CreateCodecContext(context.get(), stream);
+  const AVCodecParameters* codecpar = context->streams[stream]->codecpar;
+  auto codec_context = CreateCodecContext(
+      context, stream,
+      GetLowres({codecpar->width, codecpar->height}, options.size));
   auto size = GetThumbnailSize({codec_context->width, codec_context->height},
                                options.size);
   Graph read_graph =
       std::move(
-          GraphBuilder(context.get(), stream, codec_context.get())
+          GraphBuilder(context, stream, codec_context.get())
               .AddFilter("scale", {{"width", std::to_string(size.width)},
                                    {"height", std::to_string(size.height)}}))
           .Build();
   Graph thumbnail_graph =
       std::move(GraphBuilder(read_graph).AddFilter("thumbnail", {})).Build();
 
-  int stream_orientation = [&] {
-    const AVPacketSideData* stream_matrix = av_packet_side_data_get(
-        context->streams[stream]->codecpar->coded_side_data,
-        context->streams[stream]->codecpar->nb_coded_side_data,
-        AV_PKT_DATA_DISPLAYMATRIX);
-    if (stream_matrix != nullptr) {
-      return GetExifOrientation(
-          reinterpret_cast<const int32_t*>(stream_matrix->data));
-    } else {
-      return 0;
-    }
-  }();
+  int stream_orientation = GetStreamOrientation(context->streams[stream]);
 
   int read_frame_count = 0;
   int written_frame_count = 0;
@@ -464,37 +999,308 @@ auto GetThumbnailFrame(AVIOContext* io_context, ThumbnailOptions options,
       }
       continue;
     }
-    auto frame =
-        DecodeFrame(context.get(), codec_context.get(), stream, interrupted);
+    auto frame = DecodeFrame(context, codec_context.get(), stream, interrupted);
     if (frame) {
-      AVFrameSideData* frame_matrix =
-          av_frame_get_side_data(frame.get(), AV_FRAME_DATA_DISPLAYMATRIX);
-      int orientation =
-          frame_matrix ? GetExifOrientation(
-                             reinterpret_cast<int32_t*>(frame_matrix->data))
-                       : stream_orientation;
-      if (orientation != 0) {
-        CheckAVError(
-            av_dict_set_int(&frame->metadata, "Orientation", orientation, 0),
-            "av_dict_set_int");
-      }
+      SetFrameOrientation(frame.get(), stream_orientation);
     }
     read_frame_count++;
     read_graph.WriteFrame(read_frame_count < 200 ? frame.get() : nullptr);
   }
 }
 
-std::string GenerateThumbnail(AVIOContext* io_context, ThumbnailOptions options,
-                              std::atomic_bool* interrupted) {
-  return EncodeFrame(GetThumbnailFrame(io_context, options, interrupted),
-                     options, interrupted);
+std::unique_ptr<AVFrame, AVFrameDeleter> GetThumbnailFrame(
+    AVIOContext* io_context, ThumbnailOptions options,
+    std::atomic_bool* interrupted) {
+  auto context = CreateFormatContext(io_context);
+  return OrientFrame(GetThumbnailFrame(context.get(), options, interrupted));
+}
+
+// Returns null if the embedded preview is smaller than the thumbnail.
+std::unique_ptr<AVFrame, AVFrameDeleter> GetThumbnailFrame(
+    const ExifThumbnail& exif, ThumbnailOptions options,
+    std::atomic_bool* interrupted) {
+  MemoryInput input{.data = exif.data};
+  auto io_context = CreateMemoryIOContext(&input);
+  auto context = CreateFormatContext(io_context.get());
+  if (context->nb_streams != 1 ||
+      std::max(context->streams[0]->codecpar->width,
+               context->streams[0]->codecpar->height) < options.size) {
+    return nullptr;
+  }
+  auto frame = GetThumbnailFrame(context.get(), options, interrupted);
+  if (exif.orientation != 1) {
+    CheckAVError(
+        av_dict_set_int(&frame->metadata, "Orientation", exif.orientation, 0),
+        "av_dict_set_int");
+  }
+  return OrientFrame(std::move(frame));
+}
+
+// Reads the part of a JPEG file which holds its EXIF block.
+Task<std::string> GetJpegHeader(const AbstractCloudProvider* provider,
+                                AbstractCloudProvider::File file,
+                                stdx::stop_token stop_token) {
+  if (!file.size || *file.size == 0) {
+    co_return "";
+  }
+  auto size = static_cast<size_t>(std::min(*file.size, kExifHeaderSize));
+  std::string header;
+  FOR_CO_AWAIT(
+      std::string & chunk,
+      provider->GetFileContent(
+          file,
+          http::Range{.start = 0, .end = static_cast<int64_t>(size) - 1},
+          stop_token)) {
+    header += chunk;
+    if (header.size() >= size) {
+      break;
+    }
+  }
+  header.resize(std::min(header.size(), size));
+  co_return header;
+}
+
+// Thumbnail converted to RGBA, waiting to be put on a contact sheet.
+struct TileImage {
+  int width;
+  int height;
+  std::vector<uint8_t> pixels;
+};
+
+ImageSignature GetFrameSignature(const AVFrame* frame) {
+  auto rgba_frame = ConvertFrame(frame, AV_PIX_FMT_RGBA);
+  return GetImageSignature({.data = rgba_frame->data[0],
+                            .linesize = rgba_frame->linesize[0],
+                            .width = rgba_frame->width,
+                            .height = rgba_frame->height});
+}
+
+TileImage GetTileImage(const AVFrame* frame) {
+  auto rgba_frame = ConvertFrame(frame, AV_PIX_FMT_RGBA);
+  TileImage image{.width = frame->width,
+                  .height = frame->height,
+                  .pixels = std::vector<uint8_t>(
+                      static_cast<size_t>(frame->width) * frame->height * 4)};
+  av_image_copy_plane(image.pixels.data(), image.width * 4,
+                      rgba_frame->data[0], rgba_frame->linesize[0],
+                      image.width * 4, image.height);
+  return image;
+}
+
+// Draws `images` into the cells of `sheet`, which comes from
+// GetContactSheetLayout.
+void ComposeContactSheet(const std::vector<std::optional<TileImage>>& images,
+                         ContactSheetOptions options, ContactSheet* sheet,
+                         std::atomic_bool* interrupted) {
+  if (sheet->tiles.empty()) {
+    return;
+  }
+  auto canvas = CreateFrame();
+  canvas->format = AV_PIX_FMT_RGBA;
+  canvas->width = sheet->width;
+  canvas->height = sheet->height;
+  CheckAVError(av_frame_get_buffer(canvas.get(), 0), "av_frame_get_buffer");
+  for (int i = 0; i < canvas->height; i++) {
+    memset(canvas->data[0] + static_cast<ptrdiff_t>(i) * canvas->linesize[0],
+           0, static_cast<size_t>(canvas->width) * 4);
+  }
+  for (size_t i = 0; i < images.size(); i++) {
+    if (!images[i]) {
+      continue;
+    }
+    const TileImage& image = *images[i];
+    const ContactSheet::Tile& tile = sheet->tiles[i];
+    int x = tile.x + (tile.width - image.width) / 2;
+    int y = tile.y + (tile.height - image.height) / 2;
+    av_image_copy_plane(
+        canvas->data[0] + static_cast<ptrdiff_t>(y) * canvas->linesize[0] +
+            x * 4,
+        canvas->linesize[0], image.pixels.data(), image.width * 4,
+        image.width * 4, image.height);
+  }
+  sheet->image = EncodeFrame(
+      canvas.get(),
+      ThumbnailOptions{.size = options.tile_size, .codec = options.codec},
+      interrupted, /*reuse_encoder=*/false);
+}
+
+// Runs `f(index)` for every index below `count`, at most `max_parallel` at a
+// time.
+template <typename F>
+Task<> ForEachBounded(size_t count, int max_parallel, F f) {
+  size_t next = 0;
+  auto worker = [&]() -> Task<> {
+    while (next < count) {
+      co_await f(next++);
+    }
+  };
+  std::vector<Task<>> workers;
+  for (size_t i = 0;
+       i < std::min(count, static_cast<size_t>(std::max(max_parallel, 1)));
+       i++) {
+    workers.emplace_back(worker());
+  }
+  co_await WhenAll(std::move(workers));
 }
 
 }  // namespace
 
+ContactSheet GetContactSheetLayout(
+    std::span<const AbstractCloudProvider::File> files,
+    const ContactSheetOptions& options) {
+  ContactSheet sheet{.mime_type = std::string(GetMimeType(options.codec))};
+  if (files.empty()) {
+    return sheet;
+  }
+  int count = static_cast<int>(files.size());
+  int columns = std::clamp(options.columns, 1, count);
+  int rows = (count + columns - 1) / columns;
+  sheet.width = columns * options.tile_size;
+  sheet.height = rows * options.tile_size;
+  for (int i = 0; i < count; i++) {
+    sheet.tiles.push_back(
+        ContactSheet::Tile{.id = files[i].id,
+                           .x = i % columns * options.tile_size,
+                           .y = i / columns * options.tile_size,
+                           .width = options.tile_size,
+                           .height = options.tile_size});
+  }
+  return sheet;
+}
+
+bool IsThumbnailCodecSupported(ThumbnailOptions::Codec codec) {
+  if (!FindThumbnailEncoder(codec)) {
+    return false;
+  }
+  return codec != ThumbnailOptions::Codec::AVIF ||
+         av_guess_format("avif", nullptr, nullptr) != nullptr;
+}
+
+ThumbnailOptions::Codec GetBrowserThumbnailCodec() {
+  for (auto codec :
+       {ThumbnailOptions::Codec::AVIF, ThumbnailOptions::Codec::WEBP}) {
+    if (IsThumbnailCodecSupported(codec)) {
+      return codec;
+    }
+  }
+  return ThumbnailOptions::Codec::PNG;
+}
+
+bool IsAnimatedPreviewSupported() {
+  return FindEncoderByName({"libwebp_anim"}) != nullptr &&
+         av_guess_format("webp", nullptr, nullptr) != nullptr;
+}
+
 Task<std::string> ThumbnailGenerator::operator()(
     const AbstractCloudProvider* provider, AbstractCloudProvider::File file,
     ThumbnailOptions options, stdx::stop_token stop_token) const {
+  co_return (co_await Generate(provider, std::move(file), options,
+                               JobScheduler::Priority::kInteractive,
+                               std::move(stop_token)))
+      .image;
+}
+
+Task<GeneratedThumbnail> ThumbnailGenerator::Generate(
+    const AbstractCloudProvider* provider, AbstractCloudProvider::File file,
+    ThumbnailOptions options, JobScheduler::Priority priority,
+    stdx::stop_token stop_token) const {
+  GeneratedThumbnail thumbnail;
+  co_await ProcessThumbnailFrame(
+      provider, std::move(file), options, priority,
+      [&](const AVFrame* frame, std::atomic_bool* interrupted) {
+        thumbnail.image = EncodeFrame(frame, options, interrupted);
+        thumbnail.signature = GetFrameSignature(frame);
+      },
+      std::move(stop_token));
+  co_return thumbnail;
+}
+
+Task<ImageSignature> ThumbnailGenerator::GetSignature(
+    const AbstractCloudProvider* provider, std::string image,
+    JobScheduler::Priority priority, stdx::stop_token stop_token) const {
+  auto slot = co_await job_scheduler_->Acquire(priority, provider, stop_token);
+  std::atomic_bool interrupted = false;
+  stdx::stop_callback cb(stop_token, [&] { interrupted = true; });
+  co_return co_await thread_pool_->Do(stop_token, [&] {
+    try {
+      MemoryInput input{.data = image};
+      auto io_context = CreateMemoryIOContext(&input);
+      auto context = CreateFormatContext(io_context.get());
+      // The hash and the color don't need more detail than this.
+      auto frame = GetThumbnailFrame(
+          context.get(),
+          ThumbnailOptions{.size = 64, .codec = ThumbnailOptions::Codec::PNG},
+          &interrupted);
+      return GetFrameSignature(frame.get());
+    } catch (const std::exception& e) {
+      throw ThumbnailGeneratorException(e.what());
+    }
+  });
+}
+
+Task<std::vector<std::optional<std::string>>> ThumbnailGenerator::operator()(
+    const AbstractCloudProvider* provider,
+    std::vector<AbstractCloudProvider::File> files, ThumbnailOptions options,
+    int max_parallel, stdx::stop_token stop_token) const {
+  std::vector<std::optional<std::string>> thumbnails(files.size());
+  co_await ForEachBounded(
+      files.size(), max_parallel, [&](size_t index) -> Task<> {
+        try {
+          thumbnails[index] = co_await (*this)(
+              provider, std::move(files[index]), options, stop_token);
+        } catch (const std::exception&) {
+          if (stop_token.stop_requested()) {
+            throw InterruptedException();
+          }
+        }
+      });
+  co_return thumbnails;
+}
+
+Task<ContactSheet> ThumbnailGenerator::GetContactSheet(
+    std::vector<AbstractCloudProvider::File> files,
+    ContactSheetOptions options, GetTileThumbnail get_thumbnail,
+    stdx::stop_token stop_token) const {
+  ThumbnailOptions tile_options{.size = options.tile_size,
+                                .codec = options.codec};
+  std::atomic_bool interrupted = false;
+  stdx::stop_callback cb(stop_token, [&] { interrupted = true; });
+  std::vector<std::optional<TileImage>> images(files.size());
+  co_await ForEachBounded(
+      files.size(), options.max_parallel, [&](size_t index) -> Task<> {
+        try {
+          std::string thumbnail =
+              co_await get_thumbnail(files[index], stop_token);
+          // Cached thumbnails are small, decoding them is short next to
+          // generating one, which takes its own slot.
+          auto slot = co_await job_scheduler_->Acquire(
+              JobScheduler::Priority::kInteractive, /*owner=*/nullptr,
+              stop_token);
+          images[index] = co_await thread_pool_->Do(stop_token, [&] {
+            MemoryInput input{.data = thumbnail};
+            auto io_context = CreateMemoryIOContext(&input);
+            auto frame =
+                GetThumbnailFrame(io_context.get(), tile_options, &interrupted);
+            return GetTileImage(frame.get());
+          });
+        } catch (const std::exception&) {
+          if (stop_token.stop_requested()) {
+            throw InterruptedException();
+          }
+        }
+      });
+  ContactSheet sheet = GetContactSheetLayout(files, options);
+  co_await thread_pool_->Do(stop_token, [&] {
+    ComposeContactSheet(images, options, &sheet, &interrupted);
+  });
+  co_return sheet;
+}
+
+Task<std::string> ThumbnailGenerator::GetAnimatedPreview(
+    const AbstractCloudProvider* provider, AbstractCloudProvider::File file,
+    AnimatedPreviewOptions options, stdx::stop_token stop_token) const {
+  auto slot = co_await job_scheduler_->Acquire(
+      JobScheduler::Priority::kInteractive, provider, stop_token);
   std::unique_ptr<AVIOContext, AVIOContextDeleter> io_context;
   std::atomic_bool interrupted = false;
   stdx::stop_callback cb(stop_token, [&] { interrupted = true; });
@@ -502,7 +1308,53 @@ Task<std::string> ThumbnailGenerator::operator()(
     try {
       io_context = CreateIOContext(event_loop_, provider, std::move(file),
                                    std::move(stop_token));
-      return GenerateThumbnail(io_context.get(), options, &interrupted);
+      return EncodeAnimatedPreview(
+          GetAnimatedPreviewFrames(io_context.get(), options, &interrupted),
+          options, &interrupted);
+    } catch (const std::exception& e) {
+      throw ThumbnailGeneratorException(e.what());
+    }
+  });
+}
+
+Task<> ThumbnailGenerator::ProcessThumbnailFrame(
+    const AbstractCloudProvider* provider, AbstractCloudProvider::File file,
+    ThumbnailOptions options, JobScheduler::Priority priority,
+    stdx::any_invocable<void(const AVFrame*, std::atomic_bool* interrupted)>
+        consume,
+    stdx::stop_token stop_token) const {
+  auto slot = co_await job_scheduler_->Acquire(priority, provider, stop_token);
+  // Camera photos carry a preview in their EXIF block, which only needs the
+  // first few kilobytes of the file instead of all of it.
+  std::string jpeg_header;
+  if (file.mime_type == "image/jpeg") {
+    jpeg_header = co_await GetJpegHeader(provider, file, stop_token);
+  }
+  std::unique_ptr<AVIOContext, AVIOContextDeleter> io_context;
+  std::atomic_bool interrupted = false;
+  stdx::stop_callback cb(stop_token, [&] { interrupted = true; });
+  co_await thread_pool_->Do(stop_token, [&] {
+    try {
+      std::unique_ptr<AVFrame, AVFrameDeleter> frame;
+      if (auto exif = GetExifThumbnail(jpeg_header)) {
+        frame = GetThumbnailFrame(*exif, options, &interrupted);
+      }
+      if (!frame && !jpeg_header.empty() &&
+          file.size == static_cast<int64_t>(jpeg_header.size())) {
+        // The header is the whole file.
+        MemoryInput input{.data = jpeg_header};
+        auto memory_io_context = CreateMemoryIOContext(&input);
+        frame = GetThumbnailFrame(memory_io_context.get(), options,
+                                  &interrupted);
+      }
+      if (!frame) {
+        // The header is read again by the decoder, it's not fetched twice.
+        io_context = CreateIOContext(event_loop_, provider, std::move(file),
+                                     std::move(stop_token),
+                                     std::move(jpeg_header));
+        frame = GetThumbnailFrame(io_context.get(), options, &interrupted);
+      }
+      consume(frame.get(), &interrupted);
     } catch (const std::exception& e) {
       throw ThumbnailGeneratorException(e.what());
     }
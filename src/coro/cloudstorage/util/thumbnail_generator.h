@@ -1,13 +1,83 @@
 #ifndef CORO_CLOUDSTORAGE_UTIL_GENERATE_THUMBNAIL_H
 #define CORO_CLOUDSTORAGE_UTIL_GENERATE_THUMBNAIL_H
 
+#include <atomic>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
 #include "coro/cloudstorage/util/abstract_cloud_provider.h"
+#include "coro/cloudstorage/util/image_signature.h"
+#include "coro/cloudstorage/util/job_scheduler.h"
 #include "coro/cloudstorage/util/thumbnail_options.h"
+#include "coro/stdx/any_invocable.h"
 #include "coro/task.h"
 #include "coro/util/thread_pool.h"
 
+struct AVFrame;
+
 namespace coro::cloudstorage::util {
 
+struct ContactSheetOptions {
+  // Thumbnails are fit in square tiles of this size.
+  int tile_size = 128;
+  int columns = 8;
+  ThumbnailOptions::Codec codec = ThumbnailOptions::Codec::JPEG;
+  // Number of tile thumbnails fetched at the same time.
+  int max_parallel = 4;
+};
+
+// Thumbnails of many files laid out on a single image, one square cell per
+// file, row by row in the order of the files.
+struct ContactSheet {
+  // Cell of a file within the image. The thumbnail is centered in it, cells of
+  // files without a thumbnail stay transparent.
+  struct Tile {
+    std::string id;
+    int x;
+    int y;
+    int width;
+    int height;
+  };
+
+  std::string image;
+  std::string mime_type;
+  int width = 0;
+  int height = 0;
+  std::vector<Tile> tiles;
+};
+
+// The layout of the contact sheet of `files`, without its image. It only
+// depends on the files and the options, not on the generated thumbnails.
+ContactSheet GetContactSheetLayout(
+    std::span<const AbstractCloudProvider::File> files,
+    const ContactSheetOptions& options);
+
+struct GeneratedThumbnail {
+  std::string image;
+  ImageSignature signature;
+};
+
+// Hover preview of a video, made of keyframes spread over its duration.
+struct AnimatedPreviewOptions {
+  int size = 256;
+  int frame_count = 8;
+  // In milliseconds.
+  int frame_duration = 500;
+};
+
+// Whether this ffmpeg build can generate thumbnails with `codec`. WebP and AVIF
+// depend on optional encoders.
+bool IsThumbnailCodecSupported(ThumbnailOptions::Codec codec);
+
+// The codec browsers get from the thumbnail endpoint, they accept both AVIF
+// and WebP. Thumbnails cached with other codecs aren't hit by browsers.
+ThumbnailOptions::Codec GetBrowserThumbnailCodec();
+
+// Animated previews are WebP and need the libwebp_anim encoder.
+bool IsAnimatedPreviewSupported();
+
 class ThumbnailGeneratorException : public std::exception {
  public:
   explicit ThumbnailGeneratorException(std::string message)
@@ -22,17 +92,72 @@ class ThumbnailGeneratorException : public std::exception {
 class ThumbnailGenerator {
  public:
   ThumbnailGenerator(coro::util::ThreadPool* thread_pool,
-                     const coro::util::EventLoop* event_loop)
-      : thread_pool_(thread_pool), event_loop_(event_loop) {}
+                     const coro::util::EventLoop* event_loop,
+                     JobScheduler* job_scheduler)
+      : thread_pool_(thread_pool),
+        event_loop_(event_loop),
+        job_scheduler_(job_scheduler) {}
 
   Task<std::string> operator()(const AbstractCloudProvider* provider,
                                AbstractCloudProvider::File file,
                                ThumbnailOptions options,
                                stdx::stop_token stop_token) const;
 
+  // Also returns the signature of the thumbnail, taken from the decoded frame
+  // the thumbnail was encoded from. Waits for a slot of class `priority`,
+  // operator() uses the interactive one.
+  Task<GeneratedThumbnail> Generate(const AbstractCloudProvider* provider,
+                                    AbstractCloudProvider::File file,
+                                    ThumbnailOptions options,
+                                    JobScheduler::Priority priority,
+                                    stdx::stop_token stop_token) const;
+
+  // Decodes `image` to compute its signature, for thumbnails which come from
+  // `provider`. Waits for a slot of class `priority` like Generate.
+  Task<ImageSignature> GetSignature(const AbstractCloudProvider* provider,
+                                    std::string image,
+                                    JobScheduler::Priority priority,
+                                    stdx::stop_token stop_token) const;
+
+  // Generates the thumbnails of `files`, at most `max_parallel` at a time.
+  // Files whose thumbnail couldn't be generated get nullopt.
+  Task<std::vector<std::optional<std::string>>> operator()(
+      const AbstractCloudProvider* provider,
+      std::vector<AbstractCloudProvider::File> files, ThumbnailOptions options,
+      int max_parallel, stdx::stop_token stop_token) const;
+
+  // Returns the encoded thumbnail of a contact sheet tile.
+  using GetTileThumbnail = stdx::any_invocable<Task<std::string>(
+      AbstractCloudProvider::File, stdx::stop_token)>;
+
+  // Returns the layout of GetContactSheetLayout along with the image. The
+  // thumbnails of the tiles come from `get_thumbnail`, they are decoded and
+  // scaled down to the tile size. Tiles whose thumbnail couldn't be fetched or
+  // decoded stay empty.
+  Task<ContactSheet> GetContactSheet(
+      std::vector<AbstractCloudProvider::File> files,
+      ContactSheetOptions options, GetTileThumbnail get_thumbnail,
+      stdx::stop_token stop_token) const;
+
+  // Returns an animated WebP.
+  Task<std::string> GetAnimatedPreview(const AbstractCloudProvider* provider,
+                                       AbstractCloudProvider::File file,
+                                       AnimatedPreviewOptions options,
+                                       stdx::stop_token stop_token) const;
+
  private:
+  // Generates the thumbnail frame of `file` and passes it to `consume` on a
+  // thread of the thread pool.
+  Task<> ProcessThumbnailFrame(
+      const AbstractCloudProvider* provider, AbstractCloudProvider::File file,
+      ThumbnailOptions options, JobScheduler::Priority priority,
+      stdx::any_invocable<void(const AVFrame*, std::atomic_bool* interrupted)>
+          consume,
+      stdx::stop_token stop_token) const;
+
   coro::util::ThreadPool* thread_pool_;
   const coro::util::EventLoop* event_loop_;
+  JobScheduler* job_scheduler_;
 };
 
 }  // namespace coro::cloudstorage::util
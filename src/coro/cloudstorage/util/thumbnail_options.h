@@ -1,13 +1,47 @@
 #ifndef CORO_CLOUDSTORAGE_UTIL_THUMBNAIL_OPTIONS
 #define CORO_CLOUDSTORAGE_UTIL_THUMBNAIL_OPTIONS
 
+#include <string_view>
+
+#include "coro/cloudstorage/util/thumbnail_quality.h"
+
 namespace coro::cloudstorage::util {
 
 struct ThumbnailOptions {
   int size = 256;
-  enum class Codec { PNG, JPEG } codec;
+  enum class Codec { PNG, JPEG, WEBP, AVIF } codec;
+  // When positive, the thumbnail of a video is the best of this many
+  // keyframes spread over its duration, which bounds the amount of data read
+  // from remote files. Otherwise the thumbnail filter picks one of the first
+  // 200 frames after 10% of the duration.
+  int keyframe_count = 0;
 };
 
+// Longest side of generated thumbnails of the given quality.
+constexpr int GetThumbnailSize(ThumbnailQuality quality) {
+  switch (quality) {
+    case ThumbnailQuality::kLow:
+      return 256;
+    case ThumbnailQuality::kHigh:
+      return 1024;
+  }
+  return 256;
+}
+
+constexpr std::string_view GetMimeType(ThumbnailOptions::Codec codec) {
+  switch (codec) {
+    case ThumbnailOptions::Codec::PNG:
+      return "image/png";
+    case ThumbnailOptions::Codec::JPEG:
+      return "image/jpeg";
+    case ThumbnailOptions::Codec::WEBP:
+      return "image/webp";
+    case ThumbnailOptions::Codec::AVIF:
+      return "image/avif";
+  }
+  return "application/octet-stream";
+}
+
 }  // namespace coro::cloudstorage::util
 
-#endif  // CORO_CLOUDSTORAGE_UTIL_THUMBNAIL_OPTIONS
\ No newline at end of file
+#endif  // CORO_CLOUDSTORAGE_UTIL_THUMBNAIL_OPTIONS
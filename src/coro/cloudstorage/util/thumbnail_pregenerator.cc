@@ -0,0 +1,139 @@
+#include "coro/cloudstorage/util/thumbnail_pregenerator.h"
+
+#include <exception>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include "coro/cloudstorage/util/cloud_provider_utils.h"
+#include "coro/cloudstorage/util/thumbnail_generator.h"
+#include "coro/util/stop_token_or.h"
+
+namespace coro::cloudstorage::util {
+
+namespace {
+
+using ::coro::util::MakeUniqueStopTokenOr;
+
+}  // namespace
+
+ThumbnailPregenerator::ThumbnailPregenerator(
+    const coro::util::EventLoop* event_loop, JobScheduler* job_scheduler,
+    Config config)
+    : event_loop_(event_loop),
+      job_scheduler_(job_scheduler),
+      config_(config),
+      codec_(GetBrowserThumbnailCodec()) {}
+
+ThumbnailPregenerator::~ThumbnailPregenerator() { stop_source_.request_stop(); }
+
+void ThumbnailPregenerator::OnDirectoryListed(
+    CloudProviderAccount account,
+    std::vector<AbstractCloudProvider::Item> items) {
+  Enqueue(account, std::move(items), /*depth=*/0);
+}
+
+void ThumbnailPregenerator::Enqueue(
+    const CloudProviderAccount& account,
+    std::vector<AbstractCloudProvider::Item> items, int depth) {
+  // Jobs are taken from the back, the first listed item goes last.
+  for (auto it = items.rbegin(); it != items.rend(); it++) {
+    bool wanted = std::visit(
+        [&]<typename Item>(const Item& item) {
+          if constexpr (std::is_same_v<Item, AbstractCloudProvider::File>) {
+            switch (GetFileType(item.mime_type)) {
+              case FileType::kImage:
+                return item.size.value_or(0) <= config_.max_image_size;
+              case FileType::kVideo:
+                return true;
+              default:
+                return false;
+            }
+          } else {
+            return depth < config_.max_depth;
+          }
+        },
+        *it);
+    if (!wanted) {
+      continue;
+    }
+    queue_.push_back(Job{.account = account, .item = std::move(*it),
+                         .depth = depth});
+    if (queue_.size() > config_.max_queued) {
+      queue_.pop_front();
+    }
+  }
+  if (!running_ && !queue_.empty()) {
+    running_ = true;
+    RunTask([this] { return Run(); });
+  }
+}
+
+Task<> ThumbnailPregenerator::Run() {
+  // Once stopped, the pregenerator may be gone by the time an await returns.
+  stdx::stop_token stop_token = stop_source_.get_token();
+  try {
+    while (!queue_.empty()) {
+      co_await event_loop_->Wait(config_.delay_ms, stop_token);
+      if (stop_token.stop_requested()) {
+        co_return;
+      }
+      if (!job_scheduler_->IsIdle(JobScheduler::Priority::kInteractive)) {
+        continue;
+      }
+      Job job = std::move(queue_.back());
+      queue_.pop_back();
+      co_await Process(std::move(job), stop_token);
+      if (stop_token.stop_requested()) {
+        co_return;
+      }
+    }
+    running_ = false;
+  } catch (const InterruptedException&) {
+  }
+}
+
+Task<> ThumbnailPregenerator::Process(Job job, stdx::stop_token stop_token) {
+  ThumbnailOptions::Codec codec = codec_;
+  auto stop_token_or =
+      MakeUniqueStopTokenOr(stop_token, job.account.stop_token());
+  try {
+    // Bounds the share of the CPU and of the bandwidth taken by
+    // pregeneration, on top of only running while interactive jobs don't.
+    // The idle class keeps it from taking the slots of remuxes. Cached
+    // entries are refreshed in the background, the refresh is awaited so that
+    // it's bounded as well.
+    if (auto* directory =
+            std::get_if<AbstractCloudProvider::Directory>(&job.item)) {
+      auto slot = co_await job_scheduler_->Acquire(
+          JobScheduler::Priority::kIdle, job.account.provider().get(),
+          stop_token_or->GetToken());
+      std::vector<AbstractCloudProvider::Item> items;
+      auto versioned = co_await job.account.ListDirectory(
+          *directory, stop_token_or->GetToken());
+      FOR_CO_AWAIT(auto& page, versioned.content) {
+        for (auto& item : page.items) {
+          items.emplace_back(std::move(item));
+        }
+      }
+      co_await *versioned.updated;
+      if (!stop_token.stop_requested()) {
+        Enqueue(job.account, std::move(items), job.depth + 1);
+      }
+    } else {
+      // Stores the thumbnail in the cache unless it's already there. The
+      // generator takes the idle slot itself, only once the provider has no
+      // thumbnail.
+      auto thumbnail = co_await job.account.GetItemThumbnailWithFallback(
+          std::get<AbstractCloudProvider::File>(std::move(job.item)),
+          ThumbnailQuality::kLow, codec, http::Range{},
+          JobScheduler::Priority::kIdle, stop_token_or->GetToken());
+      co_await http::GetBody(std::move(thumbnail.thumbnail.data));
+      co_await *thumbnail.updated;
+    }
+  } catch (const std::exception&) {
+    // Left for on demand generation, which reports the error to the client.
+  }
+}
+
+}  // namespace coro::cloudstorage::util
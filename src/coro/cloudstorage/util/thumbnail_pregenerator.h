@@ -0,0 +1,71 @@
+#ifndef CORO_CLOUDSTORAGE_UTIL_THUMBNAIL_PREGENERATOR_H
+#define CORO_CLOUDSTORAGE_UTIL_THUMBNAIL_PREGENERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "coro/cloudstorage/util/abstract_cloud_provider.h"
+#include "coro/cloudstorage/util/cloud_provider_account.h"
+#include "coro/cloudstorage/util/job_scheduler.h"
+#include "coro/stdx/stop_source.h"
+#include "coro/task.h"
+#include "coro/util/event_loop.h"
+
+namespace coro::cloudstorage::util {
+
+// Fills the thumbnail cache ahead of the first visit of a directory. Items of
+// listed directories are queued, subdirectories get listed in turn, and their
+// missing thumbnails are fetched or generated one at a time, while no
+// interactive job runs or waits. Only used on the event loop thread.
+class ThumbnailPregenerator {
+ public:
+  struct Config {
+    // Pending items, the least recently listed ones are dropped first.
+    size_t max_queued = 512;
+    // How deep below a listed directory to look for files.
+    int max_depth = 1;
+    // Larger images are left for on demand generation, which reads them
+    // whole.
+    int64_t max_image_size = int64_t{32} << 20;
+    // Pause after each item and between checks for interactive load.
+    int delay_ms = 250;
+  };
+
+  ThumbnailPregenerator(const coro::util::EventLoop* event_loop,
+                        JobScheduler* job_scheduler, Config config);
+  ThumbnailPregenerator(const ThumbnailPregenerator&) = delete;
+  ThumbnailPregenerator(ThumbnailPregenerator&&) = delete;
+  ThumbnailPregenerator& operator=(const ThumbnailPregenerator&) = delete;
+  ThumbnailPregenerator& operator=(ThumbnailPregenerator&&) = delete;
+  ~ThumbnailPregenerator();
+
+  void OnDirectoryListed(CloudProviderAccount account,
+                         std::vector<AbstractCloudProvider::Item> items);
+
+ private:
+  struct Job {
+    CloudProviderAccount account;
+    AbstractCloudProvider::Item item;
+    int depth;
+  };
+
+  void Enqueue(const CloudProviderAccount& account,
+               std::vector<AbstractCloudProvider::Item> items, int depth);
+  Task<> Run();
+  Task<> Process(Job job, stdx::stop_token stop_token);
+
+  const coro::util::EventLoop* event_loop_;
+  JobScheduler* job_scheduler_;
+  Config config_;
+  ThumbnailOptions::Codec codec_;
+  // Most recently listed items at the back.
+  std::deque<Job> queue_;
+  bool running_ = false;
+  stdx::stop_source stop_source_;
+};
+
+}  // namespace coro::cloudstorage::util
+
+#endif  // CORO_CLOUDSTORAGE_UTIL_THUMBNAIL_PREGENERATOR_H
@@ -0,0 +1,136 @@
+#include "coro/cloudstorage/util/thumbnail_sheet_handler.h"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "coro/cloudstorage/util/cloud_provider_utils.h"
+#include "coro/http/http_parse.h"
+#include "coro/util/regex.h"
+
+namespace coro::cloudstorage::util {
+
+namespace {
+
+namespace re = coro::util::re;
+
+// Bounds the work of a single request, larger directories get a sheet of
+// their first items.
+constexpr size_t kMaxTileCount = 256;
+constexpr int kMinTileSize = 32;
+constexpr int kMaxTileSize = 512;
+constexpr int kMaxColumns = 32;
+// Bounds both sides of the sheet, whose RGBA canvas is held in memory while
+// it's encoded.
+constexpr int kMaxSheetSize = 4096;
+
+template <typename Query>
+int GetIntParameter(const Query& query, const char* name, int default_value,
+                    int min_value, int max_value) {
+  if (auto it = query.find(name); it != query.end()) {
+    return std::clamp(std::stoi(it->second), min_value, max_value);
+  }
+  return default_value;
+}
+
+nlohmann::json ToJson(const ContactSheet& sheet) {
+  nlohmann::json json;
+  json["width"] = sheet.width;
+  json["height"] = sheet.height;
+  json["tiles"] = nlohmann::json::array();
+  for (const auto& tile : sheet.tiles) {
+    nlohmann::json entry;
+    entry["id"] = tile.id;
+    entry["x"] = tile.x;
+    entry["y"] = tile.y;
+    entry["width"] = tile.width;
+    entry["height"] = tile.height;
+    json["tiles"].emplace_back(std::move(entry));
+  }
+  return json;
+}
+
+}  // namespace
+
+Task<http::Response<>> ThumbnailSheetHandler::operator()(
+    http::Request<> request, stdx::stop_token stop_token) const {
+  auto uri = http::ParseUri(request.url);
+  re::smatch results;
+  if (!re::regex_match(
+          uri.path.value(), results,
+          re::regex(R"(\/thumbnail-sheet\/[^\/]+\/[^\/]+\/(.*)$)"))) {
+    co_return http::Response<>{.status = 400};
+  }
+  auto query = http::ParseQuery(uri.query.value_or(""));
+  ContactSheetOptions options;
+  try {
+    options.tile_size = GetIntParameter(query, "tile_size", options.tile_size,
+                                        kMinTileSize, kMaxTileSize);
+    options.columns = GetIntParameter(
+        query, "columns", options.columns, 1,
+        std::min(kMaxColumns, kMaxSheetSize / options.tile_size));
+  } catch (const std::exception&) {
+    co_return http::Response<>{.status = 400};
+  }
+  int max_rows = kMaxSheetSize / options.tile_size;
+  size_t max_tile_count =
+      std::min(kMaxTileCount, static_cast<size_t>(options.columns * max_rows));
+  if (auto it = query.find("format"); it != query.end()) {
+    if (it->second == "png") {
+      options.codec = ThumbnailOptions::Codec::PNG;
+    } else if (it->second != "jpeg") {
+      co_return http::Response<>{.status = 400};
+    }
+  }
+  std::string item_id =
+      http::DecodeUri(ToStringView(results[1].begin(), results[1].end()));
+  auto item = co_await account_.GetItemById(item_id, stop_token);
+  auto* directory = std::get_if<AbstractCloudProvider::Directory>(&item.item);
+  if (!directory) {
+    co_return http::Response<>{.status = 400};
+  }
+  std::vector<AbstractCloudProvider::File> files;
+  auto versioned = co_await account_.ListDirectory(*directory, stop_token);
+  FOR_CO_AWAIT(const auto& page, versioned.content) {
+    for (const auto& entry : page.items) {
+      const auto* file = std::get_if<AbstractCloudProvider::File>(&entry);
+      if (file && (GetFileType(file->mime_type) == FileType::kImage ||
+                   GetFileType(file->mime_type) == FileType::kVideo)) {
+        files.push_back(*file);
+      }
+    }
+    if (files.size() >= max_tile_count) {
+      files.resize(max_tile_count);
+      break;
+    }
+  }
+  // The position of each item's cell, requested separately so that the image
+  // is served as is.
+  if (auto it = query.find("layout");
+      it != query.end() && it->second == "true") {
+    co_return http::Response<>{
+        .status = 200,
+        .headers = {{"Content-Type", "application/json"},
+                    {"Cache-Control", "private"},
+                    {"Cache-Control", "max-age=3600"}},
+        .body = http::CreateBody(
+            ToJson(GetContactSheetLayout(files, options)).dump())};
+  }
+  ContactSheet sheet = co_await account_.GetContactSheet(
+      std::move(files), options, std::move(stop_token));
+  if (sheet.image.empty()) {
+    co_return http::Response<>{.status = 204};
+  }
+  std::string size = std::to_string(sheet.image.size());
+  co_return http::Response<>{
+      .status = 200,
+      .headers = {{"Content-Type", std::move(sheet.mime_type)},
+                  {"Content-Length", std::move(size)},
+                  {"Cache-Control", "private"},
+                  {"Cache-Control", "max-age=3600"}},
+      .body = http::CreateBody(std::move(sheet.image))};
+}
+
+}  // namespace coro::cloudstorage::util
@@ -0,0 +1,28 @@
+#ifndef CORO_CLOUDSTORAGE_UTIL_THUMBNAIL_SHEET_HANDLER_H
+#define CORO_CLOUDSTORAGE_UTIL_THUMBNAIL_SHEET_HANDLER_H
+
+#include "coro/cloudstorage/util/cloud_provider_account.h"
+#include "coro/http/http.h"
+#include "coro/stdx/stop_token.h"
+#include "coro/task.h"
+
+namespace coro::cloudstorage::util {
+
+// Serves the thumbnails of a directory's images and videos as a single
+// contact sheet image. With "layout=true" returns the position of each item's
+// cell on the sheet as JSON instead, without generating any thumbnails.
+class ThumbnailSheetHandler {
+ public:
+  explicit ThumbnailSheetHandler(CloudProviderAccount account)
+      : account_(std::move(account)) {}
+
+  Task<http::Response<>> operator()(http::Request<> request,
+                                    stdx::stop_token stop_token) const;
+
+ private:
+  CloudProviderAccount account_;
+};
+
+}  // namespace coro::cloudstorage::util
+
+#endif  // CORO_CLOUDSTORAGE_UTIL_THUMBNAIL_SHEET_HANDLER_H
@@ -0,0 +1,317 @@
+#include "coro/cloudstorage/util/transcoder.h"
+
+#include <algorithm>
+#include <string_view>
+#include <utility>
+
+#include "coro/cloudstorage/util/string_utils.h"
+#include "coro/exception.h"
+#include "coro/util/raii_utils.h"
+
+namespace coro::cloudstorage::util {
+
+namespace {
+
+using ::coro::util::AtScopeExit;
+
+using Frame = std::unique_ptr<AVFrame, AVFrameDeleter>;
+using Packet = std::unique_ptr<AVPacket, AVPacketDeleter>;
+
+// Used when the encoder accepts frames of any size.
+constexpr int kAudioFrameSize = 1024;
+
+// Channel layouts are described by AVChannelLayout since FFmpeg 5.1.
+int GetChannelCount(const AVCodecContext* context) {
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 28, 100)
+  return context->ch_layout.nb_channels;
+#else
+  return context->channels;
+#endif
+}
+
+void SetDefaultChannelLayout(AVCodecContext* context, int channel_count) {
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 28, 100)
+  av_channel_layout_uninit(&context->ch_layout);
+  av_channel_layout_default(&context->ch_layout, channel_count);
+#else
+  context->channels = channel_count;
+  context->channel_layout = av_get_default_channel_layout(channel_count);
+#endif
+}
+
+void CopyChannelLayout(const AVCodecContext* context, AVFrame* frame) {
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 28, 100)
+  CheckAVError(av_channel_layout_copy(&frame->ch_layout, &context->ch_layout),
+               "av_channel_layout_copy");
+#else
+  frame->channels = context->channels;
+  frame->channel_layout = context->channel_layout;
+#endif
+}
+
+// Decoders may leave the layout unspecified, the resampler needs one.
+void SetMissingChannelLayout(AVFrame* frame) {
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 28, 100)
+  if (frame->ch_layout.order == AV_CHANNEL_ORDER_UNSPEC) {
+    int channel_count = frame->ch_layout.nb_channels;
+    av_channel_layout_uninit(&frame->ch_layout);
+    av_channel_layout_default(&frame->ch_layout, channel_count);
+  }
+#else
+  if (!frame->channel_layout) {
+    frame->channel_layout = av_get_default_channel_layout(frame->channels);
+  }
+#endif
+}
+
+const AVCodec* FindEncoder(AVCodecID codec_id) {
+  // Preferred over the built-in encoders, which are slower or experimental.
+  const char* name = [&]() -> const char* {
+    switch (codec_id) {
+      case AV_CODEC_ID_H264:
+        return "libx264";
+      case AV_CODEC_ID_VP8:
+        return "libvpx";
+      case AV_CODEC_ID_OPUS:
+        return "libopus";
+      default:
+        return nullptr;
+    }
+  }();
+  const AVCodec* codec = name ? avcodec_find_encoder_by_name(name) : nullptr;
+  if (!codec) {
+    codec = avcodec_find_encoder(codec_id);
+  }
+  if (!codec) {
+    throw RuntimeError(
+        StrCat("encoder for ", avcodec_get_name(codec_id), " not found"));
+  }
+  return codec;
+}
+
+// Presets which keep up with playback on a few cores.
+void SetEncoderOptions(const AVCodec* codec, AVDictionary** options) {
+  std::string_view name = codec->name;
+  if (name == "libx264") {
+    CheckAVError(av_dict_set(options, "preset", "veryfast", 0), "av_dict_set");
+    CheckAVError(av_dict_set(options, "crf", "23", 0), "av_dict_set");
+  } else if (name == "libvpx") {
+    CheckAVError(av_dict_set(options, "deadline", "realtime", 0),
+                 "av_dict_set");
+    CheckAVError(av_dict_set(options, "cpu-used", "8", 0), "av_dict_set");
+    CheckAVError(av_dict_set(options, "crf", "10", 0), "av_dict_set");
+    CheckAVError(av_dict_set(options, "b", "2M", 0), "av_dict_set");
+  }
+}
+
+int GetSampleRate(const AVCodec* codec, int sample_rate) {
+  if (!codec->supported_samplerates) {
+    return sample_rate;
+  }
+  for (const int* it = codec->supported_samplerates; *it; it++) {
+    if (*it == sample_rate) {
+      return sample_rate;
+    }
+  }
+  return codec->supported_samplerates[0];
+}
+
+}  // namespace
+
+Transcoder::Transcoder(const AVStream* stream, AVCodecID codec_id,
+                       const TranscodeOptions& options, bool global_header)
+    : input_time_base_(stream->time_base) {
+  const AVCodec* decoder = avcodec_find_decoder(stream->codecpar->codec_id);
+  if (!decoder) {
+    throw LogicError("decoder not found");
+  }
+  decoder_.reset(avcodec_alloc_context3(decoder));
+  if (!decoder_) {
+    throw RuntimeError("avcodec_alloc_context3");
+  }
+  CheckAVError(avcodec_parameters_to_context(decoder_.get(), stream->codecpar),
+               "avcodec_parameters_to_context");
+  decoder_->pkt_timebase = stream->time_base;
+  decoder_->thread_count = options.thread_count;
+  CheckAVError(avcodec_open2(decoder_.get(), decoder, nullptr),
+               "avcodec_open2");
+
+  const AVCodec* codec = FindEncoder(codec_id);
+  encoder_.reset(avcodec_alloc_context3(codec));
+  if (!encoder_) {
+    throw RuntimeError("avcodec_alloc_context3");
+  }
+  encoder_->thread_count = options.thread_count;
+  encoder_->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;
+  if (global_header) {
+    encoder_->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+  }
+  if (decoder_->codec_type == AVMEDIA_TYPE_VIDEO) {
+    int width = decoder_->width;
+    int height = decoder_->height;
+    if (options.max_height > 0 && height > options.max_height) {
+      width = static_cast<int>(av_rescale(width, options.max_height, height));
+      height = options.max_height;
+    }
+    // 4:2:0 chroma subsampling needs even dimensions.
+    encoder_->width = std::max(2, width & ~1);
+    encoder_->height = std::max(2, height & ~1);
+    encoder_->pix_fmt = AV_PIX_FMT_YUV420P;
+    encoder_->sample_aspect_ratio = decoder_->sample_aspect_ratio;
+    encoder_->time_base = stream->time_base;
+    if (stream->avg_frame_rate.num > 0) {
+      encoder_->framerate = stream->avg_frame_rate;
+    }
+  } else if (decoder_->codec_type == AVMEDIA_TYPE_AUDIO) {
+    encoder_->sample_fmt =
+        codec->sample_fmts ? codec->sample_fmts[0] : AV_SAMPLE_FMT_FLTP;
+    encoder_->sample_rate = GetSampleRate(codec, decoder_->sample_rate);
+    SetDefaultChannelLayout(encoder_.get(),
+                            std::min(GetChannelCount(decoder_.get()), 2));
+    encoder_->time_base = AVRational{1, encoder_->sample_rate};
+    encoder_->bit_rate = 128000;
+  } else {
+    throw RuntimeError("unsupported stream type");
+  }
+  AVDictionary* options_dict = nullptr;
+  auto guard = AtScopeExit([&] { av_dict_free(&options_dict); });
+  SetEncoderOptions(codec, &options_dict);
+  CheckAVError(avcodec_open2(encoder_.get(), codec, &options_dict),
+               "avcodec_open2");
+
+  if (decoder_->codec_type == AVMEDIA_TYPE_AUDIO) {
+    resampler_.reset(swr_alloc());
+    if (!resampler_) {
+      throw RuntimeError("swr_alloc");
+    }
+    fifo_.reset(av_audio_fifo_alloc(encoder_->sample_fmt,
+                                    GetChannelCount(encoder_.get()),
+                                    std::max(encoder_->frame_size, 1)));
+    if (!fifo_) {
+      throw RuntimeError("av_audio_fifo_alloc");
+    }
+  }
+}
+
+std::vector<Frame> Transcoder::Decode(const AVPacket* packet) {
+  int result = avcodec_send_packet(decoder_.get(), packet);
+  if (result != AVERROR_EOF) {
+    CheckAVError(result, "avcodec_send_packet");
+  }
+  std::vector<Frame> frames;
+  while (true) {
+    Frame frame = CreateFrame();
+    result = avcodec_receive_frame(decoder_.get(), frame.get());
+    if (result == AVERROR(EAGAIN) || result == AVERROR_EOF) {
+      break;
+    }
+    CheckAVError(result, "avcodec_receive_frame");
+    if (decoder_->codec_type == AVMEDIA_TYPE_VIDEO) {
+      ConvertVideo(std::move(frame), &frames);
+    } else {
+      ConvertAudio(frame.get(), &frames);
+    }
+  }
+  if (!packet && decoder_->codec_type == AVMEDIA_TYPE_AUDIO) {
+    ConvertAudio(nullptr, &frames);
+  }
+  return frames;
+}
+
+std::vector<Packet> Transcoder::Encode(const AVFrame* frame) {
+  int result = avcodec_send_frame(encoder_.get(), frame);
+  if (result != AVERROR_EOF) {
+    CheckAVError(result, "avcodec_send_frame");
+  }
+  std::vector<Packet> packets;
+  while (true) {
+    Packet packet = CreatePacket();
+    result = avcodec_receive_packet(encoder_.get(), packet.get());
+    if (result == AVERROR(EAGAIN) || result == AVERROR_EOF) {
+      break;
+    }
+    CheckAVError(result, "avcodec_receive_packet");
+    packets.push_back(std::move(packet));
+  }
+  return packets;
+}
+
+void Transcoder::ConvertVideo(Frame frame, std::vector<Frame>* output) {
+  // The encoder's time base is the input stream's.
+  frame->pts = frame->best_effort_timestamp;
+  frame->pict_type = AV_PICTURE_TYPE_NONE;
+  if (frame->width == encoder_->width && frame->height == encoder_->height &&
+      frame->format == encoder_->pix_fmt) {
+    output->push_back(std::move(frame));
+    return;
+  }
+  scaler_.reset(sws_getCachedContext(
+      scaler_.release(), frame->width, frame->height,
+      static_cast<AVPixelFormat>(frame->format), encoder_->width,
+      encoder_->height, encoder_->pix_fmt, SWS_BILINEAR, nullptr, nullptr,
+      nullptr));
+  if (!scaler_) {
+    throw RuntimeError("sws_getCachedContext");
+  }
+  Frame scaled = CreateFrame();
+  scaled->format = encoder_->pix_fmt;
+  scaled->width = encoder_->width;
+  scaled->height = encoder_->height;
+  CheckAVError(av_frame_get_buffer(scaled.get(), 0), "av_frame_get_buffer");
+  CheckAVError(av_frame_copy_props(scaled.get(), frame.get()),
+               "av_frame_copy_props");
+  CheckAVError(sws_scale(scaler_.get(), frame->data, frame->linesize, 0,
+                         frame->height, scaled->data, scaled->linesize),
+               "sws_scale");
+  output->push_back(std::move(scaled));
+}
+
+// Resamples the frame and cuts the result into frames of the encoder's frame
+// size. A null frame flushes the resampler and the remaining samples.
+void Transcoder::ConvertAudio(AVFrame* frame, std::vector<Frame>* output) {
+  if (frame) {
+    SetMissingChannelLayout(frame);
+    if (next_audio_pts_ == AV_NOPTS_VALUE) {
+      next_audio_pts_ = frame->best_effort_timestamp != AV_NOPTS_VALUE
+                            ? av_rescale_q(frame->best_effort_timestamp,
+                                           input_time_base_,
+                                           encoder_->time_base)
+                            : 0;
+    }
+  }
+  if (frame || swr_is_initialized(resampler_.get())) {
+    Frame resampled = CreateFrame();
+    resampled->format = encoder_->sample_fmt;
+    resampled->sample_rate = encoder_->sample_rate;
+    CopyChannelLayout(encoder_.get(), resampled.get());
+    CheckAVError(swr_convert_frame(resampler_.get(), resampled.get(), frame),
+                 "swr_convert_frame");
+    if (resampled->nb_samples > 0 &&
+        av_audio_fifo_write(fifo_.get(),
+                            reinterpret_cast<void**>(resampled->data),
+                            resampled->nb_samples) < resampled->nb_samples) {
+      throw RuntimeError("av_audio_fifo_write");
+    }
+  }
+  int frame_size =
+      encoder_->frame_size > 0 ? encoder_->frame_size : kAudioFrameSize;
+  while (av_audio_fifo_size(fifo_.get()) >= frame_size ||
+         (!frame && av_audio_fifo_size(fifo_.get()) > 0)) {
+    int size = std::min(av_audio_fifo_size(fifo_.get()), frame_size);
+    Frame chunk = CreateFrame();
+    chunk->format = encoder_->sample_fmt;
+    chunk->sample_rate = encoder_->sample_rate;
+    chunk->nb_samples = size;
+    CopyChannelLayout(encoder_.get(), chunk.get());
+    CheckAVError(av_frame_get_buffer(chunk.get(), 0), "av_frame_get_buffer");
+    if (av_audio_fifo_read(fifo_.get(), reinterpret_cast<void**>(chunk->data),
+                           size) < size) {
+      throw RuntimeError("av_audio_fifo_read");
+    }
+    chunk->pts = next_audio_pts_;
+    next_audio_pts_ += size;
+    output->push_back(std::move(chunk));
+  }
+}
+
+}  // namespace coro::cloudstorage::util
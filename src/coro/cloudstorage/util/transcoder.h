@@ -0,0 +1,62 @@
+#ifndef CORO_CLOUDSTORAGE_UTIL_TRANSCODER_H
+#define CORO_CLOUDSTORAGE_UTIL_TRANSCODER_H
+
+extern "C" {
+#include <libavutil/audio_fifo.h>
+#include <libswresample/swresample.h>
+}
+
+#include <memory>
+#include <vector>
+
+#include "coro/cloudstorage/util/ffmpeg_utils.h"
+#include "coro/cloudstorage/util/muxer.h"
+
+namespace coro::cloudstorage::util {
+
+struct SwrContextDeleter {
+  void operator()(SwrContext* context) const { swr_free(&context); }
+};
+
+struct AVAudioFifoDeleter {
+  void operator()(AVAudioFifo* fifo) const { av_audio_fifo_free(fifo); }
+};
+
+// Decodes a stream and encodes it again with a fast software encoder. Decoded
+// frames are scaled or resampled to the encoder's format in between. Decode
+// and Encode may run concurrently with each other, but not with themselves.
+class Transcoder {
+ public:
+  Transcoder(const AVStream* stream, AVCodecID codec_id,
+             const TranscodeOptions& options, bool global_header);
+
+  const AVCodecContext* encoder() const { return encoder_.get(); }
+
+  // Returns the frames decoded from the packet, ready to be encoded. A null
+  // packet flushes the decoder.
+  std::vector<std::unique_ptr<AVFrame, AVFrameDeleter>> Decode(
+      const AVPacket* packet);
+
+  // Returns the packets encoded from the frame, timestamped in the encoder's
+  // time base. A null frame flushes the encoder.
+  std::vector<std::unique_ptr<AVPacket, AVPacketDeleter>> Encode(
+      const AVFrame* frame);
+
+ private:
+  void ConvertVideo(std::unique_ptr<AVFrame, AVFrameDeleter> frame,
+                    std::vector<std::unique_ptr<AVFrame, AVFrameDeleter>>*);
+  void ConvertAudio(AVFrame* frame,
+                    std::vector<std::unique_ptr<AVFrame, AVFrameDeleter>>*);
+
+  AVRational input_time_base_;
+  std::unique_ptr<AVCodecContext, AVCodecContextDeleter> decoder_;
+  std::unique_ptr<AVCodecContext, AVCodecContextDeleter> encoder_;
+  std::unique_ptr<SwsContext, SwsContextDeleter> scaler_;
+  std::unique_ptr<SwrContext, SwrContextDeleter> resampler_;
+  std::unique_ptr<AVAudioFifo, AVAudioFifoDeleter> fifo_;
+  int64_t next_audio_pts_ = AV_NOPTS_VALUE;
+};
+
+}  // namespace coro::cloudstorage::util
+
+#endif  // CORO_CLOUDSTORAGE_UTIL_TRANSCODER_H
@@ -207,16 +207,9 @@ Task<Response> HandleExistingItem(CloudProvider* provider, Request request,
     }
   } else if (request.method == http::Method::kGet) {
     if constexpr (std::is_same_v<Item, AbstractCloudProvider::File>) {
-      co_return co_await GetFileContentResponse(
-          provider, std::move(d),
-          [&]() -> std::optional<http::Range> {
-            if (auto header = http::GetHeader(request.headers, "Range")) {
-              return http::ParseRange(std::move(*header));
-            } else {
-              return std::nullopt;
-            }
-          }(),
-          std::move(stop_token));
+      co_return co_await GetFileContentResponse(provider, std::move(d),
+                                                std::move(request.headers),
+                                                std::move(stop_token));
     } else {
       co_return Response{.status = 400};
     }
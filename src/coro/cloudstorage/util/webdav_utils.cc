@@ -2,6 +2,8 @@
 
 #include <array>
 #include <cstring>
+#include <iomanip>
+#include <locale>
 #include <sstream>
 
 #include "coro/http/http_parse.h"
@@ -16,6 +18,8 @@ constexpr std::array<std::string_view, 12> kMonthNames = {
     "Jan", "Feb", "Mar", "Apr", "May", "Jun",
     "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
 
+}  // namespace
+
 std::string GetRFC1123(int64_t timestamp) {
   const int kBufferSize = 29;
   tm tm = coro::http::gmtime(timestamp);
@@ -26,7 +30,16 @@ std::string GetRFC1123(int64_t timestamp) {
   return buffer;
 }
 
-}  // namespace
+std::optional<int64_t> ParseRFC1123(std::string_view date) {
+  std::istringstream stream{std::string(date)};
+  stream.imbue(std::locale::classic());
+  std::tm tm{};
+  stream >> std::get_time(&tm, "%a, %d %b %Y %H:%M:%S GMT");
+  if (stream.fail()) {
+    return std::nullopt;
+  }
+  return http::timegm(tm);
+}
 
 std::string GetMultiStatusResponse(std::span<const std::string> responses) {
   std::stringstream stream;
@@ -4,6 +4,7 @@
 #include <optional>
 #include <span>
 #include <string>
+#include <string_view>
 
 #include "coro/generator.h"
 
@@ -21,6 +22,9 @@ struct ElementData {
 std::string GetMultiStatusResponse(std::span<const std::string> responses);
 std::string GetElement(const ElementData&);
 
+std::string GetRFC1123(int64_t timestamp);
+std::optional<int64_t> ParseRFC1123(std::string_view date);
+
 }  // namespace coro::cloudstorage::util
 
 #endif  // CORO_CLOUDSTORAGE_WEBDAV_UTILS_H
@@ -0,0 +1,55 @@
+#include "coro/cloudstorage/util/content_hash.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+namespace coro::cloudstorage::util {
+namespace {
+
+TEST(ContentHashTest, ComputesMD5) {
+  EXPECT_EQ(GetContentHash(ContentHash::Type::kMD5, "abc").value,
+            "900150983cd24fb0d6963f7d28e17f72");
+}
+
+TEST(ContentHashTest, ComputesDropboxContentHash) {
+  EXPECT_EQ(GetContentHash(ContentHash::Type::kDropbox, "").value,
+            "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+  EXPECT_EQ(GetContentHash(ContentHash::Type::kDropbox, "abc").value,
+            "4f8b42c22dd3729b519ba6f68d2da7cc5b2d606d05daed5ad5128cc03e6c6358");
+
+  ContentHasher hasher(ContentHash::Type::kDropbox);
+  hasher.Update(std::string(4 * 1024 * 1024 - 1, 'x'));
+  hasher.Update("xxxx");
+  EXPECT_EQ(std::move(hasher).Finalize().value,
+            "3a61de5895fc8a51189b8a0cc06e6e71478d1e946219c707c5f5781e3ace9d98");
+}
+
+TEST(ContentHashTest, ComputesQuickXorHash) {
+  EXPECT_EQ(GetContentHash(ContentHash::Type::kQuickXor, "").value,
+            "AAAAAAAAAAAAAAAAAAAAAAAAAAA=");
+  EXPECT_EQ(GetContentHash(ContentHash::Type::kQuickXor, "abc").value,
+            "YRDDGAAAAAAAAAAAAwAAAAAAAAA=");
+}
+
+TEST(ContentHashTest, QuickXorHashDoesNotDependOnChunking) {
+  std::string content;
+  for (int i = 0; i < 1000; i++) {
+    content += static_cast<char>(i * 31 + 7);
+  }
+  ContentHasher hasher(ContentHash::Type::kQuickXor);
+  hasher.Update(content.substr(0, 17));
+  hasher.Update(content.substr(17, 400));
+  hasher.Update(content.substr(417));
+  EXPECT_EQ(std::move(hasher).Finalize(),
+            GetContentHash(ContentHash::Type::kQuickXor, content));
+}
+
+TEST(ContentHashTest, ComparesHexDigestsCaseInsensitively) {
+  EXPECT_EQ(GetContentHash(ContentHash::Type::kMD5, "abc"),
+            (ContentHash{.type = ContentHash::Type::kMD5,
+                         .value = "900150983CD24FB0D6963F7D28E17F72"}));
+}
+
+}  // namespace
+}  // namespace coro::cloudstorage::util
@@ -9,11 +9,14 @@ namespace coro::cloudstorage::test {
 
 namespace {
 
+using ::coro::cloudstorage::util::AbstractCloudProvider;
 using ::coro::cloudstorage::util::AuthData;
 using ::coro::cloudstorage::util::CloudFactoryContext;
 using ::coro::cloudstorage::util::CloudProviderAccount;
+using ::coro::cloudstorage::util::JobScheduler;
 using ::coro::cloudstorage::util::RandomNumberGenerator;
 using ::coro::cloudstorage::util::StrCat;
+using ::coro::cloudstorage::util::ThumbnailPregenerator;
 using ::coro::http::CreateHttpServer;
 using ::coro::http::GetBody;
 using ::coro::util::EventLoop;
@@ -45,11 +48,21 @@ class AccountListener {
 
 CloudFactoryContext CreateContext(const EventLoop* event_loop,
                                   std::string config_path,
-                                  std::string cache_path, http::Http http) {
+                                  std::string cache_path,
+                                  std::string mux_cache_path,
+                                  int64_t mux_cache_size,
+                                  JobScheduler::Config job_scheduler_config,
+                                  ThumbnailPregenerator::Config
+                                      thumbnail_pregenerator_config,
+                                  http::Http http) {
   return CloudFactoryContext(
       {.event_loop = event_loop,
        .config_path = std::move(config_path),
        .cache_path = std::move(cache_path),
+       .mux_cache_path = std::move(mux_cache_path),
+       .mux_cache_size = mux_cache_size,
+       .job_scheduler_config = job_scheduler_config,
+       .thumbnail_pregenerator_config = thumbnail_pregenerator_config,
        .auth_data =
            AuthData("http://localhost:12345", nlohmann::json::parse(R"js({
              "google": {
@@ -100,6 +113,16 @@ CloudProviderAccount TestCloudProviderAccount::GetAccount() const {
   throw CloudException(CloudException::Type::kNotFound);
 }
 
+std::string TestCloudProviderAccount::GetFileContent(
+    AbstractCloudProvider::File file, http::Range range) const {
+  return event_loop_->Do(
+      [this, file = std::move(file), range]() mutable -> Task<std::string> {
+        CloudProviderAccount account = GetAccount();
+        co_return co_await GetBody(account.provider()->GetFileContent(
+            std::move(file), range, stdx::stop_token()));
+      });
+}
+
 FakeCloudFactoryContext::FakeCloudFactoryContext(
     FakeCloudFactoryContextConfig config)
     : thread_([this, config = std::move(config)]() mutable {
@@ -161,6 +184,10 @@ FakeCloudFactoryContext::ThreadState::ThreadState(
     : config_(std::move(config)),
       context_(CreateContext(&event_loop_, config_.config_file_path,
                              config_.cache_file_path,
+                             config_.mux_cache_path,
+                             config_.mux_cache_size,
+                             config_.job_scheduler_config,
+                             config_.thumbnail_pregenerator_config,
                              coro::http::Http(std::move(config_.http)))) {}
 
 }  // namespace coro::cloudstorage::test
\ No newline at end of file
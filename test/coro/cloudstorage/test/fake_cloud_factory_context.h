@@ -3,6 +3,8 @@
 
 #include <coro/util/event_loop.h>
 
+#include <utility>
+
 #include "coro/cloudstorage/test/fake_http_client.h"
 #include "coro/cloudstorage/test/test_utils.h"
 #include "coro/cloudstorage/util/cloud_factory_context.h"
@@ -34,6 +36,16 @@ class TestCloudProviderAccount {
         std::move(args)...);
   }
 
+  auto GetItem(std::string id) const {
+    return WithAccount(
+        &coro::cloudstorage::util::AbstractCloudProvider::GetItem,
+        std::move(id));
+  }
+
+  std::string GetFileContent(
+      coro::cloudstorage::util::AbstractCloudProvider::File file,
+      http::Range range) const;
+
  private:
   friend class FakeCloudFactoryContext;
 
@@ -55,6 +67,12 @@ struct FakeCloudFactoryContextConfig {
   std::optional<TemporaryFile> cache_file = TemporaryFile();
   std::string config_file_path{config_file->path()};
   std::string cache_file_path{cache_file->path()};
+  std::optional<TemporaryDirectory> mux_cache_directory = TemporaryDirectory();
+  std::string mux_cache_path{mux_cache_directory->path()};
+  int64_t mux_cache_size = int64_t{4} << 30;
+  coro::cloudstorage::util::JobScheduler::Config job_scheduler_config;
+  coro::cloudstorage::util::ThumbnailPregenerator::Config
+      thumbnail_pregenerator_config;
   FakeHttpClient http;
 };
 
@@ -75,6 +93,15 @@ class FakeCloudFactoryContext {
   TestCloudProviderAccount GetAccount(
       coro::cloudstorage::util::CloudProviderAccount::Id id);
 
+  // Runs the task returned by `f(context, accounts)` on the event loop thread
+  // and waits for its result.
+  template <typename F>
+  auto Do(F f) {
+    return state_->event_loop().Do([this, f = std::move(f)]() mutable {
+      return f(state_->context(), std::as_const(state_->accounts()));
+    });
+  }
+
  private:
   void RunThread(FakeCloudFactoryContextConfig);
 
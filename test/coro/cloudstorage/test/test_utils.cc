@@ -4,6 +4,7 @@
 
 #include <filesystem>
 #include <fstream>
+#include <utility>
 
 #include "coro/cloudstorage/util/file_utils.h"
 #include "coro/cloudstorage/util/string_utils.h"
@@ -160,6 +161,52 @@ bool AreVideosEquivImpl(std::string_view path1, std::string_view path2,
   return true;
 }
 
+DecodedFrameCount CountDecodedFramesImpl(std::string_view path,
+                                         std::string_view format) {
+  std::unique_ptr<AVFilterGraph, AVFilterGraphDeleter> graph{
+      avfilter_graph_alloc()};
+  if (!graph) {
+    throw RuntimeError("avfilter_graph_alloc");
+  }
+  std::string graph_str = fmt::format(
+      "movie=filename={}:f={}:dec_threads=1:s=dv+da [v][a];"
+      "[v] buffersink@video;"
+      "[a] abuffersink@audio;",
+      EscapePath(path), format);
+  if (avfilter_graph_parse(graph.get(), graph_str.c_str(), nullptr, nullptr,
+                           nullptr) != 0) {
+    throw RuntimeError("avfilter_graph_parse2 error");
+  }
+  if (avfilter_graph_config(graph.get(), nullptr) != 0) {
+    throw RuntimeError("avfilter_graph_config error");
+  }
+  AVFilterContext* sinks[] = {
+      avfilter_graph_get_filter(graph.get(), "buffersink@video"),
+      avfilter_graph_get_filter(graph.get(), "abuffersink@audio")};
+  int64_t counts[] = {0, 0};
+  bool drained[] = {false, false};
+  while (!drained[0] || !drained[1]) {
+    for (int i = 0; i < 2; i++) {
+      if (drained[i]) {
+        continue;
+      }
+      std::unique_ptr<AVFrame, AVFrameDeleter> frame{av_frame_alloc()};
+      if (!frame) {
+        throw RuntimeError("av_frame_alloc");
+      }
+      int err = av_buffersink_get_frame(sinks[i], frame.get());
+      if (err == AVERROR_EOF) {
+        drained[i] = true;
+      } else if (err != 0) {
+        throw RuntimeError("av_buffersink_get_frame");
+      } else {
+        counts[i]++;
+      }
+    }
+  }
+  return DecodedFrameCount{.video = counts[0], .audio = counts[1]};
+}
+
 void WriteFileContent(std::FILE* file, std::string_view content) {
   if (std::fwrite(content.data(), 1, content.size(), file) != content.size()) {
     throw RuntimeError("fwrite error");
@@ -202,6 +249,39 @@ TemporaryFile::~TemporaryFile() {
   }
 }
 
+TemporaryDirectory::TemporaryDirectory() {
+#ifdef _WIN32
+  std::string path(MAX_PATH, 0);
+  if (GetTempFileNameA(kTestRunDirectory.data(), "tmp", 0, path.data()) == 0) {
+    throw RuntimeError("GetTempFileNameA error");
+  }
+  path.resize(strlen(path.c_str()));
+  std::filesystem::remove(path);
+  std::filesystem::create_directory(path);
+  path_ = std::move(path);
+#else
+  std::string tmpl = StrCat(kTestRunDirectory, "/tmp.XXXXXX");
+  if (!mkdtemp(tmpl.data())) {
+    throw RuntimeError("mkdtemp error");
+  }
+  path_ = std::move(tmpl);
+#endif
+}
+
+TemporaryDirectory::TemporaryDirectory(TemporaryDirectory&& other) noexcept
+    : path_(std::exchange(other.path_, "")) {}
+
+TemporaryDirectory::~TemporaryDirectory() {
+  if (!path_.empty()) {
+    std::error_code ec;
+    std::filesystem::remove_all(path_, ec);
+    if (ec) {
+      fmt::println(stderr, "Failed to remove directory {}.", path_);
+      abort();
+    }
+  }
+}
+
 std::string GetTestFileContent(std::string_view filename) {
   return GetFileContent(StrCat(kTestDataDirectory, '/', filename));
 }
@@ -222,4 +302,11 @@ bool AreVideosEquiv(std::string_view video1, std::string_view video2,
   return AreVideosEquivImpl(f1.path(), f2.path(), format);
 }
 
+DecodedFrameCount CountDecodedFrames(std::string_view video,
+                                     std::string_view format) {
+  TemporaryFile file;
+  WriteFileContent(file.stream(), video);
+  return CountDecodedFramesImpl(file.path(), format);
+}
+
 }  // namespace coro::cloudstorage::test
\ No newline at end of file
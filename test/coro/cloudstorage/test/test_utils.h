@@ -1,6 +1,7 @@
 #ifndef CORO_CLOUDSTORAGE_TEST_TEST_UTILS_H
 #define CORO_CLOUDSTORAGE_TEST_TEST_UTILS_H
 
+#include <cstdint>
 #include <string>
 #include <string_view>
 
@@ -29,6 +30,22 @@ class TemporaryFile {
   std::unique_ptr<std::FILE, coro::cloudstorage::util::FileDeleter> file_;
 };
 
+class TemporaryDirectory {
+ public:
+  TemporaryDirectory();
+  TemporaryDirectory(const TemporaryDirectory&) = delete;
+  TemporaryDirectory(TemporaryDirectory&&) noexcept;
+  TemporaryDirectory& operator=(const TemporaryDirectory&) = delete;
+  TemporaryDirectory& operator=(TemporaryDirectory&&) = delete;
+
+  ~TemporaryDirectory();
+
+  std::string_view path() const { return path_; }
+
+ private:
+  std::string path_;
+};
+
 std::string GetTestFileContent(std::string_view filename);
 
 void WriteTestFileContent(std::string_view filename, std::string_view content);
@@ -36,6 +53,16 @@ void WriteTestFileContent(std::string_view filename, std::string_view content);
 bool AreVideosEquiv(std::string_view video1, std::string_view video2,
                     std::string_view format);
 
+struct DecodedFrameCount {
+  int64_t video;
+  int64_t audio;
+};
+
+// Decodes the video and the audio stream of `video`, throws if either is
+// missing or doesn't decode.
+DecodedFrameCount CountDecodedFrames(std::string_view video,
+                                     std::string_view format);
+
 }  // namespace coro::cloudstorage::test
 
 #endif  // CORO_CLOUDSTORAGE_TEST_TEST_UTILS_H
@@ -0,0 +1,88 @@
+#include "coro/cloudstorage/util/exif_utils.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace coro::cloudstorage::util {
+namespace {
+
+constexpr std::string_view kPreview = "\xFF\xD8preview\xFF\xD9";
+
+void Append16(std::string& data, uint16_t value) {
+  data += static_cast<char>(value >> 8);
+  data += static_cast<char>(value & 0xFF);
+}
+
+void Append32(std::string& data, uint32_t value) {
+  Append16(data, static_cast<uint16_t>(value >> 16));
+  Append16(data, static_cast<uint16_t>(value & 0xFFFF));
+}
+
+void AppendEntry(std::string& data, uint16_t tag, uint16_t type,
+                 uint32_t value) {
+  Append16(data, tag);
+  Append16(data, type);
+  Append32(data, 1);
+  if (type == 3) {
+    Append16(data, static_cast<uint16_t>(value));
+    Append16(data, 0);
+  } else {
+    Append32(data, value);
+  }
+}
+
+// Big endian TIFF with the orientation in IFD0 and the preview in IFD1.
+std::string CreateJpeg(int orientation) {
+  std::string tiff = "MM";
+  Append16(tiff, 42);
+  Append32(tiff, 8);
+  // IFD0 at 8, one entry.
+  Append16(tiff, 1);
+  AppendEntry(tiff, 0x0112, 3, static_cast<uint32_t>(orientation));
+  Append32(tiff, 26);
+  // IFD1 at 26, two entries, preview at 56.
+  Append16(tiff, 2);
+  AppendEntry(tiff, 0x0201, 4, 56);
+  AppendEntry(tiff, 0x0202, 4, static_cast<uint32_t>(kPreview.size()));
+  Append32(tiff, 0);
+  tiff += kPreview;
+
+  std::string exif = std::string("Exif\0\0", 6) + tiff;
+  std::string jpeg = "\xFF\xD8";
+  jpeg += "\xFF\xE0";
+  Append16(jpeg, 4);
+  jpeg += "JF";
+  jpeg += "\xFF\xE1";
+  Append16(jpeg, static_cast<uint16_t>(exif.size() + 2));
+  jpeg += exif;
+  jpeg += "\xFF\xDA";
+  Append16(jpeg, 2);
+  return jpeg;
+}
+
+TEST(ExifUtilsTest, FindsPreview) {
+  std::string jpeg = CreateJpeg(/*orientation=*/6);
+
+  auto thumbnail = GetExifThumbnail(jpeg);
+
+  ASSERT_TRUE(thumbnail);
+  EXPECT_EQ(thumbnail->data, kPreview);
+  EXPECT_EQ(thumbnail->orientation, 6);
+}
+
+TEST(ExifUtilsTest, IgnoresTruncatedHeader) {
+  std::string jpeg = CreateJpeg(/*orientation=*/1);
+
+  EXPECT_FALSE(GetExifThumbnail(std::string_view(jpeg).substr(0, 40)));
+}
+
+TEST(ExifUtilsTest, IgnoresFileWithoutExif) {
+  EXPECT_FALSE(GetExifThumbnail("\xFF\xD8\xFF\xDA\x00\x02"));
+  EXPECT_FALSE(GetExifThumbnail("not a jpeg"));
+}
+
+}  // namespace
+}  // namespace coro::cloudstorage::util
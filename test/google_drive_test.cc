@@ -36,7 +36,8 @@ TEST(GoogleDriveTest, ListDirectory) {
                       {{"q", "'root' in parents"},
                        {"fields",
                         "files(id,name,thumbnailLink,trashed,mimeType,iconLink,"
-                        "parents,size,modifiedTime),kind,nextPageToken"}})))
+                        "parents,size,modifiedTime,md5Checksum),kind,"
+                        "nextPageToken"}})))
               .WillReturn(R"js({
                 "files": [
                   {
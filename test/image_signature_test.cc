@@ -0,0 +1,62 @@
+#include "coro/cloudstorage/util/image_signature.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace coro::cloudstorage::util {
+namespace {
+
+struct Image {
+  int width;
+  int height;
+  std::vector<uint8_t> pixels;
+
+  RgbaImage view() const {
+    return RgbaImage{.data = pixels.data(),
+                     .linesize = width * 4,
+                     .width = width,
+                     .height = height};
+  }
+};
+
+// Horizontal gradient, brightening to the right unless `reversed`.
+Image CreateGradient(int width, int height, bool reversed) {
+  Image image{.width = width, .height = height};
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      auto value = static_cast<uint8_t>((reversed ? width - 1 - x : x) * 255 /
+                                        (width - 1));
+      image.pixels.insert(image.pixels.end(), {value, value, value, 255});
+    }
+  }
+  return image;
+}
+
+TEST(ImageSignatureTest, ScaledImagesHaveSimilarHashes) {
+  auto small = GetImageSignature(CreateGradient(36, 24, false).view());
+  auto large = GetImageSignature(CreateGradient(144, 96, false).view());
+  auto reversed = GetImageSignature(CreateGradient(144, 96, true).view());
+
+  EXPECT_LE(GetHammingDistance(small.perceptual_hash, large.perceptual_hash),
+            4);
+  EXPECT_GE(
+      GetHammingDistance(large.perceptual_hash, reversed.perceptual_hash), 32);
+}
+
+TEST(ImageSignatureTest, FindsDominantColor) {
+  Image image{.width = 10, .height = 10};
+  for (int i = 0; i < 100; i++) {
+    if (i < 70) {
+      image.pixels.insert(image.pixels.end(), {200, 16, 16, 255});
+    } else {
+      image.pixels.insert(image.pixels.end(), {16, 16, 200, 255});
+    }
+  }
+
+  EXPECT_EQ(GetImageSignature(image.view()).dominant_color, 0xC81010u);
+}
+
+}  // namespace
+}  // namespace coro::cloudstorage::util
@@ -0,0 +1,388 @@
+#include <fmt/format.h>
+#include <gtest/gtest.h>
+
+#include <nlohmann/json.hpp>
+
+#include "coro/cloudstorage/test/fake_cloud_factory_context.h"
+#include "coro/cloudstorage/test/fake_http_client.h"
+#include "coro/cloudstorage/test/test_utils.h"
+#include "coro/cloudstorage/util/handler_utils.h"
+
+namespace coro::cloudstorage::test {
+namespace {
+
+using ::coro::cloudstorage::util::AbstractCloudProvider;
+using ::coro::cloudstorage::util::CloudFactoryContext;
+using ::coro::cloudstorage::util::CloudProviderAccount;
+using ::coro::cloudstorage::util::ContentHash;
+using ::coro::cloudstorage::util::GetContentValidators;
+
+constexpr int64_t kTimestamp = 1703852943;
+
+FakeHttpClient CreateHttpClient(
+    std::string_view content,
+    std::vector<ResponseContent> failed_content_responses = {},
+    std::string_view md5_checksum = "", bool has_size = true) {
+  nlohmann::json metadata = {{"id", "id1"},
+                             {"name", "file.txt"},
+                             {"modifiedTime", "2023-12-29T12:29:03Z"},
+                             {"parents", nlohmann::json::array({"root"})},
+                             {"mimeType", "text/plain"}};
+  if (has_size) {
+    metadata["size"] = std::to_string(content.size());
+  }
+  if (!md5_checksum.empty()) {
+    metadata["md5Checksum"] = md5_checksum;
+  }
+  FakeHttpClient http;
+  http.Expect(HttpRequest("https://accounts.google.com/o/oauth2/token")
+                  .WillReturn(R"js({
+                    "access_token": "access_token",
+                    "refresh_token": "refresh_token"
+                  })js"))
+      .Expect(HttpRequest("https://www.googleapis.com/drive/v3/"
+                          "about?fields=user,storageQuota")
+                  .WillReturn(R"js({
+                    "user": {
+                      "emailAddress": "test@gmail.com"
+                    },
+                    "storageQuota": {
+                      "usage": "2137"
+                    }
+                  })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/id1?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(metadata.dump()));
+  for (auto& response : failed_content_responses) {
+    http.Expect(
+        HttpRequest("https://www.googleapis.com/drive/v3/files/id1?alt=media")
+            .WillReturn(std::move(response)));
+  }
+  http.Expect(
+      HttpRequest("https://www.googleapis.com/drive/v3/files/id1?alt=media")
+          .WillRespondToRangeRequestWith(content));
+  return http;
+}
+
+TEST(ItemContentHandlerTest, ServesSingleRange) {
+  FakeCloudFactoryContext test_helper(CreateHttpClient("0123456789"));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response =
+      test_helper.Fetch({.url = "/content/google/test%40gmail.com/id1",
+                         .headers = {{"Range", "bytes=2-4"}}});
+
+  EXPECT_EQ(response.status, 206);
+  EXPECT_EQ(response.body, "234");
+  EXPECT_EQ(http::GetHeader(response.headers, "Content-Range"),
+            "bytes 2-4/10");
+}
+
+TEST(ItemContentHandlerTest, ServesMultipleRanges) {
+  FakeCloudFactoryContext test_helper(CreateHttpClient("0123456789"));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response =
+      test_helper.Fetch({.url = "/content/google/test%40gmail.com/id1",
+                         .headers = {{"Range", "bytes=7-8, 0-1,1-2,-1"}}});
+
+  EXPECT_EQ(response.status, 206);
+  auto content_type = http::GetHeader(response.headers, "Content-Type");
+  ASSERT_TRUE(content_type);
+  std::string_view prefix = "multipart/byteranges; boundary=";
+  ASSERT_TRUE(content_type->starts_with(prefix));
+  std::string boundary = content_type->substr(prefix.size());
+  EXPECT_EQ(response.body,
+            fmt::format("\r\n--{0}\r\nContent-Type: text/plain\r\n"
+                        "Content-Range: bytes 0-2/10\r\n\r\n012"
+                        "\r\n--{0}\r\nContent-Type: text/plain\r\n"
+                        "Content-Range: bytes 7-9/10\r\n\r\n789"
+                        "\r\n--{0}--\r\n",
+                        boundary));
+  EXPECT_EQ(http::GetHeader(response.headers, "Content-Length"),
+            std::to_string(response.body.size()));
+}
+
+TEST(ItemContentHandlerTest, IgnoresTooManyRanges) {
+  FakeCloudFactoryContext test_helper(CreateHttpClient("0123456789"));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  std::string header = "bytes=0-0";
+  for (int i = 1; i < 17; i++) {
+    header += fmt::format(",{0}-{0}", i % 10);
+  }
+  auto response =
+      test_helper.Fetch({.url = "/content/google/test%40gmail.com/id1",
+                         .headers = {{"Range", header}}});
+
+  EXPECT_EQ(response.status, 200);
+  EXPECT_EQ(response.body, "0123456789");
+}
+
+TEST(ItemContentHandlerTest, IgnoresOverlappingRangesLargerThanFile) {
+  FakeCloudFactoryContext test_helper(CreateHttpClient("0123456789"));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response =
+      test_helper.Fetch({.url = "/content/google/test%40gmail.com/id1",
+                         .headers = {{"Range", "bytes=0-8,1-9"}}});
+
+  EXPECT_EQ(response.status, 200);
+  EXPECT_EQ(response.body, "0123456789");
+}
+
+TEST(ItemContentHandlerTest, ServesWholeFileOfUnknownSizeForSuffixRange) {
+  FakeCloudFactoryContext test_helper(
+      CreateHttpClient("0123456789", {}, "", /*has_size=*/false));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response =
+      test_helper.Fetch({.url = "/content/google/test%40gmail.com/id1",
+                         .headers = {{"Range", "bytes=0-1,-2"}}});
+
+  EXPECT_EQ(response.status, 200);
+  EXPECT_EQ(response.body, "0123456789");
+}
+
+TEST(ItemContentHandlerTest, ServesWholeFileOfUnknownSizeForMultipleRanges) {
+  FakeCloudFactoryContext test_helper(
+      CreateHttpClient("0123456789", {}, "", /*has_size=*/false));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response =
+      test_helper.Fetch({.url = "/content/google/test%40gmail.com/id1",
+                         .headers = {{"Range", "bytes=0-1,4-5"}}});
+
+  EXPECT_EQ(response.status, 200);
+  EXPECT_EQ(response.body, "0123456789");
+}
+
+TEST(ItemContentHandlerTest, RejectsUnsatisfiableRange) {
+  FakeCloudFactoryContext test_helper(CreateHttpClient("0123456789"));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response =
+      test_helper.Fetch({.url = "/content/google/test%40gmail.com/id1",
+                         .headers = {{"Range", "bytes=10-"}}});
+
+  EXPECT_EQ(response.status, 416);
+  EXPECT_EQ(http::GetHeader(response.headers, "Content-Range"), "bytes */10");
+}
+
+TEST(ItemContentHandlerTest, RejectsEmptySuffixRange) {
+  FakeCloudFactoryContext test_helper(CreateHttpClient("0123456789"));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response =
+      test_helper.Fetch({.url = "/content/google/test%40gmail.com/id1",
+                         .headers = {{"Range", "bytes=-0"}}});
+
+  EXPECT_EQ(response.status, 416);
+  EXPECT_EQ(http::GetHeader(response.headers, "Content-Range"), "bytes */10");
+}
+
+TEST(ItemContentHandlerTest, RejectsSuffixRangeOfEmptyFile) {
+  FakeCloudFactoryContext test_helper(CreateHttpClient(""));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response =
+      test_helper.Fetch({.url = "/content/google/test%40gmail.com/id1",
+                         .headers = {{"Range", "bytes=-5"}}});
+
+  EXPECT_EQ(response.status, 416);
+  EXPECT_EQ(http::GetHeader(response.headers, "Content-Range"), "bytes */0");
+}
+
+TEST(ItemContentHandlerTest, ReturnsValidators) {
+  FakeCloudFactoryContext test_helper(CreateHttpClient("0123456789"));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response =
+      test_helper.Fetch({.url = "/content/google/test%40gmail.com/id1"});
+
+  EXPECT_EQ(response.status, 200);
+  EXPECT_EQ(response.body, "0123456789");
+  EXPECT_EQ(http::GetHeader(response.headers, "ETag"),
+            GetContentValidators("id1", kTimestamp, 10).etag);
+  EXPECT_EQ(http::GetHeader(response.headers, "Last-Modified"),
+            "Fri, 29 Dec 2023 12:29:03 GMT");
+}
+
+TEST(ItemContentHandlerTest, ReturnsETagOfContentHash) {
+  FakeCloudFactoryContext test_helper(CreateHttpClient(
+      "0123456789", {}, "781e5e245d69b566979b86e28d23f2c7"));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response =
+      test_helper.Fetch({.url = "/content/google/test%40gmail.com/id1"});
+
+  auto etag = GetContentValidators(
+                  "id1", kTimestamp, 10,
+                  ContentHash{.type = ContentHash::Type::kMD5,
+                              .value = "781e5e245d69b566979b86e28d23f2c7"})
+                  .etag;
+  ASSERT_TRUE(etag);
+  EXPECT_EQ(http::GetHeader(response.headers, "ETag"), etag);
+  EXPECT_NE(etag, GetContentValidators("id1", kTimestamp, 10).etag);
+}
+
+TEST(ItemContentHandlerTest, ReturnsETagWithoutTimestamp) {
+  auto validators = GetContentValidators("id1", std::nullopt, 10);
+
+  EXPECT_TRUE(validators.etag);
+  EXPECT_FALSE(validators.last_modified);
+  EXPECT_NE(validators.etag,
+            GetContentValidators("id1", std::nullopt, 11).etag);
+  EXPECT_FALSE(GetContentValidators("id1", std::nullopt, std::nullopt).etag);
+}
+
+TEST(ItemContentHandlerTest, HonorsIfNoneMatch) {
+  FakeCloudFactoryContext test_helper(CreateHttpClient("0123456789"));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  std::string etag = *GetContentValidators("id1", kTimestamp, 10).etag;
+  auto response = test_helper.Fetch(
+      {.url = "/content/google/test%40gmail.com/id1",
+       .headers = {{"If-None-Match", fmt::format("\"other\", W/{}", etag)}}});
+
+  EXPECT_EQ(response.status, 304);
+  EXPECT_EQ(response.body, "");
+}
+
+TEST(ItemContentHandlerTest, HonorsIfModifiedSince) {
+  FakeCloudFactoryContext test_helper(CreateHttpClient("0123456789"));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response = test_helper.Fetch(
+      {.url = "/content/google/test%40gmail.com/id1",
+       .headers = {{"If-Modified-Since", "Sat, 30 Dec 2023 00:00:00 GMT"}}});
+
+  EXPECT_EQ(response.status, 304);
+}
+
+TEST(ItemContentHandlerTest, IgnoresRangeWhenIfRangeDoesNotMatch) {
+  FakeCloudFactoryContext test_helper(CreateHttpClient("0123456789"));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response =
+      test_helper.Fetch({.url = "/content/google/test%40gmail.com/id1",
+                         .headers = {{"Range", "bytes=2-4"},
+                                     {"If-Range", "\"stale-etag\""}}});
+
+  EXPECT_EQ(response.status, 200);
+  EXPECT_EQ(response.body, "0123456789");
+}
+
+TEST(ItemContentHandlerTest, RetriesTransientUpstreamError) {
+  FakeCloudFactoryContext test_helper(
+      CreateHttpClient("0123456789", {ResponseContent{.status = 503}}));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response =
+      test_helper.Fetch({.url = "/content/google/test%40gmail.com/id1",
+                         .headers = {{"Range", "bytes=2-4"}}});
+
+  EXPECT_EQ(response.status, 206);
+  EXPECT_EQ(response.body, "234");
+}
+
+TEST(ItemContentHandlerTest, ResumesTruncatedUpstreamStream) {
+  FakeCloudFactoryContext test_helper(CreateHttpClient(
+      "0123456789", {ResponseContent{.status = 200, .body = "0123"},
+                     ResponseContent{.status = 206, .body = "45"}}));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response =
+      test_helper.Fetch({.url = "/content/google/test%40gmail.com/id1"});
+
+  EXPECT_EQ(response.status, 200);
+  EXPECT_EQ(response.body, "0123456789");
+}
+
+TEST(ItemContentHandlerTest, ResumesStreamWithRangeEndPastEndOfFile) {
+  FakeCloudFactoryContext test_helper(CreateHttpClient(
+      "0123456789", {ResponseContent{.status = 206, .body = "23"}}));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+  auto account = test_helper.GetAccount(CloudProviderAccount::Id{
+      .type = "google", .username = "test@gmail.com"});
+  auto file = std::get<AbstractCloudProvider::File>(account.GetItem("id1"));
+
+  EXPECT_EQ(account.GetFileContent(file, http::Range{.start = 2, .end = 20}),
+            "23456789");
+}
+
+TEST(ItemContentHandlerTest, VerifiesContentHash) {
+  FakeCloudFactoryContext test_helper(CreateHttpClient(
+      "0123456789", {}, "781e5e245d69b566979b86e28d23f2c7"));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response =
+      test_helper.Fetch({.url = "/content/google/test%40gmail.com/id1"});
+
+  EXPECT_EQ(response.body, "0123456789");
+}
+
+TEST(ItemContentHandlerTest, DetectsContentHashMismatch) {
+  FakeCloudFactoryContext test_helper(CreateHttpClient(
+      "0123456789", {}, "00000000000000000000000000000000"));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response =
+      test_helper.Fetch({.url = "/content/google/test%40gmail.com/id1"});
+
+  EXPECT_TRUE(response.body.starts_with("0123456789"));
+  EXPECT_NE(response.body.find("Content hash mismatch"), std::string::npos);
+}
+
+TEST(ItemContentHandlerTest, ExportsTransferMetrics) {
+  FakeCloudFactoryContext test_helper(CreateHttpClient("0123456789"));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+  ASSERT_EQ(
+      test_helper.Fetch({.url = "/content/google/test%40gmail.com/id1"}).body,
+      "0123456789");
+
+  auto response = test_helper.Fetch({.url = "/metrics"});
+
+  EXPECT_EQ(response.status, 200);
+  EXPECT_NE(response.body.find("cloudstorage_downloaded_bytes_total{provider="
+                               "\"google\"} 10\n"),
+            std::string::npos);
+  EXPECT_EQ(response.body.find("test@gmail.com"), std::string::npos);
+  EXPECT_NE(
+      response.body.find("# TYPE cloudstorage_content_time_to_first_byte_"
+                         "seconds histogram\n"),
+      std::string::npos);
+}
+
+TEST(ItemContentHandlerTest, CountsDroppedContentStreams) {
+  FakeCloudFactoryContext test_helper(CreateHttpClient("0123456789"));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+  auto file = std::get<AbstractCloudProvider::File>(
+      test_helper
+          .GetAccount(CloudProviderAccount::Id{.type = "google",
+                                               .username = "test@gmail.com"})
+          .GetItem("id1"));
+
+  test_helper.Do([&](CloudFactoryContext&,
+                     const std::vector<CloudProviderAccount>& accounts)
+                     -> Task<> {
+    auto content = accounts.at(0).provider()->GetFileContent(
+        file, http::Range{}, stdx::stop_token());
+    co_await content.begin();
+  });
+  auto response = test_helper.Fetch({.url = "/metrics"});
+
+  EXPECT_NE(response.body.find("cloudstorage_provider_requests_total{provider="
+                               "\"google\",method=\"GetFileContent\","
+                               "result=\"cancelled\"} 1\n"),
+            std::string::npos);
+}
+
+}  // namespace
+}  // namespace coro::cloudstorage::test
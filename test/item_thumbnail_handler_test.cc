@@ -0,0 +1,148 @@
+#include <fmt/format.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "coro/cloudstorage/test/fake_cloud_factory_context.h"
+#include "coro/cloudstorage/test/fake_http_client.h"
+#include "coro/cloudstorage/test/test_utils.h"
+#include "coro/cloudstorage/util/thumbnail_generator.h"
+
+namespace coro::cloudstorage::test {
+namespace {
+
+using ::coro::cloudstorage::util::IsThumbnailCodecSupported;
+using ::coro::cloudstorage::util::ThumbnailOptions;
+
+constexpr std::string_view kThumbnailUrl =
+    "/thumbnail/google/test%40gmail.com/id1";
+
+// The provider has no thumbnail of the video, so each of the
+// `generated_count` thumbnails is generated from the file content.
+// `fetch_count` is the number of thumbnail requests made.
+FakeHttpClient CreateHttpClient(int fetch_count, int generated_count) {
+  FakeHttpClient http;
+  http.Expect(HttpRequest("https://accounts.google.com/o/oauth2/token")
+                  .WillReturn(R"js({
+                    "access_token": "access_token",
+                    "refresh_token": "refresh_token"
+                  })js"))
+      .Expect(HttpRequest("https://www.googleapis.com/drive/v3/"
+                          "about?fields=user,storageQuota")
+                  .WillReturn(R"js({
+                    "user": {
+                      "emailAddress": "test@gmail.com"
+                    },
+                    "storageQuota": {
+                      "usage": "2137"
+                    }
+                  })js"));
+  for (int i = 0; i < fetch_count; i++) {
+    http.Expect(
+        HttpRequest(
+            fmt::format("https://www.googleapis.com/drive/v3/files/id1?{}",
+                        http::FormDataToString(
+                            {{"fields",
+                              "id,name,thumbnailLink,trashed,mimeType,"
+                              "iconLink,parents,size,modifiedTime,"
+                              "md5Checksum"}})))
+            .WillReturn(R"js({
+              "id": "id1",
+              "name": "name1.mp4",
+              "thumbnailLink": "thumbnail-link",
+              "modifiedTime": "2023-12-29T12:29:03Z",
+              "parents": [ "root" ],
+              "size": "2508570",
+              "mimeType": "video/mp4"
+            })js"));
+  }
+  for (int i = 0; i < generated_count; i++) {
+    http.Expect(HttpRequest("thumbnail-link")
+                    .WillReturn(ResponseContent{.status = 404}));
+  }
+  http.Expect(
+      HttpRequest("https://www.googleapis.com/drive/v3/files/id1?alt=media")
+          .WillRespondToRangeRequestWith(GetTestFileContent("video.mp4")));
+  return http;
+}
+
+uint32_t Read32(std::string_view data, size_t offset) {
+  uint32_t value = 0;
+  for (size_t i = 0; i < 4; i++) {
+    value = (value << 8) | static_cast<uint8_t>(data[offset + i]);
+  }
+  return value;
+}
+
+// The account manager appends its own Vary header.
+bool IsVaryingOnAccept(const ResponseContent& response) {
+  return std::any_of(response.headers.begin(), response.headers.end(),
+                     [](const auto& header) {
+                       return http::ToLowerCase(header.first) == "vary" &&
+                              header.second == "Accept";
+                     });
+}
+
+// Longest side of a PNG image, from its IHDR chunk.
+uint32_t GetPngSize(std::string_view png) {
+  EXPECT_GE(png.size(), 24u);
+  EXPECT_EQ(png.substr(1, 3), "PNG");
+  EXPECT_EQ(png.substr(12, 4), "IHDR");
+  return std::max(Read32(png, 16), Read32(png, 20));
+}
+
+TEST(ItemThumbnailHandlerTest, ReturnsWebpWhenAccepted) {
+  if (!IsThumbnailCodecSupported(ThumbnailOptions::Codec::WEBP)) {
+    GTEST_SKIP() << "FFmpeg has no WebP encoder";
+  }
+  FakeCloudFactoryContext test_helper(
+      CreateHttpClient(/*fetch_count=*/1, /*generated_count=*/1));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response = test_helper.Fetch(
+      {.url = std::string(kThumbnailUrl),
+       .headers = {{"Accept", "image/webp,image/*;q=0.8,*/*;q=0.5"}}});
+
+  EXPECT_EQ(response.status, 200);
+  EXPECT_EQ(http::GetHeader(response.headers, "Content-Type"), "image/webp");
+  EXPECT_TRUE(IsVaryingOnAccept(response));
+  EXPECT_EQ(response.body.substr(0, 4), "RIFF");
+  EXPECT_EQ(response.body.substr(8, 4), "WEBP");
+}
+
+TEST(ItemThumbnailHandlerTest, ReturnsPngWithoutAcceptedFormat) {
+  FakeCloudFactoryContext test_helper(
+      CreateHttpClient(/*fetch_count=*/1, /*generated_count=*/1));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  // The test client sends "Accept: */*", wildcards don't select a format.
+  auto response = test_helper.Fetch({.url = std::string(kThumbnailUrl)});
+
+  EXPECT_EQ(response.status, 200);
+  EXPECT_EQ(http::GetHeader(response.headers, "Content-Type"), "image/png");
+  EXPECT_TRUE(IsVaryingOnAccept(response));
+  EXPECT_EQ(GetPngSize(response.body), 256u);
+}
+
+TEST(ItemThumbnailHandlerTest, CachesQualitiesSeparately) {
+  FakeCloudFactoryContext test_helper(
+      CreateHttpClient(/*fetch_count=*/3, /*generated_count=*/2));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto low = test_helper.Fetch({.url = std::string(kThumbnailUrl)});
+  auto high = test_helper.Fetch(
+      {.url = fmt::format("{}?quality=high", kThumbnailUrl)});
+  auto cached_low = test_helper.Fetch({.url = std::string(kThumbnailUrl)});
+
+  EXPECT_EQ(low.status, 200);
+  EXPECT_EQ(high.status, 200);
+  EXPECT_EQ(GetPngSize(low.body), 256u);
+  EXPECT_EQ(GetPngSize(high.body), 1024u);
+  EXPECT_EQ(cached_low.body, low.body);
+}
+
+}  // namespace
+}  // namespace coro::cloudstorage::test
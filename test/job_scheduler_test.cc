@@ -0,0 +1,138 @@
+#include "coro/cloudstorage/util/job_scheduler.h"
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "coro/exception.h"
+#include "coro/http/http_exception.h"
+#include "coro/stdx/stop_source.h"
+#include "coro/task.h"
+
+namespace coro::cloudstorage::util {
+namespace {
+
+using Priority = JobScheduler::Priority;
+
+class JobSchedulerTest : public ::testing::Test {
+ protected:
+  void Start(int id, Priority priority, const void* owner,
+             stdx::stop_token stop_token = stdx::stop_token()) {
+    RunTask([this, id, priority, owner,
+             stop_token = std::move(stop_token)]() -> Task<> {
+      try {
+        auto slot = co_await scheduler_.Acquire(priority, owner, stop_token);
+        admitted_.push_back(id);
+        slots_.emplace(id, std::move(slot));
+      } catch (const http::HttpException&) {
+        rejected_.push_back(id);
+      } catch (const InterruptedException&) {
+        interrupted_.push_back(id);
+      }
+    });
+  }
+
+  void Finish(int id) { slots_.erase(id); }
+
+  JobScheduler scheduler_{
+      JobScheduler::Config{.interactive = {.max_running = 1, .max_queued = 3},
+                           .streaming = {.max_running = 1, .max_queued = 1},
+                           .background = {.max_running = 1, .max_queued = 1},
+                           .idle = {.max_running = 1, .max_queued = 1}}};
+  std::map<int, JobScheduler::Slot> slots_;
+  std::vector<int> admitted_;
+  std::vector<int> rejected_;
+  std::vector<int> interrupted_;
+};
+
+TEST_F(JobSchedulerTest, AdmitsQueuedJobsRoundRobinAcrossOwners) {
+  int owner_a;
+  int owner_b;
+  Start(0, Priority::kInteractive, &owner_a);
+  Start(1, Priority::kInteractive, &owner_a);
+  Start(2, Priority::kInteractive, &owner_a);
+  Start(3, Priority::kInteractive, &owner_b);
+  EXPECT_EQ(admitted_, (std::vector<int>{0}));
+
+  Finish(0);
+  Finish(3);
+  Finish(1);
+  EXPECT_EQ(admitted_, (std::vector<int>{0, 3, 1, 2}));
+}
+
+TEST_F(JobSchedulerTest, BackgroundJobsDontTakeInteractiveSlots) {
+  int owner;
+  Start(0, Priority::kBackground, &owner);
+  Start(1, Priority::kInteractive, &owner);
+  EXPECT_EQ(admitted_, (std::vector<int>{0, 1}));
+}
+
+TEST_F(JobSchedulerTest, StreamingJobsDontWaitForBackgroundJobs) {
+  int owner;
+  Start(0, Priority::kBackground, &owner);
+  Start(1, Priority::kBackground, &owner);
+  Start(2, Priority::kStreaming, &owner);
+  EXPECT_EQ(admitted_, (std::vector<int>{0, 2}));
+  EXPECT_FALSE(scheduler_.IsIdle(Priority::kStreaming));
+
+  Finish(2);
+  EXPECT_TRUE(scheduler_.IsIdle(Priority::kStreaming));
+  EXPECT_EQ(admitted_, (std::vector<int>{0, 2}));
+}
+
+TEST_F(JobSchedulerTest, IdleJobsDontTakeBackgroundSlots) {
+  int owner;
+  Start(0, Priority::kIdle, &owner);
+  Start(1, Priority::kBackground, &owner);
+  Start(2, Priority::kIdle, &owner);
+  EXPECT_EQ(admitted_, (std::vector<int>{0, 1}));
+  EXPECT_TRUE(scheduler_.IsIdle(Priority::kInteractive));
+
+  Finish(0);
+  EXPECT_EQ(admitted_, (std::vector<int>{0, 1, 2}));
+}
+
+TEST_F(JobSchedulerTest, ReportsIdleClasses) {
+  int owner;
+  EXPECT_TRUE(scheduler_.IsIdle(Priority::kInteractive));
+
+  Start(0, Priority::kInteractive, &owner);
+  Start(1, Priority::kInteractive, &owner);
+  Finish(0);
+  EXPECT_FALSE(scheduler_.IsIdle(Priority::kInteractive));
+  EXPECT_TRUE(scheduler_.IsIdle(Priority::kBackground));
+
+  Finish(1);
+  EXPECT_TRUE(scheduler_.IsIdle(Priority::kInteractive));
+}
+
+TEST_F(JobSchedulerTest, RejectsJobsOverQueueLimit) {
+  int owner;
+  Start(0, Priority::kBackground, &owner);
+  Start(1, Priority::kBackground, &owner);
+  Start(2, Priority::kBackground, &owner);
+  EXPECT_EQ(admitted_, (std::vector<int>{0}));
+  EXPECT_EQ(rejected_, (std::vector<int>{2}));
+
+  Finish(0);
+  EXPECT_EQ(admitted_, (std::vector<int>{0, 1}));
+}
+
+TEST_F(JobSchedulerTest, RemovesInterruptedJobsFromQueue) {
+  int owner;
+  stdx::stop_source stop_source;
+  Start(0, Priority::kBackground, &owner);
+  Start(1, Priority::kBackground, &owner, stop_source.get_token());
+  stop_source.request_stop();
+  EXPECT_EQ(interrupted_, (std::vector<int>{1}));
+
+  Start(2, Priority::kBackground, &owner);
+  Finish(0);
+  EXPECT_EQ(admitted_, (std::vector<int>{0, 2}));
+  EXPECT_TRUE(rejected_.empty());
+}
+
+}  // namespace
+}  // namespace coro::cloudstorage::util
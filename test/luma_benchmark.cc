@@ -0,0 +1,95 @@
+#include <fmt/format.h>
+
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "coro/cloudstorage/util/luma_utils.h"
+
+// Compares the scalar dark pixel count the thumbnail generator used to run on
+// every decoded frame with IsMostlyDark, on a black frame (which has to be
+// scanned completely) and on a regular one (where the scan exits early).
+
+namespace coro::cloudstorage::test {
+namespace {
+
+using ::coro::cloudstorage::util::IsMostlyDark;
+using ::coro::cloudstorage::util::LumaPlane;
+
+constexpr int kWidth = 1920;
+constexpr int kHeight = 1080;
+constexpr int kLinesize = 1984;
+constexpr int kIterations = 500;
+
+bool IsMostlyDarkScalar(const LumaPlane& plane) {
+  int count = 0;
+  const uint8_t* p = plane.data;
+  for (int i = 0; i < plane.height; i++) {
+    for (int j = 0; j < plane.width; j++) {
+      count += p[j] < 32;
+    }
+    p += plane.linesize;
+  }
+  return count * 100 / (plane.width * plane.height) >= 95;
+}
+
+// Luma plane with `bright_percent` percent of the samples above the threshold.
+std::vector<uint8_t> CreatePlane(int bright_percent) {
+  std::mt19937 random(2137);
+  std::uniform_int_distribution<int> percent(0, 99);
+  std::uniform_int_distribution<int> dark(0, 31);
+  std::uniform_int_distribution<int> bright(32, 255);
+  std::vector<uint8_t> data(size_t{kLinesize} * kHeight);
+  for (uint8_t& sample : data) {
+    sample = static_cast<uint8_t>(percent(random) < bright_percent
+                                      ? bright(random)
+                                      : dark(random));
+  }
+  return data;
+}
+
+template <typename F>
+double GetFramesPerSecond(const LumaPlane& plane, F is_dark) {
+  int dark_count = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; i++) {
+    dark_count += is_dark(plane);
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  if (dark_count != 0 && dark_count != kIterations) {
+    fmt::println("inconsistent result");
+  }
+  return kIterations / elapsed.count();
+}
+
+void RunBenchmark() {
+  fmt::println("{:<16}{:>14}{:>14}{:>10}", "frame", "scalar fps", "simd fps",
+               "speedup");
+  for (auto [name, bright_percent] :
+       {std::pair<std::string_view, int>{"black", 2}, {"dim", 30},
+        {"regular", 70}}) {
+    std::vector<uint8_t> data = CreatePlane(bright_percent);
+    LumaPlane plane{.data = data.data(),
+                    .linesize = kLinesize,
+                    .width = kWidth,
+                    .height = kHeight};
+    double scalar = GetFramesPerSecond(plane, IsMostlyDarkScalar);
+    double simd = GetFramesPerSecond(plane, [](const LumaPlane& plane) {
+      return IsMostlyDark(plane, /*threshold=*/32, /*min_percent=*/95);
+    });
+    fmt::println("{:<16}{:>14.0f}{:>14.0f}{:>9.2f}x", name, scalar, simd,
+                 simd / scalar);
+  }
+}
+
+}  // namespace
+}  // namespace coro::cloudstorage::test
+
+int main() {
+  coro::cloudstorage::test::RunBenchmark();
+  return 0;
+}
@@ -0,0 +1,53 @@
+#include "coro/cloudstorage/util/luma_utils.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace coro::cloudstorage::util {
+namespace {
+
+constexpr int kSize = 16;
+
+LumaPlane GetPlane(const std::vector<uint8_t>& data) {
+  return LumaPlane{
+      .data = data.data(), .linesize = kSize, .width = kSize, .height = kSize};
+}
+
+TEST(LumaUtilsTest, DetectsDarkPlane) {
+  std::vector<uint8_t> data(kSize * kSize, 10);
+  data[0] = 255;
+
+  EXPECT_TRUE(IsMostlyDark(GetPlane(data), /*threshold=*/32,
+                           /*min_percent=*/95));
+
+  std::fill(data.begin(), data.begin() + kSize * 2, 255);
+
+  EXPECT_FALSE(IsMostlyDark(GetPlane(data), /*threshold=*/32,
+                            /*min_percent=*/95));
+}
+
+TEST(LumaUtilsTest, ComputesMeanLuma) {
+  std::vector<uint8_t> data(kSize * kSize, 100);
+  std::fill(data.begin(), data.begin() + kSize * kSize / 2, 200);
+
+  EXPECT_DOUBLE_EQ(GetMeanLuma(GetPlane(data)), 150);
+}
+
+TEST(LumaUtilsTest, FlatPlaneIsLessSharpThanCheckerboard) {
+  std::vector<uint8_t> flat(kSize * kSize, 128);
+  std::vector<uint8_t> checkerboard(kSize * kSize);
+  for (int i = 0; i < kSize; i++) {
+    for (int j = 0; j < kSize; j++) {
+      checkerboard[i * kSize + j] = (i + j) % 2 ? 255 : 0;
+    }
+  }
+
+  EXPECT_DOUBLE_EQ(GetSharpness(GetPlane(flat)), 0);
+  EXPECT_DOUBLE_EQ(GetSharpness(GetPlane(checkerboard)), 255);
+}
+
+}  // namespace
+}  // namespace coro::cloudstorage::util
@@ -1,13 +1,120 @@
 #include <fmt/format.h>
 #include <gtest/gtest.h>
 
+#include <nlohmann/json.hpp>
+
+#include <exception>
+#include <filesystem>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "coro/cloudstorage/providers/local_filesystem.h"
 #include "coro/cloudstorage/test/fake_cloud_factory_context.h"
 #include "coro/cloudstorage/test/fake_http_client.h"
 #include "coro/cloudstorage/test/test_utils.h"
+#include "coro/cloudstorage/util/abstract_cloud_provider_impl.h"
+#include "coro/cloudstorage/util/cloud_provider_utils.h"
+#include "coro/cloudstorage/util/job_scheduler.h"
+#include "coro/cloudstorage/util/mux_handler.h"
+#include "coro/cloudstorage/util/muxer.h"
+#include "coro/generator.h"
+#include "coro/http/http_parse.h"
+#include "coro/promise.h"
+#include "coro/util/event_loop.h"
+#include "coro/util/thread_pool.h"
 
 namespace coro::cloudstorage::test {
 namespace {
 
+using ::coro::cloudstorage::util::AbstractCloudProvider;
+using ::coro::cloudstorage::util::CloudFactoryContext;
+using ::coro::cloudstorage::util::CloudProviderAccount;
+using ::coro::cloudstorage::util::CreateAbstractCloudProviderImpl;
+using ::coro::cloudstorage::util::GetItemById;
+using ::coro::cloudstorage::util::JobScheduler;
+using ::coro::cloudstorage::util::MediaContainer;
+using ::coro::cloudstorage::util::MuxedFile;
+using ::coro::cloudstorage::util::Muxer;
+using ::coro::cloudstorage::util::MuxerProgress;
+using ::coro::cloudstorage::util::MuxHandler;
+
+// Opened on the event loop thread, resumes everything waiting for it.
+class Gate {
+ public:
+  Task<> Wait() {
+    if (open_) {
+      co_return;
+    }
+    auto promise = std::make_shared<Promise<void>>();
+    waiters_.push_back(promise);
+    co_await *promise;
+  }
+
+  void Open() {
+    open_ = true;
+    for (const auto& waiter : std::exchange(waiters_, {})) {
+      waiter->SetValue();
+    }
+  }
+
+ private:
+  bool open_ = false;
+  std::vector<std::shared_ptr<Promise<void>>> waiters_;
+};
+
+Generator<std::string> GetHeldBackContent(std::string content,
+                                          size_t held_offset,
+                                          std::shared_ptr<Gate> gate) {
+  if (held_offset > 0) {
+    co_yield content.substr(0, held_offset);
+  }
+  if (held_offset < content.size()) {
+    co_await gate->Wait();
+    co_yield content.substr(held_offset);
+  }
+}
+
+// Responds to range requests for `url` with `content`, holding back the bytes
+// past `held_offset` until `gate` is opened.
+HttpRequestStubbing RespondHoldingBack(std::string url, std::string content,
+                                       size_t held_offset,
+                                       std::shared_ptr<Gate> gate) {
+  return HttpRequestStubbing{
+      .matcher =
+          [url = std::move(url)](const http::Request<std::string>& request) {
+            return request.url == url;
+          },
+      .request_f = [content = std::move(content), held_offset,
+                    gate = std::move(gate)](
+                       http::Request<std::string> request,
+                       stdx::stop_token) -> Task<http::Response<>> {
+        http::Range range;
+        if (auto header = http::GetHeader(request.headers, "Range")) {
+          range = http::ParseRange(std::move(*header));
+        }
+        size_t start = static_cast<size_t>(range.start);
+        size_t end = range.end ? static_cast<size_t>(*range.end) + 1
+                               : content.size();
+        co_return http::Response<>{
+            .status = 206,
+            .headers = {{"Accept-Ranges", "bytes"},
+                        {"Content-Length", std::to_string(end - start)},
+                        {"Content-Range",
+                         fmt::format("bytes {}-{}/{}", start, end - 1,
+                                     content.size())}},
+            .body = GetHeldBackContent(
+                content.substr(start, end - start),
+                held_offset > start ? held_offset - start : 0, gate)};
+      },
+      .pending = false};
+}
+
 TEST(MuxerTest, Mp4Test) {
   FakeHttpClient http;
   http.Expect(HttpRequest("https://accounts.google.com/o/oauth2/token")
@@ -31,7 +138,8 @@ TEST(MuxerTest, Mp4Test) {
                           http::FormDataToString(
                               {{"fields",
                                 "id,name,thumbnailLink,trashed,mimeType,"
-                                "iconLink,parents,size,modifiedTime"}})))
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
               .WillReturn(R"js({
                 "id": "id1",
                 "name": "video.mp4",
@@ -47,7 +155,8 @@ TEST(MuxerTest, Mp4Test) {
                           http::FormDataToString(
                               {{"fields",
                                 "id,name,thumbnailLink,trashed,mimeType,"
-                                "iconLink,parents,size,modifiedTime"}})))
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
               .WillReturn(R"js({
                 "id": "id2",
                 "name": "audio.m4a",
@@ -105,7 +214,8 @@ TEST(MuxerTest, MuxerSeekableMp4Output) {
                           http::FormDataToString(
                               {{"fields",
                                 "id,name,thumbnailLink,trashed,mimeType,"
-                                "iconLink,parents,size,modifiedTime"}})))
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
               .WillReturn(R"js({
                 "id": "id1",
                 "name": "video.mp4",
@@ -121,7 +231,8 @@ TEST(MuxerTest, MuxerSeekableMp4Output) {
                           http::FormDataToString(
                               {{"fields",
                                 "id,name,thumbnailLink,trashed,mimeType,"
-                                "iconLink,parents,size,modifiedTime"}})))
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
               .WillReturn(R"js({
                 "id": "id2",
                 "name": "audio.m4a",
@@ -156,7 +267,7 @@ TEST(MuxerTest, MuxerSeekableMp4Output) {
                              GetTestFileContent("muxed-seekable.mp4"), "mov"));
 }
 
-TEST(Muxer, MuxerWebmTest) {
+TEST(MuxerTest, ServesRangeOfSeekableMp4Output) {
   FakeHttpClient http;
   http.Expect(HttpRequest("https://accounts.google.com/o/oauth2/token")
                   .WillReturn(R"js({
@@ -179,15 +290,16 @@ TEST(Muxer, MuxerWebmTest) {
                           http::FormDataToString(
                               {{"fields",
                                 "id,name,thumbnailLink,trashed,mimeType,"
-                                "iconLink,parents,size,modifiedTime"}})))
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
               .WillReturn(R"js({
                 "id": "id1",
-                "name": "video.webm",
+                "name": "video.mp4",
                 "thumbnailLink": "thumbnail-link",
                 "modifiedTime": "2023-12-29T12:29:03Z",
                 "parents": [ "root" ],
-                "size": "197787",
-                "mimeType": "video/webm"
+                "size": "2508570",
+                "mimeType": "video/mp4"
               })js"))
       .Expect(
           HttpRequest(
@@ -195,22 +307,23 @@ TEST(Muxer, MuxerWebmTest) {
                           http::FormDataToString(
                               {{"fields",
                                 "id,name,thumbnailLink,trashed,mimeType,"
-                                "iconLink,parents,size,modifiedTime"}})))
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
               .WillReturn(R"js({
                 "id": "id2",
-                "name": "audio.webm",
+                "name": "audio.m4a",
                 "iconLink": "icon-link",
                 "modifiedTime": "2023-12-29T12:29:03Z",
                 "parents": [ "root" ],
-                "size": "249177",
-                "mimeType": "audio/webm"
+                "size": "245256",
+                "mimeType": "audio/mp4"
               })js"))
       .Expect(
           HttpRequest("https://www.googleapis.com/drive/v3/files/id1?alt=media")
-              .WillRespondToRangeRequestWith(GetTestFileContent("video.webm")))
+              .WillRespondToRangeRequestWith(GetTestFileContent("video.mp4")))
       .Expect(
           HttpRequest("https://www.googleapis.com/drive/v3/files/id2?alt=media")
-              .WillRespondToRangeRequestWith(GetTestFileContent("audio.webm")));
+              .WillRespondToRangeRequestWith(GetTestFileContent("audio.m4a")));
   FakeCloudFactoryContext test_helper(std::move(http));
   ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
 
@@ -223,14 +336,116 @@ TEST(Muxer, MuxerWebmTest) {
                                    {"audio_account_name", "test@gmail.com"},
                                    {"video_id", "id1"},
                                    {"audio_id", "id2"},
-                                   {"format", "webm"},
-                                   {"seekable", "false"}}))});
+                                   {"format", "mp4"},
+                                   {"seekable", "true"}})),
+       .headers = {{"Range", "bytes=0-99"}}});
+  EXPECT_EQ(response.status, 206);
+  EXPECT_EQ(response.body.size(), 100u);
+  EXPECT_EQ(response.body.substr(4, 4), "ftyp");
+  EXPECT_EQ(http::GetHeader(response.headers, "Accept-Ranges"), "bytes");
+  auto content_range = http::GetHeader(response.headers, "Content-Range");
+  ASSERT_TRUE(content_range);
+  EXPECT_TRUE(content_range->starts_with("bytes 0-99/"));
+}
+
+// The head of the output is final as soon as it's written, so the range is
+// served while the audio track, held back near its end, keeps the mux running.
+TEST(MuxerTest, ServesRangeOfSeekableMp4OutputBeforeMuxCompletes) {
+  auto gate = std::make_shared<Gate>();
+  FakeHttpClient http;
+  http.Expect(HttpRequest("https://accounts.google.com/o/oauth2/token")
+                  .WillReturn(R"js({
+                    "access_token": "access_token",
+                    "refresh_token": "refresh_token"
+                  })js"))
+      .Expect(HttpRequest("https://www.googleapis.com/drive/v3/"
+                          "about?fields=user,storageQuota")
+                  .WillReturn(R"js({
+                    "user": {
+                      "emailAddress": "test@gmail.com"
+                    },
+                    "storageQuota": {
+                      "usage": "2137"
+                    }
+                  })js"));
+  // Once for the range, once for the whole output.
+  for (int i = 0; i < 2; i++) {
+    http.Expect(
+            HttpRequest(fmt::format(
+                            "https://www.googleapis.com/drive/v3/files/id1?{}",
+                            http::FormDataToString(
+                                {{"fields",
+                                  "id,name,thumbnailLink,trashed,mimeType,"
+                                  "iconLink,parents,size,modifiedTime,"
+                                  "md5Checksum"}})))
+                .WillReturn(R"js({
+                  "id": "id1",
+                  "name": "video.mp4",
+                  "modifiedTime": "2023-12-29T12:29:03Z",
+                  "parents": [ "root" ],
+                  "size": "2508570",
+                  "mimeType": "video/mp4"
+                })js"))
+        .Expect(
+            HttpRequest(fmt::format(
+                            "https://www.googleapis.com/drive/v3/files/id2?{}",
+                            http::FormDataToString(
+                                {{"fields",
+                                  "id,name,thumbnailLink,trashed,mimeType,"
+                                  "iconLink,parents,size,modifiedTime,"
+                                  "md5Checksum"}})))
+                .WillReturn(R"js({
+                  "id": "id2",
+                  "name": "audio.m4a",
+                  "modifiedTime": "2023-12-29T12:29:03Z",
+                  "parents": [ "root" ],
+                  "size": "245256",
+                  "mimeType": "audio/mp4"
+                })js"));
+  }
+  http.Expect(
+          HttpRequest("https://www.googleapis.com/drive/v3/files/id1?alt=media")
+              .WillRespondToRangeRequestWith(GetTestFileContent("video.mp4")))
+      .Expect(RespondHoldingBack(
+          "https://www.googleapis.com/drive/v3/files/id2?alt=media",
+          GetTestFileContent("audio.m4a"), /*held_offset=*/200000, gate));
+  FakeCloudFactoryContext test_helper(std::move(http));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+  std::string url = fmt::format(
+      "/mux?{}",
+      http::FormDataToString({{"video_account_type", "google"},
+                              {"video_account_name", "test@gmail.com"},
+                              {"audio_account_type", "google"},
+                              {"audio_account_name", "test@gmail.com"},
+                              {"video_id", "id1"},
+                              {"audio_id", "id2"},
+                              {"format", "mp4"},
+                              {"seekable", "true"}}));
+
+  auto range_response =
+      test_helper.Fetch({.url = url, .headers = {{"Range", "bytes=0-99"}}});
+  EXPECT_EQ(range_response.status, 206);
+  EXPECT_EQ(http::GetHeader(range_response.headers, "Content-Range"),
+            "bytes 0-99/*");
+  ASSERT_EQ(range_response.body.size(), 100u);
+  EXPECT_EQ(range_response.body.substr(4, 4), "ftyp");
+  // Finished jobs aren't listed.
+  EXPECT_EQ(
+      nlohmann::json::parse(test_helper.Fetch({.url = "/mux/jobs"}).body)
+          .size(),
+      1u);
+
+  test_helper.Do([&](CloudFactoryContext&,
+                     const std::vector<CloudProviderAccount>&) -> Task<> {
+    gate->Open();
+    co_return;
+  });
+  auto response = test_helper.Fetch({.url = url});
   EXPECT_EQ(response.status, 200);
-  EXPECT_TRUE(AreVideosEquiv(
-      response.body, GetTestFileContent("muxed-nonseekable.webm"), "webm"));
+  EXPECT_EQ(response.body.substr(0, 100), range_response.body);
 }
 
-TEST(MuxerTest, MuxerWebmSeekableOutput) {
+TEST(MuxerTest, ReusesCachedMuxOutput) {
   FakeHttpClient http;
   http.Expect(HttpRequest("https://accounts.google.com/o/oauth2/token")
                   .WillReturn(R"js({
@@ -253,15 +468,16 @@ TEST(MuxerTest, MuxerWebmSeekableOutput) {
                           http::FormDataToString(
                               {{"fields",
                                 "id,name,thumbnailLink,trashed,mimeType,"
-                                "iconLink,parents,size,modifiedTime"}})))
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
               .WillReturn(R"js({
                 "id": "id1",
-                "name": "video.webm",
+                "name": "video.mp4",
                 "thumbnailLink": "thumbnail-link",
                 "modifiedTime": "2023-12-29T12:29:03Z",
                 "parents": [ "root" ],
-                "size": "197787",
-                "mimeType": "video/webm"
+                "size": "2508570",
+                "mimeType": "video/mp4"
               })js"))
       .Expect(
           HttpRequest(
@@ -269,39 +485,907 @@ TEST(MuxerTest, MuxerWebmSeekableOutput) {
                           http::FormDataToString(
                               {{"fields",
                                 "id,name,thumbnailLink,trashed,mimeType,"
-                                "iconLink,parents,size,modifiedTime"}})))
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
               .WillReturn(R"js({
                 "id": "id2",
-                "name": "audio.webm",
+                "name": "audio.m4a",
                 "iconLink": "icon-link",
                 "modifiedTime": "2023-12-29T12:29:03Z",
                 "parents": [ "root" ],
+                "size": "245256",
+                "mimeType": "audio/mp4"
+              })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/id1?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(R"js({
+                "id": "id1",
+                "name": "video.mp4",
+                "thumbnailLink": "thumbnail-link",
+                "modifiedTime": "2023-12-29T12:29:03Z",
+                "parents": [ "root" ],
+                "size": "2508570",
+                "mimeType": "video/mp4"
+              })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/id2?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(R"js({
+                "id": "id2",
+                "name": "audio.m4a",
+                "iconLink": "icon-link",
+                "modifiedTime": "2023-12-29T12:29:03Z",
+                "parents": [ "root" ],
+                "size": "245256",
+                "mimeType": "audio/mp4"
+              })js"))
+      .Expect(
+          HttpRequest("https://www.googleapis.com/drive/v3/files/id1?alt=media")
+              .WillRespondToRangeRequestWith(GetTestFileContent("video.mp4")))
+      .Expect(
+          HttpRequest("https://www.googleapis.com/drive/v3/files/id2?alt=media")
+              .WillRespondToRangeRequestWith(GetTestFileContent("audio.m4a")));
+  FakeCloudFactoryContext test_helper(std::move(http));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  std::string url = fmt::format(
+      "/mux?{}",
+      http::FormDataToString({{"video_account_type", "google"},
+                              {"video_account_name", "test@gmail.com"},
+                              {"audio_account_type", "google"},
+                              {"audio_account_name", "test@gmail.com"},
+                              {"video_id", "id1"},
+                              {"audio_id", "id2"},
+                              {"format", "mp4"},
+                              {"seekable", "true"}}));
+  auto get_downloaded_bytes = [&] {
+    std::string metrics = test_helper.Fetch({.url = "/metrics"}).body;
+    auto begin = metrics.find("cloudstorage_downloaded_bytes_total{");
+    return metrics.substr(begin, metrics.find('\n', begin) - begin);
+  };
+
+  auto first_response = test_helper.Fetch({.url = url});
+  std::string downloaded_bytes = get_downloaded_bytes();
+  auto second_response = test_helper.Fetch({.url = url});
+
+  EXPECT_EQ(second_response.status, 200);
+  EXPECT_EQ(second_response.body, first_response.body);
+  EXPECT_EQ(get_downloaded_bytes(), downloaded_bytes);
+}
+
+// The output being read stays on disk over the budget until it's released,
+// open files can't be removed on every platform.
+TEST(MuxerTest, KeepsCachedMuxOutputWhileItsRead) {
+  FakeHttpClient http;
+  http.Expect(HttpRequest("https://accounts.google.com/o/oauth2/token")
+                  .WillReturn(R"js({
+                    "access_token": "access_token",
+                    "refresh_token": "refresh_token"
+                  })js"))
+      .Expect(HttpRequest("https://www.googleapis.com/drive/v3/"
+                          "about?fields=user,storageQuota")
+                  .WillReturn(R"js({
+                    "user": {
+                      "emailAddress": "test@gmail.com"
+                    },
+                    "storageQuota": {
+                      "usage": "2137"
+                    }
+                  })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/id1?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(R"js({
+                "id": "id1",
+                "name": "video.mp4",
+                "modifiedTime": "2023-12-29T12:29:03Z",
+                "parents": [ "root" ],
+                "size": "2508570",
+                "mimeType": "video/mp4"
+              })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/id2?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(R"js({
+                "id": "id2",
+                "name": "audio.m4a",
+                "modifiedTime": "2023-12-29T12:29:03Z",
+                "parents": [ "root" ],
+                "size": "245256",
+                "mimeType": "audio/mp4"
+              })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/id3?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(R"js({
+                "id": "id3",
+                "name": "video.webm",
+                "modifiedTime": "2023-12-29T12:29:03Z",
+                "parents": [ "root" ],
+                "size": "197787",
+                "mimeType": "video/webm"
+              })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/id4?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(R"js({
+                "id": "id4",
+                "name": "audio.webm",
+                "modifiedTime": "2023-12-29T12:29:03Z",
+                "parents": [ "root" ],
                 "size": "249177",
                 "mimeType": "audio/webm"
               })js"))
       .Expect(
           HttpRequest("https://www.googleapis.com/drive/v3/files/id1?alt=media")
-              .WillRespondToRangeRequestWith(GetTestFileContent("video.webm")))
+              .WillRespondToRangeRequestWith(GetTestFileContent("video.mp4")))
       .Expect(
           HttpRequest("https://www.googleapis.com/drive/v3/files/id2?alt=media")
+              .WillRespondToRangeRequestWith(GetTestFileContent("audio.m4a")))
+      .Expect(
+          HttpRequest("https://www.googleapis.com/drive/v3/files/id3?alt=media")
+              .WillRespondToRangeRequestWith(GetTestFileContent("video.webm")))
+      .Expect(
+          HttpRequest("https://www.googleapis.com/drive/v3/files/id4?alt=media")
               .WillRespondToRangeRequestWith(GetTestFileContent("audio.webm")));
+  FakeCloudFactoryContextConfig config{.mux_cache_size = 1,
+                                       .http = std::move(http)};
+  std::string mux_cache_path = config.mux_cache_path;
+  FakeCloudFactoryContext test_helper(std::move(config));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+  auto count_files = [&] {
+    auto it = std::filesystem::directory_iterator(mux_cache_path);
+    return std::distance(begin(it), end(it));
+  };
+
+  std::optional<MuxedFile> mp4_file;
+  test_helper.Do([&](CloudFactoryContext& context,
+                     const std::vector<CloudProviderAccount>& accounts)
+                     -> Task<> {
+    const CloudProviderAccount& account = accounts.at(0);
+    auto get_file = [&](std::string id) -> Task<AbstractCloudProvider::File> {
+      co_return std::get<AbstractCloudProvider::File>(co_await GetItemById(
+          account.provider().get(), std::move(id), stdx::stop_token()));
+    };
+    mp4_file = co_await context.mux_cache()->Get(
+        account, co_await get_file("id1"), account, co_await get_file("id2"),
+        MediaContainer::kMp4, /*range=*/std::nullopt, stdx::stop_token());
+    co_await context.mux_cache()->Get(
+        account, co_await get_file("id3"), account, co_await get_file("id4"),
+        MediaContainer::kWebm, /*range=*/std::nullopt, stdx::stop_token());
+  });
+  EXPECT_EQ(count_files(), 2);
+  EXPECT_EQ(mp4_file->file->Read(4, 4), "ftyp");
+
+  test_helper.Do([&](CloudFactoryContext&,
+                     const std::vector<CloudProviderAccount>&) -> Task<> {
+    mp4_file = std::nullopt;
+    co_return;
+  });
+  EXPECT_EQ(count_files(), 1);
+}
+
+TEST(MuxerTest, ServesHlsSegments) {
+  FakeHttpClient http;
+  http.Expect(HttpRequest("https://accounts.google.com/o/oauth2/token")
+                  .WillReturn(R"js({
+                    "access_token": "access_token",
+                    "refresh_token": "refresh_token"
+                  })js"))
+      .Expect(HttpRequest("https://www.googleapis.com/drive/v3/"
+                          "about?fields=user,storageQuota")
+                  .WillReturn(R"js({
+                    "user": {
+                      "emailAddress": "test@gmail.com"
+                    },
+                    "storageQuota": {
+                      "usage": "2137"
+                    }
+                  })js"));
+  // The playlist, the init segment and the first segment are fetched.
+  for (int i = 0; i < 3; i++) {
+    http.Expect(
+            HttpRequest(fmt::format(
+                            "https://www.googleapis.com/drive/v3/files/id1?{}",
+                            http::FormDataToString(
+                                {{"fields",
+                                  "id,name,thumbnailLink,trashed,mimeType,"
+                                  "iconLink,parents,size,modifiedTime,"
+                                  "md5Checksum"}})))
+                .WillReturn(R"js({
+                  "id": "id1",
+                  "name": "video.mp4",
+                  "thumbnailLink": "thumbnail-link",
+                  "modifiedTime": "2023-12-29T12:29:03Z",
+                  "parents": [ "root" ],
+                  "size": "2508570",
+                  "mimeType": "video/mp4"
+                })js"))
+        .Expect(
+            HttpRequest(fmt::format(
+                            "https://www.googleapis.com/drive/v3/files/id2?{}",
+                            http::FormDataToString(
+                                {{"fields",
+                                  "id,name,thumbnailLink,trashed,mimeType,"
+                                  "iconLink,parents,size,modifiedTime,"
+                                  "md5Checksum"}})))
+                .WillReturn(R"js({
+                  "id": "id2",
+                  "name": "audio.m4a",
+                  "iconLink": "icon-link",
+                  "modifiedTime": "2023-12-29T12:29:03Z",
+                  "parents": [ "root" ],
+                  "size": "245256",
+                  "mimeType": "audio/mp4"
+                })js"));
+  }
+  http.Expect(
+          HttpRequest("https://www.googleapis.com/drive/v3/files/id1?alt=media")
+              .WillRespondToRangeRequestWith(GetTestFileContent("video.mp4")))
+      .Expect(
+          HttpRequest("https://www.googleapis.com/drive/v3/files/id2?alt=media")
+              .WillRespondToRangeRequestWith(GetTestFileContent("audio.m4a")));
   FakeCloudFactoryContext test_helper(std::move(http));
   ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
 
-  auto response = test_helper.Fetch(
-      {.url = fmt::format(
-           "/mux?{}",
-           http::FormDataToString({{"video_account_type", "google"},
-                                   {"video_account_name", "test@gmail.com"},
-                                   {"audio_account_type", "google"},
-                                   {"audio_account_name", "test@gmail.com"},
-                                   {"video_id", "id1"},
-                                   {"audio_id", "id2"},
-                                   {"format", "webm"},
-                                   {"seekable", "true"}}))});
-  EXPECT_EQ(response.status, 200);
-  EXPECT_TRUE(AreVideosEquiv(
-      response.body, GetTestFileContent("muxed-seekable.webm"), "webm"));
+  std::string query =
+      http::FormDataToString({{"video_account_type", "google"},
+                              {"video_account_name", "test@gmail.com"},
+                              {"audio_account_type", "google"},
+                              {"audio_account_name", "test@gmail.com"},
+                              {"video_id", "id1"},
+                              {"audio_id", "id2"},
+                              {"format", "hls"}});
+  auto playlist = test_helper.Fetch({.url = fmt::format("/mux?{}", query)});
+  EXPECT_EQ(playlist.status, 200);
+  EXPECT_EQ(http::GetHeader(playlist.headers, "Content-Type"),
+            "application/vnd.apple.mpegurl");
+  EXPECT_TRUE(playlist.body.starts_with("#EXTM3U\n"));
+  EXPECT_NE(playlist.body.find(
+                fmt::format("#EXT-X-MAP:URI=\"?{}&segment=init\"", query)),
+            std::string::npos);
+  EXPECT_NE(playlist.body.find(fmt::format("\n?{}&segment=0\n", query)),
+            std::string::npos);
+  EXPECT_TRUE(playlist.body.ends_with("#EXT-X-ENDLIST\n"));
+
+  auto init_segment = test_helper.Fetch(
+      {.url = fmt::format("/mux?{}&segment=init", query)});
+  EXPECT_EQ(init_segment.status, 200);
+  EXPECT_EQ(init_segment.body.substr(4, 4), "ftyp");
+  EXPECT_NE(init_segment.body.find("moov"), std::string::npos);
+
+  auto segment =
+      test_helper.Fetch({.url = fmt::format("/mux?{}&segment=0", query)});
+  EXPECT_EQ(segment.status, 200);
+  EXPECT_EQ(segment.body.substr(4, 4), "moof");
+  EXPECT_NE(segment.body.find("mdat"), std::string::npos);
+}
+
+TEST(MuxerTest, RejectsOutOfRangeSegmentNumber) {
+  FakeHttpClient http;
+  http.Expect(HttpRequest("https://accounts.google.com/o/oauth2/token")
+                  .WillReturn(R"js({
+                    "access_token": "access_token",
+                    "refresh_token": "refresh_token"
+                  })js"))
+      .Expect(HttpRequest("https://www.googleapis.com/drive/v3/"
+                          "about?fields=user,storageQuota")
+                  .WillReturn(R"js({
+                    "user": {
+                      "emailAddress": "test@gmail.com"
+                    },
+                    "storageQuota": {
+                      "usage": "2137"
+                    }
+                  })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/id1?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(R"js({
+                "id": "id1",
+                "name": "video.mp4",
+                "thumbnailLink": "thumbnail-link",
+                "modifiedTime": "2023-12-29T12:29:03Z",
+                "parents": [ "root" ],
+                "size": "2508570",
+                "mimeType": "video/mp4"
+              })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/id2?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(R"js({
+                "id": "id2",
+                "name": "audio.m4a",
+                "iconLink": "icon-link",
+                "modifiedTime": "2023-12-29T12:29:03Z",
+                "parents": [ "root" ],
+                "size": "245256",
+                "mimeType": "audio/mp4"
+              })js"));
+  FakeCloudFactoryContext test_helper(std::move(http));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response = test_helper.Fetch(
+      {.url = fmt::format(
+           "/mux?{}",
+           http::FormDataToString({{"video_account_type", "google"},
+                                   {"video_account_name", "test@gmail.com"},
+                                   {"audio_account_type", "google"},
+                                   {"audio_account_name", "test@gmail.com"},
+                                   {"video_id", "id1"},
+                                   {"audio_id", "id2"},
+                                   {"format", "hls"},
+                                   {"segment", "99999999999999999999999"}}))});
+  EXPECT_EQ(response.status, 400);
+}
+
+TEST(Muxer, MuxerWebmTest) {
+  FakeHttpClient http;
+  http.Expect(HttpRequest("https://accounts.google.com/o/oauth2/token")
+                  .WillReturn(R"js({
+                    "access_token": "access_token",
+                    "refresh_token": "refresh_token"
+                  })js"))
+      .Expect(HttpRequest("https://www.googleapis.com/drive/v3/"
+                          "about?fields=user,storageQuota")
+                  .WillReturn(R"js({
+                    "user": {
+                      "emailAddress": "test@gmail.com"
+                    },
+                    "storageQuota": {
+                      "usage": "2137"
+                    }
+                  })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/id1?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(R"js({
+                "id": "id1",
+                "name": "video.webm",
+                "thumbnailLink": "thumbnail-link",
+                "modifiedTime": "2023-12-29T12:29:03Z",
+                "parents": [ "root" ],
+                "size": "197787",
+                "mimeType": "video/webm"
+              })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/id2?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(R"js({
+                "id": "id2",
+                "name": "audio.webm",
+                "iconLink": "icon-link",
+                "modifiedTime": "2023-12-29T12:29:03Z",
+                "parents": [ "root" ],
+                "size": "249177",
+                "mimeType": "audio/webm"
+              })js"))
+      .Expect(
+          HttpRequest("https://www.googleapis.com/drive/v3/files/id1?alt=media")
+              .WillRespondToRangeRequestWith(GetTestFileContent("video.webm")))
+      .Expect(
+          HttpRequest("https://www.googleapis.com/drive/v3/files/id2?alt=media")
+              .WillRespondToRangeRequestWith(GetTestFileContent("audio.webm")));
+  FakeCloudFactoryContext test_helper(std::move(http));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response = test_helper.Fetch(
+      {.url = fmt::format(
+           "/mux?{}",
+           http::FormDataToString({{"video_account_type", "google"},
+                                   {"video_account_name", "test@gmail.com"},
+                                   {"audio_account_type", "google"},
+                                   {"audio_account_name", "test@gmail.com"},
+                                   {"video_id", "id1"},
+                                   {"audio_id", "id2"},
+                                   {"format", "webm"},
+                                   {"seekable", "false"}}))});
+  EXPECT_EQ(response.status, 200);
+  EXPECT_TRUE(AreVideosEquiv(
+      response.body, GetTestFileContent("muxed-nonseekable.webm"), "webm"));
+}
+
+TEST(MuxerTest, MuxerWebmSeekableOutput) {
+  FakeHttpClient http;
+  http.Expect(HttpRequest("https://accounts.google.com/o/oauth2/token")
+                  .WillReturn(R"js({
+                    "access_token": "access_token",
+                    "refresh_token": "refresh_token"
+                  })js"))
+      .Expect(HttpRequest("https://www.googleapis.com/drive/v3/"
+                          "about?fields=user,storageQuota")
+                  .WillReturn(R"js({
+                    "user": {
+                      "emailAddress": "test@gmail.com"
+                    },
+                    "storageQuota": {
+                      "usage": "2137"
+                    }
+                  })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/id1?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(R"js({
+                "id": "id1",
+                "name": "video.webm",
+                "thumbnailLink": "thumbnail-link",
+                "modifiedTime": "2023-12-29T12:29:03Z",
+                "parents": [ "root" ],
+                "size": "197787",
+                "mimeType": "video/webm"
+              })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/id2?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(R"js({
+                "id": "id2",
+                "name": "audio.webm",
+                "iconLink": "icon-link",
+                "modifiedTime": "2023-12-29T12:29:03Z",
+                "parents": [ "root" ],
+                "size": "249177",
+                "mimeType": "audio/webm"
+              })js"))
+      .Expect(
+          HttpRequest("https://www.googleapis.com/drive/v3/files/id1?alt=media")
+              .WillRespondToRangeRequestWith(GetTestFileContent("video.webm")))
+      .Expect(
+          HttpRequest("https://www.googleapis.com/drive/v3/files/id2?alt=media")
+              .WillRespondToRangeRequestWith(GetTestFileContent("audio.webm")));
+  FakeCloudFactoryContext test_helper(std::move(http));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response = test_helper.Fetch(
+      {.url = fmt::format(
+           "/mux?{}",
+           http::FormDataToString({{"video_account_type", "google"},
+                                   {"video_account_name", "test@gmail.com"},
+                                   {"audio_account_type", "google"},
+                                   {"audio_account_name", "test@gmail.com"},
+                                   {"video_id", "id1"},
+                                   {"audio_id", "id2"},
+                                   {"format", "webm"},
+                                   {"seekable", "true"}}))});
+  EXPECT_EQ(response.status, 200);
+  EXPECT_TRUE(AreVideosEquiv(
+      response.body, GetTestFileContent("muxed-seekable.webm"), "webm"));
+}
+
+TEST(MuxerTest, RewrapsSingleAudioTrack) {
+  FakeHttpClient http;
+  http.Expect(HttpRequest("https://accounts.google.com/o/oauth2/token")
+                  .WillReturn(R"js({
+                    "access_token": "access_token",
+                    "refresh_token": "refresh_token"
+                  })js"))
+      .Expect(HttpRequest("https://www.googleapis.com/drive/v3/"
+                          "about?fields=user,storageQuota")
+                  .WillReturn(R"js({
+                    "user": {
+                      "emailAddress": "test@gmail.com"
+                    },
+                    "storageQuota": {
+                      "usage": "2137"
+                    }
+                  })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/id2?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(R"js({
+                "id": "id2",
+                "name": "audio.m4a",
+                "iconLink": "icon-link",
+                "modifiedTime": "2023-12-29T12:29:03Z",
+                "parents": [ "root" ],
+                "size": "245256",
+                "mimeType": "audio/mp4"
+              })js"))
+      .Expect(
+          HttpRequest("https://www.googleapis.com/drive/v3/files/id2?alt=media")
+              .WillRespondToRangeRequestWith(GetTestFileContent("audio.m4a")));
+  FakeCloudFactoryContext test_helper(std::move(http));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response = test_helper.Fetch(
+      {.url = fmt::format(
+           "/mux?{}",
+           http::FormDataToString({{"audio_account_type", "google"},
+                                   {"audio_account_name", "test@gmail.com"},
+                                   {"audio_id", "id2"},
+                                   {"format", "mp4"}}))});
+  EXPECT_EQ(response.status, 200);
+  EXPECT_EQ(response.body.substr(4, 4), "ftyp");
+  EXPECT_NE(response.body.find("moof"), std::string::npos);
+}
+
+TEST(MuxerTest, RewrapsSingleVideoTrack) {
+  FakeHttpClient http;
+  http.Expect(HttpRequest("https://accounts.google.com/o/oauth2/token")
+                  .WillReturn(R"js({
+                    "access_token": "access_token",
+                    "refresh_token": "refresh_token"
+                  })js"))
+      .Expect(HttpRequest("https://www.googleapis.com/drive/v3/"
+                          "about?fields=user,storageQuota")
+                  .WillReturn(R"js({
+                    "user": {
+                      "emailAddress": "test@gmail.com"
+                    },
+                    "storageQuota": {
+                      "usage": "2137"
+                    }
+                  })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/id1?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(R"js({
+                "id": "id1",
+                "name": "video.mp4",
+                "thumbnailLink": "thumbnail-link",
+                "modifiedTime": "2023-12-29T12:29:03Z",
+                "parents": [ "root" ],
+                "size": "2508570",
+                "mimeType": "video/mp4"
+              })js"))
+      .Expect(
+          HttpRequest("https://www.googleapis.com/drive/v3/files/id1?alt=media")
+              .WillRespondToRangeRequestWith(GetTestFileContent("video.mp4")));
+  FakeCloudFactoryContext test_helper(std::move(http));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response = test_helper.Fetch(
+      {.url = fmt::format(
+           "/mux?{}",
+           http::FormDataToString({{"video_account_type", "google"},
+                                   {"video_account_name", "test@gmail.com"},
+                                   {"video_id", "id1"},
+                                   {"format", "mp4"}}))});
+  EXPECT_EQ(response.status, 200);
+  EXPECT_EQ(response.body.substr(4, 4), "ftyp");
+  EXPECT_NE(response.body.find("moof"), std::string::npos);
+}
+
+TEST(MuxerTest, RejectsStreamedMuxBeforeSendingHeaders) {
+  FakeHttpClient http;
+  http.Expect(HttpRequest("https://accounts.google.com/o/oauth2/token")
+                  .WillReturn(R"js({
+                    "access_token": "access_token",
+                    "refresh_token": "refresh_token"
+                  })js"))
+      .Expect(HttpRequest("https://www.googleapis.com/drive/v3/"
+                          "about?fields=user,storageQuota")
+                  .WillReturn(R"js({
+                    "user": {
+                      "emailAddress": "test@gmail.com"
+                    },
+                    "storageQuota": {
+                      "usage": "2137"
+                    }
+                  })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/id2?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(R"js({
+                "id": "id2",
+                "name": "audio.m4a",
+                "iconLink": "icon-link",
+                "modifiedTime": "2023-12-29T12:29:03Z",
+                "parents": [ "root" ],
+                "size": "245256",
+                "mimeType": "audio/mp4"
+              })js"));
+  FakeCloudFactoryContext test_helper(FakeCloudFactoryContextConfig{
+      .job_scheduler_config = {.streaming = {.max_running = 0,
+                                             .max_queued = 0}},
+      .http = std::move(http)});
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response = test_helper.Fetch(
+      {.url = fmt::format(
+           "/mux?{}",
+           http::FormDataToString({{"audio_account_type", "google"},
+                                   {"audio_account_name", "test@gmail.com"},
+                                   {"audio_id", "id2"},
+                                   {"format", "mp4"}}))});
+  EXPECT_EQ(response.status, 503);
+}
+
+TEST(MuxerTest, TranscodesStreamedOutput) {
+  FakeHttpClient http;
+  http.Expect(HttpRequest("https://accounts.google.com/o/oauth2/token")
+                  .WillReturn(R"js({
+                    "access_token": "access_token",
+                    "refresh_token": "refresh_token"
+                  })js"))
+      .Expect(HttpRequest("https://www.googleapis.com/drive/v3/"
+                          "about?fields=user,storageQuota")
+                  .WillReturn(R"js({
+                    "user": {
+                      "emailAddress": "test@gmail.com"
+                    },
+                    "storageQuota": {
+                      "usage": "2137"
+                    }
+                  })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/id1?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(R"js({
+                "id": "id1",
+                "name": "video.mp4",
+                "modifiedTime": "2023-12-29T12:29:03Z",
+                "parents": [ "root" ],
+                "size": "2508570",
+                "mimeType": "video/mp4"
+              })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/id2?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(R"js({
+                "id": "id2",
+                "name": "audio.m4a",
+                "modifiedTime": "2023-12-29T12:29:03Z",
+                "parents": [ "root" ],
+                "size": "245256",
+                "mimeType": "audio/mp4"
+              })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/id3?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(R"js({
+                "id": "id3",
+                "name": "video.webm",
+                "modifiedTime": "2023-12-29T12:29:03Z",
+                "parents": [ "root" ],
+                "size": "197787",
+                "mimeType": "video/webm"
+              })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/id4?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(R"js({
+                "id": "id4",
+                "name": "audio.webm",
+                "modifiedTime": "2023-12-29T12:29:03Z",
+                "parents": [ "root" ],
+                "size": "249177",
+                "mimeType": "audio/webm"
+              })js"))
+      .Expect(
+          HttpRequest("https://www.googleapis.com/drive/v3/files/id1?alt=media")
+              .WillRespondToRangeRequestWith(GetTestFileContent("video.mp4")))
+      .Expect(
+          HttpRequest("https://www.googleapis.com/drive/v3/files/id2?alt=media")
+              .WillRespondToRangeRequestWith(GetTestFileContent("audio.m4a")))
+      .Expect(
+          HttpRequest("https://www.googleapis.com/drive/v3/files/id3?alt=media")
+              .WillRespondToRangeRequestWith(GetTestFileContent("video.webm")))
+      .Expect(
+          HttpRequest("https://www.googleapis.com/drive/v3/files/id4?alt=media")
+              .WillRespondToRangeRequestWith(GetTestFileContent("audio.webm")));
+  FakeCloudFactoryContext test_helper(std::move(http));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  struct Output {
+    std::string_view video_id;
+    std::string_view audio_id;
+    std::string_view format;
+    std::string_view demuxer;
+    std::string_view muxed_filename;
+  };
+  for (const Output& output :
+       {Output{"id1", "id2", "mp4", "mov", "muxed-nonseekable.mp4"},
+        Output{"id3", "id4", "webm", "webm", "muxed-nonseekable.webm"}}) {
+    auto response = test_helper.Fetch(
+        {.url = fmt::format(
+             "/mux?{}",
+             http::FormDataToString(
+                 {{"video_account_type", "google"},
+                  {"video_account_name", "test@gmail.com"},
+                  {"audio_account_type", "google"},
+                  {"audio_account_name", "test@gmail.com"},
+                  {"video_id", std::string(output.video_id)},
+                  {"audio_id", std::string(output.audio_id)},
+                  {"format", std::string(output.format)},
+                  {"seekable", "false"},
+                  {"transcode", "true"}}))});
+    ASSERT_EQ(response.status, 200) << output.format;
+    // The encoders keep the frame rate, every source frame is re-encoded.
+    DecodedFrameCount count =
+        CountDecodedFrames(response.body, output.demuxer);
+    EXPECT_EQ(count.video,
+              CountDecodedFrames(GetTestFileContent(output.muxed_filename),
+                                 output.demuxer)
+                  .video)
+        << output.format;
+    EXPECT_GT(count.audio, 0) << output.format;
+  }
+}
+
+TEST(MuxerTest, RejectsTranscodeOfSeekableAndSegmentedOutput) {
+  FakeCloudFactoryContext test_helper;
+
+  std::string tracks =
+      http::FormDataToString({{"video_account_type", "google"},
+                              {"video_account_name", "test@gmail.com"},
+                              {"audio_account_type", "google"},
+                              {"audio_account_name", "test@gmail.com"},
+                              {"video_id", "id1"},
+                              {"audio_id", "id2"},
+                              {"transcode", "true"}});
+  for (std::string_view options :
+       {"format=mp4&seekable=true", "format=hls", "format=dash"}) {
+    auto response = test_helper.Fetch(
+        {.url = fmt::format("/mux?{}&{}", tracks, options)});
+    EXPECT_EQ(response.status, 400) << options;
+  }
+}
+
+TEST(MuxerTest, ListsNoJobsWhenIdle) {
+  FakeCloudFactoryContext test_helper;
+
+  auto response = test_helper.Fetch({.url = "/mux/jobs"});
+  EXPECT_EQ(response.status, 200);
+  EXPECT_EQ(response.body, "[]");
+}
+
+TEST(MuxerTest, ReportsProgressOfRunningMux) {
+  coro::util::EventLoop event_loop;
+  coro::util::ThreadPool thread_pool(&event_loop, 2, "coro-test");
+  LocalFileSystem local(&thread_pool,
+                        {.root = std::string(kTestDataDirectory)});
+  auto provider = CreateAbstractCloudProviderImpl(&local);
+  JobScheduler job_scheduler(JobScheduler::Config{});
+  Muxer muxer(&event_loop, &thread_pool, &job_scheduler);
+  MuxHandler handler(&muxer, /*mux_cache=*/nullptr, /*segment_cache=*/nullptr,
+                     /*accounts=*/{});
+  std::vector<MuxerProgress> reports;
+  std::optional<std::string> jobs_while_running;
+  std::exception_ptr exception;
+  RunTask([&]() -> Task<> {
+    try {
+      auto get_file = [&](std::string_view filename)
+          -> Task<AbstractCloudProvider::File> {
+        co_return std::get<AbstractCloudProvider::File>(co_await GetItemById(
+            &provider,
+            std::string(kTestDataDirectory) + "/" + std::string(filename),
+            stdx::stop_token()));
+      };
+      auto video = co_await get_file("video.mp4");
+      auto audio = co_await get_file("audio.m4a");
+      FOR_CO_AWAIT(
+          std::string & chunk,
+          muxer(&provider, std::move(video), &provider, std::move(audio),
+                {.container = MediaContainer::kMp4,
+                 .buffered = false,
+                 .on_progress =
+                     [&](const MuxerProgress& progress) {
+                       reports.push_back(progress);
+                     }},
+                stdx::stop_token())) {
+        if (!jobs_while_running) {
+          auto response = co_await handler(
+              http::Request<>{.url = "/mux/jobs"}, stdx::stop_token());
+          jobs_while_running = co_await http::GetBody(std::move(response.body));
+        }
+      }
+    } catch (...) {
+      exception = std::current_exception();
+    }
+  });
+  event_loop.EnterLoop();
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+
+  ASSERT_FALSE(reports.empty());
+  EXPECT_TRUE(reports.back().done);
+  EXPECT_GT(reports.back().packets_written, 0);
+  EXPECT_GT(reports.back().bytes_written, 0);
+  EXPECT_EQ(reports.back().video_name, "video.mp4");
+
+  ASSERT_TRUE(jobs_while_running);
+  auto jobs = nlohmann::json::parse(*jobs_while_running);
+  ASSERT_EQ(jobs.size(), 1u);
+  EXPECT_EQ(jobs[0]["video_name"], "video.mp4");
+  EXPECT_EQ(jobs[0]["audio_name"], "audio.m4a");
+  EXPECT_EQ(jobs[0]["container"], "mp4");
 }
 
 }  // namespace
@@ -0,0 +1,113 @@
+#include <fmt/format.h>
+
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <string>
+#include <string_view>
+
+#include "coro/cloudstorage/test/test_utils.h"
+#include "coro/cloudstorage/util/file_utils.h"
+#include "coro/cloudstorage/util/spill_file.h"
+#include "coro/exception.h"
+#include "coro/task.h"
+#include "coro/util/event_loop.h"
+#include "coro/util/thread_pool.h"
+
+// Compares spilling the test data files through stdio (4 KiB writes, then 4 KiB
+// reads with a thread pool hop each, as the muxer used to do) with SpillFile.
+
+namespace coro::cloudstorage::test {
+namespace {
+
+using ::coro::cloudstorage::util::CreateTmpFile;
+using ::coro::cloudstorage::util::ReadFile;
+using ::coro::cloudstorage::util::SpillFile;
+using ::coro::util::ThreadPool;
+
+constexpr int kIterations = 20;
+constexpr size_t kStdioBufferSize = 4096;
+
+Task<size_t> SpillWithStdio(ThreadPool* thread_pool, std::string_view content) {
+  auto file = CreateTmpFile();
+  for (size_t offset = 0; offset < content.size();
+       offset += kStdioBufferSize) {
+    std::string_view chunk = content.substr(offset, kStdioBufferSize);
+    if (fwrite(chunk.data(), 1, chunk.size(), file.get()) != chunk.size()) {
+      throw RuntimeError("fwrite failed");
+    }
+  }
+  size_t size = 0;
+  FOR_CO_AWAIT(std::string & chunk, ReadFile(thread_pool, file.get())) {
+    size += chunk.size();
+  }
+  co_return size;
+}
+
+Task<size_t> SpillWithSpillFile(ThreadPool* thread_pool,
+                                std::string_view content) {
+  SpillFile file(CreateTmpFile());
+  for (size_t offset = 0; offset < content.size();
+       offset += SpillFile::kBufferSize) {
+    file.Write(static_cast<int64_t>(offset),
+               content.substr(offset, SpillFile::kBufferSize));
+  }
+  size_t size = 0;
+  FOR_CO_AWAIT(std::string & chunk,
+               file.GetContent(thread_pool, 0,
+                               static_cast<int64_t>(content.size()))) {
+    size += chunk.size();
+  }
+  co_return size;
+}
+
+template <typename F>
+Task<double> GetThroughput(ThreadPool* thread_pool, std::string_view content,
+                           F spill) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; i++) {
+    if (co_await spill(thread_pool, content) != content.size()) {
+      throw RuntimeError("size mismatch");
+    }
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  co_return static_cast<double>(kIterations * content.size()) /
+      elapsed.count() / (1024 * 1024);
+}
+
+Task<> RunBenchmark(ThreadPool* thread_pool) {
+  fmt::println("{:<24}{:>14}{:>14}{:>10}", "file", "stdio MiB/s",
+               "spill MiB/s", "speedup");
+  for (std::string_view filename :
+       {"video.mp4", "video.webm", "audio.m4a", "audio.webm",
+        "muxed-seekable.mp4", "muxed-seekable.webm"}) {
+    std::string content = GetTestFileContent(filename);
+    double stdio = co_await GetThroughput(thread_pool, content, SpillWithStdio);
+    double spill =
+        co_await GetThroughput(thread_pool, content, SpillWithSpillFile);
+    fmt::println("{:<24}{:>14.1f}{:>14.1f}{:>9.2f}x", filename, stdio, spill,
+                 spill / stdio);
+  }
+}
+
+}  // namespace
+}  // namespace coro::cloudstorage::test
+
+int main() {
+  coro::util::EventLoop event_loop;
+  coro::util::ThreadPool thread_pool(&event_loop, 1, "coro-bench");
+  std::exception_ptr exception;
+  coro::RunTask([&]() -> coro::Task<> {
+    try {
+      co_await coro::cloudstorage::test::RunBenchmark(&thread_pool);
+    } catch (...) {
+      exception = std::current_exception();
+    }
+  });
+  event_loop.EnterLoop();
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+  return 0;
+}
@@ -2,6 +2,8 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <nlohmann/json.hpp>
+
 #include "coro/cloudstorage/test/fake_cloud_factory_context.h"
 #include "coro/cloudstorage/test/fake_http_client.h"
 #include "coro/cloudstorage/test/test_utils.h"
@@ -10,6 +12,7 @@ namespace coro::cloudstorage::test {
 namespace {
 
 using ::coro::cloudstorage::util::CloudProviderAccount;
+using ::coro::cloudstorage::util::IsAnimatedPreviewSupported;
 
 TEST(ThumbnailGeneratorTest, GetCloudThumbnailTest) {
   FakeHttpClient http;
@@ -34,7 +37,8 @@ TEST(ThumbnailGeneratorTest, GetCloudThumbnailTest) {
                           http::FormDataToString(
                               {{"fields",
                                 "id,name,thumbnailLink,trashed,mimeType,"
-                                "iconLink,parents,size,modifiedTime"}})))
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
               .WillReturn(R"js({
                 "id": "id1",
                 "name": "name1.mp4",
@@ -54,6 +58,7 @@ TEST(ThumbnailGeneratorTest, GetCloudThumbnailTest) {
       test_helper.Fetch({.url = "/thumbnail/google/test%40gmail.com/id1"});
   EXPECT_EQ(response.status, 200);
   EXPECT_THAT(response.body, "thumbnail");
+  EXPECT_FALSE(http::GetHeader(response.headers, "X-Perceptual-Hash"));
 }
 
 TEST(ThumbnailGeneratorTest, ThumbnailGeneratorTest) {
@@ -79,7 +84,8 @@ TEST(ThumbnailGeneratorTest, ThumbnailGeneratorTest) {
                           http::FormDataToString(
                               {{"fields",
                                 "id,name,thumbnailLink,trashed,mimeType,"
-                                "iconLink,parents,size,modifiedTime"}})))
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
               .WillReturn(R"js({
                 "id": "id1",
                 "name": "name1.mp4",
@@ -102,8 +108,63 @@ TEST(ThumbnailGeneratorTest, ThumbnailGeneratorTest) {
   auto response =
       test_helper.Fetch({.url = "/thumbnail/google/test%40gmail.com/id1"});
   EXPECT_EQ(response.status, 200);
-  EXPECT_TRUE(AreVideosEquiv(response.body, GetTestFileContent("thumbnail.png"),
-                             "png"));
+  // The frame is the best scoring keyframe rather than the one picked by the
+  // thumbnail filter, which thumbnail.png holds.
+  EXPECT_THAT(response.body, testing::StartsWith("\x89PNG"));
+  EXPECT_THAT(http::GetHeader(response.headers, "X-Perceptual-Hash"),
+              testing::Optional(testing::MatchesRegex("[0-9a-f]{16}")));
+  EXPECT_THAT(http::GetHeader(response.headers, "X-Dominant-Color"),
+              testing::Optional(testing::MatchesRegex("#[0-9a-f]{6}")));
+}
+
+TEST(ThumbnailGeneratorTest, ReturnsAnimatedPreviewOfVideo) {
+  if (!IsAnimatedPreviewSupported()) {
+    GTEST_SKIP() << "libwebp_anim unavailable";
+  }
+  FakeHttpClient http;
+  http.Expect(HttpRequest("https://accounts.google.com/o/oauth2/token")
+                  .WillReturn(R"js({
+                    "access_token": "access_token",
+                    "refresh_token": "refresh_token"
+                  })js"))
+      .Expect(HttpRequest("https://www.googleapis.com/drive/v3/"
+                          "about?fields=user,storageQuota")
+                  .WillReturn(R"js({
+                    "user": {
+                      "emailAddress": "test@gmail.com"
+                    },
+                    "storageQuota": {
+                      "usage": "2137"
+                    }
+                  })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/id1?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(R"js({
+                "id": "id1",
+                "name": "name1.mp4",
+                "modifiedTime": "2023-12-29T12:29:03Z",
+                "parents": [ "root" ],
+                "size": "2508570",
+                "mimeType": "video/mp4"
+              })js"))
+      .Expect(
+          HttpRequest("https://www.googleapis.com/drive/v3/files/id1?alt=media")
+              .WillRespondToRangeRequestWith(GetTestFileContent("video.mp4")));
+  FakeCloudFactoryContext test_helper(std::move(http));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto response =
+      test_helper.Fetch({.url = "/preview/google/test%40gmail.com/id1"});
+
+  ASSERT_EQ(response.status, 200);
+  EXPECT_THAT(response.body, ::testing::StartsWith("RIFF"));
+  EXPECT_THAT(response.body, ::testing::HasSubstr("ANIM"));
 }
 
 TEST(ThumbnailGeneratorTest, ThumbnailGeneratorRespectsExifOrientation) {
@@ -129,7 +190,8 @@ TEST(ThumbnailGeneratorTest, ThumbnailGeneratorRespectsExifOrientation) {
                           http::FormDataToString(
                               {{"fields",
                                 "id,name,thumbnailLink,trashed,mimeType,"
-                                "iconLink,parents,size,modifiedTime"}})))
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
               .WillReturn(R"js({
                 "id": "id1",
                 "name": "frame.jpg",
@@ -157,5 +219,179 @@ TEST(ThumbnailGeneratorTest, ThumbnailGeneratorRespectsExifOrientation) {
                              GetTestFileContent("thumbnail-exif.png"), "png"));
 }
 
+TEST(ThumbnailGeneratorTest, ReturnsContactSheetOfDirectory) {
+  FakeHttpClient http;
+  http.Expect(HttpRequest("https://accounts.google.com/o/oauth2/token")
+                  .WillReturn(R"js({
+                    "access_token": "access_token",
+                    "refresh_token": "refresh_token"
+                  })js"))
+      .Expect(HttpRequest("https://www.googleapis.com/drive/v3/"
+                          "about?fields=user,storageQuota")
+                  .WillReturn(R"js({
+                    "user": {
+                      "emailAddress": "test@gmail.com"
+                    },
+                    "storageQuota": {
+                      "usage": "2137"
+                    }
+                  })js"));
+  // The sheet and its layout are fetched.
+  for (int i = 0; i < 2; i++) {
+    http.Expect(
+            HttpRequest(fmt::format(
+                            "https://www.googleapis.com/drive/v3/files/dir1?{}",
+                            http::FormDataToString(
+                                {{"fields",
+                                  "id,name,thumbnailLink,trashed,mimeType,"
+                                  "iconLink,parents,size,modifiedTime,"
+                                  "md5Checksum"}})))
+                .WillReturn(R"js({
+                  "id": "dir1",
+                  "name": "photos",
+                  "modifiedTime": "2023-12-29T12:29:03Z",
+                  "parents": [ "root" ],
+                  "mimeType": "application/vnd.google-apps.folder"
+                })js"))
+        .Expect(
+            HttpRequest(
+                fmt::format(
+                    "https://www.googleapis.com/drive/v3/files?{}",
+                    http::FormDataToString(
+                        {{"q", "'dir1' in parents"},
+                         {"fields",
+                          "files(id,name,thumbnailLink,trashed,mimeType,"
+                          "iconLink,parents,size,modifiedTime,md5Checksum),"
+                          "kind,nextPageToken"}})))
+                .WillReturn(R"js({
+                  "files": [
+                    {
+                      "id": "id1",
+                      "name": "name1.mp4",
+                      "modifiedTime": "2023-12-29T12:29:03Z",
+                      "parents": [ "dir1" ],
+                      "size": "2508570",
+                      "mimeType": "video/mp4"
+                    },
+                    {
+                      "id": "id2",
+                      "name": "notes.txt",
+                      "modifiedTime": "2023-12-29T12:29:03Z",
+                      "parents": [ "dir1" ],
+                      "size": "2137",
+                      "mimeType": "text/plain"
+                    },
+                    {
+                      "id": "id3",
+                      "name": "frame.jpg",
+                      "modifiedTime": "2023-12-29T12:29:03Z",
+                      "parents": [ "dir1" ],
+                      "size": "9447",
+                      "mimeType": "image/jpeg"
+                    }
+                  ]
+                })js"));
+  }
+  http.Expect(
+          HttpRequest("https://www.googleapis.com/drive/v3/files/id1?alt=media")
+              .WillRespondToRangeRequestWith(GetTestFileContent("video.mp4")))
+      .Expect(
+          HttpRequest("https://www.googleapis.com/drive/v3/files/id3?alt=media")
+              .WillRespondToRangeRequestWith(
+                  GetTestFileContent("frame-exif.jpg")));
+  FakeCloudFactoryContext test_helper(std::move(http));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto sheet = test_helper.Fetch(
+      {.url = "/thumbnail-sheet/google/test%40gmail.com/dir1?tile_size=64"});
+  auto layout = test_helper.Fetch(
+      {.url = "/thumbnail-sheet/google/test%40gmail.com/dir1?tile_size=64&"
+              "layout=true"});
+
+  ASSERT_EQ(sheet.status, 200);
+  EXPECT_EQ(http::GetHeader(sheet.headers, "Content-Type"), "image/jpeg");
+  EXPECT_TRUE(sheet.body.starts_with("\xFF\xD8"));
+  ASSERT_EQ(layout.status, 200);
+  auto json = nlohmann::json::parse(layout.body);
+  EXPECT_EQ(json["width"], 128);
+  EXPECT_EQ(json["height"], 64);
+  ASSERT_EQ(json["tiles"].size(), 2);
+  EXPECT_EQ(json["tiles"][0]["id"], "id1");
+  EXPECT_EQ(json["tiles"][0]["x"], 0);
+  EXPECT_EQ(json["tiles"][0]["width"], 64);
+  EXPECT_EQ(json["tiles"][1]["id"], "id3");
+  EXPECT_EQ(json["tiles"][1]["x"], 64);
+}
+
+TEST(ThumbnailGeneratorTest, ComposesContactSheetOfProviderThumbnails) {
+  FakeHttpClient http;
+  http.Expect(HttpRequest("https://accounts.google.com/o/oauth2/token")
+                  .WillReturn(R"js({
+                    "access_token": "access_token",
+                    "refresh_token": "refresh_token"
+                  })js"))
+      .Expect(HttpRequest("https://www.googleapis.com/drive/v3/"
+                          "about?fields=user,storageQuota")
+                  .WillReturn(R"js({
+                    "user": {
+                      "emailAddress": "test@gmail.com"
+                    },
+                    "storageQuota": {
+                      "usage": "2137"
+                    }
+                  })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/dir1?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(R"js({
+                "id": "dir1",
+                "name": "photos",
+                "modifiedTime": "2023-12-29T12:29:03Z",
+                "parents": [ "root" ],
+                "mimeType": "application/vnd.google-apps.folder"
+              })js"))
+      .Expect(HttpRequest(
+                  fmt::format(
+                      "https://www.googleapis.com/drive/v3/files?{}",
+                      http::FormDataToString(
+                          {{"q", "'dir1' in parents"},
+                           {"fields",
+                            "files(id,name,thumbnailLink,trashed,mimeType,"
+                            "iconLink,parents,size,modifiedTime,md5Checksum),"
+                            "kind,nextPageToken"}})))
+                  .WillReturn(R"js({
+                    "files": [
+                      {
+                        "id": "id1",
+                        "name": "frame.jpg",
+                        "thumbnailLink": "thumbnail-link",
+                        "modifiedTime": "2023-12-29T12:29:03Z",
+                        "parents": [ "dir1" ],
+                        "size": "9447",
+                        "mimeType": "image/jpeg"
+                      }
+                    ]
+                  })js"))
+      // The file content isn't expected, the tile is decoded from the
+      // thumbnail of the provider.
+      .Expect(HttpRequest("thumbnail-link")
+                  .WillReturn(GetTestFileContent("thumbnail.png")));
+  FakeCloudFactoryContext test_helper(std::move(http));
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  auto sheet = test_helper.Fetch(
+      {.url = "/thumbnail-sheet/google/test%40gmail.com/dir1?tile_size=64&"
+              "format=png"});
+
+  ASSERT_EQ(sheet.status, 200);
+  EXPECT_EQ(http::GetHeader(sheet.headers, "Content-Type"), "image/png");
+  EXPECT_TRUE(sheet.body.starts_with("\x89PNG"));
+}
+
 }  // namespace
 }  // namespace coro::cloudstorage::test
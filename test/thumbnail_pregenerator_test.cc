@@ -0,0 +1,197 @@
+#include <fmt/format.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "coro/cloudstorage/test/fake_cloud_factory_context.h"
+#include "coro/cloudstorage/test/fake_http_client.h"
+#include "coro/cloudstorage/test/test_utils.h"
+#include "coro/cloudstorage/util/cache_manager.h"
+#include "coro/cloudstorage/util/thumbnail_generator.h"
+#include "coro/promise.h"
+#include "coro/stdx/stop_token.h"
+#include "coro/task.h"
+
+namespace coro::cloudstorage::test {
+namespace {
+
+using ::coro::cloudstorage::util::CacheManager;
+using ::coro::cloudstorage::util::CloudFactoryContext;
+using ::coro::cloudstorage::util::CloudProviderAccount;
+using ::coro::cloudstorage::util::GetBrowserThumbnailCodec;
+using ::coro::cloudstorage::util::JobScheduler;
+using ::coro::cloudstorage::util::ThumbnailOptions;
+using ::coro::cloudstorage::util::ThumbnailQuality;
+
+constexpr int kDelayMs = 10;
+
+// The listed directory holds an image without a provider thumbnail, its
+// thumbnail is generated from the file content.
+FakeHttpClient CreateHttpClient() {
+  FakeHttpClient http;
+  http.Expect(HttpRequest("https://accounts.google.com/o/oauth2/token")
+                  .WillReturn(R"js({
+                    "access_token": "access_token",
+                    "refresh_token": "refresh_token"
+                  })js"))
+      .Expect(HttpRequest("https://www.googleapis.com/drive/v3/"
+                          "about?fields=user,storageQuota")
+                  .WillReturn(R"js({
+                    "user": {
+                      "emailAddress": "test@gmail.com"
+                    },
+                    "storageQuota": {
+                      "usage": "2137"
+                    }
+                  })js"))
+      .Expect(
+          HttpRequest(
+              fmt::format("https://www.googleapis.com/drive/v3/files/dir1?{}",
+                          http::FormDataToString(
+                              {{"fields",
+                                "id,name,thumbnailLink,trashed,mimeType,"
+                                "iconLink,parents,size,modifiedTime,"
+                                "md5Checksum"}})))
+              .WillReturn(R"js({
+                "id": "dir1",
+                "name": "photos",
+                "modifiedTime": "2023-12-29T12:29:03Z",
+                "parents": [ "root" ],
+                "mimeType": "application/vnd.google-apps.folder"
+              })js"))
+      .Expect(HttpRequest(
+                  fmt::format(
+                      "https://www.googleapis.com/drive/v3/files?{}",
+                      http::FormDataToString(
+                          {{"q", "'dir1' in parents"},
+                           {"fields",
+                            "files(id,name,thumbnailLink,trashed,mimeType,"
+                            "iconLink,parents,size,modifiedTime,md5Checksum),"
+                            "kind,nextPageToken"}})))
+                  .WillReturn(R"js({
+                    "files": [
+                      {
+                        "id": "id1",
+                        "name": "frame.jpg",
+                        "modifiedTime": "2023-12-29T12:29:03Z",
+                        "parents": [ "dir1" ],
+                        "size": "9447",
+                        "mimeType": "image/jpeg"
+                      }
+                    ]
+                  })js"))
+      .Expect(
+          HttpRequest("https://www.googleapis.com/drive/v3/files/id1?alt=media")
+              .WillRespondToRangeRequestWith(
+                  GetTestFileContent("frame-exif.jpg")));
+  return http;
+}
+
+std::optional<CacheManager::ImageData> GetCachedThumbnail(
+    FakeCloudFactoryContext& test_helper, std::string item_id) {
+  return test_helper.Do(
+      [item_id = std::move(item_id)](
+          CloudFactoryContext& context,
+          const std::vector<CloudProviderAccount>& accounts)
+          -> Task<std::optional<CacheManager::ImageData>> {
+        co_return co_await context.cache()->Get(
+            CacheManager::AccountKey{
+                .provider = accounts.at(0).provider(),
+                .username = std::string(accounts.at(0).username())},
+            CacheManager::ImageKey{.item_id = item_id,
+                                   .quality = ThumbnailQuality::kLow,
+                                   .codec = GetBrowserThumbnailCodec()},
+            stdx::stop_token());
+      });
+}
+
+std::optional<CacheManager::ImageData> WaitForCachedThumbnail(
+    FakeCloudFactoryContext& test_helper, std::string item_id) {
+  for (int i = 0; i < 1000; i++) {
+    if (auto image = GetCachedThumbnail(test_helper, item_id)) {
+      return image;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(kDelayMs));
+  }
+  return std::nullopt;
+}
+
+TEST(ThumbnailPregeneratorTest, CachesThumbnailsOfListedFiles) {
+  FakeCloudFactoryContext test_helper(
+      {.thumbnail_pregenerator_config = {.delay_ms = kDelayMs},
+       .http = CreateHttpClient()});
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+  ASSERT_FALSE(GetCachedThumbnail(test_helper, "id1"));
+
+  ASSERT_EQ(
+      test_helper.Fetch({.url = "/list/google/test%40gmail.com/dir1"}).status,
+      200);
+
+  auto image = WaitForCachedThumbnail(test_helper, "id1");
+  ASSERT_TRUE(image);
+  EXPECT_FALSE(image->image_bytes.empty());
+}
+
+TEST(ThumbnailPregeneratorTest, GeneratesThumbnailsInIdleSlots) {
+  // Interactive jobs are rejected, the thumbnail is only cached if its
+  // generation doesn't take an interactive slot.
+  FakeCloudFactoryContext test_helper(
+      {.job_scheduler_config = {.interactive = {.max_running = 0,
+                                                .max_queued = 0}},
+       .thumbnail_pregenerator_config = {.delay_ms = kDelayMs},
+       .http = CreateHttpClient()});
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+
+  ASSERT_EQ(
+      test_helper.Fetch({.url = "/list/google/test%40gmail.com/dir1"}).status,
+      200);
+
+  EXPECT_TRUE(WaitForCachedThumbnail(test_helper, "id1"));
+}
+
+TEST(ThumbnailPregeneratorTest, WaitsForInteractiveJobs) {
+  FakeCloudFactoryContext test_helper(
+      {.job_scheduler_config = {.interactive = {.max_running = 1,
+                                                .max_queued = 1}},
+       .thumbnail_pregenerator_config = {.delay_ms = kDelayMs},
+       .http = CreateHttpClient()});
+  ASSERT_EQ(test_helper.Fetch({.url = "/auth/google?code=test"}).status, 302);
+  // The first interactive job holds the only slot until released, the second
+  // one waits in the queue and finishes as soon as it's admitted.
+  Promise<void> release;
+  test_helper.Do([&](CloudFactoryContext& context,
+                     const std::vector<CloudProviderAccount>&) -> Task<> {
+    auto* job_scheduler = context.job_scheduler();
+    RunTask([job_scheduler, &release]() -> Task<> {
+      auto slot = co_await job_scheduler->Acquire(
+          JobScheduler::Priority::kInteractive, /*owner=*/nullptr,
+          stdx::stop_token());
+      co_await release;
+    });
+    RunTask([job_scheduler]() -> Task<> {
+      co_await job_scheduler->Acquire(JobScheduler::Priority::kInteractive,
+                                      /*owner=*/nullptr, stdx::stop_token());
+    });
+    co_return;
+  });
+
+  ASSERT_EQ(
+      test_helper.Fetch({.url = "/list/google/test%40gmail.com/dir1"}).status,
+      200);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20 * kDelayMs));
+  EXPECT_FALSE(GetCachedThumbnail(test_helper, "id1"));
+
+  test_helper.Do([&](CloudFactoryContext&,
+                     const std::vector<CloudProviderAccount>&) -> Task<> {
+    release.SetValue();
+    co_return;
+  });
+  EXPECT_TRUE(WaitForCachedThumbnail(test_helper, "id1"));
+}
+
+}  // namespace
+}  // namespace coro::cloudstorage::test
@@ -0,0 +1,113 @@
+#include <fmt/format.h>
+
+#include <chrono>
+#include <exception>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+
+#include "coro/cloudstorage/providers/local_filesystem.h"
+#include "coro/cloudstorage/test/test_utils.h"
+#include "coro/cloudstorage/util/abstract_cloud_provider_impl.h"
+#include "coro/cloudstorage/util/cloud_provider_utils.h"
+#include "coro/cloudstorage/util/job_scheduler.h"
+#include "coro/cloudstorage/util/muxer.h"
+#include "coro/task.h"
+#include "coro/util/event_loop.h"
+#include "coro/util/thread_pool.h"
+
+// Transcodes the test data files with different thread pool sizes and codec
+// thread counts, one transcode at a time. Measures the cost of a single
+// transcode; the muxer's pool is sized for the number of concurrently admitted
+// jobs instead.
+
+namespace coro::cloudstorage::test {
+namespace {
+
+using ::coro::cloudstorage::util::AbstractCloudProvider;
+using ::coro::cloudstorage::util::CreateAbstractCloudProviderImpl;
+using ::coro::cloudstorage::util::GetItemById;
+using ::coro::cloudstorage::util::JobScheduler;
+using ::coro::cloudstorage::util::MediaContainer;
+using ::coro::cloudstorage::util::Muxer;
+using ::coro::cloudstorage::util::TranscodeOptions;
+using ::coro::util::EventLoop;
+using ::coro::util::ThreadPool;
+
+// A transcode runs a demuxer, a decoder and an encoder per track on the pool.
+constexpr int kThreadPoolSizes[] = {3, 6, 12};
+constexpr int kCodecThreadCounts[] = {1, 2, 0};
+
+struct Input {
+  std::string_view video;
+  std::string_view audio;
+  MediaContainer container;
+};
+
+constexpr Input kInputs[] = {
+    {"video.mp4", "audio.m4a", MediaContainer::kMp4},
+    {"video.webm", "audio.webm", MediaContainer::kWebm}};
+
+Task<AbstractCloudProvider::File> GetFile(
+    const AbstractCloudProvider* provider, std::string_view filename) {
+  co_return std::get<AbstractCloudProvider::File>(co_await GetItemById(
+      provider, std::string(kTestDataDirectory) + "/" + std::string(filename),
+      stdx::stop_token()));
+}
+
+Task<> RunBenchmark(const EventLoop* event_loop) {
+  fmt::println("{:<12}{:>8}{:>10}{:>12}{:>12}", "input", "pool",
+               "threads", "seconds", "MiB/s");
+  for (const Input& input : kInputs) {
+    for (int pool_size : kThreadPoolSizes) {
+      for (int thread_count : kCodecThreadCounts) {
+        ThreadPool thread_pool(event_loop, pool_size, "coro-bench");
+        LocalFileSystem local(&thread_pool,
+                              {.root = std::string(kTestDataDirectory)});
+        auto provider = CreateAbstractCloudProviderImpl(&local);
+        JobScheduler job_scheduler(JobScheduler::Config{});
+        Muxer muxer(event_loop, &thread_pool, &job_scheduler);
+        auto video = co_await GetFile(&provider, input.video);
+        auto audio = co_await GetFile(&provider, input.audio);
+        auto start = std::chrono::steady_clock::now();
+        size_t size = 0;
+        FOR_CO_AWAIT(
+            std::string & chunk,
+            muxer(&provider, std::move(video), &provider, std::move(audio),
+                  {.container = input.container,
+                   .buffered = false,
+                   .transcode = TranscodeOptions{.thread_count = thread_count}},
+                  stdx::stop_token())) {
+          size += chunk.size();
+        }
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        fmt::println("{:<12}{:>8}{:>10}{:>12.2f}{:>12.1f}", input.video,
+                     pool_size, thread_count, elapsed.count(),
+                     static_cast<double>(size) / elapsed.count() /
+                         (1024 * 1024));
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace coro::cloudstorage::test
+
+int main() {
+  coro::util::EventLoop event_loop;
+  std::exception_ptr exception;
+  coro::RunTask([&]() -> coro::Task<> {
+    try {
+      co_await coro::cloudstorage::test::RunBenchmark(&event_loop);
+    } catch (...) {
+      exception = std::current_exception();
+    }
+  });
+  event_loop.EnterLoop();
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+  return 0;
+}